@@ -0,0 +1,75 @@
+#include <benchmark/benchmark.h>
+
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "space/aoi_grid.h"
+
+namespace kbs {
+namespace {
+
+// Entities scattered over a square of the given side; ids start at 1.
+std::vector<Vec3> scatter(size_t n, float side, std::mt19937& rng) {
+  std::uniform_real_distribution<float> coord(-side / 2, side / 2);
+  std::vector<Vec3> pos(n);
+  for (Vec3& p : pos) p = Vec3{coord(rng), 0, coord(rng)};
+  return pos;
+}
+
+// One tick of a populated zone: a quarter of the entities take a step and
+// update() produces the enter/leave events.  range(0) is the population;
+// the area is scaled so each entity sees ~30 neighbours regardless.
+void BM_AoiUpdate(benchmark::State& state) {
+  const size_t n = static_cast<size_t>(state.range(0));
+  const float side = std::sqrt(static_cast<float>(n) * 3.14159f * 50 * 50 / 30);
+  std::mt19937 rng(1234);
+  std::vector<Vec3> pos = scatter(n, side, rng);
+  AoiGrid grid;
+  for (size_t i = 0; i < n; ++i) grid.add(i + 1, pos[i]);
+  std::vector<AoiEvent> events;
+  grid.update(events);
+
+  std::uniform_real_distribution<float> step(-3, 3);
+  size_t cursor = 0;
+  uint64_t total_events = 0;
+  for (auto _ : state) {
+    for (size_t k = 0; k < n / 4; ++k) {
+      const size_t i = cursor++ % n;
+      pos[i] = pos[i] + Vec3{step(rng), 0, step(rng)};
+      grid.move(i + 1, pos[i]);
+    }
+    events.clear();
+    grid.update(events);
+    total_events += events.size();
+  }
+  state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(n / 4));
+  state.counters["events/tick"] =
+      benchmark::Counter(static_cast<double>(total_events), benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_AoiUpdate)->Arg(1000)->Arg(10000)->Unit(benchmark::kMicrosecond);
+
+void BM_AoiQueryRadius(benchmark::State& state) {
+  const size_t n = 10000;
+  std::mt19937 rng(1234);
+  const std::vector<Vec3> pos = scatter(n, 1600, rng);
+  AoiGrid grid;
+  for (size_t i = 0; i < n; ++i) grid.add(i + 1, pos[i]);
+  std::vector<AoiEvent> events;
+  grid.update(events);
+
+  const float radius = static_cast<float>(state.range(0));
+  std::vector<EntityId> hits;
+  size_t i = 0;
+  for (auto _ : state) {
+    hits.clear();
+    grid.query_radius(pos[i++ % n], radius, hits);
+    benchmark::DoNotOptimize(hits.data());
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_AoiQueryRadius)->Arg(10)->Arg(50);
+
+}  // namespace
+}  // namespace kbs
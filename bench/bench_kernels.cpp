@@ -0,0 +1,89 @@
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "game/kernels.h"
+
+namespace kbs {
+namespace {
+
+std::vector<Vec3> scatter(size_t n, float side, std::mt19937& rng) {
+  std::uniform_real_distribution<float> coord(-side / 2, side / 2);
+  std::vector<Vec3> pos(n);
+  for (Vec3& p : pos) p = Vec3{coord(rng), coord(rng), coord(rng)};
+  return pos;
+}
+
+// range(0) selects the kernel level (0 scalar, 1 widest available); the
+// label says which one actually ran.
+void use_level(benchmark::State& state) {
+  const kernels::SimdLevel level = kernels::set_simd_level(
+      state.range(0) ? kernels::SimdLevel::kAvx2 : kernels::SimdLevel::kScalar);
+  state.SetLabel(kernels::simd_level_name(level));
+}
+
+// An AoE skill against a crowded fight: 4096 candidates, about a fifth hit.
+void BM_SelectInRange(benchmark::State& state) {
+  use_level(state);
+  std::mt19937 rng(1234);
+  const std::vector<Vec3> pos = scatter(4096, 200, rng);
+  std::vector<uint32_t> out(pos.size());
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(kernels::select_in_range(pos, Vec3{0, 0, 0}, 50, out));
+  }
+  state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(pos.size()));
+  kernels::set_simd_level(kernels::SimdLevel::kAvx2);
+}
+BENCHMARK(BM_SelectInRange)->Arg(0)->Arg(1);
+
+void BM_SelectInCone(benchmark::State& state) {
+  use_level(state);
+  std::mt19937 rng(1234);
+  const std::vector<Vec3> pos = scatter(4096, 200, rng);
+  std::vector<uint32_t> out(pos.size());
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        kernels::select_in_cone(pos, Vec3{0, 0, 0}, Vec3{1, 0, 1}, 50, 0.5f, out));
+  }
+  state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(pos.size()));
+  kernels::set_simd_level(kernels::SimdLevel::kAvx2);
+}
+BENCHMARK(BM_SelectInCone)->Arg(0)->Arg(1);
+
+void BM_Integrate(benchmark::State& state) {
+  use_level(state);
+  std::mt19937 rng(1234);
+  std::vector<Vec3> pos = scatter(4096, 200, rng);
+  const std::vector<Vec3> vel = scatter(4096, 10, rng);
+  for (auto _ : state) {
+    kernels::integrate(pos, vel, 0.05f);
+    benchmark::DoNotOptimize(pos.data());
+  }
+  state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(pos.size()));
+  kernels::set_simd_level(kernels::SimdLevel::kAvx2);
+}
+BENCHMARK(BM_Integrate)->Arg(0)->Arg(1);
+
+void BM_EvaluateDamage(benchmark::State& state) {
+  use_level(state);
+  std::mt19937 rng(1234);
+  std::uniform_real_distribution<float> armor_d(0, 500), scale_d(0.5f, 2.0f);
+  std::vector<float> armor(4096), scale(4096), out(4096);
+  for (size_t i = 0; i < armor.size(); ++i) {
+    armor[i] = armor_d(rng);
+    scale[i] = scale_d(rng);
+  }
+  const kernels::DamageFormula f{120, 100, 1};
+  for (auto _ : state) {
+    kernels::evaluate_damage(f, armor, scale, out);
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(armor.size()));
+  kernels::set_simd_level(kernels::SimdLevel::kAvx2);
+}
+BENCHMARK(BM_EvaluateDamage)->Arg(0)->Arg(1);
+
+}  // namespace
+}  // namespace kbs
@@ -0,0 +1,78 @@
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "space/lag_history.h"
+
+namespace kbs {
+namespace {
+
+// A space with range(0) entities and a full second of 20 Hz history.
+struct Populated {
+  LagHistory history;
+  std::vector<Vec3> pos;
+
+  explicit Populated(size_t n) {
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> coord(-800, 800);
+    std::uniform_real_distribution<float> step(-0.5f, 0.5f);
+    pos.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+      pos[i] = Vec3{coord(rng), 0, coord(rng)};
+      history.add(i + 1, pos[i]);
+    }
+    for (uint64_t t = 0; t <= 1000; t += 50) {
+      for (size_t i = 0; i < n; ++i) {
+        pos[i] = pos[i] + Vec3{step(rng), 0, step(rng)};
+        history.set(i + 1, pos[i]);
+      }
+      history.commit(t);
+    }
+  }
+};
+
+// One tick's bookkeeping: every entity moved, then the frame is sealed.
+void BM_LagCommit(benchmark::State& state) {
+  const size_t n = static_cast<size_t>(state.range(0));
+  Populated p(n);
+  uint64_t t = 1000;
+  for (auto _ : state) {
+    for (size_t i = 0; i < n; ++i) p.history.set(i + 1, p.pos[i]);
+    p.history.commit(t += 50);
+  }
+  state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(n));
+}
+BENCHMARK(BM_LagCommit)->Arg(1000)->Arg(10000)->Unit(benchmark::kMicrosecond);
+
+// A skill cast validated 180 ms in the past: one rewound target lookup.
+void BM_LagPositionAt(benchmark::State& state) {
+  Populated p(10000);
+  Vec3 out;
+  EntityId id = 1;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(p.history.position_at(id, 820, out));
+    id = id % 10000 + 1;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LagPositionAt);
+
+// An area skill: everything within 10 m of the caster, 180 ms ago.
+void BM_LagQueryRadiusAt(benchmark::State& state) {
+  const size_t n = static_cast<size_t>(state.range(0));
+  Populated p(n);
+  std::vector<EntityId> hits;
+  size_t i = 0;
+  for (auto _ : state) {
+    hits.clear();
+    p.history.query_radius_at(820, p.pos[i++ % n], 10, hits);
+    benchmark::DoNotOptimize(hits.data());
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LagQueryRadiusAt)->Arg(1000)->Arg(10000)->Unit(benchmark::kMicrosecond);
+
+}  // namespace
+}  // namespace kbs
@@ -0,0 +1,82 @@
+#include <benchmark/benchmark.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+#include "net/event_loop.h"
+#include "net/socket_ops.h"
+#include "net/tcp_server.h"
+
+namespace kbs {
+namespace {
+
+// Cross-thread task submission, the path every mailbox wakeup and
+// TcpServer::send_to() takes.
+void BM_EventLoopPost(benchmark::State& state) {
+  EventLoop loop;
+  std::thread thread([&] { loop.run(); });
+  std::atomic<uint64_t> done{0};
+  uint64_t posted = 0;
+  for (auto _ : state) {
+    loop.post([&done] { done.fetch_add(1, std::memory_order_relaxed); });
+    ++posted;
+  }
+  while (done.load(std::memory_order_relaxed) != posted) std::this_thread::yield();
+  loop.quit();
+  thread.join();
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_EventLoopPost)->UseRealTime();
+
+// Loopback ping-pong through a one-loop echo server: one iteration is one
+// request/response round trip of range(0) bytes.
+void BM_EchoRoundTrip(benchmark::State& state) {
+  TcpServerOptions options;
+  options.listen_addr = InetAddress(0, true);
+  options.num_loops = 1;
+  TcpServer server(options);
+  server.set_message_callback([](TcpConnection& conn, ByteBuffer& in) {
+    conn.send(in.view());
+    in.retrieve_all();
+  });
+  server.start();
+
+  const int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  const InetAddress addr(server.port(), true);
+  if (::connect(fd, addr.sockaddr_ptr(), addr.length()) != 0) {
+    state.SkipWithError("connect failed");
+    ::close(fd);
+    return;
+  }
+  sockets::set_tcp_nodelay(fd, true);
+
+  const std::string msg(static_cast<size_t>(state.range(0)), 'p');
+  std::string reply(msg.size(), '\0');
+  for (auto _ : state) {
+    if (::send(fd, msg.data(), msg.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(msg.size())) {
+      state.SkipWithError("send failed");
+      break;
+    }
+    size_t got = 0;
+    while (got < reply.size()) {
+      const ssize_t n = ::recv(fd, reply.data() + got, reply.size() - got, 0);
+      if (n <= 0) break;
+      got += static_cast<size_t>(n);
+    }
+    if (got != reply.size()) {
+      state.SkipWithError("short reply");
+      break;
+    }
+  }
+  ::close(fd);
+  server.stop();
+  state.SetBytesProcessed(state.iterations() * state.range(0) * 2);
+}
+BENCHMARK(BM_EchoRoundTrip)->Arg(32)->Arg(4096)->UseRealTime();
+
+}  // namespace
+}  // namespace kbs
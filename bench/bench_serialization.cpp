@@ -0,0 +1,104 @@
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <string>
+
+#include "common/vec3.h"
+#include "entity/property_set.h"
+#include "net/message_buffer.h"
+
+namespace kbs {
+namespace {
+
+struct Position : Property<Vec3> {};
+struct Direction : Property<Vec3> {};
+struct Hp : Property<int32_t> {};
+struct Mp : Property<int32_t> {};
+struct Level : Property<uint16_t> {};
+struct Gold : Property<uint64_t, kScopeOwnClient | kScopeServer> {};
+struct Exp : Property<uint64_t, kScopeOwnClient | kScopeServer> {};
+struct State : Property<uint8_t> {};
+using AvatarProps = PropertySet<Position, Direction, Hp, Mp, Level, Gold, Exp, State>;
+
+constexpr uint16_t kMsgEntityUpdate = 0x0101;
+
+// The common case: a moving avatar whose position and facing changed.
+void BM_PropertyEncodeDelta(benchmark::State& state) {
+  AvatarProps props;
+  MessageBuffer buf;
+  float t = 0;
+  for (auto _ : state) {
+    props.set<Position>(Vec3{t, 0, t});
+    props.set<Direction>(Vec3{1, 0, 0});
+    buf.clear();
+    const size_t token = buf.begin_frame(kMsgEntityUpdate);
+    buf.append_pod(uint64_t{42});
+    props.encode_delta(buf, kScopeOtherClients);
+    buf.end_frame(token);
+    props.clear_dirty();
+    benchmark::DoNotOptimize(buf.size());
+    t += 1;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_PropertyEncodeDelta);
+
+void BM_PropertyEncodeFull(benchmark::State& state) {
+  AvatarProps props;
+  MessageBuffer buf;
+  for (auto _ : state) {
+    buf.clear();
+    props.encode_full(buf, kScopeOwnClient);
+    benchmark::DoNotOptimize(buf.size());
+  }
+  state.SetBytesProcessed(state.iterations() *
+                          static_cast<int64_t>(AvatarProps::encoded_size(AvatarProps::kAllMask)));
+}
+BENCHMARK(BM_PropertyEncodeFull);
+
+void BM_PropertyDecode(benchmark::State& state) {
+  AvatarProps src;
+  src.set<Position>(Vec3{1, 2, 3});
+  src.set<Hp>(100);
+  const std::string wire = [&] {
+    MessageBuffer buf;
+    src.encode_full(buf);
+    return buf.to_string();
+  }();
+  AvatarProps dst;
+  for (auto _ : state) {
+    std::string_view in = wire;
+    benchmark::DoNotOptimize(dst.decode(in));
+  }
+  state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(wire.size()));
+}
+BENCHMARK(BM_PropertyDecode);
+
+// Frames a batch of small messages and parses them back, as a gateway does
+// for every client packet.
+void BM_FrameRoundTrip(benchmark::State& state) {
+  const int frames = static_cast<int>(state.range(0));
+  const std::string body(24, 'x');
+  MessageBuffer buf;
+  for (auto _ : state) {
+    buf.clear();
+    for (int i = 0; i < frames; ++i) {
+      const size_t token = buf.begin_frame(static_cast<uint16_t>(i));
+      buf.append(body);
+      buf.end_frame(token);
+    }
+    const std::string wire = buf.to_string();
+    std::string_view in = wire;
+    Frame frame;
+    size_t consumed = 0;
+    while (parse_frame(in, frame, consumed) == FrameStatus::kOk) {
+      benchmark::DoNotOptimize(frame.body.data());
+      in.remove_prefix(consumed);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * frames);
+}
+BENCHMARK(BM_FrameRoundTrip)->Arg(1)->Arg(64);
+
+}  // namespace
+}  // namespace kbs
@@ -0,0 +1,50 @@
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "common/timer_wheel.h"
+
+namespace kbs {
+namespace {
+
+// Buff/cooldown pattern: most timers are cancelled or replaced before they
+// fire.
+void BM_TimerScheduleCancel(benchmark::State& state) {
+  TimerWheel wheel;
+  std::mt19937 rng(1234);
+  std::uniform_int_distribution<uint64_t> delay(1, 60000);
+  std::vector<TimerId> ids(4096);
+  for (TimerId& id : ids) id = wheel.schedule(delay(rng), [] {});
+  size_t i = 0;
+  for (auto _ : state) {
+    TimerId& id = ids[i++ & (ids.size() - 1)];
+    wheel.cancel(id);
+    id = wheel.schedule(delay(rng), [] {});
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_TimerScheduleCancel);
+
+// range(0) live periodic timers spread over one second, advanced one
+// millisecond tick per iteration.
+void BM_TimerAdvance(benchmark::State& state) {
+  const size_t n = static_cast<size_t>(state.range(0));
+  TimerWheel wheel;
+  std::mt19937 rng(1234);
+  std::uniform_int_distribution<uint64_t> delay(1, 1000);
+  uint64_t fired = 0;
+  for (size_t i = 0; i < n; ++i) {
+    const uint64_t d = delay(rng);
+    wheel.schedule(d, [&fired] { ++fired; }, d);
+  }
+  size_t advanced = 0;
+  for (auto _ : state) advanced += wheel.advance(1);
+  benchmark::DoNotOptimize(fired);
+  state.SetItemsProcessed(static_cast<int64_t>(advanced));
+}
+BENCHMARK(BM_TimerAdvance)->Arg(1000)->Arg(100000);
+
+}  // namespace
+}  // namespace kbs
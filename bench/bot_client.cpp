@@ -0,0 +1,476 @@
+// kbs_bots: headless load generator.
+//
+// Opens thousands of client connections spread over a few reactor threads
+// and drives each one like a player: movement at a fixed rate plus random
+// chat and skill casts.  Every client frame starts with the send time, so
+// a server that echoes frames back (and the built-in --local one does)
+// yields round-trip latency percentiles as well as throughput.
+//
+//   kbs_bots --local --bots 5000 --seconds 30
+//   kbs_bots --host 10.0.0.5 --port 20013 --bots 20000 --threads 4
+//   kbs_bots --local --record bots.kbsr   # capture for kbs_replay
+//
+// Runs are reproducible: every bot draws from its own RNG seeded from
+// --seed and its index.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "common/vec3.h"
+#include "net/event_loop.h"
+#include "net/message_buffer.h"
+#include "net/socket_ops.h"
+#include "net/tcp_connection.h"
+#include "net/tcp_server.h"
+#include "net/traffic_recorder.h"
+
+namespace kbs {
+namespace {
+
+constexpr uint16_t kMsgMove = 1;
+constexpr uint16_t kMsgChat = 2;
+constexpr uint16_t kMsgSkill = 3;
+
+struct BotOptions {
+  std::string host = "127.0.0.1";
+  uint16_t port = 20013;
+  bool local = false;
+  size_t bots = 1000;
+  size_t threads = 2;
+  uint32_t seconds = 10;
+  uint32_t ramp_ms = 2000;  // connects are spread over this window
+  uint32_t move_hz = 10;
+  double chat_per_min = 2;
+  double skill_per_min = 12;
+  uint32_t seed = 1;
+  std::string record;  // --local: TrafficRecorder capture of what the server read
+};
+
+uint64_t now_ns() {
+  return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                   std::chrono::steady_clock::now().time_since_epoch())
+                                   .count());
+}
+
+// Linear 10 us buckets up to 100 ms, then one overflow bucket.
+class LatencyHistogram {
+ public:
+  static constexpr uint64_t kBucketUs = 10;
+  static constexpr size_t kBuckets = 10000;
+
+  LatencyHistogram() : counts_(kBuckets + 1) {}
+
+  void record(uint64_t us) {
+    ++counts_[std::min<uint64_t>(us / kBucketUs, kBuckets)];
+    ++total_;
+    max_us_ = std::max(max_us_, us);
+  }
+
+  void merge(const LatencyHistogram& o) {
+    for (size_t i = 0; i < counts_.size(); ++i) counts_[i] += o.counts_[i];
+    total_ += o.total_;
+    max_us_ = std::max(max_us_, o.max_us_);
+  }
+
+  // Upper edge of the bucket holding quantile q.
+  uint64_t percentile(double q) const {
+    if (total_ == 0) return 0;
+    const uint64_t rank = static_cast<uint64_t>(q * static_cast<double>(total_ - 1)) + 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kBuckets; ++i) {
+      seen += counts_[i];
+      if (seen >= rank) return (i + 1) * kBucketUs;
+    }
+    return max_us_;
+  }
+
+  uint64_t total() const { return total_; }
+  uint64_t max_us() const { return max_us_; }
+
+ private:
+  std::vector<uint64_t> counts_;
+  uint64_t total_ = 0;
+  uint64_t max_us_ = 0;
+};
+
+// Per-thread counters; read by the reporter thread, so atomics.
+struct BotStats {
+  std::atomic<uint64_t> connected{0};
+  std::atomic<uint64_t> failed{0};
+  std::atomic<uint64_t> closed{0};
+  std::atomic<uint64_t> frames_out{0};
+  std::atomic<uint64_t> frames_in{0};
+  std::atomic<uint64_t> bytes_out{0};
+  std::atomic<uint64_t> bytes_in{0};
+
+  static void bump(std::atomic<uint64_t>& c, uint64_t n = 1) {
+    c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+  }
+};
+
+struct Worker;
+
+// One simulated player.  Owns its socket through a TcpConnection once the
+// non-blocking connect has completed; until then it is the fd's handler.
+class Bot final : public IoHandler {
+ public:
+  Bot(Worker& worker, uint32_t index);
+  ~Bot() override;
+
+  void connect();
+  void stop();
+  void handle_events(uint32_t events) override;
+
+ private:
+  void on_connected();
+  void on_message(ByteBuffer& in);
+  void tick();
+  void send_move();
+  void send_chat();
+  void send_skill();
+  void flush();
+
+  Worker& worker_;
+  uint32_t index_;
+  std::mt19937 rng_;
+  int connecting_fd_ = -1;
+  std::unique_ptr<TcpConnection> conn_;
+  TimerId timer_ = kInvalidTimerId;
+  MessageBuffer out_;  // frames batched for this tick
+  uint32_t pending_frames_ = 0;
+  Vec3 pos_;
+  float yaw_ = 0;
+};
+
+struct Worker {
+  const BotOptions* options = nullptr;
+  InetAddress server;
+  EventLoop loop;
+  std::vector<std::unique_ptr<Bot>> bots;
+  BotStats stats;
+  LatencyHistogram rtt;  // loop thread only; read after join
+  std::thread thread;
+};
+
+Bot::Bot(Worker& worker, uint32_t index)
+    : worker_(worker), index_(index), rng_(worker.options->seed * 1000003u + index) {
+  std::uniform_real_distribution<float> coord(-500, 500);
+  pos_ = Vec3{coord(rng_), 0, coord(rng_)};
+}
+
+Bot::~Bot() {
+  if (connecting_fd_ >= 0) sockets::close_fd(connecting_fd_);
+}
+
+void Bot::connect() {
+  try {
+    connecting_fd_ = sockets::connect_nonblocking(worker_.server);
+  } catch (const std::system_error&) {
+    BotStats::bump(worker_.stats.failed);
+    return;
+  }
+  worker_.loop.add_handler(connecting_fd_, this, kPollWritable);
+}
+
+void Bot::handle_events(uint32_t) {
+  const int fd = connecting_fd_;
+  worker_.loop.remove_handler(fd);
+  connecting_fd_ = -1;
+  if (sockets::socket_error(fd) != 0) {
+    sockets::close_fd(fd);
+    BotStats::bump(worker_.stats.failed);
+    return;
+  }
+  sockets::set_tcp_nodelay(fd, true);
+  conn_ = std::make_unique<TcpConnection>(worker_.loop, fd, index_, worker_.server);
+  on_connected();
+}
+
+void Bot::on_connected() {
+  BotStats::bump(worker_.stats.connected);
+  conn_->set_message_callback([this](TcpConnection&, ByteBuffer& in) { on_message(in); });
+  conn_->set_close_callback([this](TcpConnection&) {
+    BotStats::bump(worker_.stats.closed);
+    worker_.loop.cancel_timer(timer_);
+    timer_ = kInvalidTimerId;
+    worker_.loop.defer([this] { conn_.reset(); });
+  });
+  conn_->start();
+
+  // Desynchronise the bots so they do not all send on the same millisecond.
+  const uint32_t period = 1000 / std::max<uint32_t>(worker_.options->move_hz, 1);
+  const uint64_t phase = std::uniform_int_distribution<uint32_t>(0, period - 1)(rng_);
+  timer_ = worker_.loop.run_after(phase, [this, period] {
+    timer_ = worker_.loop.run_every(period, [this] { tick(); });
+    tick();
+  });
+}
+
+void Bot::stop() {
+  worker_.loop.cancel_timer(timer_);
+  timer_ = kInvalidTimerId;
+  if (conn_) conn_->force_close();
+}
+
+void Bot::on_message(ByteBuffer& in) {
+  const uint64_t now = now_ns();
+  Frame frame;
+  size_t consumed = 0;
+  while (parse_frame(in.view(), frame, consumed) == FrameStatus::kOk) {
+    BotStats::bump(worker_.stats.frames_in);
+    BotStats::bump(worker_.stats.bytes_in, consumed);
+    if (frame.msg_id >= kMsgMove && frame.msg_id <= kMsgSkill &&
+        frame.body.size() >= sizeof(uint64_t)) {
+      uint64_t sent;
+      std::memcpy(&sent, frame.body.data(), sizeof(sent));
+      if (sent <= now) worker_.rtt.record((now - sent) / 1000);
+    }
+    in.retrieve(consumed);
+  }
+}
+
+void Bot::tick() {
+  if (!conn_ || !conn_->connected()) return;
+  send_move();
+  const double ticks_per_min = 60.0 * worker_.options->move_hz;
+  std::uniform_real_distribution<double> roll(0, 1);
+  if (roll(rng_) < worker_.options->chat_per_min / ticks_per_min) send_chat();
+  if (roll(rng_) < worker_.options->skill_per_min / ticks_per_min) send_skill();
+  flush();
+}
+
+void Bot::send_move() {
+  std::uniform_real_distribution<float> turn(-0.3f, 0.3f);
+  yaw_ += turn(rng_);
+  pos_ = pos_ + Vec3{std::cos(yaw_), 0, std::sin(yaw_)} * 0.5f;
+  const size_t token = out_.begin_frame(kMsgMove);
+  ++pending_frames_;
+  out_.append_pod(now_ns());
+  out_.append_pod(pos_);
+  out_.append_pod(yaw_);
+  out_.end_frame(token);
+}
+
+void Bot::send_chat() {
+  static constexpr std::string_view kLines[] = {
+      "lfg dungeon", "anyone selling mana potions?", "gg", "brb",
+      "where is the quest giver for the swamp chain", "wts epic sword pm me"};
+  const size_t token = out_.begin_frame(kMsgChat);
+  ++pending_frames_;
+  out_.append_pod(now_ns());
+  out_.append(kLines[std::uniform_int_distribution<size_t>(0, std::size(kLines) - 1)(rng_)]);
+  out_.end_frame(token);
+}
+
+void Bot::send_skill() {
+  const size_t token = out_.begin_frame(kMsgSkill);
+  ++pending_frames_;
+  out_.append_pod(now_ns());
+  out_.append_pod(std::uniform_int_distribution<uint32_t>(1, 40)(rng_));
+  out_.append_pod(static_cast<uint64_t>(
+      std::uniform_int_distribution<size_t>(0, worker_.options->bots - 1)(rng_)));
+  out_.end_frame(token);
+}
+
+void Bot::flush() {
+  if (out_.empty()) return;
+  BotStats::bump(worker_.stats.bytes_out, out_.size());
+  BotStats::bump(worker_.stats.frames_out, pending_frames_);
+  conn_->send(out_);
+  out_.clear();
+  pending_frames_ = 0;
+}
+
+std::optional<BotOptions> parse_args(int argc, char** argv) {
+  BotOptions o;
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg = argv[i];
+    const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+    auto take = [&](auto& field) {
+      if (!value) return false;
+      using T = std::decay_t<decltype(field)>;
+      if constexpr (std::is_same_v<T, std::string>) {
+        field = value;
+      } else if constexpr (std::is_floating_point_v<T>) {
+        field = std::strtod(value, nullptr);
+      } else {
+        field = static_cast<T>(std::strtoull(value, nullptr, 10));
+      }
+      ++i;
+      return true;
+    };
+    bool ok = true;
+    if (arg == "--local") {
+      o.local = true;
+    } else if (arg == "--host") {
+      ok = take(o.host);
+    } else if (arg == "--port") {
+      ok = take(o.port);
+    } else if (arg == "--bots") {
+      ok = take(o.bots);
+    } else if (arg == "--threads") {
+      ok = take(o.threads);
+    } else if (arg == "--seconds") {
+      ok = take(o.seconds);
+    } else if (arg == "--ramp-ms") {
+      ok = take(o.ramp_ms);
+    } else if (arg == "--move-hz") {
+      ok = take(o.move_hz);
+    } else if (arg == "--chat-per-min") {
+      ok = take(o.chat_per_min);
+    } else if (arg == "--skill-per-min") {
+      ok = take(o.skill_per_min);
+    } else if (arg == "--seed") {
+      ok = take(o.seed);
+    } else if (arg == "--record") {
+      ok = take(o.record);
+    } else {
+      ok = false;
+    }
+    if (!ok) {
+      std::fprintf(stderr,
+                   "usage: %s [--local] [--host H] [--port P] [--bots N] [--threads T]\n"
+                   "          [--seconds S] [--ramp-ms MS] [--move-hz HZ]\n"
+                   "          [--chat-per-min R] [--skill-per-min R] [--seed N]\n"
+                   "          [--record FILE]\n",
+                   argv[0]);
+      return std::nullopt;
+    }
+  }
+  o.threads = std::max<size_t>(o.threads, 1);
+  o.move_hz = std::max<uint32_t>(o.move_hz, 1);
+  return o;
+}
+
+int run(const BotOptions& options) {
+  // --local: an in-process echo server, so the harness measures the whole
+  // client+server stack on one box without a deployed cluster.
+  std::unique_ptr<TrafficRecorder> recorder;
+  std::unique_ptr<TcpServer> echo;
+  uint16_t port = options.port;
+  if (options.local) {
+    TcpServerOptions so;
+    so.listen_addr = InetAddress(0, true);
+    so.num_loops = options.threads;
+    if (!options.record.empty()) {
+      recorder = std::make_unique<TrafficRecorder>(TrafficRecorderOptions{.path = options.record});
+      so.recorder = recorder.get();
+    }
+    echo = std::make_unique<TcpServer>(so);
+    echo->set_message_callback([](TcpConnection& conn, ByteBuffer& in) {
+      conn.send(in.view());
+      in.retrieve_all();
+    });
+    echo->start();
+    port = echo->port();
+  }
+  const InetAddress server = options.local ? InetAddress(port, true)
+                                           : InetAddress::parse(options.host, port);
+
+  std::vector<std::unique_ptr<Worker>> workers;
+  for (size_t t = 0; t < options.threads; ++t) {
+    auto w = std::make_unique<Worker>();
+    w->options = &options;
+    w->server = server;
+    workers.push_back(std::move(w));
+  }
+  for (size_t i = 0; i < options.bots; ++i) {
+    Worker& w = *workers[i % workers.size()];
+    w.bots.push_back(std::make_unique<Bot>(w, static_cast<uint32_t>(i)));
+  }
+  for (auto& w : workers) {
+    Worker* wp = w.get();
+    wp->loop.post([wp, &options] {
+      const size_t n = wp->bots.size();
+      for (size_t i = 0; i < n; ++i) {
+        Bot* bot = wp->bots[i].get();
+        wp->loop.run_after(options.ramp_ms * i / std::max<size_t>(n, 1), [bot] { bot->connect(); });
+      }
+    });
+    wp->thread = std::thread([wp] { wp->loop.run(); });
+  }
+
+  std::printf("kbs_bots: %zu bots on %zu threads against %s for %us\n", options.bots,
+              options.threads, server.to_string().c_str(), options.seconds);
+  uint64_t last_out = 0;
+  uint64_t last_in = 0;
+  for (uint32_t s = 1; s <= options.seconds; ++s) {
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    uint64_t connected = 0, failed = 0, out = 0, in = 0;
+    for (auto& w : workers) {
+      connected += w->stats.connected.load(std::memory_order_relaxed) -
+                   w->stats.closed.load(std::memory_order_relaxed);
+      failed += w->stats.failed.load(std::memory_order_relaxed);
+      out += w->stats.frames_out.load(std::memory_order_relaxed);
+      in += w->stats.frames_in.load(std::memory_order_relaxed);
+    }
+    std::printf("t=%us connected=%llu failed=%llu out/s=%llu in/s=%llu\n", s,
+                static_cast<unsigned long long>(connected),
+                static_cast<unsigned long long>(failed),
+                static_cast<unsigned long long>(out - last_out),
+                static_cast<unsigned long long>(in - last_in));
+    std::fflush(stdout);
+    last_out = out;
+    last_in = in;
+  }
+
+  for (auto& w : workers) {
+    Worker* wp = w.get();
+    wp->loop.post([wp] {
+      for (auto& bot : wp->bots) bot->stop();
+      wp->loop.quit();
+    });
+  }
+  LatencyHistogram rtt;
+  uint64_t frames_out = 0, frames_in = 0, bytes_out = 0, bytes_in = 0, failed = 0;
+  for (auto& w : workers) {
+    w->thread.join();
+    rtt.merge(w->rtt);
+    frames_out += w->stats.frames_out.load();
+    frames_in += w->stats.frames_in.load();
+    bytes_out += w->stats.bytes_out.load();
+    bytes_in += w->stats.bytes_in.load();
+    failed += w->stats.failed.load();
+  }
+  workers.clear();
+  if (echo) echo->stop();
+
+  // One greppable line so CI can track it across releases.
+  std::printf(
+      "summary bots=%zu seconds=%u failed=%llu frames_out=%llu frames_in=%llu "
+      "bytes_out=%llu bytes_in=%llu rtt_samples=%llu rtt_p50_us=%llu rtt_p99_us=%llu "
+      "rtt_p999_us=%llu rtt_max_us=%llu\n",
+      options.bots, options.seconds, static_cast<unsigned long long>(failed),
+      static_cast<unsigned long long>(frames_out), static_cast<unsigned long long>(frames_in),
+      static_cast<unsigned long long>(bytes_out), static_cast<unsigned long long>(bytes_in),
+      static_cast<unsigned long long>(rtt.total()),
+      static_cast<unsigned long long>(rtt.percentile(0.50)),
+      static_cast<unsigned long long>(rtt.percentile(0.99)),
+      static_cast<unsigned long long>(rtt.percentile(0.999)),
+      static_cast<unsigned long long>(rtt.max_us()));
+  return failed == 0 ? 0 : 1;
+}
+
+}  // namespace
+}  // namespace kbs
+
+int main(int argc, char** argv) {
+  const auto options = kbs::parse_args(argc, argv);
+  if (!options) return 2;
+  return kbs::run(*options);
+}
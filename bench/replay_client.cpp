@@ -0,0 +1,514 @@
+// kbs_replay: plays a traffic recording back against a server.
+//
+// Every connection in the recording (see net/traffic_recorder.h) is
+// reopened and fed exactly the bytes it received in production, split the
+// same way and at the same offsets in time, so a spike caused by a real
+// traffic shape -- a raid boss pull, a login storm after a restart --
+// reproduces on a new build instead of being approximated by bots.
+//
+// Before and after the run the server's /metrics are scraped; the report
+// is the difference, per histogram (count, mean, p50, p99) and for every
+// allocation counter, and can be compared against a previous run's:
+//
+//   kbs_replay --file peak.kbsr --host 10.0.0.5 --port 20013
+//              --metrics 10.0.0.5:9100 --report new.txt --baseline old.txt
+//   kbs_replay --file peak.kbsr --local         # in-process echo server
+//
+// --speed 2 compresses time by half; server responses are read and
+// discarded.
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "metrics/metrics.h"
+#include "net/event_loop.h"
+#include "net/socket_ops.h"
+#include "net/tcp_connection.h"
+#include "net/tcp_server.h"
+#include "net/traffic_recorder.h"
+
+namespace kbs {
+namespace {
+
+struct ReplayOptions {
+  std::string file;
+  std::string host = "127.0.0.1";
+  uint16_t port = 20013;
+  bool local = false;
+  double speed = 1.0;
+  std::string metrics;  // host:port of the server's MetricsServer
+  std::string report;
+  std::string baseline;
+};
+
+uint64_t now_ns() {
+  return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                   std::chrono::steady_clock::now().time_since_epoch())
+                                   .count());
+}
+
+struct Event {
+  TrafficRecorder::RecordType type;
+  uint64_t time_ns;
+  uint64_t conn_id;
+  size_t offset;  // into Recording::bytes
+  size_t length;
+};
+
+struct Recording {
+  std::vector<Event> events;
+  std::string bytes;
+  size_t connections = 0;
+  size_t gaps = 0;  // where the recorder fell behind and dropped data
+};
+
+Recording load(const std::string& path) {
+  Recording rec;
+  TrafficRecorder::read(path, [&](const TrafficRecorder::Record& r) {
+    rec.events.push_back(Event{r.type, r.time_ns, r.conn_id, rec.bytes.size(), r.data.size()});
+    rec.bytes.append(r.data);
+    if (r.type == TrafficRecorder::RecordType::kOpen) ++rec.connections;
+    if (r.type == TrafficRecorder::RecordType::kGap) ++rec.gaps;
+  });
+  return rec;
+}
+
+struct ReplayStats {
+  uint64_t connected = 0;
+  uint64_t failed = 0;
+  uint64_t bytes_out = 0;
+  uint64_t bytes_in = 0;
+  uint64_t max_lag_us = 0;  // how far behind the recording's clock a send ran
+};
+
+class Replayer;
+
+// One recorded connection.  Bytes due before the connect completes are
+// held and sent in one go once it does.
+class ReplayConn final : public IoHandler {
+ public:
+  ReplayConn(Replayer& r, uint64_t id) : replayer_(r), id_(id) {}
+  ~ReplayConn() override;
+
+  void open(EventLoop& loop, const InetAddress& server);
+  void send(std::string_view data);
+  void close();
+  void handle_events(uint32_t events) override;
+  bool done() const { return done_; }
+
+ private:
+  Replayer& replayer_;
+  EventLoop* loop_ = nullptr;
+  uint64_t id_;
+  int connecting_fd_ = -1;
+  std::unique_ptr<TcpConnection> conn_;
+  std::string pending_;
+  bool close_pending_ = false;
+  bool done_ = false;
+};
+
+class Replayer {
+ public:
+  Replayer(const Recording& rec, const ReplayOptions& options, const InetAddress& server)
+      : rec_(rec), options_(options), server_(server) {}
+
+  // Runs the whole recording on this thread.
+  void run() {
+    start_ns_ = now_ns();
+    loop_.run_every(1, [this] { pump(); });
+    loop_.run();
+    conns_.clear();
+  }
+
+  ReplayStats& stats() { return stats_; }
+
+ private:
+  void pump() {
+    const auto elapsed =
+        static_cast<uint64_t>(static_cast<double>(now_ns() - start_ns_) * options_.speed);
+    for (; next_ < rec_.events.size() && rec_.events[next_].time_ns <= elapsed; ++next_) {
+      const Event& e = rec_.events[next_];
+      stats_.max_lag_us = std::max<uint64_t>(
+          stats_.max_lag_us,
+          static_cast<uint64_t>(static_cast<double>(elapsed - e.time_ns) / options_.speed / 1000));
+      dispatch(e);
+    }
+    if (next_ < rec_.events.size()) return;
+    // Everything sent: give the server a moment to drain, then stop.
+    if (drain_deadline_ == 0) drain_deadline_ = now_ns() + 1'000'000'000ull;
+    const bool idle = std::all_of(conns_.begin(), conns_.end(),
+                                  [](const auto& kv) { return kv.second->done(); });
+    if (idle || now_ns() > drain_deadline_) {
+      for (auto& [id, c] : conns_) c->close();
+      loop_.quit();
+    }
+  }
+
+  void dispatch(const Event& e) {
+    using Type = TrafficRecorder::RecordType;
+    if (e.type == Type::kOpen) {
+      auto& c = conns_[e.conn_id];
+      c = std::make_unique<ReplayConn>(*this, e.conn_id);
+      c->open(loop_, server_);
+      return;
+    }
+    auto it = conns_.find(e.conn_id);
+    if (it == conns_.end()) return;  // opened before the recording started
+    if (e.type == Type::kData) {
+      it->second->send(std::string_view(rec_.bytes).substr(e.offset, e.length));
+    } else {
+      // kClose, or a kGap: what follows it is not the stream the server saw.
+      it->second->close();
+    }
+  }
+
+  const Recording& rec_;
+  const ReplayOptions& options_;
+  InetAddress server_;
+  EventLoop loop_;
+  std::unordered_map<uint64_t, std::unique_ptr<ReplayConn>> conns_;
+  size_t next_ = 0;
+  uint64_t start_ns_ = 0;
+  uint64_t drain_deadline_ = 0;
+  ReplayStats stats_;
+};
+
+ReplayConn::~ReplayConn() {
+  if (connecting_fd_ >= 0) {
+    loop_->remove_handler(connecting_fd_);
+    sockets::close_fd(connecting_fd_);
+  }
+}
+
+void ReplayConn::open(EventLoop& loop, const InetAddress& server) {
+  loop_ = &loop;
+  try {
+    connecting_fd_ = sockets::connect_nonblocking(server);
+  } catch (const std::system_error&) {
+    ++replayer_.stats().failed;
+    done_ = true;
+    return;
+  }
+  loop.add_handler(connecting_fd_, this, kPollWritable);
+}
+
+void ReplayConn::handle_events(uint32_t) {
+  const int fd = connecting_fd_;
+  loop_->remove_handler(fd);
+  connecting_fd_ = -1;
+  if (sockets::socket_error(fd) != 0) {
+    sockets::close_fd(fd);
+    ++replayer_.stats().failed;
+    done_ = true;
+    return;
+  }
+  sockets::set_tcp_nodelay(fd, true);
+  ++replayer_.stats().connected;
+  conn_ = std::make_unique<TcpConnection>(*loop_, fd, id_, InetAddress(0));
+  conn_->set_message_callback([this](TcpConnection&, ByteBuffer& in) {
+    replayer_.stats().bytes_in += in.readable_bytes();
+    in.retrieve_all();
+  });
+  conn_->set_close_callback([this](TcpConnection&) {
+    done_ = true;
+    loop_->defer([this] { conn_.reset(); });
+  });
+  conn_->start();
+  if (!pending_.empty()) {
+    replayer_.stats().bytes_out += pending_.size();
+    conn_->send(std::exchange(pending_, {}));
+  }
+  if (close_pending_) conn_->shutdown();
+}
+
+void ReplayConn::send(std::string_view data) {
+  if (done_ || close_pending_) return;
+  if (!conn_) {
+    pending_.append(data);
+    return;
+  }
+  replayer_.stats().bytes_out += data.size();
+  conn_->send(data);
+}
+
+void ReplayConn::close() {
+  if (done_ || close_pending_) return;
+  close_pending_ = true;
+  if (conn_) conn_->shutdown();
+}
+
+// --- metrics scrape and report ----------------------------------------------
+
+// Blocking HTTP/1.0 GET of /metrics; the server closes after responding.
+std::optional<std::string> scrape(const std::string& target) {
+  const size_t colon = target.rfind(':');
+  if (colon == std::string::npos) return std::nullopt;
+  const InetAddress addr = InetAddress::parse(
+      target.substr(0, colon), static_cast<uint16_t>(std::strtoul(target.c_str() + colon + 1,
+                                                                  nullptr, 10)));
+  const int fd = ::socket(addr.family(), SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) return std::nullopt;
+  std::string body;
+  const std::string_view req = "GET /metrics HTTP/1.0\r\n\r\n";
+  if (::connect(fd, addr.sockaddr_ptr(), addr.length()) == 0 &&
+      ::write(fd, req.data(), req.size()) == static_cast<ssize_t>(req.size())) {
+    char buf[1 << 16];
+    ssize_t n;
+    while ((n = ::read(fd, buf, sizeof(buf))) > 0) body.append(buf, static_cast<size_t>(n));
+  }
+  ::close(fd);
+  const size_t head_end = body.find("\r\n\r\n");
+  if (head_end == std::string::npos) return std::nullopt;
+  return body.substr(head_end + 4);
+}
+
+// series (name plus label block, as rendered) -> value
+std::map<std::string, double> parse_metrics(std::string_view text) {
+  std::map<std::string, double> out;
+  while (!text.empty()) {
+    const size_t eol = std::min(text.find('\n'), text.size());
+    const std::string_view line = text.substr(0, eol);
+    text.remove_prefix(std::min(eol + 1, text.size()));
+    if (line.empty() || line.front() == '#') continue;
+    const size_t space = line.rfind(' ');
+    if (space == std::string_view::npos) continue;
+    const std::string value(line.substr(space + 1));
+    out[std::string(line.substr(0, space))] = std::strtod(value.c_str(), nullptr);
+  }
+  return out;
+}
+
+struct HistogramDelta {
+  std::vector<std::pair<double, double>> buckets;  // (le, cumulative count)
+  double sum = 0;
+  double count = 0;
+
+  double quantile(double q) const {
+    const double rank = q * count;
+    for (const auto& [le, cumulative] : buckets) {
+      if (cumulative >= rank) return le;
+    }
+    return buckets.empty() ? 0 : buckets.back().first;
+  }
+};
+
+// after - before, as report lines "key value".
+std::map<std::string, double> diff(const std::map<std::string, double>& before,
+                                   const std::map<std::string, double>& after) {
+  const auto delta = [&](const std::string& k, double v) {
+    auto it = before.find(k);
+    return v - (it == before.end() ? 0 : it->second);
+  };
+  std::map<std::string, HistogramDelta> hists;
+  std::map<std::string, double> report;
+  for (const auto& [series, value] : after) {
+    const size_t brace = series.find('{');
+    const std::string name = series.substr(0, brace);
+    std::string labels = brace == std::string::npos ? "" : series.substr(brace);
+    const auto ends_with = [&](std::string_view s) {
+      return name.size() > s.size() && name.compare(name.size() - s.size(), s.size(), s) == 0;
+    };
+    if (ends_with("_bucket")) {
+      // le is rendered last: {a="x",le="5"} or {le="5"}.
+      const size_t le = labels.find("le=\"");
+      if (le == std::string::npos) continue;
+      const double bound = std::strtod(labels.c_str() + le + 4, nullptr);
+      labels = le <= 1 ? "" : labels.substr(0, le - 1) + "}";
+      hists[name.substr(0, name.size() - 7) + labels].buckets.emplace_back(bound,
+                                                                          delta(series, value));
+    } else if (ends_with("_sum")) {
+      hists[name.substr(0, name.size() - 4) + labels].sum = delta(series, value);
+    } else if (ends_with("_count")) {
+      hists[name.substr(0, name.size() - 6) + labels].count = delta(series, value);
+    } else if (name.find("alloc") != std::string::npos) {
+      report[series] = delta(series, value);
+    }
+  }
+  for (auto& [key, h] : hists) {
+    if (h.count <= 0) continue;
+    std::sort(h.buckets.begin(), h.buckets.end());
+    report[key + " count"] = h.count;
+    report[key + " mean"] = h.sum / h.count;
+    report[key + " p50"] = h.quantile(0.50);
+    report[key + " p99"] = h.quantile(0.99);
+  }
+  return report;
+}
+
+std::map<std::string, double> read_report(const std::string& path) {
+  std::map<std::string, double> out;
+  std::ifstream in(path);
+  std::string line;
+  while (std::getline(in, line)) {
+    const size_t space = line.rfind(' ');
+    if (space == std::string::npos) continue;
+    out[line.substr(0, space)] = std::strtod(line.c_str() + space + 1, nullptr);
+  }
+  return out;
+}
+
+std::optional<ReplayOptions> parse_args(int argc, char** argv) {
+  ReplayOptions o;
+  const auto usage = [&] {
+    std::fprintf(stderr,
+                 "usage: %s --file F [--local] [--host H] [--port P] [--speed X]\n"
+                 "          [--metrics HOST:PORT] [--report OUT] [--baseline IN]\n",
+                 argv[0]);
+    return std::nullopt;
+  };
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg = argv[i];
+    const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+    auto take = [&](auto& field) {
+      if (!value) return false;
+      using T = std::decay_t<decltype(field)>;
+      if constexpr (std::is_same_v<T, std::string>) {
+        field = value;
+      } else if constexpr (std::is_floating_point_v<T>) {
+        field = std::strtod(value, nullptr);
+      } else {
+        field = static_cast<T>(std::strtoull(value, nullptr, 10));
+      }
+      ++i;
+      return true;
+    };
+    bool ok = true;
+    if (arg == "--local") {
+      o.local = true;
+    } else if (arg == "--file") {
+      ok = take(o.file);
+    } else if (arg == "--host") {
+      ok = take(o.host);
+    } else if (arg == "--port") {
+      ok = take(o.port);
+    } else if (arg == "--speed") {
+      ok = take(o.speed);
+    } else if (arg == "--metrics") {
+      ok = take(o.metrics);
+    } else if (arg == "--report") {
+      ok = take(o.report);
+    } else if (arg == "--baseline") {
+      ok = take(o.baseline);
+    } else {
+      ok = false;
+    }
+    if (!ok) return usage();
+  }
+  if (o.file.empty()) return usage();
+  o.speed = o.speed > 0 ? o.speed : 1.0;
+  return o;
+}
+
+int run(const ReplayOptions& options) {
+  Recording rec;
+  try {
+    rec = load(options.file);
+  } catch (const std::exception& e) {
+    std::fprintf(stderr, "kbs_replay: %s\n", e.what());
+    return 2;
+  }
+
+  // --local: an in-process echo server whose own registry is the report's
+  // source, for trying recordings out without a deployed cluster.
+  std::unique_ptr<TcpServer> echo;
+  uint16_t port = options.port;
+  if (options.local) {
+    TcpServerOptions so;
+    so.listen_addr = InetAddress(0, true);
+    so.num_loops = 1;
+    echo = std::make_unique<TcpServer>(so);
+    echo->set_message_callback([](TcpConnection& conn, ByteBuffer& in) {
+      conn.send(in.view());
+      in.retrieve_all();
+    });
+    echo->start();
+    port = echo->port();
+  }
+  const InetAddress server = options.local ? InetAddress(port, true)
+                                           : InetAddress::parse(options.host, port);
+  const auto sample = [&]() -> std::optional<std::map<std::string, double>> {
+    if (options.local) return parse_metrics(metrics().render());
+    if (options.metrics.empty()) return std::nullopt;
+    auto text = scrape(options.metrics);
+    if (!text) return std::nullopt;
+    return parse_metrics(*text);
+  };
+
+  const uint64_t span_ns = rec.events.empty() ? 0 : rec.events.back().time_ns;
+  std::printf("kbs_replay: %zu connections, %zu records, %.1fs recorded, against %s at %.2fx\n",
+              rec.connections, rec.events.size(), static_cast<double>(span_ns) / 1e9,
+              server.to_string().c_str(), options.speed);
+  if (rec.gaps != 0) {
+    std::printf("kbs_replay: %zu gaps in the recording; those connections close there\n",
+                rec.gaps);
+  }
+  std::fflush(stdout);
+
+  const auto before = sample();
+  Replayer replayer(rec, options, server);
+  const uint64_t begin = now_ns();
+  replayer.run();
+  const double wall_s = static_cast<double>(now_ns() - begin) / 1e9;
+  // Let the server finish the last ticks the traffic caused.
+  if (!options.local) std::this_thread::sleep_for(std::chrono::milliseconds(500));
+  const auto after = sample();
+  if (echo) echo->stop();
+
+  const ReplayStats& s = replayer.stats();
+  std::printf(
+      "summary connections=%llu failed=%llu bytes_out=%llu bytes_in=%llu wall_s=%.2f "
+      "max_lag_us=%llu\n",
+      static_cast<unsigned long long>(s.connected), static_cast<unsigned long long>(s.failed),
+      static_cast<unsigned long long>(s.bytes_out), static_cast<unsigned long long>(s.bytes_in),
+      wall_s, static_cast<unsigned long long>(s.max_lag_us));
+
+  if (before && after) {
+    const auto report = diff(*before, *after);
+    if (!options.report.empty()) {
+      std::ofstream out(options.report);
+      for (const auto& [key, value] : report) out << key << ' ' << value << '\n';
+    }
+    const auto baseline = options.baseline.empty() ? std::map<std::string, double>{}
+                                                   : read_report(options.baseline);
+    for (const auto& [key, value] : report) {
+      auto it = baseline.find(key);
+      if (it == baseline.end()) {
+        std::printf("%s %.6g\n", key.c_str(), value);
+      } else {
+        const double change = it->second != 0 ? (value - it->second) / it->second * 100 : 0;
+        std::printf("%s %.6g (baseline %.6g, %+.1f%%)\n", key.c_str(), value, it->second, change);
+      }
+    }
+  } else if (!options.metrics.empty()) {
+    std::fprintf(stderr, "kbs_replay: could not scrape %s\n", options.metrics.c_str());
+  }
+  return s.failed == 0 ? 0 : 1;
+}
+
+}  // namespace
+}  // namespace kbs
+
+int main(int argc, char** argv) {
+  const auto options = kbs::parse_args(argc, argv);
+  if (!options) return 2;
+  return kbs::run(*options);
+}
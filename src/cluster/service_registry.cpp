@@ -0,0 +1,263 @@
+#include "cluster/service_registry.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "metrics/trace.h"
+#include "rpc/rpc_channel.h"
+
+namespace kbs {
+
+namespace {
+
+uint64_t splitmix64(uint64_t x) {
+  x += 0x9E3779B97F4A7C15ull;
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+  return x ^ (x >> 31);
+}
+
+uint64_t fnv1a64(std::string_view s) {
+  uint64_t h = 14695981039346656037ull;
+  for (unsigned char c : s) {
+    h ^= c;
+    h *= 1099511628211ull;
+  }
+  return h;
+}
+
+template <typename T>
+void put(std::string& out, T v) {
+  out.append(reinterpret_cast<const char*>(&v), sizeof(T));
+}
+
+template <typename T>
+bool take(std::string_view& in, T& v) {
+  if (in.size() < sizeof(T)) return false;
+  std::memcpy(&v, in.data(), sizeof(T));
+  in.remove_prefix(sizeof(T));
+  return true;
+}
+
+struct RegistryMetrics {
+  Counter& owner = metrics().counter("kbs_registry_routes_total", "Keys routed by the registry",
+                                     {{"result", "owner"}});
+  Counter& overflow = metrics().counter("kbs_registry_routes_total",
+                                        "Keys routed by the registry", {{"result", "overflow"}});
+  Counter& none = metrics().counter("kbs_registry_routes_total", "Keys routed by the registry",
+                                    {{"result", "none"}});
+  Counter& expired =
+      metrics().counter("kbs_registry_expired_total", "Nodes dropped for missing heartbeats");
+};
+
+RegistryMetrics& registry_metrics() {
+  static RegistryMetrics m;
+  return m;
+}
+
+}  // namespace
+
+std::string NodeInfo::encode() const {
+  std::string out;
+  out.reserve(24 + address.size());
+  put<uint64_t>(out, node_id);
+  put<uint8_t>(out, static_cast<uint8_t>(kind));
+  put<uint8_t>(out, draining ? 1 : 0);
+  put<uint32_t>(out, load.ccu);
+  put<uint32_t>(out, load.capacity);
+  put<float>(out, load.tick_ms);
+  put<uint16_t>(out, static_cast<uint16_t>(std::min<size_t>(address.size(), UINT16_MAX)));
+  out.append(address, 0, UINT16_MAX);
+  return out;
+}
+
+std::optional<NodeInfo> NodeInfo::decode(std::string_view in) {
+  NodeInfo info;
+  uint8_t kind = 0;
+  uint8_t draining = 0;
+  uint16_t len = 0;
+  if (!take(in, info.node_id) || !take(in, kind) || !take(in, draining) ||
+      !take(in, info.load.ccu) || !take(in, info.load.capacity) || !take(in, info.load.tick_ms) ||
+      !take(in, len) || in.size() != len) {
+    return std::nullopt;
+  }
+  if (kind > static_cast<uint8_t>(ServiceKind::kWorld)) return std::nullopt;
+  info.kind = static_cast<ServiceKind>(kind);
+  info.draining = draining != 0;
+  info.address.assign(in);
+  return info;
+}
+
+ServiceRegistry::ServiceRegistry(const ServiceRegistryOptions& options) : options_(options) {
+  options_.vnodes = std::max<uint32_t>(options_.vnodes, 1);
+  options_.load_factor = std::max(options_.load_factor, 1.0);
+  registry_metrics();
+  nodes_gauge_ = metrics().add_callback_gauge(
+      "kbs_registry_nodes", "Live nodes known to the service registry", [this] {
+        std::lock_guard lock(mutex_);
+        return static_cast<double>(nodes_.size());
+      });
+}
+
+ServiceRegistry::~ServiceRegistry() { metrics().remove_callback_gauge(nodes_gauge_); }
+
+void ServiceRegistry::heartbeat(const NodeInfo& info, uint64_t now_ms) {
+  std::lock_guard lock(mutex_);
+  auto [it, added] = nodes_.try_emplace(info.node_id);
+  const ServiceKind old_kind = it->second.info.kind;
+  it->second.info = info;
+  it->second.info.last_seen_ms = now_ms;
+  // The report now includes whatever was routed to it since the last one.
+  it->second.routed = 0;
+  if (added) {
+    rebuild(info.kind);
+  } else if (old_kind != info.kind) {
+    rebuild(old_kind);
+    rebuild(info.kind);
+  }
+}
+
+bool ServiceRegistry::remove(uint64_t node_id) {
+  std::lock_guard lock(mutex_);
+  auto it = nodes_.find(node_id);
+  if (it == nodes_.end()) return false;
+  const ServiceKind kind = it->second.info.kind;
+  nodes_.erase(it);
+  rebuild(kind);
+  return true;
+}
+
+size_t ServiceRegistry::expire(uint64_t now_ms) {
+  std::lock_guard lock(mutex_);
+  size_t dropped = 0;
+  bool changed[2] = {false, false};
+  for (auto it = nodes_.begin(); it != nodes_.end();) {
+    if (now_ms - std::min(now_ms, it->second.info.last_seen_ms) > options_.heartbeat_timeout_ms) {
+      changed[static_cast<size_t>(it->second.info.kind)] = true;
+      it = nodes_.erase(it);
+      ++dropped;
+    } else {
+      ++it;
+    }
+  }
+  if (changed[0]) rebuild(ServiceKind::kGateway);
+  if (changed[1]) rebuild(ServiceKind::kWorld);
+  stats_.expired += dropped;
+  registry_metrics().expired.inc(dropped);
+  return dropped;
+}
+
+std::optional<NodeInfo> ServiceRegistry::route(ServiceKind kind, uint64_t key) {
+  KBS_TRACE_SCOPE("registry.route");
+  RegistryMetrics& m = registry_metrics();
+  std::lock_guard lock(mutex_);
+  const Ring& r = ring(kind);
+
+  // Average over the nodes that may take the key; with load below
+  // ceil(c * average) at least one of them always qualifies.
+  uint64_t total = 0;
+  size_t eligible_nodes = 0;
+  for (const auto& [id, n] : nodes_) {
+    if (n.info.kind != kind || !eligible(n)) continue;
+    total += uint64_t{n.info.load.ccu} + n.routed;
+    ++eligible_nodes;
+  }
+  if (eligible_nodes == 0 || r.points.empty()) {
+    ++stats_.unroutable;
+    m.none.inc();
+    return std::nullopt;
+  }
+  const auto bound = static_cast<uint64_t>(
+      std::ceil(options_.load_factor * static_cast<double>(total + 1) / eligible_nodes));
+
+  const uint64_t h = splitmix64(key);
+  auto start = std::lower_bound(r.points.begin(), r.points.end(),
+                                std::make_pair(h, uint64_t{0}));
+  if (start == r.points.end()) start = r.points.begin();
+  const uint64_t owner = start->second;
+  auto at = start;
+  for (size_t i = 0; i < r.points.size(); ++i) {
+    Node& n = nodes_.find(at->second)->second;
+    if (eligible(n) && uint64_t{n.info.load.ccu} + n.routed < bound) {
+      ++n.routed;
+      ++stats_.routed;
+      if (at->second != owner) {
+        ++stats_.overflowed;
+        m.overflow.inc();
+      } else {
+        m.owner.inc();
+      }
+      return n.info;
+    }
+    if (++at == r.points.end()) at = r.points.begin();
+  }
+  ++stats_.unroutable;
+  m.none.inc();
+  return std::nullopt;
+}
+
+std::optional<NodeInfo> ServiceRegistry::route(ServiceKind kind, std::string_view key) {
+  return route(kind, fnv1a64(key));
+}
+
+std::vector<NodeInfo> ServiceRegistry::nodes(ServiceKind kind) const {
+  std::lock_guard lock(mutex_);
+  std::vector<NodeInfo> out;
+  for (const auto& [id, n] : nodes_) {
+    if (n.info.kind == kind) out.push_back(n.info);
+  }
+  std::sort(out.begin(), out.end(),
+            [](const NodeInfo& a, const NodeInfo& b) { return a.node_id < b.node_id; });
+  return out;
+}
+
+ServiceRegistryStats ServiceRegistry::stats() const {
+  std::lock_guard lock(mutex_);
+  ServiceRegistryStats s = stats_;
+  s.nodes = nodes_.size();
+  return s;
+}
+
+void ServiceRegistry::bind(RpcChannel& channel) {
+  channel.register_method(kMethodHeartbeat, [this](std::string req) -> Task<RpcResult> {
+    std::optional<NodeInfo> info = NodeInfo::decode(req);
+    if (!info) co_return RpcResult::error("malformed heartbeat");
+    heartbeat(*info, Tracer::now_ns() / 1'000'000);
+    co_return RpcResult{};
+  });
+  channel.register_method(kMethodRoute, [this](std::string req) -> Task<RpcResult> {
+    std::string_view in = req;
+    uint8_t kind = 0;
+    uint64_t key = 0;
+    if (!take(in, kind) || !take(in, key) || kind > static_cast<uint8_t>(ServiceKind::kWorld)) {
+      co_return RpcResult::error("malformed route request");
+    }
+    std::optional<NodeInfo> node = route(static_cast<ServiceKind>(kind), key);
+    if (!node) co_return RpcResult::error("no node available");
+    co_return RpcResult{RpcStatus::kOk, node->encode()};
+  });
+}
+
+void ServiceRegistry::rebuild(ServiceKind kind) {
+  Ring& r = ring(kind);
+  r.points.clear();
+  for (const auto& [id, n] : nodes_) {
+    if (n.info.kind != kind) continue;
+    // Points depend on the id only, so membership changes move just the
+    // arcs of the node that came or went.
+    const uint64_t seed = splitmix64(id);
+    for (uint32_t v = 0; v < options_.vnodes; ++v) r.points.emplace_back(splitmix64(seed + v), id);
+  }
+  std::sort(r.points.begin(), r.points.end());
+}
+
+bool ServiceRegistry::eligible(const Node& n) const {
+  const NodeLoad& load = n.info.load;
+  if (n.info.draining) return false;
+  if (load.capacity != 0 && uint64_t{load.ccu} + n.routed >= load.capacity) return false;
+  return options_.tick_budget_ms <= 0.0f || n.info.kind != ServiceKind::kWorld ||
+         load.tick_ms <= options_.tick_budget_ms;
+}
+
+}  // namespace kbs
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "metrics/metrics.h"
+
+namespace kbs {
+
+class RpcChannel;
+
+enum class ServiceKind : uint8_t { kGateway, kWorld };
+
+// What a process reports about itself on every heartbeat.
+struct NodeLoad {
+  uint32_t ccu = 0;       // sessions (gateway) or entities (world) it owns
+  uint32_t capacity = 0;  // ccu at which it stops taking more; 0: unlimited
+  float tick_ms = 0.0f;   // recent average tick time (world)
+};
+
+struct NodeInfo {
+  uint64_t node_id = 0;  // stable across restarts of the same process slot
+  ServiceKind kind = ServiceKind::kGateway;
+  std::string address;   // host:port clients or servers connect to
+  NodeLoad load;
+  bool draining = false;  // finishing its sessions; routes nothing new
+  uint64_t last_seen_ms = 0;
+
+  // Heartbeat payload: u64 id, u8 kind, u8 draining, u32 ccu, u32
+  // capacity, f32 tick_ms, u16 address length, address.
+  std::string encode() const;
+  static std::optional<NodeInfo> decode(std::string_view in);
+};
+
+struct ServiceRegistryOptions {
+  // A node silent this long is dropped from routing.
+  uint64_t heartbeat_timeout_ms = 3000;
+  // Ring points per node.  More spreads keys more evenly (about 1/sqrt(n)
+  // relative deviation) at the cost of a larger ring to rebuild on joins.
+  uint32_t vnodes = 128;
+  // Bounded-load factor c: no node takes a new key while its load is above
+  // c times the average, so the hottest node stays within c of the mean.
+  double load_factor = 1.25;
+  // World nodes whose tick_ms exceeds this take no new entities; 0 off.
+  float tick_budget_ms = 0.0f;
+};
+
+struct ServiceRegistryStats {
+  uint64_t nodes = 0;
+  uint64_t routed = 0;      // keys that landed on a node
+  uint64_t overflowed = 0;  // of those, moved past their ring owner by load
+  uint64_t unroutable = 0;  // no eligible node at all
+  uint64_t expired = 0;     // nodes dropped for missing heartbeats
+};
+
+// Live gateway and world processes, kept by the login/manager process
+// from their heartbeats, and the router that places new sessions and new
+// entities on them.
+//
+// Placement is consistent hashing with bounded loads.  Each node owns
+// vnodes points on a per-kind hash ring, derived from its node_id alone,
+// so a node restarting under the same id gets its old points back and a
+// join or leave moves only about 1/n of the keys -- the ones that hashed to
+// that node -- instead of reshuffling everyone as modulo assignment does.
+// A key goes to the first node clockwise of its hash that is healthy, not
+// draining, under its own capacity and tick budget, and whose load is at
+// most ceil(c * average); a hot node's keys spill to its ring successors
+// rather than piling onto it, so one overloaded process cannot be handed
+// more work while others idle.
+//
+// Load is the last reported ccu plus the keys routed to the node since
+// that report, so a burst of logins between heartbeats still spreads
+// instead of going to whichever node looked emptiest a second ago.
+//
+//   registry.heartbeat(info, now_ms);               // from each process
+//   registry.expire(now_ms);                        // on a timer
+//   auto gw = registry.route(ServiceKind::kGateway, account_id);
+//
+// Thread-safe; a mutex covers everything and routing is a binary search
+// plus a short walk.
+class ServiceRegistry {
+ public:
+  // RPC methods served by bind().
+  static constexpr uint16_t kMethodHeartbeat = 0x0400;  // NodeInfo -> empty
+  static constexpr uint16_t kMethodRoute = 0x0401;      // u8 kind, u64 key -> NodeInfo
+
+  explicit ServiceRegistry(const ServiceRegistryOptions& options = {});
+  ~ServiceRegistry();
+
+  ServiceRegistry(const ServiceRegistry&) = delete;
+  ServiceRegistry& operator=(const ServiceRegistry&) = delete;
+
+  // Adds or refreshes info.node_id.  A node changing kind or id is a
+  // leave plus a join.
+  void heartbeat(const NodeInfo& info, uint64_t now_ms);
+  // Graceful shutdown: the node leaves the ring now rather than on expiry.
+  bool remove(uint64_t node_id);
+  // Drops nodes not heard from within heartbeat_timeout_ms; returns how
+  // many.
+  size_t expire(uint64_t now_ms);
+
+  // Node for a new session or entity keyed by key (account or entity id),
+  // or nullopt when every node of kind is down, draining or full.  Counts
+  // one unit of load against the node until its next heartbeat.
+  std::optional<NodeInfo> route(ServiceKind kind, uint64_t key);
+  std::optional<NodeInfo> route(ServiceKind kind, std::string_view key);
+
+  std::vector<NodeInfo> nodes(ServiceKind kind) const;
+  ServiceRegistryStats stats() const;
+
+  // Serves kMethodHeartbeat and kMethodRoute on channel, timestamping
+  // heartbeats with the monotonic clock.  The registry must outlive it.
+  void bind(RpcChannel& channel);
+
+ private:
+  struct Node {
+    NodeInfo info;
+    uint32_t routed = 0;  // since the last heartbeat
+  };
+  struct Ring {
+    std::vector<std::pair<uint64_t, uint64_t>> points;  // (hash, node_id), sorted
+  };
+
+  Ring& ring(ServiceKind kind) { return rings_[static_cast<size_t>(kind)]; }
+  void rebuild(ServiceKind kind);
+  bool eligible(const Node& n) const;
+
+  ServiceRegistryOptions options_;
+  mutable std::mutex mutex_;
+  std::unordered_map<uint64_t, Node> nodes_;
+  Ring rings_[2];
+  ServiceRegistryStats stats_;
+  CallbackGaugeId nodes_gauge_ = 0;  // kbs_registry_nodes
+};
+
+}  // namespace kbs
@@ -0,0 +1,354 @@
+#include "cluster/topic_bus.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "metrics/metrics.h"
+#include "metrics/trace.h"
+#include "rpc/rpc_channel.h"
+
+namespace kbs {
+
+namespace {
+
+template <typename T>
+void put(std::string& out, T v) {
+  out.append(reinterpret_cast<const char*>(&v), sizeof(T));
+}
+
+template <typename T>
+bool take(std::string_view& in, T& v) {
+  if (in.size() < sizeof(T)) return false;
+  std::memcpy(&v, in.data(), sizeof(T));
+  in.remove_prefix(sizeof(T));
+  return true;
+}
+
+// Per forwarded message: u64 topic, u16 msg_id, u32 length.
+constexpr size_t kRecordHeader = sizeof(TopicId) + sizeof(uint16_t) + sizeof(uint32_t);
+
+// The peer message to append a record of `size` bytes to, starting a new
+// one when the last would grow past RpcChannel::kMaxPayload.
+std::string& chunk_for(std::vector<std::string>& chunks, size_t size) {
+  if (chunks.empty() || chunks.back().size() + size > RpcChannel::kMaxPayload) {
+    chunks.emplace_back();
+  }
+  return chunks.back();
+}
+
+struct BusMetrics {
+  Counter& published = metrics().counter("kbs_pubsub_messages_total", "Messages offered to the bus",
+                                         {{"result", "published"}});
+  Counter& rate_limited = metrics().counter(
+      "kbs_pubsub_messages_total", "Messages offered to the bus", {{"result", "rate_limited"}});
+  Counter& dropped = metrics().counter("kbs_pubsub_messages_total", "Messages offered to the bus",
+                                       {{"result", "dropped"}});
+  Counter& coalesced = metrics().counter("kbs_pubsub_messages_total",
+                                         "Messages offered to the bus", {{"result", "coalesced"}});
+  Counter& buffers =
+      metrics().counter("kbs_pubsub_buffers_total", "Fan-out buffers encoded by the bus");
+  Counter& deliveries = metrics().counter(
+      "kbs_pubsub_deliveries_total", "Fan-out buffers queued to sessions (buffer x recipient)");
+};
+
+BusMetrics& bus_metrics() {
+  static BusMetrics m;
+  return m;
+}
+
+}  // namespace
+
+TopicBus::TopicBus(Sink sink, const TopicBusOptions& options)
+    : sink_(std::move(sink)), options_(options) {
+  bus_metrics();
+}
+
+void TopicBus::subscribe(uint64_t session, TopicId topic) {
+  std::lock_guard lock(mutex_);
+  std::vector<uint64_t>& subs = topics_[topic];
+  auto it = std::lower_bound(subs.begin(), subs.end(), session);
+  if (it != subs.end() && *it == session) return;
+  subs.insert(it, session);
+  sessions_[session].push_back(topic);
+  if (subs.size() == 1) announce(topic, true);
+}
+
+void TopicBus::unsubscribe(uint64_t session, TopicId topic) {
+  std::lock_guard lock(mutex_);
+  auto t = topics_.find(topic);
+  if (t == topics_.end()) return;
+  std::vector<uint64_t>& subs = t->second;
+  auto it = std::lower_bound(subs.begin(), subs.end(), session);
+  if (it == subs.end() || *it != session) return;
+  subs.erase(it);
+  if (subs.empty()) {
+    topics_.erase(t);
+    announce(topic, false);
+  }
+  auto s = sessions_.find(session);
+  if (s != sessions_.end()) {
+    std::erase(s->second, topic);
+    if (s->second.empty()) sessions_.erase(s);
+  }
+}
+
+void TopicBus::unsubscribe_all(uint64_t session) {
+  std::lock_guard lock(mutex_);
+  buckets_.erase(session);
+  auto s = sessions_.find(session);
+  if (s == sessions_.end()) return;
+  for (TopicId topic : s->second) {
+    auto t = topics_.find(topic);
+    if (t == topics_.end()) continue;
+    std::vector<uint64_t>& subs = t->second;
+    auto it = std::lower_bound(subs.begin(), subs.end(), session);
+    if (it != subs.end() && *it == session) subs.erase(it);
+    if (subs.empty()) {
+      topics_.erase(t);
+      announce(topic, false);
+    }
+  }
+  sessions_.erase(s);
+}
+
+TopicBus::PublishResult TopicBus::publish(TopicId topic, uint16_t msg_id,
+                                          std::string_view payload, uint64_t sender,
+                                          uint64_t coalesce_key) {
+  std::lock_guard lock(mutex_);
+  // Before admit(), so a message that could never be sent costs no token.
+  if (payload.size() > options_.max_payload) {
+    ++stats_.dropped;
+    bus_metrics().dropped.inc();
+    return PublishResult::kDropped;
+  }
+  if (!admit(sender, topic_kind(topic))) {
+    ++stats_.rate_limited;
+    bus_metrics().rate_limited.inc();
+    return PublishResult::kRateLimited;
+  }
+  return enqueue(topic, msg_id, payload, coalesce_key, false);
+}
+
+bool TopicBus::admit(uint64_t sender, TopicKind kind) {
+  const TopicRateLimit& limit = options_.limits[static_cast<size_t>(kind)];
+  if (sender == 0 || limit.per_sec <= 0) return true;
+  const double burst = std::max(limit.burst, 1.0);
+  Bucket& b = buckets_[sender][static_cast<size_t>(kind)];
+  const uint64_t now = Tracer::now_ns();
+  b.tokens = b.tokens < 0 ? burst
+                          : std::min(burst, b.tokens + static_cast<double>(now - b.last_ns) *
+                                                           1e-9 * limit.per_sec);
+  b.last_ns = now;
+  if (b.tokens < 1) return false;
+  b.tokens -= 1;
+  return true;
+}
+
+TopicBus::PublishResult TopicBus::enqueue(TopicId topic, uint16_t msg_id,
+                                          std::string_view payload, uint64_t coalesce_key,
+                                          bool remote) {
+  BusMetrics& m = bus_metrics();
+  if (payload.size() > options_.max_payload) {
+    ++stats_.dropped;
+    m.dropped.inc();
+    return PublishResult::kDropped;
+  }
+  const auto accepted = [&] {
+    ++stats_.published;
+    m.published.inc();
+    return PublishResult::kOk;
+  };
+  // Nobody to deliver to: accepted, and nothing to encode.
+  const bool local = topics_.count(topic) != 0;
+  const bool forward = !remote && std::any_of(peers_.begin(), peers_.end(), [&](const auto& kv) {
+    return kv.second.interest.count(topic) != 0;
+  });
+  if (!local && !forward) return accepted();
+
+  Pending& p = pending_[topic];
+  if (coalesce_key != 0) {
+    auto it = p.by_key.find(coalesce_key);
+    if (it != p.by_key.end()) {
+      Message& old = p.messages[it->second];
+      old.msg_id = msg_id;
+      old.remote = remote;
+      old.payload.assign(payload);
+      ++stats_.coalesced;
+      m.coalesced.inc();
+      return accepted();
+    }
+  }
+  if (p.messages.size() >= options_.max_pending_per_topic) {
+    ++stats_.dropped;
+    m.dropped.inc();
+    return PublishResult::kDropped;
+  }
+  if (coalesce_key != 0) p.by_key.emplace(coalesce_key, p.messages.size());
+  p.messages.push_back(Message{msg_id, remote, std::string(payload)});
+  return accepted();
+}
+
+size_t TopicBus::flush() {
+  KBS_TRACE_SCOPE("pubsub.flush");
+  struct Batch {
+    TopicId topic;
+    std::vector<Message> messages;
+    std::vector<uint64_t> subscribers;
+  };
+  std::vector<Batch> batches;
+  std::vector<std::pair<PeerSend, std::vector<std::string>>> forwards;
+  {
+    std::lock_guard lock(mutex_);
+    if (pending_.empty()) return 0;
+    batches.reserve(pending_.size());
+    std::unordered_map<PeerId, size_t> forward_index;
+    for (auto& [topic, p] : pending_) {
+      auto t = topics_.find(topic);
+      Batch& b = batches.emplace_back(Batch{topic, std::move(p.messages), {}});
+      if (t != topics_.end()) b.subscribers = t->second;
+      for (auto& [id, peer] : peers_) {
+        if (!peer.interest.count(topic)) continue;
+        auto [fi, added] = forward_index.try_emplace(id, forwards.size());
+        if (added) forwards.emplace_back(peer.send, std::vector<std::string>());
+        std::vector<std::string>& chunks = forwards[fi->second].second;
+        for (const Message& msg : b.messages) {
+          if (msg.remote) continue;
+          const size_t size = kRecordHeader + msg.payload.size();
+          if (size > RpcChannel::kMaxPayload) {
+            ++stats_.dropped;
+            bus_metrics().dropped.inc();
+            continue;
+          }
+          std::string& out = chunk_for(chunks, size);
+          put<uint64_t>(out, topic);
+          put<uint16_t>(out, msg.msg_id);
+          put<uint32_t>(out, static_cast<uint32_t>(msg.payload.size()));
+          out += msg.payload;
+          ++stats_.remote_out;
+        }
+      }
+    }
+    pending_.clear();
+  }
+
+  BusMetrics& m = bus_metrics();
+  size_t flushed = 0;
+  uint64_t buffers = 0;
+  uint64_t deliveries = 0;
+  for (const Batch& b : batches) {
+    flushed += b.messages.size();
+    if (b.subscribers.empty()) continue;
+    MessageBuffer buf;
+    for (const Message& msg : b.messages) {
+      const size_t token = buf.begin_frame(msg.msg_id);
+      buf.append_pod(b.topic);
+      buf.append(msg.payload);
+      buf.end_frame(token);
+    }
+    sink_(b.subscribers, buf);
+    ++buffers;
+    deliveries += b.subscribers.size();
+  }
+  for (auto& [send, chunks] : forwards) {
+    for (std::string& payload : chunks) send(kMethodPublish, std::move(payload));
+  }
+  m.buffers.inc(buffers);
+  m.deliveries.inc(deliveries);
+  std::lock_guard lock(mutex_);
+  stats_.buffers += buffers;
+  stats_.deliveries += deliveries;
+  return flushed;
+}
+
+void TopicBus::announce(TopicId topic, bool add) {
+  if (peers_.empty()) return;
+  std::string payload;
+  put<uint8_t>(payload, add ? 1 : 0);
+  put<uint64_t>(payload, topic);
+  for (auto& [id, peer] : peers_) peer.send(kMethodInterest, payload);
+}
+
+TopicBus::PeerId TopicBus::add_peer(PeerSend send) {
+  std::lock_guard lock(mutex_);
+  const PeerId id = next_peer_++;
+  Peer& peer = peers_[id];
+  peer.send = std::move(send);
+  if (!topics_.empty()) {
+    std::vector<std::string> chunks;
+    for (const auto& [topic, subs] : topics_) {
+      std::string& payload = chunk_for(chunks, sizeof(TopicId));
+      if (payload.empty()) put<uint8_t>(payload, 1);
+      put<uint64_t>(payload, topic);
+    }
+    for (std::string& payload : chunks) peer.send(kMethodInterest, std::move(payload));
+  }
+  return id;
+}
+
+void TopicBus::remove_peer(PeerId peer) {
+  std::lock_guard lock(mutex_);
+  peers_.erase(peer);
+}
+
+bool TopicBus::on_peer_message(PeerId peer, uint16_t method, std::string_view payload) {
+  std::lock_guard lock(mutex_);
+  auto p = peers_.find(peer);
+  if (p == peers_.end()) return false;
+  if (method == kMethodInterest) {
+    uint8_t add = 0;
+    if (!take(payload, add) || payload.size() % sizeof(TopicId) != 0) return false;
+    TopicId topic;
+    while (take(payload, topic)) {
+      if (add) {
+        p->second.interest.insert(topic);
+      } else {
+        p->second.interest.erase(topic);
+      }
+    }
+    return true;
+  }
+  if (method != kMethodPublish) return false;
+  while (!payload.empty()) {
+    TopicId topic = 0;
+    uint16_t msg_id = 0;
+    uint32_t len = 0;
+    if (!take(payload, topic) || !take(payload, msg_id) || !take(payload, len) ||
+        payload.size() < len) {
+      return false;
+    }
+    enqueue(topic, msg_id, payload.substr(0, len), 0, true);
+    payload.remove_prefix(len);
+    ++stats_.remote_in;
+  }
+  return true;
+}
+
+TopicBus::PeerId TopicBus::bind(const std::shared_ptr<RpcChannel>& channel) {
+  EventLoop& loop = channel->connection()->loop();
+  const PeerId id = add_peer([weak = std::weak_ptr<RpcChannel>(channel), &loop](
+                                 uint16_t method, std::string payload) {
+    loop.post([weak, method, payload = std::move(payload)] {
+      if (auto c = weak.lock()) c->notify(method, payload);
+    });
+  });
+  for (uint16_t method : {kMethodInterest, kMethodPublish}) {
+    channel->register_method(method, [this, id, method](std::string req) -> Task<RpcResult> {
+      if (!on_peer_message(id, method, req)) co_return RpcResult::error("malformed bus message");
+      co_return RpcResult{};
+    });
+  }
+  return id;
+}
+
+size_t TopicBus::subscribers(TopicId topic) const {
+  std::lock_guard lock(mutex_);
+  auto t = topics_.find(topic);
+  return t == topics_.end() ? 0 : t->second.size();
+}
+
+TopicBusStats TopicBus::stats() const {
+  std::lock_guard lock(mutex_);
+  return stats_;
+}
+
+}  // namespace kbs
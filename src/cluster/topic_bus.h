@@ -0,0 +1,189 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "net/message_buffer.h"
+
+namespace kbs {
+
+class RpcChannel;
+
+// Topic ids carry their channel kind in the top byte, so rate limits can
+// differ per kind without a lookup: make_topic(TopicKind::kGuild, guild_id).
+enum class TopicKind : uint8_t { kWorld, kZone, kGuild, kParty, kCustom };
+constexpr size_t kTopicKinds = 5;
+
+using TopicId = uint64_t;
+
+constexpr TopicId make_topic(TopicKind kind, uint64_t id) {
+  return (static_cast<uint64_t>(kind) << 56) | (id & ((uint64_t{1} << 56) - 1));
+}
+constexpr TopicKind topic_kind(TopicId topic) {
+  const auto k = static_cast<uint8_t>(topic >> 56);
+  return k < kTopicKinds ? static_cast<TopicKind>(k) : TopicKind::kCustom;
+}
+
+// Token bucket per sender and topic kind; per_sec == 0 disables it.
+struct TopicRateLimit {
+  double per_sec = 0;
+  double burst = 0;
+};
+
+struct TopicBusOptions {
+  // Indexed by TopicKind: world chat is the one players spam during events.
+  std::array<TopicRateLimit, kTopicKinds> limits = {{
+      {0.5, 3},  // kWorld
+      {2, 5},    // kZone
+      {2, 5},    // kGuild
+      {5, 10},   // kParty
+      {0, 0},    // kCustom
+  }};
+  // Messages held per topic between flushes; beyond this the newest are
+  // dropped, so a flood costs one bounded buffer instead of a backlog.
+  size_t max_pending_per_topic = 256;
+  size_t max_payload = 4096;
+};
+
+struct TopicBusStats {
+  uint64_t published = 0;     // accepted
+  uint64_t rate_limited = 0;  // rejected by a sender's bucket
+  // Over max_pending_per_topic or max_payload, or (forwarding only) too
+  // large for one peer message.
+  uint64_t dropped = 0;
+  uint64_t coalesced = 0;     // replaced by a newer message with the same key
+  uint64_t buffers = 0;       // encoded fan-out buffers
+  uint64_t deliveries = 0;    // buffer x recipient
+  uint64_t remote_in = 0;     // messages received from peers
+  uint64_t remote_out = 0;    // messages forwarded to peers
+};
+
+// Publish/subscribe for chat and game events on world, zone, guild and
+// party channels, in-process and across processes.
+//
+// Sessions subscribe to topic ids; publish() only queues.  flush() -- once
+// per tick or on a short timer -- turns each topic's queued messages into
+// ONE MessageBuffer (one frame per message: u64 topic, then the payload)
+// and hands it with the topic's subscriber list to the sink, normally
+// TcpServer::broadcast(), which queues a reference to those same chunks on
+// every recipient.  A world-chat line is therefore encoded once no matter
+// how many thousand players read it, and a burst of lines costs one
+// buffer and one send per recipient per flush instead of one per line.
+//
+// Spam is cut before fan-out.  Each sending session has a token bucket per
+// topic kind (TopicBusOptions::limits); sender 0 is the server itself and
+// is never limited.  A message published with a coalesce key replaces an
+// earlier queued message with the same topic and key, so progress updates
+// for an event ("boss at 40%") collapse to the latest per flush.
+//
+// Across processes, buses link through peers (bind() does it over an
+// RpcChannel).  Each bus tells its peers which topics it has subscribers
+// for and sends them, once per flush, only messages for those topics that
+// were published locally.  Messages from a peer reach local subscribers
+// but are not forwarded again, so links are expected to be a full mesh or
+// a star around one bus.
+//
+// Thread-safe: publish and subscribe from loop or tick threads, flush from
+// one thread.  The sink runs on the flushing thread without the lock held.
+// Peer senders may run under it (so interest changes reach a peer in
+// order) and must only queue, as bind()'s post to the channel's loop does.
+class TopicBus {
+ public:
+  using Sink = std::function<void(std::span<const uint64_t> sessions, const MessageBuffer&)>;
+  using PeerId = uint32_t;
+  using PeerSend = std::function<void(uint16_t method, std::string payload)>;
+
+  // Methods exchanged between peers.  A flush forwards each peer's share in
+  // as many messages as it takes to keep each under RpcChannel::kMaxPayload.
+  static constexpr uint16_t kMethodInterest = 0x0410;  // u8 add, u64 topics...
+  static constexpr uint16_t kMethodPublish = 0x0411;   // (u64 topic, u16 id, u32 len, bytes)...
+
+  enum class PublishResult : uint8_t { kOk, kRateLimited, kDropped };
+
+  explicit TopicBus(Sink sink, const TopicBusOptions& options = {});
+
+  TopicBus(const TopicBus&) = delete;
+  TopicBus& operator=(const TopicBus&) = delete;
+
+  // Idempotent.  The first local subscriber of a topic registers interest
+  // with every peer, the last one withdraws it.
+  void subscribe(uint64_t session, TopicId topic);
+  void unsubscribe(uint64_t session, TopicId topic);
+  // On disconnect: every subscription and the session's rate buckets.
+  void unsubscribe_all(uint64_t session);
+
+  // Queues one message (frame msg_id) for topic's subscribers.  sender is
+  // the publishing session for rate limiting, 0 for the server; a non-zero
+  // coalesce_key replaces a queued message with the same topic and key.
+  PublishResult publish(TopicId topic, uint16_t msg_id, std::string_view payload,
+                        uint64_t sender = 0, uint64_t coalesce_key = 0);
+
+  // Encodes and fans out everything queued since the last flush.  Returns
+  // the number of messages flushed.
+  size_t flush();
+
+  // Cross-process links.  add_peer() sends our interest through send;
+  // feed what the peer sends back into on_peer_message().
+  PeerId add_peer(PeerSend send);
+  void remove_peer(PeerId peer);
+  // false on a malformed payload.
+  bool on_peer_message(PeerId peer, uint16_t method, std::string_view payload);
+  // Links to the bus on the other end of channel: serves both methods and
+  // posts outgoing ones to the channel's loop.  Call on that loop right
+  // after creating the channel, on both ends, so neither side's first
+  // message finds no handler; pass the returned id to remove_peer() when
+  // the channel closes.
+  PeerId bind(const std::shared_ptr<RpcChannel>& channel);
+
+  size_t subscribers(TopicId topic) const;
+  TopicBusStats stats() const;
+
+ private:
+  struct Message {
+    uint16_t msg_id;
+    bool remote;  // from a peer: deliver locally, do not forward
+    std::string payload;
+  };
+  struct Pending {
+    std::vector<Message> messages;
+    std::unordered_map<uint64_t, size_t> by_key;  // coalesce key -> index
+  };
+  struct Bucket {
+    double tokens = -1;  // < 0: not yet used, starts full
+    uint64_t last_ns = 0;
+  };
+  struct Peer {
+    PeerSend send;
+    std::unordered_set<TopicId> interest;
+  };
+
+  bool admit(uint64_t sender, TopicKind kind);
+  PublishResult enqueue(TopicId topic, uint16_t msg_id, std::string_view payload,
+                        uint64_t coalesce_key, bool remote);
+  void announce(TopicId topic, bool add);
+
+  Sink sink_;
+  TopicBusOptions options_;
+
+  mutable std::mutex mutex_;
+  std::unordered_map<TopicId, std::vector<uint64_t>> topics_;  // subscribers, sorted
+  std::unordered_map<uint64_t, std::vector<TopicId>> sessions_;
+  std::unordered_map<uint64_t, std::array<Bucket, kTopicKinds>> buckets_;
+  std::unordered_map<TopicId, Pending> pending_;
+  std::unordered_map<PeerId, Peer> peers_;
+  PeerId next_peer_ = 1;
+  TopicBusStats stats_;
+};
+
+}  // namespace kbs
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+namespace kbs {
+
+// Replaces path with bytes so that a crash leaves either the old file or
+// the new one, never a torn mix: writes path + ".tmp", fsync()s it,
+// rename()s it over path, then fsync()s the directory so the rename
+// itself survives a power loss.  Readers that still have the old file
+// open or mapped keep its inode until they let go.
+//
+// Throws std::system_error; on failure before the rename the temporary
+// file is removed and path is untouched.
+void write_file_atomic(const std::string& path, std::string_view bytes);
+
+}  // namespace kbs
@@ -0,0 +1,186 @@
+#pragma once
+
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace kbs {
+
+// Typed generational handle: the low IndexBits of a 32- or 64-bit word are
+// a slot index, the rest the slot's generation when the handle was issued.
+// Generations start at 1, so a zero handle is never valid.  Tag keeps
+// handles of different pools from converting into each other.
+template <typename Tag, typename Rep = uint64_t, int IndexBits = 32>
+class Handle {
+  static_assert(std::is_same_v<Rep, uint32_t> || std::is_same_v<Rep, uint64_t>);
+  static_assert(IndexBits > 0 && IndexBits <= 32 && IndexBits < int(sizeof(Rep) * 8));
+
+ public:
+  using rep_type = Rep;
+  static constexpr int kIndexBits = IndexBits;
+  static constexpr Rep kIndexMask = (Rep{1} << IndexBits) - 1;
+  static constexpr Rep kMaxGeneration = static_cast<Rep>(~Rep{0}) >> IndexBits;
+
+  constexpr Handle() = default;
+  static constexpr Handle make(uint32_t index, Rep generation) {
+    return Handle((generation << IndexBits) | (Rep{index} & kIndexMask));
+  }
+  // For handles that crossed a wire or were packed into a wider id.
+  static constexpr Handle from_bits(Rep bits) { return Handle(bits); }
+
+  constexpr Rep bits() const { return bits_; }
+  constexpr uint32_t index() const { return static_cast<uint32_t>(bits_ & kIndexMask); }
+  constexpr Rep generation() const { return bits_ >> IndexBits; }
+  constexpr explicit operator bool() const { return bits_ != 0; }
+
+  friend constexpr bool operator==(Handle, Handle) = default;
+  friend constexpr auto operator<=>(Handle, Handle) = default;
+
+ private:
+  constexpr explicit Handle(Rep bits) : bits_(bits) {}
+
+  Rep bits_ = 0;
+};
+
+// Typed object pool addressed by generational handles, for long-lived
+// objects that other code refers to: sessions, timers, entities.
+//
+// Holders keep a Handle instead of a raw pointer or a shared_ptr, and
+// resolve it with get() when they need the object.  A handle to a
+// destroyed object resolves to nullptr rather than to freed memory or to
+// whatever reused the slot, and resolving costs one index plus a compare
+// against the generation stored beside the object -- no refcount traffic
+// on shared cache lines.  Slots live in fixed pages that never move, so a
+// T* from get() stays valid until that object is erased, and emplace() /
+// erase() are O(1) through an intrusive free list.
+//
+// A slot whose generation is exhausted is retired instead of reused, so a
+// stale handle can never alias a newer object; with 32-bit handles that
+// costs one slot per 2^(32 - IndexBits) reuses of it.  Not thread-safe:
+// like everything else on a loop, a pool belongs to one thread.
+template <typename T, typename H = Handle<T>, size_t PageSize = 256>
+class HandlePool {
+  static_assert(PageSize > 0 && (PageSize & (PageSize - 1)) == 0);
+
+ public:
+  using handle_type = H;
+
+  HandlePool() = default;
+  ~HandlePool() { clear(); }
+
+  HandlePool(const HandlePool&) = delete;
+  HandlePool& operator=(const HandlePool&) = delete;
+
+  // Constructs a T and returns its handle; an invalid handle once every
+  // index H can express is taken.
+  template <typename... Args>
+  H emplace(Args&&... args) {
+    uint32_t index;
+    if (free_head_ != kNoSlot) {
+      index = free_head_;
+    } else {
+      if (next_index_ > H::kIndexMask || next_index_ >= kLive) return H();
+      index = static_cast<uint32_t>(next_index_);
+      if (index / PageSize == pages_.size()) pages_.push_back(std::make_unique<Slot[]>(PageSize));
+    }
+    Slot& s = slot(index);
+    // Book-keeping only after T's constructor, so a throw leaves the
+    // slot free.
+    ::new (static_cast<void*>(s.storage)) T(std::forward<Args>(args)...);
+    if (index == free_head_) {
+      free_head_ = s.next_free;
+    } else {
+      ++next_index_;
+    }
+    s.next_free = kLive;
+    ++size_;
+    return H::make(index, s.generation);
+  }
+
+  T* get(H h) {
+    if (h.index() >= next_index_) return nullptr;
+    Slot& s = slot(h.index());
+    // The live check keeps a forged handle (one from the wire) carrying a
+    // free slot's next generation from reaching unconstructed storage.
+    return s.generation == h.generation() && s.next_free == kLive ? s.object() : nullptr;
+  }
+  const T* get(H h) const { return const_cast<HandlePool*>(this)->get(h); }
+  bool contains(H h) const { return get(h) != nullptr; }
+
+  // Destroys the object; false when h is stale.
+  bool erase(H h) {
+    if (!get(h)) return false;
+    release(h.index());
+    return true;
+  }
+
+  // Destroys every object; all outstanding handles go stale.
+  void clear() {
+    for (uint32_t i = 0; i < next_index_ && size_ > 0; ++i) {
+      if (slot(i).next_free == kLive) release(i);
+    }
+  }
+
+  // fn(H, T&) for every live object, in slot order.  fn must not emplace
+  // or erase.
+  template <typename F>
+  void for_each(F&& fn) {
+    for (uint32_t i = 0; i < next_index_; ++i) {
+      Slot& s = slot(i);
+      if (s.next_free == kLive) fn(H::make(i, s.generation), *s.object());
+    }
+  }
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  // Slots ever allocated, live or not.
+  size_t capacity() const { return static_cast<size_t>(next_index_); }
+  // Slots retired after exhausting their generations.
+  size_t retired() const { return retired_; }
+
+ private:
+  using Rep = typename H::rep_type;
+  static constexpr uint32_t kNoSlot = UINT32_MAX;
+  static constexpr uint32_t kLive = UINT32_MAX - 1;
+
+  struct Slot {
+    // Of the current object, or of the next one while free; one past
+    // kMaxGeneration when retired, which no handle carries.
+    Rep generation = 1;
+    uint32_t next_free = kNoSlot;
+    alignas(T) unsigned char storage[sizeof(T)];
+
+    T* object() { return std::launder(reinterpret_cast<T*>(storage)); }
+  };
+
+  Slot& slot(uint32_t index) { return pages_[index / PageSize][index % PageSize]; }
+
+  void release(uint32_t index) {
+    Slot& s = slot(index);
+    s.object()->~T();
+    --size_;
+    if (s.generation == H::kMaxGeneration) {
+      // Cannot wrap to 1 without reissuing old handles.
+      s.generation = H::kMaxGeneration + 1;
+      s.next_free = kNoSlot;
+      ++retired_;
+      return;
+    }
+    ++s.generation;
+    s.next_free = free_head_;
+    free_head_ = index;
+  }
+
+  std::vector<std::unique_ptr<Slot[]>> pages_;
+  uint64_t next_index_ = 0;
+  uint32_t free_head_ = kNoSlot;
+  size_t size_ = 0;
+  size_t retired_ = 0;
+};
+
+}  // namespace kbs
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace kbs {
+
+template <typename Signature, size_t Capacity = 48>
+class InplaceFunction;
+
+// Move-only type-erased callable stored inline in Capacity bytes.  Unlike
+// std::function it never allocates: a callable that does not fit is a
+// compile error, which keeps pooled objects (timers, jobs) allocation-free.
+template <typename R, typename... Args, size_t Capacity>
+class InplaceFunction<R(Args...), Capacity> {
+ public:
+  InplaceFunction() = default;
+  InplaceFunction(std::nullptr_t) {}
+
+  template <typename F>
+    requires(!std::is_same_v<std::decay_t<F>, InplaceFunction> &&
+             std::is_invocable_r_v<R, std::decay_t<F>&, Args...>)
+  InplaceFunction(F&& f) {
+    using Fn = std::decay_t<F>;
+    static_assert(sizeof(Fn) <= Capacity, "callable too large for InplaceFunction");
+    static_assert(alignof(Fn) <= alignof(std::max_align_t), "callable over-aligned");
+    static_assert(std::is_nothrow_move_constructible_v<Fn>);
+    new (storage_) Fn(std::forward<F>(f));
+    invoke_ = [](void* p, Args&&... args) -> R {
+      return (*static_cast<Fn*>(p))(std::forward<Args>(args)...);
+    };
+    manage_ = [](void* dst, void* src) {
+      if (dst) new (dst) Fn(std::move(*static_cast<Fn*>(src)));
+      static_cast<Fn*>(src)->~Fn();
+    };
+  }
+
+  InplaceFunction(InplaceFunction&& o) noexcept { take(o); }
+  InplaceFunction& operator=(InplaceFunction&& o) noexcept {
+    if (this != &o) {
+      reset();
+      take(o);
+    }
+    return *this;
+  }
+  InplaceFunction& operator=(std::nullptr_t) {
+    reset();
+    return *this;
+  }
+  InplaceFunction(const InplaceFunction&) = delete;
+  InplaceFunction& operator=(const InplaceFunction&) = delete;
+  ~InplaceFunction() { reset(); }
+
+  R operator()(Args... args) { return invoke_(storage_, std::forward<Args>(args)...); }
+  explicit operator bool() const { return invoke_ != nullptr; }
+
+  void reset() {
+    if (manage_) manage_(nullptr, storage_);
+    invoke_ = nullptr;
+    manage_ = nullptr;
+  }
+
+ private:
+  void take(InplaceFunction& o) {
+    if (!o.manage_) return;
+    o.manage_(storage_, o.storage_);
+    invoke_ = std::exchange(o.invoke_, nullptr);
+    manage_ = std::exchange(o.manage_, nullptr);
+  }
+
+  alignas(std::max_align_t) std::byte storage_[Capacity];
+  R (*invoke_)(void*, Args&&...) = nullptr;
+  void (*manage_)(void* dst, void* src) = nullptr;  // move into dst (if any), destroy src
+};
+
+}  // namespace kbs
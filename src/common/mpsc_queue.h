@@ -0,0 +1,112 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace kbs {
+
+constexpr size_t kCacheLine = 64;
+
+// Bounded lock-free multi-producer / single-consumer queue (Vyukov's
+// sequence-numbered ring).  Producers claim a slot with one CAS on the
+// shared tail; the consumer needs no atomic RMW at all.  Capacity is rounded
+// up to a power of two.
+template <typename T>
+class MpscQueue {
+ public:
+  explicit MpscQueue(size_t capacity)
+      : mask_(std::bit_ceil(std::max<size_t>(capacity, 2)) - 1),
+        cells_(std::make_unique<Cell[]>(mask_ + 1)) {
+    for (size_t i = 0; i <= mask_; ++i) cells_[i].seq.store(i, std::memory_order_relaxed);
+  }
+
+  ~MpscQueue() {
+    drain([](T&) {});
+  }
+
+  MpscQueue(const MpscQueue&) = delete;
+  MpscQueue& operator=(const MpscQueue&) = delete;
+
+  // Any thread.  Returns false when the queue is full.
+  template <typename U>
+  bool try_push(U&& value) {
+    size_t pos = tail_.load(std::memory_order_relaxed);
+    Cell* cell;
+    for (;;) {
+      cell = &cells_[pos & mask_];
+      const size_t seq = cell->seq.load(std::memory_order_acquire);
+      const intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+      if (diff == 0) {
+        if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = tail_.load(std::memory_order_relaxed);
+      }
+    }
+    new (cell->storage) T(std::forward<U>(value));
+    cell->seq.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer thread only.
+  bool try_pop(T& out) {
+    const size_t pos = head_.load(std::memory_order_relaxed);
+    Cell& cell = cells_[pos & mask_];
+    if (cell.seq.load(std::memory_order_acquire) != pos + 1) return false;
+    T* p = std::launder(reinterpret_cast<T*>(cell.storage));
+    out = std::move(*p);
+    p->~T();
+    cell.seq.store(pos + mask_ + 1, std::memory_order_release);
+    head_.store(pos + 1, std::memory_order_relaxed);
+    return true;
+  }
+
+  // Consumer thread only.  Hands up to max items to fn(T&) in FIFO order
+  // without moving them out of the ring; returns the number consumed.
+  template <typename F>
+  size_t drain(F&& fn, size_t max = SIZE_MAX) {
+    size_t pos = head_.load(std::memory_order_relaxed);
+    size_t n = 0;
+    while (n < max) {
+      Cell& cell = cells_[pos & mask_];
+      if (cell.seq.load(std::memory_order_acquire) != pos + 1) break;
+      T* p = std::launder(reinterpret_cast<T*>(cell.storage));
+      fn(*p);
+      p->~T();
+      cell.seq.store(pos + mask_ + 1, std::memory_order_release);
+      ++pos;
+      ++n;
+    }
+    head_.store(pos, std::memory_order_relaxed);
+    return n;
+  }
+
+  // Approximate when read from a producer thread.
+  size_t size_approx() const {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    const size_t head = head_.load(std::memory_order_relaxed);
+    return tail > head ? tail - head : 0;
+  }
+  size_t capacity() const { return mask_ + 1; }
+
+ private:
+  struct Cell {
+    std::atomic<size_t> seq;
+    alignas(T) std::byte storage[sizeof(T)];
+  };
+
+  const size_t mask_;
+  std::unique_ptr<Cell[]> cells_;
+  alignas(kCacheLine) std::atomic<size_t> tail_{0};
+  alignas(kCacheLine) std::atomic<size_t> head_{0};
+};
+
+}  // namespace kbs
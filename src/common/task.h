@@ -0,0 +1,152 @@
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+
+namespace kbs {
+
+template <typename T = void>
+class Task;
+
+namespace detail {
+
+struct TaskPromiseBase {
+  std::coroutine_handle<> continuation;
+  std::exception_ptr error;
+  bool detached = false;
+
+  std::suspend_always initial_suspend() noexcept { return {}; }
+
+  struct FinalAwaiter {
+    bool await_ready() noexcept { return false; }
+    template <typename P>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept {
+      TaskPromiseBase& p = h.promise();
+      if (p.continuation) return p.continuation;
+      if (p.detached) {
+        // Nobody can observe a detached task's failure.
+        if (p.error) std::terminate();
+        h.destroy();
+      }
+      return std::noop_coroutine();
+    }
+    void await_resume() noexcept {}
+  };
+  FinalAwaiter final_suspend() noexcept { return {}; }
+
+  void unhandled_exception() noexcept { error = std::current_exception(); }
+};
+
+template <typename T>
+struct TaskPromise : TaskPromiseBase {
+  std::optional<T> value;
+
+  Task<T> get_return_object() noexcept;
+  template <typename U>
+  void return_value(U&& v) {
+    value.emplace(std::forward<U>(v));
+  }
+  T take() {
+    if (error) std::rethrow_exception(error);
+    return std::move(*value);
+  }
+};
+
+template <>
+struct TaskPromise<void> : TaskPromiseBase {
+  Task<void> get_return_object() noexcept;
+  void return_void() noexcept {}
+  void take() {
+    if (error) std::rethrow_exception(error);
+  }
+};
+
+}  // namespace detail
+
+// Lazily started coroutine returning T.  Nothing runs until the task is
+// co_awaited (the awaiting coroutine resumes when it finishes, by symmetric
+// transfer, so deep co_await chains do not grow the stack) or handed to
+// co_spawn().  Exceptions propagate to the awaiter.
+//
+//   Task<int> get_level(RpcChannel& ch, EntityId id) {
+//     RpcResult r = co_await ch.call(kGetLevel, encode(id));
+//     co_return decode_level(r.payload);
+//   }
+//
+// Tasks are single-threaded: they resume on whatever thread completes the
+// operation they wait on, which for everything in this tree is the owning
+// EventLoop.  A coroutine lambda's captures live in the lambda object, not
+// the frame, so a capturing lambda must outlive the task it returns; pass
+// state as parameters when spawning.
+template <typename T>
+class [[nodiscard]] Task {
+ public:
+  using promise_type = detail::TaskPromise<T>;
+  using Handle = std::coroutine_handle<promise_type>;
+
+  Task() = default;
+  explicit Task(Handle h) : h_(h) {}
+  Task(Task&& o) noexcept : h_(std::exchange(o.h_, nullptr)) {}
+  Task& operator=(Task&& o) noexcept {
+    if (this != &o) {
+      if (h_) h_.destroy();
+      h_ = std::exchange(o.h_, nullptr);
+    }
+    return *this;
+  }
+  ~Task() {
+    if (h_) h_.destroy();
+  }
+
+  bool valid() const { return static_cast<bool>(h_); }
+  bool done() const { return !h_ || h_.done(); }
+
+  auto operator co_await() && noexcept {
+    struct Awaiter {
+      Handle h;
+      bool await_ready() noexcept { return !h || h.done(); }
+      std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+        h.promise().continuation = awaiting;
+        return h;
+      }
+      T await_resume() { return h.promise().take(); }
+    };
+    return Awaiter{h_};
+  }
+
+ private:
+  template <typename U>
+  friend void co_spawn(Task<U> task);
+
+  Handle release() { return std::exchange(h_, nullptr); }
+
+  Handle h_;
+};
+
+// Starts task and lets it run to completion on its own; the frame frees
+// itself at the end.  An exception escaping a spawned task terminates the
+// process, as with std::thread.
+template <typename T>
+void co_spawn(Task<T> task) {
+  auto h = task.release();
+  if (!h) return;
+  h.promise().detached = true;
+  h.resume();
+}
+
+namespace detail {
+
+template <typename T>
+Task<T> TaskPromise<T>::get_return_object() noexcept {
+  return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object() noexcept {
+  return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+
+}  // namespace detail
+
+}  // namespace kbs
@@ -0,0 +1,206 @@
+#include "common/thread_placement.h"
+
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <charconv>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include "metrics/metrics.h"
+
+namespace kbs {
+
+namespace {
+
+std::string read_sysfs(const std::string& path) {
+  std::ifstream in(path);
+  std::stringstream ss;
+  ss << in.rdbuf();
+  std::string s = ss.str();
+  while (!s.empty() && (s.back() == '\n' || s.back() == ' ')) s.pop_back();
+  return s;
+}
+
+int parse_int(std::string_view s, int fallback) {
+  int v = fallback;
+  const auto [p, ec] = std::from_chars(s.data(), s.data() + s.size(), v);
+  return ec == std::errc() && p == s.data() + s.size() ? v : fallback;
+}
+
+CpuTopology load_topology() {
+  CpuTopology topo;
+  std::vector<int> online;
+  try {
+    online = parse_cpu_list(read_sysfs("/sys/devices/system/cpu/online"));
+  } catch (const std::invalid_argument&) {
+  }
+  if (online.empty()) {
+    for (int i = 0; i < static_cast<int>(std::max(1l, ::sysconf(_SC_NPROCESSORS_ONLN))); ++i) {
+      online.push_back(i);
+    }
+  }
+  for (int id : online) {
+    const std::string dir = "/sys/devices/system/cpu/cpu" + std::to_string(id) + "/topology/";
+    topo.cpus.push_back(CpuTopology::Cpu{id, parse_int(read_sysfs(dir + "core_id"), id),
+                                         parse_int(read_sysfs(dir + "physical_package_id"), 0),
+                                         0});
+  }
+  std::vector<int> nodes;
+  try {
+    nodes = parse_cpu_list(read_sysfs("/sys/devices/system/node/online"));
+  } catch (const std::invalid_argument&) {
+  }
+  for (int node : nodes) {
+    std::vector<int> cpus;
+    try {
+      cpus = parse_cpu_list(
+          read_sysfs("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist"));
+    } catch (const std::invalid_argument&) {
+      continue;
+    }
+    for (int cpu : cpus) {
+      for (CpuTopology::Cpu& c : topo.cpus) {
+        if (c.id == cpu) c.node = node;
+      }
+    }
+    topo.num_nodes = std::max(topo.num_nodes, node + 1);
+  }
+  return topo;
+}
+
+Counter& placement_failures() {
+  static Counter& c = metrics().counter("kbs_thread_placement_failures_total",
+                                        "Threads the kernel would not pin or bind as configured");
+  return c;
+}
+
+// Node masks for set_mempolicy()/mbind(), up to the kernel's
+// MAX_NUMNODES ceiling.
+constexpr int kMaxNodes = 1024;
+constexpr size_t kMaskWords = kMaxNodes / (8 * sizeof(unsigned long));
+
+struct NodeMask {
+  unsigned long bits[kMaskWords] = {};
+  explicit NodeMask(int node) {
+    bits[static_cast<size_t>(node) / (8 * sizeof(unsigned long))] |=
+        1ul << (static_cast<size_t>(node) % (8 * sizeof(unsigned long)));
+  }
+  // The kernel reads maxnode - 1 bits.
+  static constexpr unsigned long kMaxNode = kMaskWords * 8 * sizeof(unsigned long) + 1;
+};
+
+}  // namespace
+
+const CpuTopology& CpuTopology::host() {
+  static const CpuTopology topo = load_topology();
+  return topo;
+}
+
+std::vector<int> CpuTopology::node_cpus(int node) const {
+  std::vector<int> out;
+  for (const Cpu& c : cpus) {
+    if (c.node == node) out.push_back(c.id);
+  }
+  return out;
+}
+
+int CpuTopology::node_of(int cpu) const {
+  auto it = std::lower_bound(cpus.begin(), cpus.end(), cpu,
+                             [](const Cpu& c, int id) { return c.id < id; });
+  return it != cpus.end() && it->id == cpu ? it->node : -1;
+}
+
+std::vector<int> parse_cpu_list(std::string_view list) {
+  std::vector<int> out;
+  while (!list.empty()) {
+    const size_t comma = std::min(list.find(','), list.size());
+    const std::string_view item = list.substr(0, comma);
+    list.remove_prefix(std::min(comma + 1, list.size()));
+    if (item.empty()) continue;
+    const size_t dash = item.find('-');
+    const int lo = parse_int(item.substr(0, dash), -1);
+    const int hi = dash == std::string_view::npos ? lo : parse_int(item.substr(dash + 1), -1);
+    if (lo < 0 || hi < lo || hi >= CPU_SETSIZE) {
+      throw std::invalid_argument("bad cpu list item '" + std::string(item) + "'");
+    }
+    for (int c = lo; c <= hi; ++c) out.push_back(c);
+  }
+  std::sort(out.begin(), out.end());
+  out.erase(std::unique(out.begin(), out.end()), out.end());
+  return out;
+}
+
+ThreadPlacement ThreadPlacement::parse(std::string_view spec) {
+  ThreadPlacement p;
+  while (!spec.empty()) {
+    const size_t semi = std::min(spec.find(';'), spec.size());
+    const std::string_view field = spec.substr(0, semi);
+    spec.remove_prefix(std::min(semi + 1, spec.size()));
+    if (field.empty()) continue;
+    if (field.starts_with("cpus:")) {
+      p.cpus = parse_cpu_list(field.substr(5));
+    } else if (field.starts_with("node:")) {
+      p.numa_node = parse_int(field.substr(5), -1);
+      if (p.numa_node < 0) {
+        throw std::invalid_argument("bad numa node in '" + std::string(field) + "'");
+      }
+    } else if (field.starts_with("name:")) {
+      p.name = field.substr(5);
+    } else if (field == "remote-memory") {
+      p.local_memory = false;
+    } else {
+      throw std::invalid_argument("unknown placement field '" + std::string(field) + "'");
+    }
+  }
+  return p;
+}
+
+bool place_current_thread(const ThreadPlacement& placement, size_t index) {
+  if (placement.empty()) return true;
+  const CpuTopology& topo = CpuTopology::host();
+  bool ok = true;
+
+  const int cpu = placement.cpu_for(index);
+  const std::vector<int> cpus = cpu >= 0 ? std::vector<int>{cpu}
+                                : placement.numa_node >= 0 ? topo.node_cpus(placement.numa_node)
+                                                           : std::vector<int>{};
+  if (!cpus.empty()) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int c : cpus) CPU_SET(c, &set);
+    ok &= ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set) == 0;
+  }
+
+  // A single-node host has nothing to prefer; skip the syscall.
+  const int node = cpu >= 0 ? topo.node_of(cpu) : placement.numa_node;
+  if (placement.local_memory && node >= 0 && node < kMaxNodes && topo.num_nodes > 1) {
+    const NodeMask mask(node);
+    ok &= ::syscall(SYS_set_mempolicy, MPOL_PREFERRED, mask.bits, NodeMask::kMaxNode) == 0;
+  }
+
+  if (!placement.name.empty()) {
+    // The kernel limit is 15 bytes; shorten the prefix, keep the index.
+    const std::string suffix = "-" + std::to_string(index);
+    const std::string name =
+        placement.name.substr(0, 15 - std::min<size_t>(suffix.size(), 15)) + suffix;
+    ::pthread_setname_np(::pthread_self(), name.c_str());
+  }
+  if (!ok) placement_failures().inc();
+  return ok;
+}
+
+bool bind_memory_to_node(void* addr, size_t len, int node) {
+  if (node < 0 || node >= kMaxNodes) return false;
+  if (CpuTopology::host().num_nodes <= 1) return true;
+  const NodeMask mask(node);
+  return ::syscall(SYS_mbind, addr, len, MPOL_PREFERRED, mask.bits, NodeMask::kMaxNode,
+                   MPOL_MF_MOVE) == 0;
+}
+
+}  // namespace kbs
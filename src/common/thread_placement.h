@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace kbs {
+
+// Online CPUs and NUMA nodes of this host, read once from sysfs.  On a
+// kernel or container without node information every CPU is on node 0.
+struct CpuTopology {
+  struct Cpu {
+    int id = 0;
+    int core = 0;     // physical core within the package; SMT siblings share it
+    int package = 0;  // socket
+    int node = 0;     // NUMA node
+  };
+
+  std::vector<Cpu> cpus;  // ascending id
+  int num_nodes = 1;
+
+  static const CpuTopology& host();
+
+  std::vector<int> node_cpus(int node) const;
+  // -1 for a CPU that is not online.
+  int node_of(int cpu) const;
+};
+
+// "0-3,8,10-11" -> {0, 1, 2, 3, 8, 10, 11}, the sysfs / taskset syntax.
+// Throws std::invalid_argument.
+std::vector<int> parse_cpu_list(std::string_view list);
+
+// Where a pool's threads run and allocate.  Every pool with threads of
+// its own (TcpServer loops, JobSystem, PacketPipeline, PathService,
+// WriteBehindCache) takes one in its options; the default leaves threads
+// floating, as before.
+//
+// On a multi-socket host a floating thread migrates between sockets and
+// then reads memory it first touched on the other one; pinning the loops,
+// the logic thread and its job workers to one node's CPUs -- and allocating
+// from that node -- keeps the traffic on-socket.
+//
+//   TcpServerOptions io;
+//   io.placement = ThreadPlacement::parse("node:0;cpus:2-9");  // loop i on cpu 2+i
+//   JobSystem jobs(8, ThreadPlacement::parse("cpus:10-17;name:job"));
+struct ThreadPlacement {
+  // Thread i of the pool is pinned to cpus[i % cpus.size()].
+  std::vector<int> cpus;
+  // With cpus empty: threads float over this node's CPUs.  Either way,
+  // memory is preferred from the node of the CPU a thread runs on (or
+  // this node), so first-touch allocations land locally.  -1: no node.
+  int numa_node = -1;
+  bool local_memory = true;
+  // Thread i is named "<name>-<i>" (truncated to 15 bytes) for top/perf.
+  std::string name;
+
+  bool empty() const { return cpus.empty() && numa_node < 0 && name.empty(); }
+  // CPU thread index is pinned to, or -1 when it floats.
+  int cpu_for(size_t index) const {
+    return cpus.empty() ? -1 : cpus[index % cpus.size()];
+  }
+
+  // Config-file form: ';'-separated "cpus:LIST", "node:N", "name:S" and
+  // "remote-memory" (local_memory off), e.g. "cpus:0-3,8;name:io".
+  // Throws std::invalid_argument.
+  static ThreadPlacement parse(std::string_view spec);
+};
+
+// Applies slot index of placement to the calling thread: affinity, memory
+// policy and name.  Call first thing in the thread's body.  False when the
+// kernel refused part of it (CPU offline or outside the cgroup's cpuset);
+// the thread then keeps running unpinned and the failure is counted in
+// kbs_thread_placement_failures_total.
+bool place_current_thread(const ThreadPlacement& placement, size_t index);
+
+// Moves the pages of [addr, addr + len) -- page-aligned, e.g. from
+// mmap() -- to node and keeps future faults there.  For buffers allocated
+// before the thread that uses them was placed.  False on failure.
+bool bind_memory_to_node(void* addr, size_t len, int node);
+
+}  // namespace kbs
@@ -0,0 +1,75 @@
+#include "common/tick_arena.h"
+
+#include <algorithm>
+#include <cstdint>
+
+namespace kbs {
+
+namespace {
+
+constexpr size_t kBlockAlign = 64;
+
+}  // namespace
+
+TickArena::TickArena(size_t block_size, std::pmr::memory_resource* upstream)
+    : upstream_(upstream), block_size_(std::max<size_t>(block_size, 4096)) {
+  add_block(block_size_);
+}
+
+TickArena::~TickArena() { release_blocks(); }
+
+void TickArena::add_block(size_t min_size) {
+  const size_t size = std::max(block_size_, min_size);
+  auto* data = static_cast<std::byte*>(upstream_->allocate(size, kBlockAlign));
+  ++upstream_allocations_;
+  if (!blocks_.empty()) used_before_current_ += offset_;
+  blocks_.push_back({data, size});
+  offset_ = 0;
+  reserved_ += size;
+}
+
+void TickArena::release_blocks() {
+  for (const Block& b : blocks_) upstream_->deallocate(b.data, b.size, kBlockAlign);
+  blocks_.clear();
+  reserved_ = 0;
+}
+
+void* TickArena::do_allocate(size_t bytes, size_t alignment) {
+  Block& b = blocks_.back();
+  const uintptr_t base = reinterpret_cast<uintptr_t>(b.data);
+  size_t aligned = ((base + offset_ + alignment - 1) & ~(alignment - 1)) - base;
+  if (aligned + bytes > b.size) {
+    add_block(bytes + alignment);
+    const uintptr_t nb = reinterpret_cast<uintptr_t>(blocks_.back().data);
+    aligned = ((nb + alignment - 1) & ~(alignment - 1)) - nb;
+  }
+  offset_ = aligned + bytes;
+  return blocks_.back().data + aligned;
+}
+
+void TickArena::do_deallocate(void* p, size_t bytes, size_t) {
+  // Give back the most recent allocation so a growing pmr::vector does not
+  // leave a trail of dead buffers; everything else waits for reset().
+  std::byte* end = blocks_.back().data + offset_;
+  if (static_cast<std::byte*>(p) + bytes == end) {
+    offset_ = static_cast<size_t>(static_cast<std::byte*>(p) - blocks_.back().data);
+  }
+}
+
+void TickArena::reset() {
+  const size_t used = bytes_used();
+  peak_ = std::max(peak_, used);
+  if (blocks_.size() > 1) {
+    // The tick outgrew one block: coalesce into a single block sized for it.
+    release_blocks();
+    used_before_current_ = 0;
+    offset_ = 0;
+    add_block(std::max(block_size_, used + used / 4));
+    block_size_ = blocks_.back().size;
+    return;
+  }
+  used_before_current_ = 0;
+  offset_ = 0;
+}
+
+}  // namespace kbs
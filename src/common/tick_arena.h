@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace kbs {
+
+// Bump allocator for objects that die within one tick: path query scratch,
+// damage calculation temporaries, outgoing packet assembly.  Allocation is
+// a pointer bump, deallocation is a no-op, and reset() reclaims everything
+// at once.  If a tick spilled into extra blocks, reset() replaces them with
+// one block big enough for that peak, so steady state is a single block
+// and zero upstream calls.
+//
+// As a std::pmr::memory_resource it backs pmr containers directly:
+//
+//   std::pmr::vector<EntityId> hits(ctx.arena);
+//
+// Containers and objects must not outlive the tick.  reset() does not run
+// destructors; create() is therefore limited to trivially destructible
+// types.  Not thread-safe: one arena per logic thread.
+class TickArena final : public std::pmr::memory_resource {
+ public:
+  static constexpr size_t kDefaultBlockSize = 256 * 1024;
+
+  explicit TickArena(size_t block_size = kDefaultBlockSize,
+                     std::pmr::memory_resource* upstream = std::pmr::new_delete_resource());
+  ~TickArena() override;
+
+  TickArena(const TickArena&) = delete;
+  TickArena& operator=(const TickArena&) = delete;
+
+  template <typename T, typename... Args>
+  T* create(Args&&... args) {
+    static_assert(std::is_trivially_destructible_v<T>,
+                  "TickArena never runs destructors; use a pmr container instead");
+    return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+  }
+
+  template <typename T>
+  T* allocate_array(size_t n) {
+    static_assert(std::is_trivially_destructible_v<T>);
+    return static_cast<T*>(allocate(sizeof(T) * n, alignof(T)));
+  }
+
+  // Releases every allocation made since the previous reset().
+  void reset();
+
+  size_t bytes_used() const { return used_before_current_ + offset_; }
+  size_t bytes_reserved() const { return reserved_; }
+  // Largest bytes_used() seen at any reset().
+  size_t peak_bytes() const { return peak_; }
+  uint64_t upstream_allocations() const { return upstream_allocations_; }
+
+ protected:
+  void* do_allocate(size_t bytes, size_t alignment) override;
+  void do_deallocate(void* p, size_t bytes, size_t alignment) override;
+  bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+    return this == &other;
+  }
+
+ private:
+  struct Block {
+    std::byte* data;
+    size_t size;
+  };
+
+  void add_block(size_t min_size);
+  void release_blocks();
+
+  std::pmr::memory_resource* upstream_;
+  size_t block_size_;
+  std::vector<Block> blocks_;
+  size_t offset_ = 0;               // within blocks_.back()
+  size_t used_before_current_ = 0;  // bytes consumed in earlier blocks
+  size_t reserved_ = 0;
+  size_t peak_ = 0;
+  uint64_t upstream_allocations_ = 0;
+};
+
+}  // namespace kbs
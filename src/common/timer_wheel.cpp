@@ -0,0 +1,195 @@
+#include "common/timer_wheel.h"
+
+#include <algorithm>
+
+#include "metrics/profiler.h"
+
+namespace kbs {
+
+TimerWheel::TimerWheel(uint64_t start_tick) : now_(start_tick) { heads_.fill(kNil); }
+
+TimerWheel::Node* TimerWheel::lookup(TimerId id) {
+  return const_cast<Node*>(static_cast<const TimerWheel*>(this)->lookup(id));
+}
+
+const TimerWheel::Node* TimerWheel::lookup(TimerId id) const {
+  const uint32_t n = index_of(id);
+  if (n >= nodes_.size()) return nullptr;
+  const Node& node = nodes_[n];
+  if (!node.active || node.generation != generation_of(id)) return nullptr;
+  return &node;
+}
+
+uint32_t TimerWheel::allocate() {
+  if (!free_.empty()) {
+    const uint32_t n = free_.back();
+    free_.pop_back();
+    return n;
+  }
+  nodes_.emplace_back();
+  return static_cast<uint32_t>(nodes_.size() - 1);
+}
+
+void TimerWheel::free_node(uint32_t n) {
+  Node& node = nodes_[n];
+  node.cb.reset();
+  node.active = false;
+  node.list = kNoList;
+  // Generation 0 is skipped so no id ever equals kInvalidTimerId.
+  if (++node.generation == 0) node.generation = 1;
+  free_.push_back(n);
+  --live_;
+}
+
+TimerId TimerWheel::schedule(uint64_t delay, Callback cb, uint64_t period) {
+  const uint32_t n = allocate();
+  Node& node = nodes_[n];
+  node.expiry = now_ + std::max<uint64_t>(delay, 1);
+  node.period = period;
+  node.active = true;
+  node.cb = std::move(cb);
+  ++live_;
+  insert(n);
+  return (static_cast<TimerId>(node.generation) << 32) | n;
+}
+
+bool TimerWheel::cancel(TimerId id) {
+  Node* node = lookup(id);
+  if (!node) return false;
+  const uint32_t n = index_of(id);
+  if (node->list != kNoList) unlink(n);
+  free_node(n);
+  return true;
+}
+
+bool TimerWheel::reschedule(TimerId id, uint64_t delay) {
+  Node* node = lookup(id);
+  if (!node) return false;
+  const uint32_t n = index_of(id);
+  if (node->list != kNoList) unlink(n);
+  node->expiry = now_ + std::max<uint64_t>(delay, 1);
+  insert(n);
+  return true;
+}
+
+bool TimerWheel::pending(TimerId id) const { return lookup(id) != nullptr; }
+
+void TimerWheel::insert(uint32_t n) {
+  const uint64_t expiry = nodes_[n].expiry;
+  // Timers past the wheel's range are filed at its far edge and re-filed
+  // when that slot cascades.
+  const uint64_t delta = expiry > now_ ? std::min<uint64_t>(expiry - now_, 0xffffffffu) : 0;
+  const uint64_t target = now_ + delta;
+  uint32_t list;
+  if (delta < (1u << kSlotBits)) {
+    list = static_cast<uint32_t>(target & kSlotMask);
+  } else if (delta < (1u << (2 * kSlotBits))) {
+    list = kSlots + static_cast<uint32_t>((target >> kSlotBits) & kSlotMask);
+  } else if (delta < (1u << (3 * kSlotBits))) {
+    list = 2 * kSlots + static_cast<uint32_t>((target >> (2 * kSlotBits)) & kSlotMask);
+  } else {
+    list = 3 * kSlots + static_cast<uint32_t>((target >> (3 * kSlotBits)) & kSlotMask);
+  }
+  link(n, list);
+}
+
+void TimerWheel::link(uint32_t n, uint32_t list) {
+  Node& node = nodes_[n];
+  node.list = list;
+  node.prev = kNil;
+  node.next = heads_[list];
+  if (node.next != kNil) nodes_[node.next].prev = n;
+  heads_[list] = n;
+}
+
+void TimerWheel::unlink(uint32_t n) {
+  Node& node = nodes_[n];
+  if (node.prev != kNil) {
+    nodes_[node.prev].next = node.next;
+  } else {
+    heads_[node.list] = node.next;
+  }
+  if (node.next != kNil) nodes_[node.next].prev = node.prev;
+  node.prev = node.next = kNil;
+  node.list = kNoList;
+}
+
+void TimerWheel::cascade(int level) {
+  const uint32_t list =
+      level * kSlots + static_cast<uint32_t>((now_ >> (level * kSlotBits)) & kSlotMask);
+  uint32_t n = heads_[list];
+  heads_[list] = kNil;
+  while (n != kNil) {
+    const uint32_t next = nodes_[n].next;
+    insert(n);
+    n = next;
+  }
+}
+
+size_t TimerWheel::fire_slot(uint32_t slot) {
+  if (heads_[slot] == kNil) return 0;
+  // Detach the slot so timers scheduled by callbacks for this same tick
+  // wait for the next pass instead of extending this one.
+  heads_[kFiringList] = heads_[slot];
+  heads_[slot] = kNil;
+  for (uint32_t n = heads_[kFiringList]; n != kNil; n = nodes_[n].next) {
+    nodes_[n].list = kFiringList;
+  }
+
+  size_t fired = 0;
+  while (heads_[kFiringList] != kNil) {
+    const uint32_t n = heads_[kFiringList];
+    unlink(n);
+    const uint32_t gen = nodes_[n].generation;
+    // The callback may grow the slab, so run it from a local.
+    Callback cb = std::move(nodes_[n].cb);
+    cb();
+    ++fired;
+    Node& node = nodes_[n];
+    if (!node.active || node.generation != gen) continue;  // cancelled itself
+    if (node.list != kNoList) {
+      node.cb = std::move(cb);  // rescheduled itself
+    } else if (node.period > 0) {
+      node.expiry += node.period;
+      node.cb = std::move(cb);
+      insert(n);
+    } else {
+      free_node(n);
+    }
+  }
+  return fired;
+}
+
+uint64_t TimerWheel::ticks_until_next() const {
+  if (live_ == 0) return UINT64_MAX;
+  const uint32_t base = static_cast<uint32_t>(now_ & kSlotMask);
+  for (uint32_t d = 1; base + d < kSlots; ++d) {
+    if (heads_[base + d] != kNil) return d;
+  }
+  // Nothing left in this level-0 revolution; the next cascade may bring
+  // timers down.
+  return kSlots - base;
+}
+
+size_t TimerWheel::advance(uint64_t ticks) {
+  KBS_PROFILE_SCOPE(kTimers);
+  size_t fired = 0;
+  for (uint64_t i = 0; i < ticks; ++i) {
+    if (live_ == 0) {
+      now_ += ticks - i;
+      break;
+    }
+    ++now_;
+    const uint32_t slot = static_cast<uint32_t>(now_ & kSlotMask);
+    if (slot == 0) {
+      for (int level = 1; level < kLevels; ++level) {
+        cascade(level);
+        if (((now_ >> (level * kSlotBits)) & kSlotMask) != 0) break;
+      }
+    }
+    fired += fire_slot(slot);
+  }
+  return fired;
+}
+
+}  // namespace kbs
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "common/inplace_function.h"
+
+namespace kbs {
+
+// Generation-tagged timer handle; 0 is never a valid id.
+using TimerId = uint64_t;
+constexpr TimerId kInvalidTimerId = 0;
+
+// Hierarchical hashed timing wheel.
+//
+// Four levels of 256 slots cover 2^32 ticks; a timer is filed in the level
+// whose span contains its remaining delay and cascades one level down when
+// the wheel below wraps.  Timer nodes come from a slab that only grows, are
+// linked into slots by index, and carry their callback inline, so schedule,
+// cancel and reschedule are O(1) and allocation-free once the slab is warm.
+//
+// Time is an abstract tick count advanced by the owner (e.g. one tick per
+// millisecond from the event loop, or one per game tick).  Not thread-safe.
+class TimerWheel {
+ public:
+  using Callback = InplaceFunction<void(), 48>;
+
+  explicit TimerWheel(uint64_t start_tick = 0);
+
+  TimerWheel(const TimerWheel&) = delete;
+  TimerWheel& operator=(const TimerWheel&) = delete;
+
+  // Fires cb after delay ticks (minimum 1), then every period ticks if
+  // period is non-zero.
+  TimerId schedule(uint64_t delay, Callback cb, uint64_t period = 0);
+  // False if id already fired (one-shot) or was cancelled.
+  bool cancel(TimerId id);
+  // Moves a pending timer's expiry to now + delay, keeping its callback.
+  bool reschedule(TimerId id, uint64_t delay);
+  bool pending(TimerId id) const;
+
+  // Advances the clock to now() + ticks, firing every timer that comes due
+  // in expiry order per tick.  Callbacks may schedule and cancel freely.
+  // Returns the number of callbacks run.
+  size_t advance(uint64_t ticks);
+
+  // Ticks until the next timer might fire (it never fires earlier), or
+  // UINT64_MAX when nothing is scheduled.  Used to bound poll timeouts.
+  uint64_t ticks_until_next() const;
+
+  uint64_t now() const { return now_; }
+  size_t size() const { return live_; }
+  // Slab size, for memory accounting.
+  size_t capacity() const { return nodes_.size(); }
+
+ private:
+  static constexpr int kLevels = 4;
+  static constexpr int kSlotBits = 8;
+  static constexpr uint32_t kSlots = 1u << kSlotBits;
+  static constexpr uint32_t kSlotMask = kSlots - 1;
+  static constexpr uint32_t kNil = UINT32_MAX;
+  // List id of the batch currently being fired.
+  static constexpr uint32_t kFiringList = kLevels * kSlots;
+  static constexpr uint32_t kNoList = kFiringList + 1;
+
+  struct Node {
+    uint64_t expiry = 0;
+    uint64_t period = 0;
+    uint32_t prev = kNil;
+    uint32_t next = kNil;
+    uint32_t list = kNoList;
+    uint32_t generation = 1;
+    bool active = false;  // scheduled, or its callback is running
+    Callback cb;
+  };
+
+  static uint32_t index_of(TimerId id) { return static_cast<uint32_t>(id); }
+  static uint32_t generation_of(TimerId id) { return static_cast<uint32_t>(id >> 32); }
+
+  Node* lookup(TimerId id);
+  const Node* lookup(TimerId id) const;
+  uint32_t allocate();
+  void free_node(uint32_t n);
+  void insert(uint32_t n);
+  void link(uint32_t n, uint32_t list);
+  void unlink(uint32_t n);
+  void cascade(int level);
+  size_t fire_slot(uint32_t slot);
+
+  uint64_t now_;
+  size_t live_ = 0;
+  std::vector<Node> nodes_;
+  std::vector<uint32_t> free_;
+  std::array<uint32_t, kFiringList + 1> heads_;
+};
+
+}  // namespace kbs
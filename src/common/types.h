@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstdint>
+
+namespace kbs {
+
+// Process-wide entity identifier.  0 is never assigned.
+using EntityId = uint64_t;
+constexpr EntityId kInvalidEntityId = 0;
+
+}  // namespace kbs
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cmath>
+
+namespace kbs {
+
+// World-space position/direction.  Plain aggregate so it can be stored in
+// SoA columns and copied onto the wire as-is.
+struct Vec3 {
+  float x = 0;
+  float y = 0;
+  float z = 0;
+
+  friend constexpr Vec3 operator+(Vec3 a, Vec3 b) { return {a.x + b.x, a.y + b.y, a.z + b.z}; }
+  friend constexpr Vec3 operator-(Vec3 a, Vec3 b) { return {a.x - b.x, a.y - b.y, a.z - b.z}; }
+  friend constexpr Vec3 operator*(Vec3 a, float s) { return {a.x * s, a.y * s, a.z * s}; }
+  friend constexpr bool operator==(Vec3 a, Vec3 b) = default;
+};
+
+constexpr float dot(Vec3 a, Vec3 b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+constexpr float length_sq(Vec3 v) { return dot(v, v); }
+inline float length(Vec3 v) { return std::sqrt(length_sq(v)); }
+
+// Ground-plane (x/z) distance, which is what AOI and range checks use.
+constexpr float distance_sq_xz(Vec3 a, Vec3 b) {
+  const float dx = a.x - b.x;
+  const float dz = a.z - b.z;
+  return dx * dx + dz * dz;
+}
+
+}  // namespace kbs
@@ -0,0 +1,231 @@
+#include "data/data_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <numeric>
+#include <system_error>
+
+#include "common/atomic_file.h"
+#include "metrics/metrics.h"
+
+namespace kbs {
+
+namespace {
+
+constexpr size_t kRowAlign = 16;
+
+uint64_t fnv1a64(const uint8_t* p, size_t n) {
+  uint64_t h = 14695981039346656037ull;
+  for (size_t i = 0; i < n; ++i) {
+    h ^= p[i];
+    h *= 1099511628211ull;
+  }
+  return h;
+}
+
+[[noreturn]] void malformed(const std::string& path, const char* what) {
+  throw std::runtime_error("data file " + path + ": " + what);
+}
+
+[[noreturn]] void throw_errno(const std::string& what) {
+  throw std::system_error(errno, std::generic_category(), what);
+}
+
+// [offset, offset + len) inside a file of size bytes, without overflow.
+bool in_bounds(uint64_t offset, uint64_t len, uint64_t size) {
+  return offset <= size && len <= size - offset;
+}
+
+void pad_to(std::string& out, size_t align) {
+  out.resize((out.size() + align - 1) / align * align, '\0');
+}
+
+Gauge& version_gauge() {
+  static Gauge& g = metrics().gauge("kbs_data_version", "Game data version in use");
+  return g;
+}
+
+}  // namespace
+
+std::shared_ptr<const DataFile> DataFile::open(const std::string& path, bool verify) {
+  const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) throw_errno("open " + path);
+  struct stat st;
+  if (::fstat(fd, &st) != 0) {
+    const int saved = errno;
+    ::close(fd);
+    throw std::system_error(saved, std::generic_category(), "fstat " + path);
+  }
+  const size_t size = static_cast<size_t>(st.st_size);
+  if (size < sizeof(DataFileHeader)) {
+    ::close(fd);
+    malformed(path, "truncated header");
+  }
+  void* base = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  const int saved = errno;
+  ::close(fd);  // the mapping keeps the file alive
+  if (base == MAP_FAILED) throw std::system_error(saved, std::generic_category(), "mmap " + path);
+  std::shared_ptr<const DataFile> file(
+      new DataFile(path, static_cast<const uint8_t*>(base), size));
+  file->validate(verify);
+  return file;
+}
+
+DataFile::~DataFile() { ::munmap(const_cast<uint8_t*>(base_), size_); }
+
+void DataFile::validate(bool verify) const {
+  const DataFileHeader& h = header();
+  if (h.magic != DataFileHeader::kMagic) malformed(path_, "bad magic");
+  if (h.format != DataFileHeader::kFormat) malformed(path_, "unsupported format");
+  if (h.file_size != size_) malformed(path_, "size mismatch");
+  const uint64_t dir_bytes = uint64_t(h.table_count) * sizeof(DataTableEntry);
+  if (!in_bounds(sizeof(DataFileHeader), dir_bytes, size_)) malformed(path_, "bad directory");
+  if (!in_bounds(h.strings_offset, h.strings_size, size_) || h.strings_size > UINT32_MAX) {
+    malformed(path_, "bad string pool");
+  }
+  if (verify && fnv1a64(base_ + sizeof(DataFileHeader), size_ - sizeof(DataFileHeader)) !=
+                    h.checksum) {
+    malformed(path_, "checksum mismatch");
+  }
+  for (const DataTableEntry& t : tables()) {
+    if (std::memchr(t.name, '\0', sizeof(t.name)) == nullptr) malformed(path_, "bad table name");
+    if (t.row_size == 0) malformed(path_, "zero row size");
+    if (t.ids_offset % alignof(uint64_t) != 0 || t.rows_offset % kRowAlign != 0 ||
+        !in_bounds(t.ids_offset, uint64_t(t.row_count) * sizeof(uint64_t), size_) ||
+        !in_bounds(t.rows_offset, uint64_t(t.row_count) * t.row_size, size_)) {
+      malformed(path_, "table out of bounds");
+    }
+    if (!verify) continue;
+    const auto* ids = reinterpret_cast<const uint64_t*>(base_ + t.ids_offset);
+    for (uint32_t i = 1; i < t.row_count; ++i) {
+      if (ids[i] <= ids[i - 1]) malformed(path_, "ids not ascending");
+    }
+    if ((t.flags & DataTableEntry::kDenseIds) && t.row_count &&
+        ids[t.row_count - 1] - ids[0] != t.row_count - 1) {
+      malformed(path_, "dense ids have gaps");
+    }
+  }
+}
+
+const DataTableEntry* DataFile::find_table(std::string_view name) const {
+  for (const DataTableEntry& t : tables()) {
+    if (name == t.name) return &t;
+  }
+  return nullptr;
+}
+
+const DataTableEntry& DataFile::checked_table(std::string_view name, uint32_t schema_hash,
+                                              size_t row_size) const {
+  const DataTableEntry* t = find_table(name);
+  if (!t) malformed(path_, ("no table " + std::string(name)).c_str());
+  if (t->schema_hash != schema_hash || t->row_size != row_size) {
+    malformed(path_, ("schema mismatch in table " + std::string(name)).c_str());
+  }
+  return *t;
+}
+
+DataString DataFileWriter::intern(std::string_view s) {
+  auto it = std::lower_bound(interned_.begin(), interned_.end(), s,
+                             [](const auto& e, std::string_view v) { return e.first < v; });
+  if (it != interned_.end() && it->first == s) return it->second;
+  if (strings_.size() + s.size() > UINT32_MAX) throw std::length_error("string pool over 4 GiB");
+  const DataString ds{static_cast<uint32_t>(strings_.size()), static_cast<uint32_t>(s.size())};
+  strings_.append(s);
+  interned_.emplace(it, std::string(s), ds);
+  return ds;
+}
+
+void DataFileWriter::add_table(std::string_view name, std::string_view schema, size_t row_size,
+                               std::span<const uint64_t> ids, std::span<const uint8_t> rows) {
+  if (name.empty() || name.size() >= sizeof(DataTableEntry::name)) {
+    throw std::invalid_argument("bad table name: " + std::string(name));
+  }
+  for (const Table& t : tables_) {
+    if (t.name == name) throw std::invalid_argument("duplicate table: " + std::string(name));
+  }
+  if (row_size == 0 || rows.size() != ids.size() * row_size) {
+    throw std::invalid_argument("row data does not match ids in table " + std::string(name));
+  }
+  std::vector<uint32_t> order(ids.size());
+  std::iota(order.begin(), order.end(), 0u);
+  std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return ids[a] < ids[b]; });
+
+  Table t;
+  t.name.assign(name);
+  t.schema_hash = data_schema_hash(schema);
+  t.row_size = static_cast<uint32_t>(row_size);
+  t.ids.reserve(ids.size());
+  t.rows.reserve(rows.size());
+  for (uint32_t i : order) {
+    if (!t.ids.empty() && t.ids.back() == ids[i]) {
+      throw std::invalid_argument("duplicate id " + std::to_string(ids[i]) + " in table " +
+                                  t.name);
+    }
+    t.ids.push_back(ids[i]);
+    t.rows.append(reinterpret_cast<const char*>(rows.data()) + size_t(i) * row_size, row_size);
+  }
+  tables_.push_back(std::move(t));
+}
+
+std::string DataFileWriter::finish() const {
+  if (tables_.size() > UINT16_MAX) throw std::length_error("too many tables");
+  std::string out(sizeof(DataFileHeader) + tables_.size() * sizeof(DataTableEntry), '\0');
+  std::vector<DataTableEntry> entries(tables_.size());
+  for (size_t i = 0; i < tables_.size(); ++i) {
+    const Table& t = tables_[i];
+    DataTableEntry& e = entries[i];
+    std::memcpy(e.name, t.name.data(), t.name.size());
+    e.schema_hash = t.schema_hash;
+    e.row_size = t.row_size;
+    e.row_count = static_cast<uint32_t>(t.ids.size());
+    if (!t.ids.empty() && t.ids.back() - t.ids.front() == t.ids.size() - 1) {
+      e.flags |= DataTableEntry::kDenseIds;
+    }
+    pad_to(out, alignof(uint64_t));
+    e.ids_offset = out.size();
+    out.append(reinterpret_cast<const char*>(t.ids.data()), t.ids.size() * sizeof(uint64_t));
+    pad_to(out, kRowAlign);
+    e.rows_offset = out.size();
+    out.append(t.rows);
+  }
+  DataFileHeader h;
+  h.table_count = static_cast<uint16_t>(tables_.size());
+  h.data_version = version_;
+  h.strings_offset = out.size();
+  h.strings_size = strings_.size();
+  out.append(strings_);
+  h.file_size = out.size();
+  std::memcpy(out.data() + sizeof(DataFileHeader), entries.data(),
+              entries.size() * sizeof(DataTableEntry));
+  h.checksum = fnv1a64(reinterpret_cast<const uint8_t*>(out.data()) + sizeof(DataFileHeader),
+                       out.size() - sizeof(DataFileHeader));
+  std::memcpy(out.data(), &h, sizeof(h));
+  return out;
+}
+
+void DataFileWriter::write(const std::string& path) const {
+  // Processes still mapping the old file keep its inode until they unmap.
+  write_file_atomic(path, finish());
+}
+
+GameData::GameData(std::string path, bool verify)
+    : verify_(verify), current_(DataFile::open(path, verify)) {
+  version_gauge().set(static_cast<int64_t>(current()->version()));
+}
+
+uint64_t GameData::reload() { return reload(current()->path()); }
+
+uint64_t GameData::reload(const std::string& path) {
+  std::shared_ptr<const DataFile> next = DataFile::open(path, verify_);
+  const uint64_t version = next->version();
+  current_.store(std::move(next), std::memory_order_release);
+  version_gauge().set(static_cast<int64_t>(version));
+  return version;
+}
+
+}  // namespace kbs
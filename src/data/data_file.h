@@ -0,0 +1,244 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace kbs {
+
+// String column value: a slice of the file's string pool.
+struct DataString {
+  uint32_t offset = 0;
+  uint32_t length = 0;
+};
+
+// FNV-1a over a table's column signature ("id:u32,name:str,price:i32"),
+// stored per table so a reader built against another layout fails at
+// startup instead of misreading rows.
+constexpr uint32_t data_schema_hash(std::string_view schema) {
+  uint32_t h = 2166136261u;
+  for (char c : schema) {
+    h ^= static_cast<uint8_t>(c);
+    h *= 16777619u;
+  }
+  return h;
+}
+
+// On-disk layout, little-endian, native struct packing (compile data on
+// the architecture that serves it):
+//
+//   DataFileHeader
+//   DataTableEntry[table_count]
+//   per table: uint64_t ids[row_count] (ascending), rows (16-byte aligned)
+//   string pool
+//
+// Rows are the plain structs game code declares, so a lookup returns a
+// pointer straight into the mapping.
+struct DataFileHeader {
+  static constexpr uint32_t kMagic = 0x5444424B;  // "KBDT"
+  static constexpr uint16_t kFormat = 1;
+
+  uint32_t magic = kMagic;
+  uint16_t format = kFormat;
+  uint16_t table_count = 0;
+  uint64_t data_version = 0;
+  uint64_t file_size = 0;
+  uint64_t checksum = 0;  // FNV-1a 64 of everything after the header
+  uint64_t strings_offset = 0;
+  uint64_t strings_size = 0;
+  uint64_t reserved[2] = {};
+};
+static_assert(sizeof(DataFileHeader) == 64);
+
+struct DataTableEntry {
+  // ids are first_id, first_id + 1, ...: lookup is an index, not a search.
+  static constexpr uint32_t kDenseIds = 1;
+
+  char name[32] = {};
+  uint32_t schema_hash = 0;
+  uint32_t row_size = 0;
+  uint32_t row_count = 0;
+  uint32_t flags = 0;
+  uint64_t ids_offset = 0;
+  uint64_t rows_offset = 0;
+};
+static_assert(sizeof(DataTableEntry) == 64);
+
+// Typed view of one table.  Pointers go into the owning DataFile's
+// mapping: valid while a shared_ptr to that file is held.
+//
+// Row is a trivially copyable struct with
+//   static constexpr std::string_view kTable = "items";
+//   static constexpr std::string_view kSchema = "id:u32,name:str,...";
+// whose members follow the schema's column order.
+template <typename Row>
+class DataTable {
+ public:
+  DataTable() = default;
+  DataTable(const uint64_t* ids, const Row* rows, size_t count, bool dense)
+      : ids_(ids), rows_(rows), count_(count), dense_(dense) {}
+
+  const Row* find(uint64_t id) const {
+    if (count_ == 0) return nullptr;
+    if (dense_) {
+      const uint64_t i = id - ids_[0];
+      return i < count_ ? rows_ + i : nullptr;
+    }
+    const uint64_t* it = std::lower_bound(ids_, ids_ + count_, id);
+    return it != ids_ + count_ && *it == id ? rows_ + (it - ids_) : nullptr;
+  }
+
+  size_t size() const { return count_; }
+  std::span<const Row> rows() const { return {rows_, count_}; }
+  std::span<const uint64_t> ids() const { return {ids_, count_}; }
+
+ private:
+  const uint64_t* ids_ = nullptr;
+  const Row* rows_ = nullptr;
+  size_t count_ = 0;
+  bool dense_ = false;
+};
+
+// Read-only mapping of a compiled data file.
+//
+// The file is mmapped MAP_SHARED, so every process on a host serving the
+// same version shares one copy in the page cache.  Nothing is parsed:
+// open() checks the header and directory bounds and hands out views.
+// With verify (the default) it also checksums the whole file and checks
+// id order, which reads every page once -- sequential and cheap next to
+// the I/O, but not free for a large file.  Without it, open() touches only
+// the header and directory, and afterwards only the pages lookups reach
+// are faulted in.
+class DataFile {
+ public:
+  // Throws std::system_error when the file cannot be opened or mapped and
+  // std::runtime_error when it is malformed.
+  static std::shared_ptr<const DataFile> open(const std::string& path, bool verify = true);
+  ~DataFile();
+
+  DataFile(const DataFile&) = delete;
+  DataFile& operator=(const DataFile&) = delete;
+
+  uint64_t version() const { return header().data_version; }
+  const std::string& path() const { return path_; }
+  size_t size_bytes() const { return size_; }
+  std::span<const DataTableEntry> tables() const {
+    return {reinterpret_cast<const DataTableEntry*>(base_ + sizeof(DataFileHeader)),
+            header().table_count};
+  }
+  const DataTableEntry* find_table(std::string_view name) const;
+
+  // Throws std::runtime_error when the table is missing or was compiled
+  // with another schema; resolve tables once per version, not per lookup.
+  template <typename Row>
+  DataTable<Row> table() const {
+    static_assert(std::is_trivially_copyable_v<Row>);
+    static_assert(alignof(Row) <= 16);
+    const DataTableEntry& t =
+        checked_table(Row::kTable, data_schema_hash(Row::kSchema), sizeof(Row));
+    return DataTable<Row>(reinterpret_cast<const uint64_t*>(base_ + t.ids_offset),
+                          reinterpret_cast<const Row*>(base_ + t.rows_offset), t.row_count,
+                          t.flags & DataTableEntry::kDenseIds);
+  }
+
+  // Empty for a slice outside the pool.
+  std::string_view str(DataString s) const {
+    const DataFileHeader& h = header();
+    if (uint64_t(s.offset) + s.length > h.strings_size) return {};
+    return {reinterpret_cast<const char*>(base_ + h.strings_offset + s.offset), s.length};
+  }
+
+ private:
+  DataFile(std::string path, const uint8_t* base, size_t size)
+      : path_(std::move(path)), base_(base), size_(size) {}
+
+  const DataFileHeader& header() const { return *reinterpret_cast<const DataFileHeader*>(base_); }
+  void validate(bool verify) const;
+  const DataTableEntry& checked_table(std::string_view name, uint32_t schema_hash,
+                                      size_t row_size) const;
+
+  std::string path_;
+  const uint8_t* base_;
+  size_t size_;
+};
+
+// Builds a data file in memory; used by the kbs_datac compiler and by
+// tests or tools that generate tables from code.
+class DataFileWriter {
+ public:
+  explicit DataFileWriter(uint64_t data_version) : version_(data_version) {}
+
+  // Deduplicated.
+  DataString intern(std::string_view s);
+
+  // rows holds ids.size() rows of row_size bytes, in any order.  Throws
+  // std::invalid_argument for duplicate ids or table names and names over
+  // 31 bytes.
+  void add_table(std::string_view name, std::string_view schema, size_t row_size,
+                 std::span<const uint64_t> ids, std::span<const uint8_t> rows);
+  template <typename Row, typename IdFn>
+  void add_table(std::span<const Row> rows, IdFn&& id_of) {
+    std::vector<uint64_t> ids;
+    ids.reserve(rows.size());
+    for (const Row& r : rows) ids.push_back(static_cast<uint64_t>(id_of(r)));
+    add_table(Row::kTable, Row::kSchema, sizeof(Row), ids,
+              {reinterpret_cast<const uint8_t*>(rows.data()), rows.size_bytes()});
+  }
+
+  std::string finish() const;
+  // Writes path.tmp and renames it over path, so readers opening path see
+  // either the old file or the complete new one.  Throws std::system_error.
+  void write(const std::string& path) const;
+
+ private:
+  struct Table {
+    std::string name;
+    uint32_t schema_hash;
+    uint32_t row_size;
+    std::vector<uint64_t> ids;  // sorted
+    std::string rows;           // in id order
+  };
+
+  uint64_t version_;
+  std::vector<Table> tables_;
+  std::string strings_;
+  std::vector<std::pair<std::string, DataString>> interned_;  // sorted by string
+};
+
+// The live data version of a process.  Logic takes a snapshot (typically
+// once per tick) and resolves its tables from it; reload() opens and
+// validates the new file off to the side, then swaps it in atomically.
+// The old mapping is unmapped when the last snapshot of it is released,
+// so a tick in progress never sees a half-switched data set.
+class GameData {
+ public:
+  // Throws like DataFile::open().  verify applies to every reload() too;
+  // it reads the whole file each time, so a process that trusts its data
+  // pipeline (or reloads often) can pass false.
+  explicit GameData(std::string path, bool verify = true);
+
+  std::shared_ptr<const DataFile> current() const {
+    return current_.load(std::memory_order_acquire);
+  }
+
+  // Re-opens path (or a new one) and publishes it; returns the new
+  // version.  On error the current version stays and the exception
+  // propagates.
+  uint64_t reload();
+  uint64_t reload(const std::string& path);
+
+ private:
+  bool verify_;
+  std::atomic<std::shared_ptr<const DataFile>> current_;
+};
+
+}  // namespace kbs
@@ -0,0 +1,33 @@
+#include "db/db_backend.h"
+
+namespace kbs {
+
+bool valid_table_name(std::string_view name) {
+  if (name.empty() || name.size() > 64) return false;
+  for (size_t i = 0; i < name.size(); ++i) {
+    const char c = name[i];
+    const bool alpha = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+    if (!alpha && !(i > 0 && c >= '0' && c <= '9')) return false;
+  }
+  return true;
+}
+
+std::string build_upsert_sql(std::string_view table, size_t rows, bool numbered_params) {
+  std::string sql;
+  sql.reserve(64 + table.size() + rows * 12);
+  sql += "INSERT INTO ";
+  sql += table;
+  sql += "(id,data) VALUES ";
+  for (size_t i = 0; i < rows; ++i) {
+    if (i > 0) sql += ',';
+    if (numbered_params) {
+      sql += "($" + std::to_string(2 * i + 1) + ",$" + std::to_string(2 * i + 2) + ")";
+    } else {
+      sql += "(?,?)";
+    }
+  }
+  sql += " ON CONFLICT(id) DO UPDATE SET data=excluded.data";
+  return sql;
+}
+
+}  // namespace kbs
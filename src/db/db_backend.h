@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+
+#include "common/types.h"
+
+namespace kbs {
+
+// One row of a key/blob table: the entity's serialized state.
+struct DbRow {
+  EntityId id = kInvalidEntityId;
+  std::string data;
+};
+
+// Storage driver used by WriteBehindCache.  Each flush thread owns its own
+// instance (and so its own connection); an instance is never shared between
+// threads.  Setup failures (cannot open, bad schema) throw
+// std::runtime_error; per-batch failures return false so the cache can
+// retry, with the reason in last_error().
+class DbBackend {
+ public:
+  virtual ~DbBackend() = default;
+
+  // Upserts every row in one transaction, preferably as multi-row
+  // statements (see build_upsert_sql()).
+  virtual bool write_batch(const std::string& table, std::span<const DbRow> rows) = 0;
+  // nullopt when the row does not exist or the read failed (check
+  // last_error()).
+  virtual std::optional<std::string> read(const std::string& table, EntityId id) = 0;
+
+  virtual const std::string& last_error() const = 0;
+};
+
+// Table names are spliced into SQL, so only [A-Za-z_][A-Za-z0-9_]* is
+// accepted.
+bool valid_table_name(std::string_view name);
+
+// "INSERT INTO t(id,data) VALUES (?,?),(?,?)... ON CONFLICT(id) DO UPDATE
+// SET data=excluded.data" for the given row count.  The upsert form is
+// shared by SQLite (3.24+) and PostgreSQL; with numbered_params the
+// placeholders are $1, $2, ... for libpq.
+std::string build_upsert_sql(std::string_view table, size_t rows, bool numbered_params = false);
+
+}  // namespace kbs
@@ -0,0 +1,121 @@
+#include "db/sqlite_backend.h"
+
+#include <sqlite3.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace kbs {
+
+SqliteBackend::SqliteBackend(const std::string& path) {
+  if (sqlite3_open_v2(path.c_str(), &db_,
+                      SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_NOMUTEX,
+                      nullptr) != SQLITE_OK) {
+    std::string msg = "sqlite open " + path + ": " + (db_ ? sqlite3_errmsg(db_) : "out of memory");
+    sqlite3_close(db_);
+    throw std::runtime_error(msg);
+  }
+  sqlite3_busy_timeout(db_, 5000);
+  exec("PRAGMA journal_mode=WAL");
+  exec("PRAGMA synchronous=NORMAL");
+}
+
+SqliteBackend::~SqliteBackend() {
+  for (auto& [key, stmt] : statements_) sqlite3_finalize(stmt);
+  sqlite3_close(db_);
+}
+
+bool SqliteBackend::fail(const char* what) {
+  error_ = std::string(what) + ": " + sqlite3_errmsg(db_);
+  return false;
+}
+
+bool SqliteBackend::exec(const std::string& sql) {
+  char* err = nullptr;
+  if (sqlite3_exec(db_, sql.c_str(), nullptr, nullptr, &err) != SQLITE_OK) {
+    error_ = err ? err : "sqlite3_exec failed";
+    sqlite3_free(err);
+    return false;
+  }
+  return true;
+}
+
+bool SqliteBackend::ensure_table(const std::string& table) {
+  if (tables_.count(table)) return true;
+  if (!valid_table_name(table)) {
+    error_ = "invalid table name: " + table;
+    return false;
+  }
+  if (!exec("CREATE TABLE IF NOT EXISTS " + table + "(id INTEGER PRIMARY KEY, data BLOB)")) {
+    return false;
+  }
+  tables_.insert(table);
+  return true;
+}
+
+sqlite3_stmt* SqliteBackend::prepare(const std::string& key, const std::string& sql) {
+  auto it = statements_.find(key);
+  if (it != statements_.end()) return it->second;
+  sqlite3_stmt* stmt = nullptr;
+  if (sqlite3_prepare_v3(db_, sql.data(), static_cast<int>(sql.size()), SQLITE_PREPARE_PERSISTENT,
+                         &stmt, nullptr) != SQLITE_OK) {
+    fail("prepare");
+    return nullptr;
+  }
+  statements_.emplace(key, stmt);
+  return stmt;
+}
+
+bool SqliteBackend::write_batch(const std::string& table, std::span<const DbRow> rows) {
+  if (rows.empty()) return true;
+  if (!ensure_table(table)) return false;
+  if (!exec("BEGIN IMMEDIATE")) return false;
+  for (size_t begin = 0; begin < rows.size(); begin += kRowsPerStatement) {
+    const size_t n = std::min(kRowsPerStatement, rows.size() - begin);
+    sqlite3_stmt* stmt =
+        prepare(table + '#' + std::to_string(n), build_upsert_sql(table, n));
+    if (!stmt) {
+      exec("ROLLBACK");
+      return false;
+    }
+    for (size_t i = 0; i < n; ++i) {
+      const DbRow& row = rows[begin + i];
+      const int col = static_cast<int>(2 * i + 1);
+      sqlite3_bind_int64(stmt, col, static_cast<sqlite3_int64>(row.id));
+      sqlite3_bind_blob64(stmt, col + 1, row.data.data(), row.data.size(), SQLITE_STATIC);
+    }
+    const int rc = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+    if (rc != SQLITE_DONE) {
+      fail("upsert");
+      exec("ROLLBACK");
+      return false;
+    }
+  }
+  if (!exec("COMMIT")) {
+    exec("ROLLBACK");
+    return false;
+  }
+  return true;
+}
+
+std::optional<std::string> SqliteBackend::read(const std::string& table, EntityId id) {
+  if (!ensure_table(table)) return std::nullopt;
+  sqlite3_stmt* stmt = prepare(table + "#read", "SELECT data FROM " + table + " WHERE id=?");
+  if (!stmt) return std::nullopt;
+  sqlite3_bind_int64(stmt, 1, static_cast<sqlite3_int64>(id));
+  std::optional<std::string> out;
+  const int rc = sqlite3_step(stmt);
+  if (rc == SQLITE_ROW) {
+    const void* blob = sqlite3_column_blob(stmt, 0);
+    const int len = sqlite3_column_bytes(stmt, 0);
+    out.emplace(static_cast<const char*>(blob), static_cast<size_t>(len));
+  } else if (rc != SQLITE_DONE) {
+    fail("select");
+  }
+  sqlite3_reset(stmt);
+  return out;
+}
+
+}  // namespace kbs
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "db/db_backend.h"
+
+struct sqlite3;
+struct sqlite3_stmt;
+
+namespace kbs {
+
+// SQLite driver.  Tables are created on first use as
+// (id INTEGER PRIMARY KEY, data BLOB).  The database runs in WAL mode so a
+// reader does not stall the flush threads; several backends may open the
+// same file, with SQLite's busy timeout serialising their commits.
+class SqliteBackend final : public DbBackend {
+ public:
+  // Rows bound per INSERT; a batch larger than this becomes several
+  // statements inside one transaction.
+  static constexpr size_t kRowsPerStatement = 256;
+
+  // Throws std::runtime_error when the file cannot be opened.
+  explicit SqliteBackend(const std::string& path);
+  ~SqliteBackend() override;
+
+  SqliteBackend(const SqliteBackend&) = delete;
+  SqliteBackend& operator=(const SqliteBackend&) = delete;
+
+  bool write_batch(const std::string& table, std::span<const DbRow> rows) override;
+  std::optional<std::string> read(const std::string& table, EntityId id) override;
+  const std::string& last_error() const override { return error_; }
+
+ private:
+  bool exec(const std::string& sql);
+  bool ensure_table(const std::string& table);
+  // Prepared statements are cached per (table, row count).
+  sqlite3_stmt* prepare(const std::string& key, const std::string& sql);
+  bool fail(const char* what);
+
+  sqlite3* db_ = nullptr;
+  std::unordered_map<std::string, sqlite3_stmt*> statements_;
+  std::unordered_set<std::string> tables_;
+  std::string error_;
+};
+
+}  // namespace kbs
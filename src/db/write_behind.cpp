@@ -0,0 +1,205 @@
+#include "db/write_behind.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "metrics/profiler.h"
+
+namespace kbs {
+
+WriteBehindCache::WriteBehindCache(BackendFactory make_backend, const WriteBehindOptions& options)
+    : options_(options) {
+  const size_t n = std::max<size_t>(options_.num_threads, 1);
+  for (size_t i = 0; i < n; ++i) {
+    auto s = std::make_unique<Shard>();
+    s->backend = make_backend();
+    shards_.push_back(std::move(s));
+  }
+  for (size_t i = 0; i < n; ++i) {
+    Shard* sp = shards_[i].get();
+    sp->thread = std::thread([this, i, sp] {
+      place_current_thread(options_.placement, i);
+      run(*sp);
+    });
+  }
+  pending_gauge_ = metrics().add_callback_gauge(
+      "kbs_db_pending_rows", "Dirty rows waiting for a write-behind flush",
+      [this] { return static_cast<double>(stats().pending); });
+}
+
+WriteBehindCache::~WriteBehindCache() {
+  metrics().remove_callback_gauge(pending_gauge_);
+  for (auto& s : shards_) {
+    std::lock_guard<std::mutex> lock(s->mutex);
+    s->stop = true;
+    s->wake.notify_one();
+  }
+  for (auto& s : shards_) s->thread.join();
+}
+
+TableId WriteBehindCache::register_table(std::string name) {
+  if (!valid_table_name(name)) throw std::invalid_argument("invalid table name: " + name);
+  auto it = std::find(tables_.begin(), tables_.end(), name);
+  if (it != tables_.end()) return static_cast<TableId>(it - tables_.begin());
+  tables_.push_back(std::move(name));
+  return static_cast<TableId>(tables_.size() - 1);
+}
+
+void WriteBehindCache::save(TableId table, EntityId id, std::string data) {
+  KBS_PROFILE_SCOPE(kDb);
+  const Key key{table, id};
+  Shard& s = shard_for(key);
+  std::string old;  // freed outside the lock
+  bool notify = false;
+  {
+    std::lock_guard<std::mutex> lock(s.mutex);
+    auto [it, inserted] = s.dirty.try_emplace(key);
+    if (!inserted) {
+      old = std::move(it->second);
+      coalesced_.fetch_add(1, std::memory_order_relaxed);
+    }
+    it->second = std::move(data);
+    notify = inserted && s.dirty.size() == options_.batch_rows;
+  }
+  saves_.fetch_add(1, std::memory_order_relaxed);
+  if (notify) s.wake.notify_one();
+}
+
+void WriteBehindCache::load(TableId table, EntityId id, LoadCallback done) {
+  const Key key{table, id};
+  Shard& s = shard_for(key);
+  std::optional<std::string> cached;
+  {
+    std::lock_guard<std::mutex> lock(s.mutex);
+    auto it = s.dirty.find(key);
+    if (it != s.dirty.end()) {
+      cached = it->second;
+    } else {
+      s.loads.push_back({key, std::move(done)});
+    }
+  }
+  if (cached) {
+    done(std::move(cached));
+  } else {
+    s.wake.notify_one();
+  }
+}
+
+size_t WriteBehindCache::flush() {
+  std::vector<uint64_t> targets;
+  for (auto& s : shards_) {
+    std::lock_guard<std::mutex> lock(s->mutex);
+    targets.push_back(++s->flush_requested);
+    s->wake.notify_one();
+  }
+  size_t pending = 0;
+  for (size_t i = 0; i < shards_.size(); ++i) {
+    Shard& s = *shards_[i];
+    std::unique_lock<std::mutex> lock(s.mutex);
+    s.flushed.wait(lock, [&] { return s.flush_completed >= targets[i]; });
+    pending += s.dirty.size();
+  }
+  return pending;
+}
+
+WriteBehindStats WriteBehindCache::stats() const {
+  WriteBehindStats st;
+  st.saves = saves_.load(std::memory_order_relaxed);
+  st.coalesced = coalesced_.load(std::memory_order_relaxed);
+  st.rows_written = rows_written_.load(std::memory_order_relaxed);
+  st.batches = batches_.load(std::memory_order_relaxed);
+  st.failures = failures_.load(std::memory_order_relaxed);
+  st.dropped = dropped_.load(std::memory_order_relaxed);
+  for (const auto& s : shards_) {
+    std::lock_guard<std::mutex> lock(s->mutex);
+    st.pending += s->dirty.size();
+  }
+  return st;
+}
+
+bool WriteBehindCache::write(Shard& s, DirtyMap& batch) {
+  // Group by table so each table becomes one multi-row upsert batch.
+  std::vector<std::vector<DbRow>> by_table(tables_.size());
+  for (auto& [key, data] : batch) by_table[key.table].push_back({key.id, std::move(data)});
+  batch.clear();
+
+  bool ok = true;
+  for (size_t t = 0; t < by_table.size(); ++t) {
+    std::vector<DbRow>& rows = by_table[t];
+    if (rows.empty()) continue;
+    if (s.backend->write_batch(tables_[t], rows)) {
+      rows_written_.fetch_add(rows.size(), std::memory_order_relaxed);
+      batches_.fetch_add(1, std::memory_order_relaxed);
+      continue;
+    }
+    ok = false;
+    failures_.fetch_add(1, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(s.mutex);
+    for (DbRow& row : rows) {
+      // A save that arrived after the swap is newer; keep it.
+      s.dirty.try_emplace(Key{static_cast<TableId>(t), row.id}, std::move(row.data));
+    }
+  }
+  return ok;
+}
+
+void WriteBehindCache::run(Shard& s) {
+  using Clock = std::chrono::steady_clock;
+  uint32_t shutdown_failures = 0;
+  Clock::time_point next_flush = Clock::now() + options_.flush_interval;
+  std::unique_lock<std::mutex> lock(s.mutex);
+  for (;;) {
+    s.wake.wait_until(lock, next_flush, [&] {
+      return s.stop || !s.loads.empty() || s.flush_requested != s.flush_completed ||
+             s.dirty.size() >= options_.batch_rows;
+    });
+    const bool due = Clock::now() >= next_flush || s.stop ||
+                     s.flush_requested != s.flush_completed ||
+                     s.dirty.size() >= options_.batch_rows;
+    DirtyMap batch;
+    if (due) batch.swap(s.dirty);
+    std::vector<LoadRequest> loads;
+    loads.swap(s.loads);
+    const uint64_t requested = s.flush_requested;
+    const bool stopping = s.stop;
+    lock.unlock();
+
+    bool ok = true;
+    {
+      KBS_PROFILE_SCOPE(kDb);
+      if (!batch.empty()) ok = write(s, batch);
+      // After the batch, so a load sees every save that preceded it.  Rows
+      // of a failed batch are back in the dirty map and are served from
+      // there.
+      for (LoadRequest& r : loads) {
+        std::optional<std::string> row;
+        {
+          std::lock_guard<std::mutex> relock(s.mutex);
+          auto it = s.dirty.find(r.key);
+          if (it != s.dirty.end()) row = it->second;
+        }
+        if (!row) row = s.backend->read(tables_[r.key.table], r.key.id);
+        r.done(std::move(row));
+      }
+    }
+
+    lock.lock();
+    if (due) {
+      s.flush_completed = requested;
+      s.flushed.notify_all();
+      next_flush = Clock::now() + (ok ? options_.flush_interval : options_.retry_delay);
+    }
+    if (stopping) {
+      if (!ok) ++shutdown_failures;
+      if (s.dirty.empty() && s.loads.empty()) break;
+      if (shutdown_failures > options_.shutdown_retries) {
+        dropped_.fetch_add(s.dirty.size(), std::memory_order_relaxed);
+        s.dirty.clear();
+        break;
+      }
+      if (!ok) s.wake.wait_for(lock, options_.retry_delay);
+    }
+  }
+}
+
+}  // namespace kbs
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "common/thread_placement.h"
+#include "common/types.h"
+#include "db/db_backend.h"
+#include "metrics/metrics.h"
+
+namespace kbs {
+
+using TableId = uint16_t;
+
+struct WriteBehindOptions {
+  // Flush threads, each with its own backend connection.
+  size_t num_threads = 2;
+  ThreadPlacement placement;
+  // How long a save may sit in the cache before it is written.
+  std::chrono::milliseconds flush_interval{500};
+  // A thread flushes early once this many distinct rows are dirty.
+  size_t batch_rows = 512;
+  // Wait before retrying after a failed batch.
+  std::chrono::milliseconds retry_delay{1000};
+  // Failed attempts tolerated per flush during shutdown before the
+  // remaining rows are dropped (and counted in stats().dropped).
+  uint32_t shutdown_retries = 3;
+};
+
+struct WriteBehindStats {
+  uint64_t saves = 0;
+  uint64_t coalesced = 0;  // saves that replaced a not yet written one
+  uint64_t rows_written = 0;
+  uint64_t batches = 0;
+  uint64_t failures = 0;  // failed batches (their rows are retried)
+  uint64_t dropped = 0;   // rows given up on at shutdown
+  size_t pending = 0;
+};
+
+// Write-behind cache in front of a DbBackend.
+//
+// save() only records the latest blob for (table, id) in memory and
+// returns; repeated saves of one entity before the next flush collapse into
+// a single row.  Keys are hashed onto a fixed flush thread, which wakes
+// every flush_interval (or once batch_rows rows are dirty), swaps its dirty
+// map out under a short lock and upserts it table by table as multi-row
+// statements.  Because an entity always lands on the same thread, its
+// writes reach the database in save order.  Failed batches are merged back
+// unless a newer save has arrived meanwhile.
+//
+// Logic threads never wait on SQL: save() and load() take only the owning
+// shard's map lock, which the flush thread holds just long enough to swap
+// or merge maps.  flush() and the destructor do block, so call them from a
+// shutdown or admin path, never from a tick.
+class WriteBehindCache {
+ public:
+  using BackendFactory = std::function<std::unique_ptr<DbBackend>()>;
+  using LoadCallback = std::function<void(std::optional<std::string>)>;
+
+  // make_backend runs once per flush thread, on the constructing thread,
+  // so connection errors surface here as exceptions.
+  WriteBehindCache(BackendFactory make_backend, const WriteBehindOptions& options = {});
+  // Flushes everything still pending, then joins the threads.
+  ~WriteBehindCache();
+
+  WriteBehindCache(const WriteBehindCache&) = delete;
+  WriteBehindCache& operator=(const WriteBehindCache&) = delete;
+
+  // Register every table before the first save() or load(); throws
+  // std::invalid_argument for names that valid_table_name() rejects.
+  TableId register_table(std::string name);
+
+  // Thread-safe, non-blocking.  data is the entity's full serialized state.
+  void save(TableId table, EntityId id, std::string data);
+
+  // Thread-safe, non-blocking.  done runs on a flush thread (post it back
+  // to the caller's loop), or inline when the row is still dirty in the
+  // cache.  Reads are ordered after every earlier save of the same key.
+  void load(TableId table, EntityId id, LoadCallback done);
+
+  // Writes everything saved before the call and waits for it.  Returns the
+  // number of rows still pending because their batch failed.
+  size_t flush();
+
+  WriteBehindStats stats() const;
+
+ private:
+  struct Key {
+    TableId table;
+    EntityId id;
+    bool operator==(const Key&) const = default;
+  };
+  struct KeyHash {
+    size_t operator()(const Key& k) const {
+      return std::hash<uint64_t>()(k.id * 0x9E3779B97F4A7C15ull ^ k.table);
+    }
+  };
+  using DirtyMap = std::unordered_map<Key, std::string, KeyHash>;
+
+  struct LoadRequest {
+    Key key;
+    LoadCallback done;
+  };
+
+  struct Shard {
+    std::unique_ptr<DbBackend> backend;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable flushed;
+    DirtyMap dirty;
+    std::vector<LoadRequest> loads;
+    uint64_t flush_requested = 0;
+    uint64_t flush_completed = 0;
+    bool stop = false;
+    std::thread thread;
+  };
+
+  Shard& shard_for(const Key& key) { return *shards_[KeyHash()(key) % shards_.size()]; }
+  void run(Shard& s);
+  // Writes batch; failed rows are moved back into s.dirty unless superseded.
+  bool write(Shard& s, DirtyMap& batch);
+
+  WriteBehindOptions options_;
+  std::vector<std::string> tables_;
+  std::vector<std::unique_ptr<Shard>> shards_;
+
+  std::atomic<uint64_t> saves_{0};
+  std::atomic<uint64_t> coalesced_{0};
+  std::atomic<uint64_t> rows_written_{0};
+  std::atomic<uint64_t> batches_{0};
+  std::atomic<uint64_t> failures_{0};
+  std::atomic<uint64_t> dropped_{0};
+  CallbackGaugeId pending_gauge_ = 0;  // kbs_db_pending_rows
+};
+
+}  // namespace kbs
@@ -0,0 +1,136 @@
+#include "entity/archetype.h"
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+
+namespace kbs {
+
+namespace {
+
+constexpr std::align_val_t kChunkAlign{64};
+
+size_t align_up(size_t v, size_t a) { return (v + a - 1) & ~(a - 1); }
+
+// Layout of one chunk for a given capacity; returns the total bytes used.
+size_t layout(uint32_t capacity, const std::vector<size_t>& sizes,
+              const std::vector<const ComponentInfo*>& infos, std::vector<size_t>& offsets) {
+  size_t off = sizeof(EntityId) * capacity;
+  offsets.resize(sizes.size());
+  for (size_t i = 0; i < sizes.size(); ++i) {
+    off = align_up(off, std::max<size_t>(infos[i]->align, 1));
+    offsets[i] = off;
+    off += sizes[i] * capacity;
+  }
+  return off;
+}
+
+struct Registry {
+  std::mutex mutex;
+  std::vector<ComponentInfo> infos;
+};
+
+Registry& registry() {
+  static Registry r;
+  return r;
+}
+
+}  // namespace
+
+namespace detail {
+
+ComponentId register_component(const ComponentInfo& info) {
+  Registry& r = registry();
+  std::lock_guard<std::mutex> lock(r.mutex);
+  if (r.infos.size() >= kMaxComponents) throw std::length_error("too many component types");
+  // Reserve up front so references handed out by component_info() stay
+  // valid while other threads register new types.
+  if (r.infos.capacity() < kMaxComponents) r.infos.reserve(kMaxComponents);
+  r.infos.push_back(info);
+  return static_cast<ComponentId>(r.infos.size() - 1);
+}
+
+}  // namespace detail
+
+const ComponentInfo& component_info(ComponentId id) { return registry().infos[id]; }
+
+Archetype::Archetype(const ComponentMask& mask, std::vector<ComponentId> components)
+    : mask_(mask), components_(std::move(components)) {
+  std::sort(components_.begin(), components_.end());
+  column_index_.fill(kNoColumn);
+  for (size_t i = 0; i < components_.size(); ++i) {
+    const ComponentInfo& info = component_info(components_[i]);
+    infos_.push_back(&info);
+    sizes_.push_back(info.size);
+    column_index_[components_[i]] = static_cast<int16_t>(i);
+  }
+  size_t row_bytes = sizeof(EntityId);
+  for (size_t s : sizes_) row_bytes += s;
+  capacity_ = static_cast<uint32_t>(std::max<size_t>(1, kChunkBytes / row_bytes));
+  while (capacity_ > 1 && layout(capacity_, sizes_, infos_, offsets_) > kChunkBytes) --capacity_;
+  chunk_bytes_ = std::max(kChunkBytes, layout(capacity_, sizes_, infos_, offsets_));
+}
+
+Archetype::~Archetype() {
+  for (Chunk& c : chunks_) {
+    for (size_t col = 0; col < infos_.size(); ++col) {
+      if (infos_[col]->trivial) continue;
+      for (uint32_t row = 0; row < c.count; ++row) {
+        infos_[col]->destroy(static_cast<std::byte*>(column_data(c, static_cast<int>(col))) +
+                             row * sizes_[col]);
+      }
+    }
+    ::operator delete(c.mem, kChunkAlign);
+  }
+}
+
+Archetype::Location Archetype::allocate(EntityId id) {
+  if (chunks_.empty() || chunks_.back().count == capacity_) {
+    chunks_.push_back(
+        Chunk{static_cast<std::byte*>(::operator new(chunk_bytes_, kChunkAlign)), 0});
+  }
+  Chunk& c = chunks_.back();
+  const Location loc{static_cast<uint32_t>(chunks_.size() - 1), c.count++};
+  ids(c)[loc.row] = id;
+  ++size_;
+  return loc;
+}
+
+EntityId Archetype::release(Location loc, bool components_moved_out) {
+  Chunk& last_chunk = chunks_.back();
+  const Location last{static_cast<uint32_t>(chunks_.size() - 1), last_chunk.count - 1};
+  const bool is_last = loc.chunk == last.chunk && loc.row == last.row;
+
+  for (size_t col = 0; col < infos_.size(); ++col) {
+    const int c = static_cast<int>(col);
+    void* hole = component(loc, c);
+    const ComponentInfo* info = infos_[col];
+    if (!components_moved_out && !info->trivial) info->destroy(hole);
+    if (is_last) continue;
+    void* src = component(last, c);
+    if (info->trivial) {
+      std::memcpy(hole, src, sizes_[col]);
+    } else {
+      info->move_construct(hole, src);
+    }
+  }
+
+  EntityId moved = kInvalidEntityId;
+  if (!is_last) {
+    moved = ids(last_chunk)[last.row];
+    ids(chunks_[loc.chunk])[loc.row] = moved;
+  }
+  --last_chunk.count;
+  --size_;
+  // Keep the first chunk around so an archetype that oscillates between
+  // zero and one entity does not hit the allocator every time.
+  if (last_chunk.count == 0 && chunks_.size() > 1) {
+    ::operator delete(last_chunk.mem, kChunkAlign);
+    chunks_.pop_back();
+  }
+  return moved;
+}
+
+}  // namespace kbs
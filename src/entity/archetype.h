@@ -0,0 +1,81 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "common/types.h"
+#include "entity/component.h"
+
+namespace kbs {
+
+// Storage for every entity that has exactly one set of components.
+//
+// Entities live in fixed-size chunks; inside a chunk each component type is
+// one contiguous column (structure of arrays), preceded by the column of
+// entity ids.  All chunks except the last are full: removal moves the
+// archetype's last row into the hole, so systems always iterate dense
+// memory.
+class Archetype {
+ public:
+  static constexpr size_t kChunkBytes = 16 * 1024;
+  static constexpr int kNoColumn = -1;
+
+  struct Chunk {
+    std::byte* mem = nullptr;
+    uint32_t count = 0;
+  };
+
+  struct Location {
+    uint32_t chunk;
+    uint32_t row;
+  };
+
+  Archetype(const ComponentMask& mask, std::vector<ComponentId> components);
+  ~Archetype();
+
+  Archetype(const Archetype&) = delete;
+  Archetype& operator=(const Archetype&) = delete;
+
+  const ComponentMask& mask() const { return mask_; }
+  const std::vector<ComponentId>& components() const { return components_; }
+  int column_of(ComponentId id) const { return column_index_[id]; }
+  uint32_t chunk_capacity() const { return capacity_; }
+  size_t size() const { return size_; }
+  std::vector<Chunk>& chunks() { return chunks_; }
+
+  EntityId* ids(const Chunk& c) const { return reinterpret_cast<EntityId*>(c.mem); }
+  void* column_data(const Chunk& c, int column) const { return c.mem + offsets_[column]; }
+  void* component(Location loc, int column) const {
+    return static_cast<std::byte*>(column_data(chunks_[loc.chunk], column)) +
+           static_cast<size_t>(loc.row) * sizes_[column];
+  }
+
+  // Reserves a row for id; component storage is left unconstructed.
+  Location allocate(EntityId id);
+
+  // Frees loc, relocating the archetype's last row into it.  Components at
+  // loc are destroyed unless they were already moved out.  Returns the id of
+  // the entity that was relocated (kInvalidEntityId if none).
+  EntityId release(Location loc, bool components_moved_out);
+
+  // Transition cache: archetype reached by adding / removing one component.
+  std::unordered_map<ComponentId, Archetype*> add_edges;
+  std::unordered_map<ComponentId, Archetype*> remove_edges;
+
+ private:
+  ComponentMask mask_;
+  std::vector<ComponentId> components_;
+  std::vector<const ComponentInfo*> infos_;
+  std::vector<size_t> sizes_;
+  std::vector<size_t> offsets_;
+  std::array<int16_t, kMaxComponents> column_index_;
+  uint32_t capacity_ = 0;
+  size_t chunk_bytes_ = 0;
+  size_t size_ = 0;
+  std::vector<Chunk> chunks_;
+};
+
+}  // namespace kbs
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <typeinfo>
+#include <utility>
+
+namespace kbs {
+
+using ComponentId = uint16_t;
+constexpr size_t kMaxComponents = 256;
+using ComponentMask = std::bitset<kMaxComponents>;
+
+// Type-erased operations an archetype needs to relocate and destroy a
+// component it only knows by size.
+struct ComponentInfo {
+  size_t size = 0;
+  size_t align = 0;
+  bool trivial = false;  // relocate with memcpy, skip destructor
+  void (*default_construct)(void* dst) = nullptr;
+  void (*move_construct)(void* dst, void* src) = nullptr;  // src is destroyed
+  void (*destroy)(void* p) = nullptr;
+  const char* name = nullptr;
+};
+
+namespace detail {
+
+ComponentId register_component(const ComponentInfo& info);
+
+template <typename T>
+ComponentInfo make_component_info() {
+  ComponentInfo info;
+  info.size = sizeof(T);
+  info.align = alignof(T);
+  info.trivial = std::is_trivially_copyable_v<T> && std::is_trivially_destructible_v<T>;
+  info.default_construct = [](void* dst) { new (dst) T(); };
+  info.move_construct = [](void* dst, void* src) {
+    new (dst) T(std::move(*static_cast<T*>(src)));
+    static_cast<T*>(src)->~T();
+  };
+  info.destroy = [](void* p) { static_cast<T*>(p)->~T(); };
+  info.name = typeid(T).name();
+  return info;
+}
+
+}  // namespace detail
+
+const ComponentInfo& component_info(ComponentId id);
+
+// Dense process-wide id for component type T, assigned on first use.
+template <typename T>
+ComponentId component_id() {
+  static_assert(std::is_nothrow_move_constructible_v<T>,
+                "components are relocated between chunks and must not throw on move");
+  static const ComponentId id = detail::register_component(detail::make_component_info<T>());
+  return id;
+}
+
+}  // namespace kbs
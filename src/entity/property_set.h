@@ -0,0 +1,227 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "entity/wire_codec.h"
+#include "net/message_buffer.h"
+
+namespace kbs {
+
+// Who a property is replicated to.  Encoders are handed a scope and only
+// emit properties that match it.
+enum PropertyScope : uint8_t {
+  kScopeOwnClient = 1u << 0,     // the controlling player only
+  kScopeOtherClients = 1u << 1,  // everyone who has the entity in AOI
+  kScopeAllClients = kScopeOwnClient | kScopeOtherClients,
+  kScopeServer = 1u << 2,  // persisted / migrated, never sent to clients
+};
+
+// Base for property tags.  Declare each property once as a distinct type:
+//
+//   struct Position : Property<Vec3> {};
+//   struct Hp : Property<int32_t> {};
+//   struct Gold : Property<uint64_t, kScopeOwnClient | kScopeServer> {};
+//   using AvatarProps = PropertySet<Position, Hp, Gold>;
+//
+// A property's wire id is its position in the PropertySet.
+template <typename T, uint8_t Scope = kScopeAllClients | kScopeServer>
+struct Property {
+  using value_type = T;
+  static constexpr uint8_t kScope = Scope;
+};
+
+namespace detail {
+
+template <typename P, typename... Ps>
+constexpr size_t property_index() {
+  constexpr bool matches[] = {std::is_same_v<P, Ps>...};
+  for (size_t i = 0; i < sizeof...(Ps); ++i) {
+    if (matches[i]) return i;
+  }
+  return sizeof...(Ps);
+}
+
+}  // namespace detail
+
+// Value storage, dirty tracking and a delta codec generated from a list of
+// property tags.
+//
+// Wire format of a delta: a little-endian field mask of kMaskBytes bytes,
+// then each present field's fixed-size encoding in ascending id order.
+// Sizes are compile-time constants and fields are dispatched through
+// function tables indexed by bit position, so encoding walks the set bits
+// of the mask once with no per-field branching or allocation.
+template <typename... Ps>
+class PropertySet {
+ public:
+  using Mask = uint64_t;
+  static constexpr size_t kCount = sizeof...(Ps);
+  static constexpr size_t kMaskBytes = (kCount + 7) / 8;
+  static constexpr Mask kAllMask = kCount == 64 ? ~Mask{0} : (Mask{1} << kCount) - 1;
+
+  static_assert(kCount > 0 && kCount <= 64, "PropertySet supports 1..64 properties");
+  static_assert((WireEncodable<typename Ps::value_type> && ...),
+                "every property type needs a WireCodec specialization");
+
+  template <typename P>
+  static constexpr size_t index_of = detail::property_index<P, Ps...>();
+
+  template <typename P>
+  static constexpr bool contains = index_of<P> < kCount;
+
+  template <typename P>
+    requires contains<P>
+  static constexpr Mask bit = Mask{1} << index_of<P>;
+
+  // Fields whose scope intersects scope.
+  static constexpr Mask scope_mask(uint8_t scope) {
+    constexpr uint8_t scopes[] = {Ps::kScope...};
+    Mask m = 0;
+    for (size_t i = 0; i < kCount; ++i) {
+      if (scopes[i] & scope) m |= Mask{1} << i;
+    }
+    return m;
+  }
+
+  static constexpr size_t kFieldSize[] = {WireCodec<typename Ps::value_type>::kSize...};
+  static constexpr size_t kMaxEncodedSize =
+      kMaskBytes + (WireCodec<typename Ps::value_type>::kSize + ...);
+
+  template <typename P>
+    requires contains<P>
+  const typename P::value_type& get() const {
+    return std::get<index_of<P>>(values_);
+  }
+
+  template <typename P>
+    requires contains<P>
+  void set(const typename P::value_type& v) {
+    std::get<index_of<P>>(values_) = v;
+    dirty_ |= bit<P>;
+  }
+
+  // Only marks dirty when the value actually changed; for properties that
+  // are assigned every tick but rarely change.
+  template <typename P>
+    requires contains<P>
+  bool set_if_changed(const typename P::value_type& v) {
+    auto& slot = std::get<index_of<P>>(values_);
+    if (slot == v) return false;
+    slot = v;
+    dirty_ |= bit<P>;
+    return true;
+  }
+
+  // In-place modification of a larger value (e.g. one inventory slot).
+  template <typename P>
+    requires contains<P>
+  typename P::value_type& mutate() {
+    dirty_ |= bit<P>;
+    return std::get<index_of<P>>(values_);
+  }
+
+  Mask dirty() const { return dirty_; }
+  void mark_dirty(Mask m) { dirty_ |= m & kAllMask; }
+  void clear_dirty(Mask m = kAllMask) { dirty_ &= ~m; }
+
+  static size_t encoded_size(Mask fields) {
+    size_t n = kMaskBytes;
+    for (Mask m = fields & kAllMask; m; m &= m - 1) n += kFieldSize[std::countr_zero(m)];
+    return n;
+  }
+
+  // Writes the given fields to out (encoded_size(fields) bytes); returns
+  // the number of bytes written.
+  size_t encode(Mask fields, char* out) const {
+    fields &= kAllMask;
+    char* p = out;
+    std::memcpy(p, &fields, kMaskBytes);
+    p += kMaskBytes;
+    for (Mask m = fields; m; m &= m - 1) {
+      const int i = std::countr_zero(m);
+      kEncoders[i](*this, p);
+      p += kFieldSize[i];
+    }
+    return static_cast<size_t>(p - out);
+  }
+
+  size_t encode(Mask fields, MessageBuffer& buf) const {
+    const size_t n = encoded_size(fields);
+    return encode(fields, buf.reserve(n));
+  }
+
+  // Dirty fields visible to scope.  Dirty bits are left set because one
+  // change is usually encoded for several audiences; call clear_dirty()
+  // once the tick's replication is done.
+  size_t encode_delta(MessageBuffer& buf, uint8_t scope = kScopeAllClients) const {
+    return encode(dirty_ & scope_mask(scope), buf);
+  }
+
+  // Every field visible to scope; used when an entity enters someone's AOI.
+  size_t encode_full(MessageBuffer& buf, uint8_t scope = kScopeAllClients) const {
+    return encode(scope_mask(scope), buf);
+  }
+
+  // Applies one delta from the front of in and advances it.  Returns false
+  // (leaving values untouched) for a truncated or malformed delta.
+  bool decode(std::string_view& in, Mask* applied = nullptr) {
+    if (in.size() < kMaskBytes) return false;
+    Mask fields = 0;
+    std::memcpy(&fields, in.data(), kMaskBytes);
+    if (fields & ~kAllMask) return false;
+    const size_t n = encoded_size(fields);
+    if (in.size() < n) return false;
+    const char* p = in.data() + kMaskBytes;
+    for (Mask m = fields; m; m &= m - 1) {
+      const int i = std::countr_zero(m);
+      kDecoders[i](*this, p);
+      p += kFieldSize[i];
+    }
+    in.remove_prefix(n);
+    if (applied) *applied = fields;
+    return true;
+  }
+
+ private:
+  using EncodeFn = void (*)(const PropertySet&, char*);
+  using DecodeFn = void (*)(PropertySet&, const char*);
+
+  template <size_t I>
+  static void encode_field(const PropertySet& s, char* out) {
+    using T = std::tuple_element_t<I, std::tuple<typename Ps::value_type...>>;
+    WireCodec<T>::encode(out, std::get<I>(s.values_));
+  }
+
+  template <size_t I>
+  static void decode_field(PropertySet& s, const char* in) {
+    using T = std::tuple_element_t<I, std::tuple<typename Ps::value_type...>>;
+    WireCodec<T>::decode(in, std::get<I>(s.values_));
+  }
+
+  template <size_t... I>
+  static constexpr std::array<EncodeFn, kCount> make_encoders(std::index_sequence<I...>) {
+    return {&encode_field<I>...};
+  }
+  template <size_t... I>
+  static constexpr std::array<DecodeFn, kCount> make_decoders(std::index_sequence<I...>) {
+    return {&decode_field<I>...};
+  }
+
+  static constexpr std::array<EncodeFn, kCount> kEncoders =
+      make_encoders(std::make_index_sequence<kCount>{});
+  static constexpr std::array<DecodeFn, kCount> kDecoders =
+      make_decoders(std::make_index_sequence<kCount>{});
+
+  std::tuple<typename Ps::value_type...> values_{};
+  Mask dirty_ = 0;
+};
+
+}  // namespace kbs
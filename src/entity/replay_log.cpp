@@ -0,0 +1,127 @@
+#include "entity/replay_log.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+
+#include "metrics/metrics.h"
+
+namespace kbs {
+
+namespace {
+
+constexpr size_t kRecordHeader = 20;
+
+uint32_t fnv1a32(const uint8_t* p, size_t n, uint32_t h = 2166136261u) {
+  for (size_t i = 0; i < n; ++i) {
+    h ^= p[i];
+    h *= 16777619u;
+  }
+  return h;
+}
+
+template <typename T>
+void put(std::string& out, T v) {
+  out.append(reinterpret_cast<const char*>(&v), sizeof(T));
+}
+
+template <typename T>
+T get(const uint8_t* p) {
+  T v;
+  std::memcpy(&v, p, sizeof(T));
+  return v;
+}
+
+Counter& log_bytes() {
+  static Counter& c =
+      metrics().counter("kbs_replay_log_bytes_total", "Bytes written to replay logs");
+  return c;
+}
+
+}  // namespace
+
+ReplayLog::ReplayLog(const std::string& path, bool truncate) : path_(path) {
+  const int flags = O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC | (truncate ? O_TRUNC : 0);
+  fd_ = ::open(path.c_str(), flags, 0644);
+  if (fd_ < 0) throw std::system_error(errno, std::generic_category(), "open " + path);
+  struct stat st;
+  if (::fstat(fd_, &st) == 0) written_ = static_cast<uint64_t>(st.st_size);
+}
+
+ReplayLog::~ReplayLog() {
+  flush(false);
+  ::close(fd_);
+}
+
+bool ReplayLog::append(uint64_t tick, uint16_t type, std::span<const uint8_t> payload) {
+  if (payload.size() > kMaxRecord) return false;
+  const size_t at = buffer_.size();
+  put<uint32_t>(buffer_, static_cast<uint32_t>(payload.size()));
+  put<uint16_t>(buffer_, type);
+  put<uint16_t>(buffer_, 0);
+  put<uint64_t>(buffer_, tick);
+  const auto* head = reinterpret_cast<const uint8_t*>(buffer_.data() + at);
+  const uint32_t sum = fnv1a32(payload.data(), payload.size(), fnv1a32(head, 16));
+  put<uint32_t>(buffer_, sum);
+  buffer_.append(reinterpret_cast<const char*>(payload.data()), payload.size());
+  return true;
+}
+
+bool ReplayLog::flush(bool sync) {
+  size_t done = 0;
+  while (done < buffer_.size()) {
+    const ssize_t n = ::write(fd_, buffer_.data() + done, buffer_.size() - done);
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0) {
+      buffer_.erase(0, done);
+      written_ += done;
+      return false;
+    }
+    done += static_cast<size_t>(n);
+  }
+  buffer_.clear();
+  written_ += done;
+  log_bytes().inc(done);
+  return !sync || ::fdatasync(fd_) == 0;
+}
+
+ReplayLog::ReadResult ReplayLog::read(const std::string& path, const RecordFn& fn) {
+  const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) throw std::system_error(errno, std::generic_category(), "open " + path);
+  std::string data;
+  char buf[1 << 16];
+  for (;;) {
+    const ssize_t n = ::read(fd, buf, sizeof(buf));
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0) {
+      const int saved = errno;
+      ::close(fd);
+      throw std::system_error(saved, std::generic_category(), "read " + path);
+    }
+    if (n == 0) break;
+    data.append(buf, static_cast<size_t>(n));
+  }
+  ::close(fd);
+
+  const auto* p = reinterpret_cast<const uint8_t*>(data.data());
+  size_t at = 0;
+  ReadResult result;
+  while (data.size() - at >= kRecordHeader) {
+    const uint32_t len = get<uint32_t>(p + at);
+    if (len > kMaxRecord || data.size() - at - kRecordHeader < len) break;
+    const uint32_t sum = fnv1a32(p + at + kRecordHeader, len, fnv1a32(p + at, 16));
+    if (sum != get<uint32_t>(p + at + 16)) break;
+    fn(get<uint64_t>(p + at + 8), get<uint16_t>(p + at + 4),
+       std::span<const uint8_t>(p + at + kRecordHeader, len));
+    at += kRecordHeader + len;
+    ++result.records;
+  }
+  result.trailing_bytes = data.size() - at;
+  return result;
+}
+
+}  // namespace kbs
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <string>
+
+namespace kbs {
+
+// Append-only journal of what changed a space since its last snapshot:
+// player commands, spawns, trades -- whatever the game needs to re-run
+// to get from the snapshot to the moment of a crash.
+//
+// Records are buffered in memory and written by flush(), once per tick,
+// so the cost on the tick is one write() and (with sync) one fdatasync()
+// rather than a syscall per record.  Each record carries its own
+// checksum; a crash mid-write leaves a torn tail that read() stops at.
+//
+//   u32 payload length | u16 type | u16 0 | u64 tick | u32 FNV-1a | payload
+class ReplayLog {
+ public:
+  using RecordFn = std::function<void(uint64_t tick, uint16_t type, std::span<const uint8_t>)>;
+
+  // Payload limit.  read() takes a larger length for a corrupt header.
+  static constexpr size_t kMaxRecord = 64u << 20;
+
+  struct ReadResult {
+    size_t records = 0;
+    // Bytes after the last intact record: a torn or corrupt tail.
+    size_t trailing_bytes = 0;
+
+    bool truncated() const { return trailing_bytes != 0; }
+  };
+
+  // Opens path for appending, or empties it first with truncate.  Throws
+  // std::system_error.
+  explicit ReplayLog(const std::string& path, bool truncate = false);
+  // Flushes without syncing.
+  ~ReplayLog();
+
+  ReplayLog(const ReplayLog&) = delete;
+  ReplayLog& operator=(const ReplayLog&) = delete;
+
+  // Buffers one record.  false, and nothing buffered, when payload is
+  // over kMaxRecord.
+  bool append(uint64_t tick, uint16_t type, std::span<const uint8_t> payload);
+
+  // Writes buffered records; with sync, also fdatasync()s.  false on an
+  // I/O error (records stay buffered for the next attempt).
+  bool flush(bool sync = true);
+
+  const std::string& path() const { return path_; }
+  // Bytes written to the file, plus buffered.
+  uint64_t size() const { return written_ + buffer_.size(); }
+
+  // Calls fn for each intact record of path in order; stops at the first
+  // torn or corrupt one and reports what it left unread.  Throws
+  // std::system_error when path cannot be read.
+  static ReadResult read(const std::string& path, const RecordFn& fn);
+
+ private:
+  std::string path_;
+  int fd_ = -1;
+  uint64_t written_ = 0;
+  std::string buffer_;
+};
+
+}  // namespace kbs
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+
+#include "common/vec3.h"
+
+namespace kbs {
+
+static_assert(std::endian::native == std::endian::little,
+              "wire format is little-endian and encoded by memcpy");
+
+// Fixed-size binary codec for one property type.  Every specialization
+// provides kSize (exact encoded bytes) plus encode/decode over raw memory;
+// sizes are compile-time constants so a delta's length is known before a
+// single byte is written.
+template <typename T>
+struct WireCodec;
+
+template <typename T>
+concept WireEncodable = requires(char* out, const char* in, T& v) {
+  { WireCodec<T>::kSize } -> std::convertible_to<size_t>;
+  WireCodec<T>::encode(out, v);
+  WireCodec<T>::decode(in, v);
+};
+
+// Codec for trivially copyable types whose in-memory layout is the wire
+// layout.
+template <typename T>
+struct RawWireCodec {
+  static_assert(std::is_trivially_copyable_v<T>);
+  static constexpr size_t kSize = sizeof(T);
+  static void encode(char* out, const T& v) { std::memcpy(out, &v, sizeof(T)); }
+  static void decode(const char* in, T& v) { std::memcpy(&v, in, sizeof(T)); }
+};
+
+template <typename T>
+  requires(std::is_arithmetic_v<T> || std::is_enum_v<T>)
+struct WireCodec<T> : RawWireCodec<T> {};
+
+template <>
+struct WireCodec<Vec3> : RawWireCodec<Vec3> {};
+
+template <WireEncodable T, size_t N>
+struct WireCodec<std::array<T, N>> {
+  static constexpr size_t kSize = WireCodec<T>::kSize * N;
+  static void encode(char* out, const std::array<T, N>& v) {
+    for (size_t i = 0; i < N; ++i) WireCodec<T>::encode(out + i * WireCodec<T>::kSize, v[i]);
+  }
+  static void decode(const char* in, std::array<T, N>& v) {
+    for (size_t i = 0; i < N; ++i) WireCodec<T>::decode(in + i * WireCodec<T>::kSize, v[i]);
+  }
+};
+
+}  // namespace kbs
+
+// Opts a trivially copyable struct with no padding into raw memcpy
+// encoding:
+//
+//   struct ItemSlot { uint32_t item_id; uint16_t count; uint16_t flags; };
+//   KBS_WIRE_POD(ItemSlot);
+#define KBS_WIRE_POD(Type) \
+  template <>              \
+  struct kbs::WireCodec<Type> : kbs::RawWireCodec<Type> {}
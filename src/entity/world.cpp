@@ -0,0 +1,115 @@
+#include "entity/world.h"
+
+#include <algorithm>
+
+namespace kbs {
+
+World::World() { root_ = archetype_for(ComponentMask{}); }
+
+// Archetypes destroy their remaining components.
+World::~World() = default;
+
+EntityId World::allocate_id() {
+  uint32_t index;
+  if (!free_.empty()) {
+    index = free_.back();
+    free_.pop_back();
+  } else {
+    index = static_cast<uint32_t>(records_.size());
+    records_.emplace_back();
+  }
+  ++live_;
+  return make_id(index, records_[index].generation);
+}
+
+EntityId World::create() {
+  const EntityId e = allocate_id();
+  Record& rec = records_[index_of(e)];
+  rec.archetype = root_;
+  rec.loc = root_->allocate(e);
+  return e;
+}
+
+const World::Record* World::record(EntityId e) const {
+  const uint32_t index = index_of(e);
+  if (index >= records_.size()) return nullptr;
+  const Record& rec = records_[index];
+  if (rec.archetype == nullptr || rec.generation != generation_of(e)) return nullptr;
+  return &rec;
+}
+
+bool World::alive(EntityId e) const { return record(e) != nullptr; }
+
+void World::destroy(EntityId e) {
+  Record* rec = record(e);
+  if (!rec) return;
+  const EntityId moved = rec->archetype->release(rec->loc, /*components_moved_out=*/false);
+  fix_moved(moved, rec->loc);
+  rec->archetype = nullptr;
+  // Skip generation 0 on wrap so ids are never kInvalidEntityId.
+  if (++rec->generation == 0) rec->generation = 1;
+  free_.push_back(index_of(e));
+  --live_;
+}
+
+void World::fix_moved(EntityId moved, Archetype::Location loc) {
+  if (moved != kInvalidEntityId) records_[index_of(moved)].loc = loc;
+}
+
+Archetype* World::archetype_for(const ComponentMask& mask) {
+  auto it = by_mask_.find(mask);
+  if (it != by_mask_.end()) return it->second;
+  std::vector<ComponentId> ids;
+  for (size_t i = 0; i < kMaxComponents; ++i) {
+    if (mask.test(i)) ids.push_back(static_cast<ComponentId>(i));
+  }
+  archetypes_.push_back(std::make_unique<Archetype>(mask, std::move(ids)));
+  Archetype* a = archetypes_.back().get();
+  by_mask_.emplace(mask, a);
+  return a;
+}
+
+Archetype* World::with_component(Archetype* from, ComponentId id) {
+  auto it = from->add_edges.find(id);
+  if (it != from->add_edges.end()) return it->second;
+  ComponentMask mask = from->mask();
+  mask.set(id);
+  Archetype* to = archetype_for(mask);
+  from->add_edges.emplace(id, to);
+  to->remove_edges.emplace(id, from);
+  return to;
+}
+
+Archetype* World::without_component(Archetype* from, ComponentId id) {
+  auto it = from->remove_edges.find(id);
+  if (it != from->remove_edges.end()) return it->second;
+  ComponentMask mask = from->mask();
+  mask.reset(id);
+  Archetype* to = archetype_for(mask);
+  from->remove_edges.emplace(id, to);
+  to->add_edges.emplace(id, from);
+  return to;
+}
+
+Archetype::Location World::relocate(EntityId e, Record& rec, Archetype* to) {
+  Archetype* from = rec.archetype;
+  const Archetype::Location old_loc = rec.loc;
+  const Archetype::Location new_loc = to->allocate(e);
+  for (ComponentId id : from->components()) {
+    void* src = from->component(old_loc, from->column_of(id));
+    const ComponentInfo& info = component_info(id);
+    const int dst_col = to->column_of(id);
+    if (dst_col == Archetype::kNoColumn) {
+      info.destroy(src);
+    } else {
+      info.move_construct(to->component(new_loc, dst_col), src);
+    }
+  }
+  const EntityId moved = from->release(old_loc, /*components_moved_out=*/true);
+  fix_moved(moved, old_loc);
+  rec.archetype = to;
+  rec.loc = new_loc;
+  return new_loc;
+}
+
+}  // namespace kbs
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "common/types.h"
+#include "entity/archetype.h"
+#include "entity/component.h"
+
+namespace kbs {
+
+// Archetype-based entity/component store.
+//
+// Entity ids pack a slot index (low 32 bits) with a generation (high 32
+// bits, never 0), so a destroyed entity's id never aliases its successor.
+// Structural changes (create/destroy/add/remove) must not happen inside
+// each()/each_chunk() over an archetype they affect.
+class World {
+ public:
+  World();
+  ~World();
+
+  World(const World&) = delete;
+  World& operator=(const World&) = delete;
+
+  EntityId create();
+
+  template <typename... Cs>
+  EntityId create(Cs&&... components);
+
+  void destroy(EntityId e);
+  bool alive(EntityId e) const;
+  size_t size() const { return live_; }
+
+  template <typename C>
+  void add(EntityId e, C&& component);
+
+  template <typename C>
+  void remove(EntityId e);
+
+  template <typename C>
+  bool has(EntityId e) const;
+
+  // nullptr when e is dead or lacks C.  Invalidated by structural changes.
+  template <typename C>
+  C* get(EntityId e);
+
+  // Calls fn(std::span<const EntityId>, std::span<Cs>...) once per chunk of
+  // every archetype that has all of Cs.  Spans are dense and parallel.
+  template <typename... Cs, typename F>
+  void each_chunk(F&& fn);
+
+  // Calls fn(Cs&...) for every entity that has all of Cs.
+  template <typename... Cs, typename F>
+  void each(F&& fn);
+
+  size_t archetype_count() const { return archetypes_.size(); }
+
+ private:
+  friend class WorldSnapshot;
+
+  struct Record {
+    Archetype* archetype = nullptr;
+    Archetype::Location loc{0, 0};
+    uint32_t generation = 1;
+  };
+
+  static uint32_t index_of(EntityId e) { return static_cast<uint32_t>(e); }
+  static uint32_t generation_of(EntityId e) { return static_cast<uint32_t>(e >> 32); }
+  static EntityId make_id(uint32_t index, uint32_t gen) {
+    return (static_cast<EntityId>(gen) << 32) | index;
+  }
+
+  const Record* record(EntityId e) const;
+  Record* record(EntityId e) { return const_cast<Record*>(std::as_const(*this).record(e)); }
+
+  EntityId allocate_id();
+  Archetype* archetype_for(const ComponentMask& mask);
+  Archetype* with_component(Archetype* from, ComponentId id);
+  Archetype* without_component(Archetype* from, ComponentId id);
+  // Moves e into `to`; columns absent from `to` are destroyed.  Returns the
+  // new location, leaving columns absent from `from` unconstructed.
+  Archetype::Location relocate(EntityId e, Record& rec, Archetype* to);
+  void fix_moved(EntityId moved, Archetype::Location loc);
+
+  template <typename... Cs, typename F, size_t... I>
+  static void invoke_chunk(F& fn, Archetype& a, const Archetype::Chunk& ch, const int* cols,
+                           std::index_sequence<I...>) {
+    fn(std::span<const EntityId>(a.ids(ch), ch.count),
+       std::span<Cs>(static_cast<Cs*>(a.column_data(ch, cols[I])), ch.count)...);
+  }
+
+  std::vector<Record> records_;
+  std::vector<uint32_t> free_;
+  size_t live_ = 0;
+  std::vector<std::unique_ptr<Archetype>> archetypes_;
+  std::unordered_map<ComponentMask, Archetype*> by_mask_;
+  Archetype* root_;
+};
+
+template <typename... Cs>
+EntityId World::create(Cs&&... components) {
+  ComponentMask mask;
+  (mask.set(component_id<std::decay_t<Cs>>()), ...);
+  Archetype* a = archetype_for(mask);
+  const EntityId e = allocate_id();
+  Record& rec = records_[index_of(e)];
+  rec.archetype = a;
+  rec.loc = a->allocate(e);
+  (new (a->component(rec.loc, a->column_of(component_id<std::decay_t<Cs>>())))
+       std::decay_t<Cs>(std::forward<Cs>(components)),
+   ...);
+  return e;
+}
+
+template <typename C>
+void World::add(EntityId e, C&& component) {
+  using T = std::decay_t<C>;
+  Record* rec = record(e);
+  if (!rec) return;
+  const ComponentId id = component_id<T>();
+  const int col = rec->archetype->column_of(id);
+  if (col != Archetype::kNoColumn) {
+    *static_cast<T*>(rec->archetype->component(rec->loc, col)) = std::forward<C>(component);
+    return;
+  }
+  Archetype* to = with_component(rec->archetype, id);
+  const Archetype::Location loc = relocate(e, *rec, to);
+  new (to->component(loc, to->column_of(id))) T(std::forward<C>(component));
+}
+
+template <typename C>
+void World::remove(EntityId e) {
+  Record* rec = record(e);
+  if (!rec) return;
+  const ComponentId id = component_id<C>();
+  if (rec->archetype->column_of(id) == Archetype::kNoColumn) return;
+  relocate(e, *rec, without_component(rec->archetype, id));
+}
+
+template <typename C>
+bool World::has(EntityId e) const {
+  const Record* rec = record(e);
+  return rec && rec->archetype->column_of(component_id<std::remove_const_t<C>>()) !=
+                    Archetype::kNoColumn;
+}
+
+template <typename C>
+C* World::get(EntityId e) {
+  Record* rec = record(e);
+  if (!rec) return nullptr;
+  const int col = rec->archetype->column_of(component_id<std::remove_const_t<C>>());
+  if (col == Archetype::kNoColumn) return nullptr;
+  return static_cast<C*>(rec->archetype->component(rec->loc, col));
+}
+
+template <typename... Cs, typename F>
+void World::each_chunk(F&& fn) {
+  static_assert(sizeof...(Cs) > 0, "each_chunk needs at least one component type");
+  const ComponentId ids[] = {component_id<std::remove_const_t<Cs>>()...};
+  ComponentMask need;
+  for (ComponentId id : ids) need.set(id);
+  for (auto& a : archetypes_) {
+    if ((a->mask() & need) != need || a->size() == 0) continue;
+    int cols[sizeof...(Cs)];
+    for (size_t i = 0; i < sizeof...(Cs); ++i) cols[i] = a->column_of(ids[i]);
+    for (const Archetype::Chunk& ch : a->chunks()) {
+      if (ch.count == 0) continue;
+      invoke_chunk<Cs...>(fn, *a, ch, cols, std::index_sequence_for<Cs...>{});
+    }
+  }
+}
+
+template <typename... Cs, typename F>
+void World::each(F&& fn) {
+  each_chunk<Cs...>([&fn](std::span<const EntityId> ids, std::span<Cs>... cols) {
+    for (size_t i = 0; i < ids.size(); ++i) fn(cols[i]...);
+  });
+}
+
+}  // namespace kbs
@@ -0,0 +1,586 @@
+#include "entity/world_snapshot.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <system_error>
+#include <vector>
+
+#include "common/atomic_file.h"
+#include "entity/world.h"
+#include "metrics/metrics.h"
+#include "metrics/trace.h"
+
+namespace kbs {
+
+namespace {
+
+constexpr uint32_t kMagic = 0x5353424b;  // "KBSS"
+constexpr uint32_t kFormatVersion = 1;
+
+struct SnapshotHeader {
+  uint32_t magic = kMagic;
+  uint32_t version = kFormatVersion;
+  uint64_t tick = 0;
+  uint64_t entities = 0;
+  uint64_t payload_bytes = 0;
+  uint64_t checksum = 0;  // FNV-1a 64 of the payload
+  uint64_t reserved = 0;
+};
+static_assert(sizeof(SnapshotHeader) == 48);
+
+struct SnapshotMetrics {
+  Histogram& capture_us = metrics().histogram("kbs_snapshot_capture_us",
+                                              "Tick-thread time to capture a world snapshot",
+                                              Histogram::exponential(50, 2, 16));
+  Histogram& write_us = metrics().histogram("kbs_snapshot_write_us",
+                                            "Writer-thread time to persist a snapshot",
+                                            Histogram::exponential(500, 2, 16));
+  Gauge& bytes = metrics().gauge("kbs_snapshot_bytes", "Size of the newest snapshot");
+};
+
+SnapshotMetrics& snapshot_metrics() {
+  static SnapshotMetrics m;
+  return m;
+}
+
+std::mutex& names_mutex() {
+  static std::mutex m;
+  return m;
+}
+
+std::array<std::string, kMaxComponents>& snapshot_names() {
+  static std::array<std::string, kMaxComponents> names;
+  return names;
+}
+
+uint64_t fnv1a64(const uint8_t* p, size_t n) {
+  uint64_t h = 14695981039346656037ull;
+  for (size_t i = 0; i < n; ++i) {
+    h ^= p[i];
+    h *= 1099511628211ull;
+  }
+  return h;
+}
+
+template <typename T>
+void put(std::string& out, T v) {
+  out.append(reinterpret_cast<const char*>(&v), sizeof(T));
+}
+
+void put_bytes(std::string& out, const void* p, size_t n) {
+  out.append(static_cast<const char*>(p), n);
+}
+
+[[noreturn]] void malformed(const std::string& path, const std::string& what) {
+  throw std::runtime_error("snapshot " + path + ": " + what);
+}
+
+// Bounds-checked reads over a loaded file.
+class Reader {
+ public:
+  Reader(const std::string& path, const uint8_t* p, size_t n) : path_(path), p_(p), n_(n) {}
+
+  template <typename T>
+  T get() {
+    T v;
+    std::memcpy(&v, take(sizeof(T)), sizeof(T));
+    return v;
+  }
+  const uint8_t* take(uint64_t n) {
+    if (n > n_ - at_) malformed(path_, "truncated");
+    const uint8_t* p = p_ + at_;
+    at_ += n;
+    return p;
+  }
+  bool done() const { return at_ == n_; }
+
+ private:
+  const std::string& path_;
+  const uint8_t* p_;
+  size_t n_;
+  size_t at_ = 0;
+};
+
+std::string read_file(const std::string& path) {
+  const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) throw std::system_error(errno, std::generic_category(), "open " + path);
+  std::string data;
+  char buf[1 << 16];
+  for (;;) {
+    const ssize_t n = ::read(fd, buf, sizeof(buf));
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0) {
+      const int saved = errno;
+      ::close(fd);
+      throw std::system_error(saved, std::generic_category(), "read " + path);
+    }
+    if (n == 0) break;
+    data.append(buf, static_cast<size_t>(n));
+  }
+  ::close(fd);
+  return data;
+}
+
+// Ticks of files named <prefix><tick><suffix> in dir, ascending.
+std::vector<uint64_t> list_ticks(const std::string& dir, std::string_view prefix,
+                                 std::string_view suffix) {
+  std::vector<uint64_t> ticks;
+  std::error_code ec;
+  for (const auto& entry : std::filesystem::directory_iterator(dir, ec)) {
+    const std::string name = entry.path().filename().string();
+    if (name.size() <= prefix.size() + suffix.size() || !name.starts_with(prefix) ||
+        !name.ends_with(suffix)) {
+      continue;
+    }
+    const std::string digits =
+        name.substr(prefix.size(), name.size() - prefix.size() - suffix.size());
+    if (digits.find_first_not_of("0123456789") != std::string::npos) continue;
+    ticks.push_back(std::stoull(digits));
+  }
+  std::sort(ticks.begin(), ticks.end());
+  return ticks;
+}
+
+}  // namespace
+
+namespace detail {
+
+void register_snapshot_component(ComponentId id, std::string_view name) {
+  std::lock_guard<std::mutex> lock(names_mutex());
+  auto& names = snapshot_names();
+  for (size_t i = 0; i < names.size(); ++i) {
+    if (i != id && names[i] == name) {
+      throw std::logic_error("snapshot component name '" + std::string(name) + "' reused");
+    }
+  }
+  names[id] = std::string(name);
+}
+
+}  // namespace detail
+
+WorldSnapshot WorldSnapshot::capture(const World& world, uint64_t tick) {
+  KBS_TRACE_SCOPE("snapshot.capture");
+  const uint64_t start = Tracer::now_ns();
+  std::array<std::string, kMaxComponents> names;
+  {
+    std::lock_guard<std::mutex> lock(names_mutex());
+    names = snapshot_names();
+  }
+
+  // Component table: registered components some archetype has.
+  std::array<uint32_t, kMaxComponents> table_index;
+  table_index.fill(UINT32_MAX);
+  std::vector<ComponentId> table;
+  for (const auto& a : world.archetypes_) {
+    if (a->size() == 0) continue;
+    for (ComponentId id : a->components()) {
+      if (names[id].empty() || table_index[id] != UINT32_MAX) continue;
+      table_index[id] = static_cast<uint32_t>(table.size());
+      table.push_back(id);
+    }
+  }
+
+  // One allocation: the copy is the only work the tick should pay for.
+  size_t estimate = sizeof(SnapshotHeader) + 16 + table.size() * 64 +
+                    (world.records_.size() + world.free_.size()) * sizeof(uint32_t);
+  for (const auto& a : world.archetypes_) {
+    size_t row = sizeof(EntityId);
+    for (ComponentId id : a->components()) {
+      if (table_index[id] != UINT32_MAX) row += component_info(id).size + sizeof(uint32_t);
+    }
+    estimate += 16 + a->size() * row;
+  }
+
+  WorldSnapshot snap;
+  snap.tick_ = tick;
+  snap.entities_ = world.size();
+  std::string& out = snap.bytes_;
+  out.reserve(estimate);
+  out.resize(sizeof(SnapshotHeader));
+  put<uint32_t>(out, static_cast<uint32_t>(table.size()));
+  for (ComponentId id : table) {
+    put<uint32_t>(out, static_cast<uint32_t>(names[id].size()));
+    put_bytes(out, names[id].data(), names[id].size());
+    put<uint32_t>(out, static_cast<uint32_t>(component_info(id).size));
+  }
+  put<uint32_t>(out, static_cast<uint32_t>(world.records_.size()));
+  for (const World::Record& rec : world.records_) put<uint32_t>(out, rec.generation);
+  put<uint32_t>(out, static_cast<uint32_t>(world.free_.size()));
+  put_bytes(out, world.free_.data(), world.free_.size() * sizeof(uint32_t));
+
+  uint32_t archetypes = 0;
+  for (const auto& a : world.archetypes_) archetypes += a->size() > 0;
+  put<uint32_t>(out, archetypes);
+  std::vector<int> columns;
+  std::vector<size_t> sizes;
+  for (const auto& a : world.archetypes_) {
+    if (a->size() == 0) continue;
+    columns.clear();
+    sizes.clear();
+    put<uint32_t>(out, 0);  // patched below
+    const size_t count_at = out.size() - sizeof(uint32_t);
+    for (ComponentId id : a->components()) {
+      if (table_index[id] == UINT32_MAX) continue;
+      put<uint32_t>(out, table_index[id]);
+      columns.push_back(a->column_of(id));
+      sizes.push_back(component_info(id).size);
+    }
+    const auto ncols = static_cast<uint32_t>(columns.size());
+    std::memcpy(out.data() + count_at, &ncols, sizeof(ncols));
+    put<uint64_t>(out, a->size());
+    for (const Archetype::Chunk& ch : a->chunks()) {
+      put_bytes(out, a->ids(ch), ch.count * sizeof(EntityId));
+    }
+    for (size_t c = 0; c < columns.size(); ++c) {
+      for (const Archetype::Chunk& ch : a->chunks()) {
+        put_bytes(out, a->column_data(ch, columns[c]), ch.count * sizes[c]);
+      }
+    }
+  }
+  snapshot_metrics().capture_us.observe(static_cast<double>(Tracer::now_ns() - start) / 1000);
+  return snap;
+}
+
+void WorldSnapshot::write(const std::string& path) {
+  SnapshotHeader h;
+  h.tick = tick_;
+  h.entities = entities_;
+  h.payload_bytes = bytes_.size() - sizeof(SnapshotHeader);
+  h.checksum = fnv1a64(reinterpret_cast<const uint8_t*>(bytes_.data()) + sizeof(SnapshotHeader),
+                       h.payload_bytes);
+  std::memcpy(bytes_.data(), &h, sizeof(h));
+
+  write_file_atomic(path, bytes_);
+}
+
+uint64_t WorldSnapshot::restore(World& world, const std::string& path) {
+  if (!world.records_.empty()) throw std::logic_error("restore needs an empty world");
+  KBS_TRACE_SCOPE("snapshot.restore");
+  const std::string data = read_file(path);
+  if (data.size() < sizeof(SnapshotHeader)) malformed(path, "truncated header");
+  SnapshotHeader h;
+  std::memcpy(&h, data.data(), sizeof(h));
+  if (h.magic != kMagic) malformed(path, "bad magic");
+  if (h.version != kFormatVersion) malformed(path, "unsupported version");
+  const auto* payload = reinterpret_cast<const uint8_t*>(data.data()) + sizeof(SnapshotHeader);
+  if (h.payload_bytes != data.size() - sizeof(SnapshotHeader)) malformed(path, "size mismatch");
+  if (fnv1a64(payload, h.payload_bytes) != h.checksum) malformed(path, "checksum mismatch");
+
+  std::array<std::string, kMaxComponents> names;
+  {
+    std::lock_guard<std::mutex> lock(names_mutex());
+    names = snapshot_names();
+  }
+
+  // Pass 1: validate everything and resolve columns, without touching
+  // world, so a bad file leaves it empty for the next candidate.
+  Reader r(path, payload, h.payload_bytes);
+  struct TableEntry {
+    int id = -1;  // local ComponentId, -1 when this build has no such column
+    uint32_t size = 0;
+  };
+  std::vector<TableEntry> table(r.get<uint32_t>());
+  for (TableEntry& t : table) {
+    const uint32_t len = r.get<uint32_t>();
+    const std::string_view name(reinterpret_cast<const char*>(r.take(len)), len);
+    t.size = r.get<uint32_t>();
+    for (size_t id = 0; id < names.size(); ++id) {
+      if (names[id] != name) continue;
+      if (component_info(static_cast<ComponentId>(id)).size != t.size) {
+        malformed(path, "component '" + std::string(name) + "' changed size");
+      }
+      t.id = static_cast<int>(id);
+    }
+  }
+  const uint32_t slots = r.get<uint32_t>();
+  const uint8_t* generations = r.take(uint64_t{slots} * sizeof(uint32_t));
+  const uint32_t free_count = r.get<uint32_t>();
+  const uint8_t* free_list = r.take(uint64_t{free_count} * sizeof(uint32_t));
+
+  struct Column {
+    ComponentId id;
+    uint32_t size;
+    const uint8_t* data;
+  };
+  struct Group {
+    ComponentMask mask;
+    uint64_t count;
+    const uint8_t* ids;
+    std::vector<Column> columns;
+  };
+  std::vector<Group> groups(r.get<uint32_t>());
+  std::vector<uint8_t> seen(slots, 0);  // 1 live, 2 free
+  uint64_t live = 0;
+  for (Group& g : groups) {
+    std::vector<uint32_t> cols(r.get<uint32_t>());
+    for (uint32_t& c : cols) {
+      c = r.get<uint32_t>();
+      if (c >= table.size()) malformed(path, "bad component index");
+    }
+    g.count = r.get<uint64_t>();
+    if (g.count > slots) malformed(path, "bad entity count");
+    g.ids = r.take(g.count * sizeof(EntityId));
+    for (uint64_t i = 0; i < g.count; ++i) {
+      EntityId e;
+      std::memcpy(&e, g.ids + i * sizeof(EntityId), sizeof(e));
+      const uint32_t index = World::index_of(e);
+      uint32_t gen = 0;
+      if (index < slots) std::memcpy(&gen, generations + index * sizeof(uint32_t), sizeof(gen));
+      if (index >= slots || seen[index] || gen != World::generation_of(e) || gen == 0) {
+        malformed(path, "bad entity id");
+      }
+      seen[index] = 1;
+    }
+    live += g.count;
+    for (uint32_t c : cols) {
+      const uint8_t* col = r.take(g.count * table[c].size);
+      if (table[c].id < 0) continue;  // dropped from this build
+      const auto id = static_cast<ComponentId>(table[c].id);
+      if (g.mask.test(id)) malformed(path, "duplicate column");
+      g.mask.set(id);
+      g.columns.push_back(Column{id, table[c].size, col});
+    }
+  }
+  if (!r.done()) malformed(path, "trailing bytes");
+  if (live != h.entities) malformed(path, "entity count mismatch");
+  for (uint32_t i = 0; i < free_count; ++i) {
+    uint32_t index;
+    std::memcpy(&index, free_list + i * sizeof(uint32_t), sizeof(index));
+    if (index >= slots || seen[index]) malformed(path, "bad free list");
+    seen[index] = 2;
+  }
+  if (live + free_count != slots) malformed(path, "slots neither live nor free");
+
+  // Pass 2: rebuild.
+  world.records_.resize(slots);
+  for (uint32_t i = 0; i < slots; ++i) {
+    std::memcpy(&world.records_[i].generation, generations + i * sizeof(uint32_t),
+                sizeof(uint32_t));
+  }
+  world.free_.resize(free_count);
+  std::memcpy(world.free_.data(), free_list, free_count * sizeof(uint32_t));
+  for (const Group& g : groups) {
+    Archetype* a = world.archetype_for(g.mask);
+    for (uint64_t i = 0; i < g.count; ++i) {
+      EntityId e;
+      std::memcpy(&e, g.ids + i * sizeof(EntityId), sizeof(e));
+      World::Record& rec = world.records_[World::index_of(e)];
+      rec.archetype = a;
+      rec.loc = a->allocate(e);
+      for (const Column& c : g.columns) {
+        std::memcpy(a->component(rec.loc, a->column_of(c.id)), c.data + i * c.size, c.size);
+      }
+    }
+  }
+  world.live_ = live;
+  return h.tick;
+}
+
+SnapshotManager::SnapshotManager(SnapshotOptions options) : options_(std::move(options)) {
+  options_.keep = std::max<size_t>(options_.keep, 2);
+  options_.interval_ticks = std::max<uint64_t>(options_.interval_ticks, 1);
+  std::error_code ec;
+  std::filesystem::create_directories(options_.dir, ec);
+  if (ec) throw std::system_error(ec, "create " + options_.dir);
+  writer_ = std::thread([this] { run_writer(); });
+}
+
+SnapshotManager::~SnapshotManager() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  wake_.notify_one();
+  writer_.join();
+  if (log_) log_->flush(options_.sync_log);
+}
+
+std::string SnapshotManager::snapshot_path(uint64_t tick) const {
+  return options_.dir + "/snapshot-" + std::to_string(tick) + ".kbss";
+}
+
+std::string SnapshotManager::log_path(uint64_t tick) const {
+  return options_.dir + "/replay-" + std::to_string(tick) + ".log";
+}
+
+uint64_t SnapshotManager::recover(World& world, const ReplayLog::RecordFn& fn) {
+  const std::vector<uint64_t> snapshots = list_ticks(options_.dir, "snapshot-", ".kbss");
+  for (size_t i = snapshots.size(); i-- > 0;) {
+    uint64_t tick;
+    try {
+      tick = WorldSnapshot::restore(world, snapshot_path(snapshots[i]));
+    } catch (const std::runtime_error&) {
+      // Torn or stale; the previous one still has its segments.
+      quarantine(snapshot_path(snapshots[i]));
+      continue;
+    }
+    uint64_t last = tick;
+    for (uint64_t segment : list_ticks(options_.dir, "replay-", ".log")) {
+      if (segment < tick) continue;
+      const ReplayLog::ReadResult read = ReplayLog::read(
+          log_path(segment), [&](uint64_t t, uint16_t type, std::span<const uint8_t> payload) {
+            if (t <= tick) return;
+            last = std::max(last, t);
+            fn(t, type, payload);
+          });
+      if (read.truncated()) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++stats_.truncated_segments;
+      }
+    }
+    return last;
+  }
+  return 0;
+}
+
+void SnapshotManager::start(const World& world, uint64_t tick) {
+  // Nothing on disk past the state we start from belongs to this history:
+  // snapshots recover() could not use, or a previous run's files when it
+  // found none.  Left in place they would outrank every new snapshot.
+  for (uint64_t t : list_ticks(options_.dir, "snapshot-", ".kbss")) {
+    if (t > tick) quarantine(snapshot_path(t));
+  }
+  for (uint64_t t : list_ticks(options_.dir, "replay-", ".log")) {
+    if (t > tick) quarantine(log_path(t));
+  }
+  WorldSnapshot snap = WorldSnapshot::capture(world, tick);
+  snap.write(snapshot_path(tick));
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++stats_.snapshots;
+    stats_.last_tick = tick;
+    written_.push_back(tick);
+  }
+  snapshot_metrics().bytes.set(static_cast<int64_t>(snap.size_bytes()));
+  // Records replayed into world are in that snapshot now; a fresh segment
+  // also drops any torn tail the crash left.
+  open_segment(tick);
+  last_capture_ = tick;
+  prune();
+}
+
+void SnapshotManager::open_segment(uint64_t tick) {
+  if (log_) log_->flush(options_.sync_log);
+  log_ = std::make_unique<ReplayLog>(log_path(tick), /*truncate=*/true);
+}
+
+bool SnapshotManager::record(uint64_t tick, uint16_t type, std::span<const uint8_t> payload) {
+  if (log_->append(tick, type, payload)) return true;
+  std::lock_guard<std::mutex> lock(mutex_);
+  ++stats_.rejected_records;
+  return false;
+}
+
+void SnapshotManager::end_tick(const World& world, uint64_t tick) {
+  const bool flushed = log_->flush(options_.sync_log);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!flushed) ++stats_.failures;
+    stats_.log_bytes = log_->size();
+  }
+  if (tick - last_capture_ < options_.interval_ticks) return;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (writing_ || pending_) {
+      ++stats_.skipped;  // disk slower than the interval; try next tick
+      return;
+    }
+  }
+  auto snap = std::make_unique<WorldSnapshot>(WorldSnapshot::capture(world, tick));
+  // Later records go to the new segment; the old one stays until a newer
+  // snapshot is durable.
+  open_segment(tick);
+  last_capture_ = tick;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_ = std::move(snap);
+  }
+  wake_.notify_one();
+}
+
+void SnapshotManager::run_writer() {
+  for (;;) {
+    std::unique_ptr<WorldSnapshot> snap;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      wake_.wait(lock, [this] { return stop_ || pending_; });
+      if (!pending_) return;  // stopping, nothing left to write
+      snap = std::move(pending_);
+      writing_ = true;
+    }
+    const uint64_t start = Tracer::now_ns();
+    bool ok = true;
+    try {
+      snap->write(snapshot_path(snap->tick()));
+    } catch (const std::system_error&) {
+      ok = false;
+    }
+    snapshot_metrics().write_us.observe(static_cast<double>(Tracer::now_ns() - start) / 1000);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      writing_ = false;
+      if (ok) {
+        ++stats_.snapshots;
+        stats_.last_tick = snap->tick();
+        written_.push_back(snap->tick());
+      } else {
+        ++stats_.failures;
+      }
+    }
+    if (ok) {
+      snapshot_metrics().bytes.set(static_cast<int64_t>(snap->size_bytes()));
+      prune();
+    }
+  }
+}
+
+void SnapshotManager::quarantine(const std::string& path) {
+  std::error_code ec;
+  std::filesystem::rename(path, path + ".bad", ec);
+  if (ec) return;
+  std::lock_guard<std::mutex> lock(mutex_);
+  ++stats_.quarantined;
+}
+
+void SnapshotManager::prune() {
+  std::vector<uint64_t> kept;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (written_.size() > options_.keep) {
+      written_.erase(written_.begin(), written_.end() - static_cast<ptrdiff_t>(options_.keep));
+    }
+    kept = written_;
+  }
+  if (kept.empty()) return;
+  // Top up with the newest snapshots from before this run (normally the
+  // one recover() restored) while ours are fewer than keep.
+  const std::vector<uint64_t> snapshots = list_ticks(options_.dir, "snapshot-", ".kbss");
+  for (size_t i = snapshots.size(); i-- > 0 && kept.size() < options_.keep;) {
+    if (snapshots[i] < kept.front()) kept.insert(kept.begin(), snapshots[i]);
+  }
+  std::error_code ec;
+  for (uint64_t t : snapshots) {
+    if (!std::binary_search(kept.begin(), kept.end(), t)) {
+      std::filesystem::remove(snapshot_path(t), ec);
+    }
+  }
+  // Segments before the oldest kept snapshot can no longer be replayed.
+  const uint64_t oldest = kept.front();
+  for (uint64_t segment : list_ticks(options_.dir, "replay-", ".log")) {
+    if (segment < oldest) std::filesystem::remove(log_path(segment), ec);
+  }
+}
+
+SnapshotStats SnapshotManager::stats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+}  // namespace kbs
@@ -0,0 +1,172 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+
+#include "entity/component.h"
+#include "entity/replay_log.h"
+
+namespace kbs {
+
+class World;
+
+namespace detail {
+void register_snapshot_component(ComponentId id, std::string_view name);
+}  // namespace detail
+
+// Includes T's column in world snapshots under name.  Component ids follow
+// first-use order and differ between runs, so snapshots identify columns
+// by this name instead.  Columns are copied as raw bytes, so T must be
+// trivially copyable; state that is not (scripts, connections) is rebuilt
+// after a restore.  Call at startup, before capturing or restoring.
+template <typename T>
+void snapshot_component(std::string_view name) {
+  static_assert(std::is_trivially_copyable_v<T>, "snapshot columns are copied as raw bytes");
+  detail::register_snapshot_component(component_id<T>(), name);
+}
+
+// Point-in-time image of a World's registered components, entity ids and
+// id generations, in a compact binary format:
+//
+//   header (magic "KBSS", tick, counts, FNV-1a 64 of the payload)
+//   component table: name, element size
+//   slot generations, free slot list
+//   per archetype: component list, entity ids, then each column
+//
+// Restoring reproduces entity ids exactly, including the generations of
+// free slots, so ids held by clients and other servers stay valid and new
+// ids never collide with them.
+class WorldSnapshot {
+ public:
+  // Tick thread, between ticks.  Copies whole chunk columns (memcpy speed;
+  // the chunks are already dense), so the tick pays a copy and nothing
+  // else -- checksum and I/O happen in write().  Components without a
+  // snapshot name are left out.
+  static WorldSnapshot capture(const World& world, uint64_t tick);
+
+  uint64_t tick() const { return tick_; }
+  size_t entities() const { return entities_; }
+  size_t size_bytes() const { return bytes_.size(); }
+
+  // Any thread.  Writes path durably with write_file_atomic().  Throws
+  // std::system_error.
+  void write(const std::string& path);
+
+  // Rebuilds world, which must be empty, from the snapshot at path and
+  // returns its tick.  The file is fully validated before world is
+  // touched.  Throws std::runtime_error for a malformed file or a
+  // component whose size changed, std::system_error when it cannot be
+  // read, std::logic_error when world is not empty.  Columns the snapshot
+  // has but this build does not register are skipped.
+  static uint64_t restore(World& world, const std::string& path);
+
+ private:
+  uint64_t tick_ = 0;
+  size_t entities_ = 0;
+  std::string bytes_;
+};
+
+struct SnapshotOptions {
+  // Holds snapshot-<tick>.kbss and replay-<tick>.log; created if missing.
+  std::string dir;
+  // Ticks between snapshots (30 s at 20 Hz).
+  uint64_t interval_ticks = 600;
+  // fdatasync the replay log every tick.  Off trades the last ticks before
+  // a machine crash (not a process crash) for latency.
+  bool sync_log = true;
+  // Snapshots kept; older ones, and log segments only they needed, are
+  // deleted.  At least 2, so a torn newest snapshot has a fallback.  The
+  // newest ones written by this manager are kept first, then the newest
+  // older ones found on disk.
+  size_t keep = 2;
+};
+
+struct SnapshotStats {
+  uint64_t snapshots = 0;  // written
+  uint64_t skipped = 0;    // due while the previous one was still writing
+  uint64_t failures = 0;   // writes that threw
+  uint64_t last_tick = 0;  // of the newest snapshot on disk
+  uint64_t log_bytes = 0;  // current segment
+  uint64_t quarantined = 0;  // unusable or stale files renamed to *.bad
+  uint64_t rejected_records = 0;    // over ReplayLog::kMaxRecord, not journaled
+  uint64_t truncated_segments = 0;  // log segments recover() found a torn tail in
+};
+
+// Periodic snapshots plus a replay log, so a crashed cell server restarts
+// from its own disk in seconds instead of reloading the zone from the
+// database, and players' entities keep their ids and state.
+//
+//   SnapshotManager snap({.dir = "/var/lib/kbs/cell-7"});
+//   uint64_t tick = snap.recover(world, apply_record);  // 0: fresh start
+//   snap.start(world, tick);
+//   // every tick: snap.record(...) for each input that changes state;
+//   // after systems ran: snap.end_tick(world, tick)
+//
+// end_tick() flushes the tick's records and, every interval, captures a
+// snapshot on the tick thread, switches to a new log segment, and hands
+// the image to a writer thread.  Recovery restores the newest snapshot
+// that validates and replays every later segment through the caller's
+// record handler.  Files that cannot be used -- a snapshot that fails to
+// restore, or anything at or past the tick start() begins from -- are
+// renamed to <name>.bad, so they are neither pruned in place of good
+// snapshots nor picked up by the next recovery.
+class SnapshotManager {
+ public:
+  // Throws std::system_error when dir cannot be created.
+  explicit SnapshotManager(SnapshotOptions options);
+  // Finishes the snapshot being written.
+  ~SnapshotManager();
+
+  SnapshotManager(const SnapshotManager&) = delete;
+  SnapshotManager& operator=(const SnapshotManager&) = delete;
+
+  // Startup, on an empty world: restores and replays (fn gets every
+  // record after the snapshot) and returns the last tick recovered, or 0
+  // when dir has no usable snapshot.  Segments that end in a torn or
+  // corrupt tail are replayed up to it and counted.
+  uint64_t recover(World& world, const ReplayLog::RecordFn& fn);
+
+  // Writes a base snapshot of world at tick synchronously and opens a
+  // fresh log segment.  Call once after recover(), before the first tick.
+  void start(const World& world, uint64_t tick);
+
+  // Tick thread.  Journals one state-changing input; false (and counted)
+  // when it is too large to journal.
+  bool record(uint64_t tick, uint16_t type, std::span<const uint8_t> payload);
+
+  // Tick thread, after the tick's systems have run.
+  void end_tick(const World& world, uint64_t tick);
+
+  SnapshotStats stats() const;
+
+ private:
+  std::string snapshot_path(uint64_t tick) const;
+  std::string log_path(uint64_t tick) const;
+  void open_segment(uint64_t tick);
+  void quarantine(const std::string& path);
+  void prune();
+  void run_writer();
+
+  SnapshotOptions options_;
+  std::unique_ptr<ReplayLog> log_;
+  uint64_t last_capture_ = 0;
+
+  mutable std::mutex mutex_;
+  std::condition_variable wake_;
+  std::unique_ptr<WorldSnapshot> pending_;
+  bool writing_ = false;
+  bool stop_ = false;
+  SnapshotStats stats_;
+  std::vector<uint64_t> written_;  // snapshot ticks this manager wrote, ascending
+  std::thread writer_;
+};
+
+}  // namespace kbs
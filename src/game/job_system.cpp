@@ -0,0 +1,280 @@
+#include "game/job_system.h"
+
+#include <bit>
+#include <stdexcept>
+
+#include "metrics/metrics.h"
+#include "metrics/trace.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace kbs {
+
+namespace {
+
+struct ThreadSlot {
+  const JobSystem* owner = nullptr;
+  void* worker = nullptr;
+};
+thread_local ThreadSlot tls_slot;
+
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+  _mm_pause();
+#else
+  std::this_thread::yield();
+#endif
+}
+
+uint64_t xorshift(uint64_t& s) {
+  s ^= s << 13;
+  s ^= s >> 7;
+  s ^= s << 17;
+  return s;
+}
+
+constexpr int kSpinsBeforeSleep = 256;
+
+Histogram& node_duration_us(const std::string& name) {
+  return metrics().histogram("kbs_job_node_duration_us", "Wall time of one job graph node run",
+                             Histogram::exponential(10, 2, 16), {{"node", name}});
+}
+
+}  // namespace
+
+// --- JobGraph ---------------------------------------------------------------
+
+JobGraph::NodeId JobGraph::add(std::string name, std::function<void()> fn) {
+  const char* trace_name = tracer().intern(name);
+  Histogram* duration_us = &node_duration_us(name);
+  nodes_.push_back({std::move(name), trace_name, duration_us, std::move(fn), {}, 0});
+  prepared_ = false;
+  return static_cast<NodeId>(nodes_.size() - 1);
+}
+
+void JobGraph::precede(NodeId before, NodeId after) {
+  nodes_[before].successors.push_back(after);
+  ++nodes_[after].predecessors;
+  prepared_ = false;
+}
+
+void JobGraph::prepare() {
+  if (prepared_) return;
+  // Kahn's algorithm, only to reject cycles before they deadlock a tick.
+  std::vector<uint32_t> indegree(nodes_.size());
+  std::vector<NodeId> ready;
+  roots_.clear();
+  for (NodeId i = 0; i < nodes_.size(); ++i) {
+    indegree[i] = nodes_[i].predecessors;
+    if (indegree[i] == 0) roots_.push_back(i);
+  }
+  ready = roots_;
+  size_t visited = 0;
+  while (!ready.empty()) {
+    const NodeId n = ready.back();
+    ready.pop_back();
+    ++visited;
+    for (NodeId s : nodes_[n].successors) {
+      if (--indegree[s] == 0) ready.push_back(s);
+    }
+  }
+  if (visited != nodes_.size()) throw std::logic_error("JobGraph has a cycle");
+  jobs_ = std::vector<Job>(nodes_.size());
+  remaining_ = std::make_unique<std::atomic<uint32_t>[]>(nodes_.size());
+  prepared_ = true;
+}
+
+// --- WorkDeque --------------------------------------------------------------
+
+JobSystem::WorkDeque::WorkDeque(size_t capacity)
+    : mask_(static_cast<int64_t>(std::bit_ceil(capacity)) - 1),
+      buffer_(std::make_unique<std::atomic<Job*>[]>(static_cast<size_t>(mask_) + 1)) {}
+
+bool JobSystem::WorkDeque::push(Job* job) {
+  const int64_t b = bottom_.load(std::memory_order_relaxed);
+  const int64_t t = top_.load(std::memory_order_acquire);
+  if (b - t > mask_) return false;
+  buffer_[b & mask_].store(job, std::memory_order_release);
+  bottom_.store(b + 1, std::memory_order_release);
+  return true;
+}
+
+Job* JobSystem::WorkDeque::pop() {
+  const int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+  bottom_.store(b, std::memory_order_seq_cst);
+  int64_t t = top_.load(std::memory_order_seq_cst);
+  if (t > b) {
+    bottom_.store(b + 1, std::memory_order_relaxed);
+    return nullptr;
+  }
+  Job* job = buffer_[b & mask_].load(std::memory_order_relaxed);
+  if (t == b) {
+    // Last item: race the thieves for it.
+    if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                      std::memory_order_relaxed)) {
+      job = nullptr;
+    }
+    bottom_.store(b + 1, std::memory_order_relaxed);
+  }
+  return job;
+}
+
+Job* JobSystem::WorkDeque::steal() {
+  int64_t t = top_.load(std::memory_order_seq_cst);
+  const int64_t b = bottom_.load(std::memory_order_seq_cst);
+  if (t >= b) return nullptr;
+  Job* job = buffer_[t & mask_].load(std::memory_order_acquire);
+  if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                    std::memory_order_relaxed)) {
+    return nullptr;
+  }
+  return job;
+}
+
+// --- JobSystem --------------------------------------------------------------
+
+JobSystem::JobSystem(size_t num_threads, const ThreadPlacement& placement) {
+  if (num_threads == 0) num_threads = std::max(1u, std::thread::hardware_concurrency());
+  for (size_t i = 0; i < num_threads; ++i) {
+    auto w = std::make_unique<Worker>(kDequeCapacity);
+    w->rng = 0x9E3779B97F4A7C15ull * (i + 1);
+    workers_.push_back(std::move(w));
+  }
+  tls_slot = {this, workers_[0].get()};
+  for (size_t i = 1; i < num_threads; ++i) {
+    workers_[i]->thread = std::thread([this, i, placement] {
+      place_current_thread(placement, i);
+      worker_loop(i);
+    });
+  }
+}
+
+JobSystem::~JobSystem() {
+  stop_.store(true, std::memory_order_release);
+  epoch_.fetch_add(1, std::memory_order_seq_cst);
+  epoch_.notify_all();
+  for (size_t i = 1; i < workers_.size(); ++i) workers_[i]->thread.join();
+  if (tls_slot.owner == this) tls_slot = {};
+}
+
+JobSystem::Worker& JobSystem::current() {
+  if (tls_slot.owner != this) {
+    throw std::logic_error("JobSystem used from a thread that is not one of its workers");
+  }
+  return *static_cast<Worker*>(tls_slot.worker);
+}
+
+void JobSystem::wake_one() {
+  epoch_.fetch_add(1, std::memory_order_seq_cst);
+  if (sleepers_.load(std::memory_order_seq_cst) != 0) epoch_.notify_one();
+}
+
+void JobSystem::submit(Job& job) {
+  Worker& self = current();
+  if (!self.deque.push(&job)) {
+    self.inline_overflow.fetch_add(1, std::memory_order_relaxed);
+    execute(self, &job);
+    return;
+  }
+  wake_one();
+}
+
+void JobSystem::execute(Worker& self, Job* job) {
+  job->fn();
+  self.executed.fetch_add(1, std::memory_order_relaxed);
+  if (job->counter) job->counter->fetch_sub(1, std::memory_order_acq_rel);
+}
+
+Job* JobSystem::find_work(Worker& self) {
+  if (Job* job = self.deque.pop()) return job;
+  const size_t n = workers_.size();
+  if (n == 1) return nullptr;
+  const size_t start = static_cast<size_t>(xorshift(self.rng) % n);
+  for (size_t k = 0; k < n; ++k) {
+    Worker& victim = *workers_[(start + k) % n];
+    if (&victim == &self) continue;
+    if (Job* job = victim.deque.steal()) {
+      self.stolen.fetch_add(1, std::memory_order_relaxed);
+      return job;
+    }
+  }
+  return nullptr;
+}
+
+bool JobSystem::run_one(Worker& self) {
+  Job* job = find_work(self);
+  if (!job) return false;
+  execute(self, job);
+  return true;
+}
+
+void JobSystem::wait(const std::atomic<int64_t>& counter) {
+  Worker& self = current();
+  while (counter.load(std::memory_order_acquire) > 0) {
+    if (!run_one(self)) cpu_relax();
+  }
+}
+
+void JobSystem::run(JobGraph& graph) {
+  graph.prepare();
+  const size_t n = graph.nodes_.size();
+  if (n == 0) return;
+  std::atomic<int64_t> counter{static_cast<int64_t>(n)};
+  for (JobGraph::NodeId i = 0; i < n; ++i) {
+    graph.remaining_[i].store(graph.nodes_[i].predecessors, std::memory_order_relaxed);
+    Job& job = graph.jobs_[i];
+    job.counter = &counter;
+    job.fn = [this, &graph, i] {
+      const JobGraph::Node& node = graph.nodes_[i];
+      const uint64_t start = Tracer::now_ns();
+      {
+        TraceSpan span(node.trace_name);
+        node.fn();
+      }
+      node.duration_us->observe(static_cast<double>(Tracer::now_ns() - start) / 1000);
+      for (JobGraph::NodeId s : node.successors) {
+        if (graph.remaining_[s].fetch_sub(1, std::memory_order_acq_rel) == 1) {
+          submit(graph.jobs_[s]);
+        }
+      }
+    };
+  }
+  for (JobGraph::NodeId r : graph.roots_) submit(graph.jobs_[r]);
+  wait(counter);
+}
+
+void JobSystem::worker_loop(size_t index) {
+  Worker& self = *workers_[index];
+  tls_slot = {this, &self};
+  while (!stop_.load(std::memory_order_acquire)) {
+    if (run_one(self)) continue;
+    bool found = false;
+    for (int i = 0; i < kSpinsBeforeSleep && !found; ++i) {
+      cpu_relax();
+      found = run_one(self);
+    }
+    if (found) continue;
+    // Announce the sleep, then look once more: a push after this point
+    // bumps the epoch, so wait() returns immediately instead of missing it.
+    sleepers_.fetch_add(1, std::memory_order_seq_cst);
+    const uint32_t epoch = epoch_.load(std::memory_order_seq_cst);
+    if (!run_one(self) && !stop_.load(std::memory_order_acquire)) {
+      epoch_.wait(epoch, std::memory_order_seq_cst);
+    }
+    sleepers_.fetch_sub(1, std::memory_order_relaxed);
+  }
+}
+
+JobSystemStats JobSystem::stats() const {
+  JobSystemStats s;
+  for (const auto& w : workers_) {
+    s.executed += w->executed.load(std::memory_order_relaxed);
+    s.stolen += w->stolen.load(std::memory_order_relaxed);
+    s.inline_overflow += w->inline_overflow.load(std::memory_order_relaxed);
+  }
+  return s;
+}
+
+}  // namespace kbs
@@ -0,0 +1,189 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "common/inplace_function.h"
+#include "common/mpsc_queue.h"
+#include "common/thread_placement.h"
+
+namespace kbs {
+
+class Histogram;
+class JobSystem;
+
+// Unit of work.  Jobs are owned by whoever waits for them (a JobGraph, or
+// the stack frame of parallel_for()), so scheduling never allocates.
+struct Job {
+  InplaceFunction<void(), 48> fn;
+  // Decremented when fn returns; waiters poll it.
+  std::atomic<int64_t>* counter = nullptr;
+};
+
+// Static dependency graph of per-tick work, built once and run every tick:
+//
+//   JobGraph g;
+//   auto aoi = g.add("aoi", [&] { jobs.parallel_for(0, cells, 16, update_cells); });
+//   auto ai = g.add("ai", [&] { run_ai(); });
+//   auto sync = g.add("replicate", [&] { replicate(); });
+//   g.precede(aoi, sync);
+//   g.precede(ai, sync);
+//   ...
+//   jobs.run(g);  // aoi and ai in parallel, then replicate
+class JobGraph {
+ public:
+  using NodeId = uint32_t;
+
+  // Nodes are traced and timed under name; graphs that share a name share
+  // its histogram.
+  NodeId add(std::string name, std::function<void()> fn);
+  // after starts only once before has finished.
+  void precede(NodeId before, NodeId after);
+
+  size_t size() const { return nodes_.size(); }
+  const std::string& name(NodeId id) const { return nodes_[id].name; }
+
+ private:
+  friend class JobSystem;
+
+  struct Node {
+    std::string name;
+    const char* trace_name;  // interned: spans may outlive the graph
+    Histogram* duration_us;  // kbs_job_node_duration_us{node=name}
+    std::function<void()> fn;
+    std::vector<NodeId> successors;
+    uint32_t predecessors = 0;
+  };
+
+  // Throws std::logic_error on a cycle; sizes the run-time state.
+  void prepare();
+
+  std::vector<Node> nodes_;
+  std::vector<NodeId> roots_;
+  std::vector<Job> jobs_;
+  std::unique_ptr<std::atomic<uint32_t>[]> remaining_;
+  bool prepared_ = false;
+};
+
+struct JobSystemStats {
+  uint64_t executed = 0;
+  uint64_t stolen = 0;
+  uint64_t inline_overflow = 0;  // jobs run in place because a deque was full
+};
+
+// Work-stealing scheduler for parallelism inside one tick.
+//
+// Each thread owns a Chase-Lev deque: it pushes and pops work at the bottom
+// without contention while idle threads steal from the top of a random
+// victim's deque, so a system that fans out stays on the cores that have
+// work.  The thread that constructs the JobSystem is worker 0 and joins in
+// whenever it waits; workers 1..n-1 spin briefly when they run dry and then
+// sleep until new work is pushed, so an idle system costs nothing between
+// ticks.
+//
+// run(), parallel_for() and wait() may be called from the constructing
+// thread or from inside a job (nested parallelism); waiting always executes
+// other jobs instead of blocking.  Jobs must not touch the TickArena, which
+// belongs to the logic thread alone.
+class JobSystem {
+ public:
+  // 0 means one thread per hardware thread.  Worker i >= 1 is placed at
+  // slot i of placement; slot 0 is the constructing thread, which the
+  // caller places (place_current_thread(placement, 0)) if it wants to.
+  explicit JobSystem(size_t num_threads = 0, const ThreadPlacement& placement = {});
+  ~JobSystem();
+
+  JobSystem(const JobSystem&) = delete;
+  JobSystem& operator=(const JobSystem&) = delete;
+
+  // Runs every node of graph, respecting edges, and returns when all have
+  // finished.
+  void run(JobGraph& graph);
+
+  // Calls fn(chunk_begin, chunk_end) over [begin, end) in chunks of about
+  // grain items, in parallel, and returns when all chunks are done.
+  template <typename F>
+  void parallel_for(size_t begin, size_t end, size_t grain, F&& fn);
+
+  // Queues job on the calling thread's deque; wait() on its counter.
+  void submit(Job& job);
+  // Runs jobs until *counter reaches zero.
+  void wait(const std::atomic<int64_t>& counter);
+
+  size_t num_threads() const { return workers_.size(); }
+  JobSystemStats stats() const;
+
+ private:
+  // Fixed-capacity Chase-Lev deque of Job pointers.
+  class WorkDeque {
+   public:
+    explicit WorkDeque(size_t capacity);
+    bool push(Job* job);  // owner
+    Job* pop();           // owner
+    Job* steal();         // any thread
+
+   private:
+    const int64_t mask_;
+    std::unique_ptr<std::atomic<Job*>[]> buffer_;
+    alignas(kCacheLine) std::atomic<int64_t> top_{0};
+    alignas(kCacheLine) std::atomic<int64_t> bottom_{0};
+  };
+
+  struct alignas(kCacheLine) Worker {
+    explicit Worker(size_t capacity) : deque(capacity) {}
+    WorkDeque deque;
+    uint64_t rng = 0;
+    std::atomic<uint64_t> executed{0};
+    std::atomic<uint64_t> stolen{0};
+    std::atomic<uint64_t> inline_overflow{0};
+    std::thread thread;
+  };
+
+  static constexpr size_t kDequeCapacity = 4096;
+
+  Worker& current();
+  bool run_one(Worker& self);
+  Job* find_work(Worker& self);
+  void execute(Worker& self, Job* job);
+  void worker_loop(size_t index);
+  void wake_one();
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::atomic<uint32_t> epoch_{0};
+  std::atomic<uint32_t> sleepers_{0};
+  std::atomic<bool> stop_{false};
+};
+
+template <typename F>
+void JobSystem::parallel_for(size_t begin, size_t end, size_t grain, F&& fn) {
+  if (begin >= end) return;
+  grain = std::max<size_t>(grain, 1);
+  const size_t chunks = (end - begin + grain - 1) / grain;
+  if (chunks == 1) {
+    fn(begin, end);
+    return;
+  }
+  std::atomic<int64_t> counter{static_cast<int64_t>(chunks - 1)};
+  std::vector<Job> jobs(chunks - 1);
+  auto* f = &fn;
+  for (size_t c = 1; c < chunks; ++c) {
+    const size_t b = begin + c * grain;
+    const size_t e = std::min(end, b + grain);
+    Job& job = jobs[c - 1];
+    job.fn = [f, b, e] { (*f)(b, e); };
+    job.counter = &counter;
+    submit(job);
+  }
+  // The first chunk runs here while the others are stolen.
+  fn(begin, std::min(end, begin + grain));
+  wait(counter);
+}
+
+}  // namespace kbs
@@ -0,0 +1,386 @@
+#include "game/kernels.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cmath>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define KBS_KERNELS_AVX2 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define KBS_KERNELS_NEON 1
+#endif
+
+namespace kbs::kernels {
+
+namespace {
+
+static_assert(sizeof(Vec3) == 3 * sizeof(float), "kernels read Vec3 columns as float triples");
+
+struct Cone {
+  float ox, oz, dir_x, dir_z, radius_sq, cos_half;
+};
+
+struct KernelTable {
+  SimdLevel level;
+  size_t (*range)(const Vec3*, size_t, float, float, float, uint32_t*);
+  size_t (*cone)(const Vec3*, size_t, const Cone&, uint32_t*);
+  void (*distances)(const Vec3*, size_t, float, float, float*);
+  void (*integrate)(float*, const float*, size_t, float);
+  void (*damage)(const DamageFormula&, const float*, const float*, size_t, float*);
+};
+
+// ---- scalar: reference semantics, and the tail of every SIMD loop ----
+
+size_t range_scalar_from(const Vec3* p, size_t begin, size_t n, float cx, float cz, float r2,
+                         uint32_t* out, size_t count) {
+  for (size_t i = begin; i < n; ++i) {
+    const float dx = p[i].x - cx;
+    const float dz = p[i].z - cz;
+    if (dx * dx + dz * dz <= r2) out[count++] = static_cast<uint32_t>(i);
+  }
+  return count;
+}
+
+size_t range_scalar(const Vec3* p, size_t n, float cx, float cz, float r2, uint32_t* out) {
+  return range_scalar_from(p, 0, n, cx, cz, r2, out, 0);
+}
+
+size_t cone_scalar_from(const Vec3* p, size_t begin, size_t n, const Cone& c, uint32_t* out,
+                        size_t count) {
+  for (size_t i = begin; i < n; ++i) {
+    const float dx = p[i].x - c.ox;
+    const float dz = p[i].z - c.oz;
+    const float d2 = dx * dx + dz * dz;
+    const float along = dx * c.dir_x + dz * c.dir_z;
+    if (d2 <= c.radius_sq && along >= c.cos_half * std::sqrt(d2)) {
+      out[count++] = static_cast<uint32_t>(i);
+    }
+  }
+  return count;
+}
+
+size_t cone_scalar(const Vec3* p, size_t n, const Cone& c, uint32_t* out) {
+  return cone_scalar_from(p, 0, n, c, out, 0);
+}
+
+void distances_scalar_from(const Vec3* p, size_t begin, size_t n, float cx, float cz,
+                           float* out) {
+  for (size_t i = begin; i < n; ++i) {
+    const float dx = p[i].x - cx;
+    const float dz = p[i].z - cz;
+    out[i] = dx * dx + dz * dz;
+  }
+}
+
+void distances_scalar(const Vec3* p, size_t n, float cx, float cz, float* out) {
+  distances_scalar_from(p, 0, n, cx, cz, out);
+}
+
+// pos and vel are n floats (3 per entity).
+void integrate_scalar_from(float* pos, const float* vel, size_t begin, size_t n, float dt) {
+  for (size_t i = begin; i < n; ++i) pos[i] = pos[i] + vel[i] * dt;
+}
+
+void integrate_scalar(float* pos, const float* vel, size_t n, float dt) {
+  integrate_scalar_from(pos, vel, 0, n, dt);
+}
+
+void damage_scalar_from(const DamageFormula& f, const float* armor, const float* scale,
+                        size_t begin, size_t n, float* out) {
+  for (size_t i = begin; i < n; ++i) {
+    const float d = f.base * scale[i] * f.armor_k / (f.armor_k + armor[i]);
+    out[i] = std::max(d, f.min_damage);
+  }
+}
+
+void damage_scalar(const DamageFormula& f, const float* armor, const float* scale, size_t n,
+                   float* out) {
+  damage_scalar_from(f, armor, scale, 0, n, out);
+}
+
+constexpr KernelTable kScalarTable = {SimdLevel::kScalar, range_scalar,    cone_scalar,
+                                      distances_scalar,   integrate_scalar, damage_scalar};
+
+#if KBS_KERNELS_AVX2
+
+#define KBS_AVX2 __attribute__((target("avx2,popcnt")))
+
+// Eight Vec3 (24 floats) to x, y, z lanes with three loads per half and
+// shuffles, rather than gathers.
+KBS_AVX2 inline void load_xyz8(const Vec3* p, __m256& x, __m256& y, __m256& z) {
+  const float* f = reinterpret_cast<const float*>(p);
+  __m256 m03 = _mm256_castps128_ps256(_mm_loadu_ps(f + 0));  // x0 y0 z0 x1
+  __m256 m14 = _mm256_castps128_ps256(_mm_loadu_ps(f + 4));  // y1 z1 x2 y2
+  __m256 m25 = _mm256_castps128_ps256(_mm_loadu_ps(f + 8));  // z2 x3 y3 z3
+  m03 = _mm256_insertf128_ps(m03, _mm_loadu_ps(f + 12), 1);  // x4 y4 z4 x5
+  m14 = _mm256_insertf128_ps(m14, _mm_loadu_ps(f + 16), 1);  // y5 z5 x6 y6
+  m25 = _mm256_insertf128_ps(m25, _mm_loadu_ps(f + 20), 1);  // z6 x7 y7 z7
+  const __m256 xy = _mm256_shuffle_ps(m14, m25, _MM_SHUFFLE(2, 1, 3, 2));
+  const __m256 yz = _mm256_shuffle_ps(m03, m14, _MM_SHUFFLE(1, 0, 2, 1));
+  x = _mm256_shuffle_ps(m03, xy, _MM_SHUFFLE(2, 0, 3, 0));
+  y = _mm256_shuffle_ps(yz, xy, _MM_SHUFFLE(3, 1, 2, 0));
+  z = _mm256_shuffle_ps(yz, m25, _MM_SHUFFLE(3, 0, 3, 1));
+}
+
+// Lane numbers of the set bits of each 8-bit hit mask, packed as bytes.
+constexpr auto kCompactLanes = [] {
+  std::array<uint64_t, 256> lut{};
+  for (unsigned mask = 0; mask < 256; ++mask) {
+    unsigned k = 0;
+    for (unsigned lane = 0; lane < 8; ++lane) {
+      if (mask & (1u << lane)) lut[mask] |= uint64_t{lane} << (8 * k++);
+    }
+  }
+  return lut;
+}();
+
+// Branch-free compaction: the indices of the hit lanes go to out[count..]
+// with one store, so scattered hits cost no mispredictions.  The store
+// writes all 8 lanes; out has room for every position, so it stays in
+// bounds and the extra lanes are overwritten later.
+KBS_AVX2 inline size_t emit_mask(unsigned mask, size_t base, uint32_t* out, size_t count) {
+  const __m256i lanes = _mm256_cvtepu8_epi32(
+      _mm_cvtsi64_si128(static_cast<long long>(kCompactLanes[mask])));
+  const __m256i idx = _mm256_add_epi32(lanes, _mm256_set1_epi32(static_cast<int>(base)));
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + count), idx);
+  return count + static_cast<size_t>(__builtin_popcount(mask));
+}
+
+KBS_AVX2 size_t range_avx2(const Vec3* p, size_t n, float cx, float cz, float r2, uint32_t* out) {
+  const __m256 vcx = _mm256_set1_ps(cx), vcz = _mm256_set1_ps(cz), vr2 = _mm256_set1_ps(r2);
+  size_t count = 0, i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256 x, y, z;
+    load_xyz8(p + i, x, y, z);
+    const __m256 dx = _mm256_sub_ps(x, vcx);
+    const __m256 dz = _mm256_sub_ps(z, vcz);
+    const __m256 d2 = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dz, dz));
+    const unsigned mask = _mm256_movemask_ps(_mm256_cmp_ps(d2, vr2, _CMP_LE_OQ));
+    count = emit_mask(mask, i, out, count);
+  }
+  return range_scalar_from(p, i, n, cx, cz, r2, out, count);
+}
+
+KBS_AVX2 size_t cone_avx2(const Vec3* p, size_t n, const Cone& c, uint32_t* out) {
+  const __m256 ox = _mm256_set1_ps(c.ox), oz = _mm256_set1_ps(c.oz);
+  const __m256 dir_x = _mm256_set1_ps(c.dir_x), dir_z = _mm256_set1_ps(c.dir_z);
+  const __m256 r2 = _mm256_set1_ps(c.radius_sq), cos_half = _mm256_set1_ps(c.cos_half);
+  size_t count = 0, i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256 x, y, z;
+    load_xyz8(p + i, x, y, z);
+    const __m256 dx = _mm256_sub_ps(x, ox);
+    const __m256 dz = _mm256_sub_ps(z, oz);
+    const __m256 d2 = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dz, dz));
+    const __m256 along = _mm256_add_ps(_mm256_mul_ps(dx, dir_x), _mm256_mul_ps(dz, dir_z));
+    const __m256 in_range = _mm256_cmp_ps(d2, r2, _CMP_LE_OQ);
+    const __m256 in_angle =
+        _mm256_cmp_ps(along, _mm256_mul_ps(cos_half, _mm256_sqrt_ps(d2)), _CMP_GE_OQ);
+    const unsigned mask = _mm256_movemask_ps(_mm256_and_ps(in_range, in_angle));
+    count = emit_mask(mask, i, out, count);
+  }
+  return cone_scalar_from(p, i, n, c, out, count);
+}
+
+KBS_AVX2 void distances_avx2(const Vec3* p, size_t n, float cx, float cz, float* out) {
+  const __m256 vcx = _mm256_set1_ps(cx), vcz = _mm256_set1_ps(cz);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256 x, y, z;
+    load_xyz8(p + i, x, y, z);
+    const __m256 dx = _mm256_sub_ps(x, vcx);
+    const __m256 dz = _mm256_sub_ps(z, vcz);
+    _mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dz, dz)));
+  }
+  distances_scalar_from(p, i, n, cx, cz, out);
+}
+
+KBS_AVX2 void integrate_avx2(float* pos, const float* vel, size_t n, float dt) {
+  const __m256 vdt = _mm256_set1_ps(dt);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m256 v = _mm256_mul_ps(_mm256_loadu_ps(vel + i), vdt);
+    _mm256_storeu_ps(pos + i, _mm256_add_ps(_mm256_loadu_ps(pos + i), v));
+  }
+  integrate_scalar_from(pos, vel, i, n, dt);
+}
+
+KBS_AVX2 void damage_avx2(const DamageFormula& f, const float* armor, const float* scale,
+                          size_t n, float* out) {
+  const __m256 base = _mm256_set1_ps(f.base), k = _mm256_set1_ps(f.armor_k);
+  const __m256 floor = _mm256_set1_ps(f.min_damage);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m256 num = _mm256_mul_ps(_mm256_mul_ps(base, _mm256_loadu_ps(scale + i)), k);
+    const __m256 d = _mm256_div_ps(num, _mm256_add_ps(k, _mm256_loadu_ps(armor + i)));
+    // max(d, floor) like std::max: floor wins only when d < floor.
+    _mm256_storeu_ps(out + i, _mm256_blendv_ps(d, floor, _mm256_cmp_ps(d, floor, _CMP_LT_OQ)));
+  }
+  damage_scalar_from(f, armor, scale, i, n, out);
+}
+
+#undef KBS_AVX2
+
+constexpr KernelTable kAvx2Table = {SimdLevel::kAvx2, range_avx2,     cone_avx2,
+                                    distances_avx2,   integrate_avx2, damage_avx2};
+
+#endif  // KBS_KERNELS_AVX2
+
+#if KBS_KERNELS_NEON
+
+inline size_t emit_lanes(uint32x4_t m, size_t base, uint32_t* out, size_t count) {
+  if (vgetq_lane_u32(m, 0)) out[count++] = static_cast<uint32_t>(base + 0);
+  if (vgetq_lane_u32(m, 1)) out[count++] = static_cast<uint32_t>(base + 1);
+  if (vgetq_lane_u32(m, 2)) out[count++] = static_cast<uint32_t>(base + 2);
+  if (vgetq_lane_u32(m, 3)) out[count++] = static_cast<uint32_t>(base + 3);
+  return count;
+}
+
+size_t range_neon(const Vec3* p, size_t n, float cx, float cz, float r2, uint32_t* out) {
+  const float32x4_t vcx = vdupq_n_f32(cx), vcz = vdupq_n_f32(cz), vr2 = vdupq_n_f32(r2);
+  size_t count = 0, i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const float32x4x3_t v = vld3q_f32(reinterpret_cast<const float*>(p + i));
+    const float32x4_t dx = vsubq_f32(v.val[0], vcx);
+    const float32x4_t dz = vsubq_f32(v.val[2], vcz);
+    const float32x4_t d2 = vaddq_f32(vmulq_f32(dx, dx), vmulq_f32(dz, dz));
+    if (vmaxvq_u32(vcleq_f32(d2, vr2)) == 0) continue;
+    count = emit_lanes(vcleq_f32(d2, vr2), i, out, count);
+  }
+  return range_scalar_from(p, i, n, cx, cz, r2, out, count);
+}
+
+size_t cone_neon(const Vec3* p, size_t n, const Cone& c, uint32_t* out) {
+  const float32x4_t ox = vdupq_n_f32(c.ox), oz = vdupq_n_f32(c.oz);
+  const float32x4_t dir_x = vdupq_n_f32(c.dir_x), dir_z = vdupq_n_f32(c.dir_z);
+  const float32x4_t r2 = vdupq_n_f32(c.radius_sq), cos_half = vdupq_n_f32(c.cos_half);
+  size_t count = 0, i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const float32x4x3_t v = vld3q_f32(reinterpret_cast<const float*>(p + i));
+    const float32x4_t dx = vsubq_f32(v.val[0], ox);
+    const float32x4_t dz = vsubq_f32(v.val[2], oz);
+    const float32x4_t d2 = vaddq_f32(vmulq_f32(dx, dx), vmulq_f32(dz, dz));
+    const float32x4_t along = vaddq_f32(vmulq_f32(dx, dir_x), vmulq_f32(dz, dir_z));
+    const uint32x4_t hit = vandq_u32(vcleq_f32(d2, r2),
+                                     vcgeq_f32(along, vmulq_f32(cos_half, vsqrtq_f32(d2))));
+    if (vmaxvq_u32(hit) == 0) continue;
+    count = emit_lanes(hit, i, out, count);
+  }
+  return cone_scalar_from(p, i, n, c, out, count);
+}
+
+void distances_neon(const Vec3* p, size_t n, float cx, float cz, float* out) {
+  const float32x4_t vcx = vdupq_n_f32(cx), vcz = vdupq_n_f32(cz);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const float32x4x3_t v = vld3q_f32(reinterpret_cast<const float*>(p + i));
+    const float32x4_t dx = vsubq_f32(v.val[0], vcx);
+    const float32x4_t dz = vsubq_f32(v.val[2], vcz);
+    vst1q_f32(out + i, vaddq_f32(vmulq_f32(dx, dx), vmulq_f32(dz, dz)));
+  }
+  distances_scalar_from(p, i, n, cx, cz, out);
+}
+
+void integrate_neon(float* pos, const float* vel, size_t n, float dt) {
+  const float32x4_t vdt = vdupq_n_f32(dt);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    vst1q_f32(pos + i, vaddq_f32(vld1q_f32(pos + i), vmulq_f32(vld1q_f32(vel + i), vdt)));
+  }
+  integrate_scalar_from(pos, vel, i, n, dt);
+}
+
+void damage_neon(const DamageFormula& f, const float* armor, const float* scale, size_t n,
+                 float* out) {
+  const float32x4_t base = vdupq_n_f32(f.base), k = vdupq_n_f32(f.armor_k);
+  const float32x4_t floor = vdupq_n_f32(f.min_damage);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const float32x4_t num = vmulq_f32(vmulq_f32(base, vld1q_f32(scale + i)), k);
+    const float32x4_t d = vdivq_f32(num, vaddq_f32(k, vld1q_f32(armor + i)));
+    vst1q_f32(out + i, vbslq_f32(vcltq_f32(d, floor), floor, d));
+  }
+  damage_scalar_from(f, armor, scale, i, n, out);
+}
+
+constexpr KernelTable kNeonTable = {SimdLevel::kNeon, range_neon,     cone_neon,
+                                    distances_neon,   integrate_neon, damage_neon};
+
+#endif  // KBS_KERNELS_NEON
+
+const KernelTable* best_table() {
+#if KBS_KERNELS_AVX2
+  if (__builtin_cpu_supports("avx2")) return &kAvx2Table;
+#elif KBS_KERNELS_NEON
+  return &kNeonTable;
+#endif
+  return &kScalarTable;
+}
+
+std::atomic<const KernelTable*>& active() {
+  static std::atomic<const KernelTable*> table{best_table()};
+  return table;
+}
+
+const KernelTable& table() { return *active().load(std::memory_order_relaxed); }
+
+}  // namespace
+
+SimdLevel simd_level() { return table().level; }
+
+const char* simd_level_name(SimdLevel level) {
+  switch (level) {
+    case SimdLevel::kScalar: return "scalar";
+    case SimdLevel::kNeon: return "neon";
+    case SimdLevel::kAvx2: return "avx2";
+  }
+  return "unknown";
+}
+
+SimdLevel set_simd_level(SimdLevel level) {
+  const KernelTable* best = best_table();
+  active().store(level >= best->level ? best : &kScalarTable, std::memory_order_relaxed);
+  return simd_level();
+}
+
+size_t select_in_range(std::span<const Vec3> positions, Vec3 center, float radius,
+                       std::span<uint32_t> out) {
+  assert(out.size() >= positions.size());
+  return table().range(positions.data(), positions.size(), center.x, center.z, radius * radius,
+                       out.data());
+}
+
+size_t select_in_cone(std::span<const Vec3> positions, Vec3 origin, Vec3 direction,
+                      float radius, float half_angle, std::span<uint32_t> out) {
+  assert(out.size() >= positions.size());
+  const float len = std::sqrt(direction.x * direction.x + direction.z * direction.z);
+  if (half_angle >= 3.14159265f || len == 0) {
+    return select_in_range(positions, origin, radius, out);
+  }
+  const Cone c{origin.x,      origin.z, direction.x / len, direction.z / len, radius * radius,
+               std::cos(half_angle)};
+  return table().cone(positions.data(), positions.size(), c, out.data());
+}
+
+void distances_sq_xz(std::span<const Vec3> positions, Vec3 center, std::span<float> out) {
+  assert(out.size() >= positions.size());
+  table().distances(positions.data(), positions.size(), center.x, center.z, out.data());
+}
+
+void integrate(std::span<Vec3> positions, std::span<const Vec3> velocities, float dt) {
+  assert(positions.size() == velocities.size());
+  table().integrate(reinterpret_cast<float*>(positions.data()),
+                    reinterpret_cast<const float*>(velocities.data()), positions.size() * 3, dt);
+}
+
+void evaluate_damage(const DamageFormula& formula, std::span<const float> armor,
+                     std::span<const float> scale, std::span<float> out) {
+  assert(armor.size() == scale.size() && out.size() >= armor.size());
+  table().damage(formula, armor.data(), scale.data(), armor.size(), out.data());
+}
+
+}  // namespace kbs::kernels
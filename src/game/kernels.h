@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+#include "common/vec3.h"
+
+namespace kbs::kernels {
+
+// Batch kernels over component columns for combat and movement: an AoE
+// skill tests hundreds of positions at once instead of one entity per
+// call.  Each kernel has a scalar, an AVX2 (x86-64) and a NEON (aarch64)
+// version; the widest one the CPU supports is picked on first use.  All
+// versions evaluate the same expressions in the same order without fused
+// multiply-add (kernels.cpp is built with -ffp-contract=off), so they
+// return identical results and a hit test never depends on which machine
+// ran it.
+//
+// Range tests use ground-plane (x/z) distance, like AOI.  Selection
+// kernels write the indices of matching positions, in ascending order, to
+// out and return how many; out needs room for positions.size(), and
+// entries past the returned count are scratch.
+
+enum class SimdLevel : uint8_t { kScalar, kNeon, kAvx2 };
+
+SimdLevel simd_level();
+const char* simd_level_name(SimdLevel level);
+// Forces a level (benchmarks, cross-checks), clamped to what the CPU
+// supports; returns the level now in effect.  Not thread-safe against
+// kernels running concurrently.
+SimdLevel set_simd_level(SimdLevel level);
+
+// distance_xz(p, center) <= radius.
+size_t select_in_range(std::span<const Vec3> positions, Vec3 center, float radius,
+                       std::span<uint32_t> out);
+
+// In range and within half_angle (radians) of direction, both in x/z;
+// direction need not be normalized.  A position at the origin is a hit.
+size_t select_in_cone(std::span<const Vec3> positions, Vec3 origin, Vec3 direction,
+                      float radius, float half_angle, std::span<uint32_t> out);
+
+// out[i] = distance_sq_xz(positions[i], center), for culling and LOD
+// bucketing.
+void distances_sq_xz(std::span<const Vec3> positions, Vec3 center, std::span<float> out);
+
+// positions[i] += velocities[i] * dt.
+void integrate(std::span<Vec3> positions, std::span<const Vec3> velocities, float dt);
+
+// Armor mitigation: base * scale * armor_k / (armor_k + armor), floored
+// at min_damage.
+struct DamageFormula {
+  float base = 0;
+  float armor_k = 100;
+  float min_damage = 1;
+};
+
+// out[i] from armor[i] and scale[i] (crit, buffs, resistances folded by
+// the caller); the three spans have equal length.
+void evaluate_damage(const DamageFormula& formula, std::span<const float> armor,
+                     std::span<const float> scale, std::span<float> out);
+
+}  // namespace kbs::kernels
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <utility>
+
+#include "common/mpsc_queue.h"
+#include "common/types.h"
+#include "net/message_buffer.h"
+
+namespace kbs {
+
+enum class SendResult : uint8_t {
+  kOk,
+  // Accepted, but the mailbox is past its high-water mark: the sender
+  // should slow down (stop reading the socket, batch DB replies, ...).
+  kBackpressure,
+  // Rejected; the mailbox is full.
+  kFull,
+};
+
+struct MailboxOptions {
+  size_t capacity = 1u << 16;
+  // Depth at which send() starts reporting kBackpressure; 0 means 3/4 of
+  // capacity.
+  size_t high_water = 0;
+};
+
+// Inbox of one logic thread.  Any number of IO, DB or other logic threads
+// send(); the owning thread drains in batches, typically once per tick.
+// Backed by a bounded lock-free MPSC ring, so producers never park on a
+// futex and the consumer takes no lock at all.
+template <typename T>
+class Mailbox {
+ public:
+  explicit Mailbox(const MailboxOptions& options = {})
+      : queue_(options.capacity),
+        high_water_(options.high_water ? options.high_water : queue_.capacity() * 3 / 4) {}
+
+  // Called at most once per drain() by the first sender after it, e.g. to
+  // wake an idle EventLoop.  Set before any producer starts.
+  void set_notify(std::function<void()> fn) { notify_ = std::move(fn); }
+
+  template <typename U>
+  SendResult send(U&& msg) {
+    const size_t depth = queue_.size_approx();
+    if (!queue_.try_push(std::forward<U>(msg))) {
+      rejected_.fetch_add(1, std::memory_order_relaxed);
+      return SendResult::kFull;
+    }
+    if (notify_ && wants_notify_.exchange(false, std::memory_order_acq_rel)) notify_();
+    return depth >= high_water_ ? SendResult::kBackpressure : SendResult::kOk;
+  }
+
+  // Owner thread only.  Calls fn(T&) for up to max messages.
+  template <typename F>
+  size_t drain(F&& fn, size_t max = SIZE_MAX) {
+    const size_t n = queue_.drain(std::forward<F>(fn), max);
+    wants_notify_.store(true, std::memory_order_seq_cst);
+    // A sender that raced with the drain may have skipped its notify.
+    if (notify_ && queue_.size_approx() > 0 &&
+        wants_notify_.exchange(false, std::memory_order_acq_rel)) {
+      notify_();
+    }
+    return n;
+  }
+
+  size_t depth() const { return queue_.size_approx(); }
+  bool under_pressure() const { return depth() >= high_water_; }
+  size_t capacity() const { return queue_.capacity(); }
+  uint64_t rejected() const { return rejected_.load(std::memory_order_relaxed); }
+
+ private:
+  MpscQueue<T> queue_;
+  size_t high_water_;
+  std::function<void()> notify_;
+  std::atomic<bool> wants_notify_{true};
+  std::atomic<uint64_t> rejected_{0};
+};
+
+// Message addressed to an entity owned by another thread.  The payload is
+// a MessageBuffer so encoded packets move between threads by reference.
+struct EntityMessage {
+  EntityId to = kInvalidEntityId;
+  EntityId from = kInvalidEntityId;
+  uint32_t type = 0;
+  MessageBuffer body;
+};
+
+using EntityMailbox = Mailbox<EntityMessage>;
+
+}  // namespace kbs
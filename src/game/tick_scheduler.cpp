@@ -0,0 +1,185 @@
+#include "game/tick_scheduler.h"
+
+#include <algorithm>
+#include <thread>
+
+#include "metrics/metrics.h"
+#include "metrics/profiler.h"
+#include "metrics/trace.h"
+
+namespace kbs {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+std::vector<double> duration_buckets_us() { return Histogram::exponential(10, 2, 16); }
+
+struct TickMetrics {
+  Histogram& tick_us = metrics().histogram("kbs_tick_duration_us", "Wall time of whole ticks",
+                                           duration_buckets_us());
+  Counter& overruns = metrics().counter("kbs_tick_overruns_total", "Ticks over budget");
+  Counter& deferrals =
+      metrics().counter("kbs_system_deferrals_total", "Low-priority system runs deferred");
+  Gauge& arena_used =
+      metrics().gauge("kbs_tick_arena_used_bytes", "TickArena bytes used by the last tick");
+  Gauge& arena_reserved =
+      metrics().gauge("kbs_tick_arena_reserved_bytes", "TickArena bytes held from the heap");
+};
+
+TickMetrics& tick_metrics() {
+  static TickMetrics m;
+  return m;
+}
+
+uint32_t micros_since(Clock::time_point start, Clock::time_point end) {
+  const auto us = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+  return static_cast<uint32_t>(std::clamp<int64_t>(us, 0, UINT32_MAX));
+}
+
+}  // namespace
+
+TickScheduler::TimingRing::TimingRing(size_t capacity)
+    : samples_(std::make_unique<std::atomic<uint32_t>[]>(std::max<size_t>(capacity, 1))),
+      capacity_(std::max<size_t>(capacity, 1)) {}
+
+void TickScheduler::TimingRing::push(uint32_t us) {
+  const uint64_t n = written_.load(std::memory_order_relaxed);
+  samples_[n % capacity_].store(us, std::memory_order_relaxed);
+  written_.store(n + 1, std::memory_order_release);
+}
+
+std::vector<uint32_t> TickScheduler::TimingRing::read() const {
+  const uint64_t n = written_.load(std::memory_order_acquire);
+  const size_t count = static_cast<size_t>(std::min<uint64_t>(n, capacity_));
+  std::vector<uint32_t> out;
+  out.reserve(count);
+  for (uint64_t i = n - count; i < n; ++i) {
+    out.push_back(samples_[i % capacity_].load(std::memory_order_relaxed));
+  }
+  return out;
+}
+
+TickScheduler::TickScheduler(const TickSchedulerOptions& options)
+    : options_(options),
+      period_(std::chrono::microseconds(1000000 / std::max<uint32_t>(options.tick_hz, 1))),
+      budget_(options.budget.count() > 0 ? options.budget : period_),
+      tick_ring_(options.history),
+      arena_(options.arena_block_size) {}
+
+TickScheduler::~TickScheduler() = default;
+
+size_t TickScheduler::add_system(std::string name, SystemPriority priority, SystemFn fn) {
+  auto s = std::make_unique<System>();
+  s->name = std::move(name);
+  s->trace_name = tracer().intern(s->name);
+  s->priority = priority;
+  s->fn = std::move(fn);
+  s->ring = std::make_unique<TimingRing>(options_.history);
+  s->histogram = &metrics().histogram("kbs_system_duration_us", "Wall time of one system run",
+                                      duration_buckets_us(), {{"system", s->name}});
+  systems_.push_back(std::move(s));
+  return systems_.size() - 1;
+}
+
+void TickScheduler::run_once() {
+  KBS_TRACE_SCOPE("tick");
+  TickMetrics& m = tick_metrics();
+  const Clock::time_point start = Clock::now();
+  const Clock::time_point deadline = start + budget_;
+  TickContext ctx;
+  ctx.tick = tick_.load(std::memory_order_relaxed);
+  ctx.dt = std::chrono::duration<double>(period_).count();
+  ctx.started = start;
+  ctx.arena = &arena_;
+  ctx.jobs = jobs_;
+
+  report_.systems.clear();
+  Clock::time_point t = start;
+  for (size_t i = 0; i < systems_.size(); ++i) {
+    System& s = *systems_[i];
+    if (s.priority == SystemPriority::kLow && t >= deadline &&
+        s.consecutive_deferrals < options_.max_consecutive_deferrals) {
+      ++s.consecutive_deferrals;
+      s.deferrals.fetch_add(1, std::memory_order_relaxed);
+      m.deferrals.inc();
+      report_.systems.push_back({i, 0, true});
+      continue;
+    }
+    s.consecutive_deferrals = 0;
+    {
+      TraceSpan span(s.trace_name);
+      s.fn(ctx);
+    }
+    const Clock::time_point end = Clock::now();
+    const uint32_t us = micros_since(t, end);
+    s.ring->push(us);
+    s.histogram->observe(us);
+    s.runs.fetch_add(1, std::memory_order_relaxed);
+    report_.systems.push_back({i, us, false});
+    t = end;
+  }
+
+  m.arena_used.set(static_cast<int64_t>(arena_.bytes_used()));
+  arena_.reset();
+  m.arena_reserved.set(static_cast<int64_t>(arena_.bytes_reserved()));
+  const uint32_t total = micros_since(start, t);
+  tick_ring_.push(total);
+  m.tick_us.observe(total);
+  tick_.store(ctx.tick + 1, std::memory_order_release);
+  if (t > deadline) {
+    overruns_.fetch_add(1, std::memory_order_relaxed);
+    m.overruns.inc();
+    if (on_overrun_) {
+      report_.tick = ctx.tick;
+      report_.total_us = total;
+      report_.budget_us = static_cast<uint32_t>(budget_.count());
+      on_overrun_(report_);
+    }
+  }
+  if (on_profile_ && profiler().enabled()) on_profile_(profiler().report(ctx.tick));
+}
+
+void TickScheduler::run() {
+  stop_.store(false, std::memory_order_release);
+  Clock::time_point next = Clock::now();
+  while (!stop_.load(std::memory_order_acquire)) {
+    run_once();
+    next += period_;
+    const Clock::time_point now = Clock::now();
+    if (now < next) {
+      std::this_thread::sleep_until(next);
+    } else if (now - next > period_ * options_.max_catch_up_ticks) {
+      // Too far behind to catch up without a burst; resynchronise.
+      next = now;
+    }
+  }
+}
+
+std::vector<SystemTimings> TickScheduler::snapshot() const {
+  std::vector<SystemTimings> out;
+  out.reserve(systems_.size());
+  for (const auto& s : systems_) {
+    SystemTimings t;
+    t.name = s->name;
+    t.priority = s->priority;
+    t.runs = s->runs.load(std::memory_order_relaxed);
+    t.deferrals = s->deferrals.load(std::memory_order_relaxed);
+    t.history_us = s->ring->read();
+    if (!t.history_us.empty()) {
+      uint64_t sum = 0;
+      for (uint32_t us : t.history_us) {
+        sum += us;
+        t.max_us = std::max(t.max_us, us);
+      }
+      t.avg_us = static_cast<uint32_t>(sum / t.history_us.size());
+      t.last_us = t.history_us.back();
+    }
+    out.push_back(std::move(t));
+  }
+  return out;
+}
+
+std::vector<uint32_t> TickScheduler::tick_history() const { return tick_ring_.read(); }
+
+}  // namespace kbs
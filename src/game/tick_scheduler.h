@@ -0,0 +1,166 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "common/tick_arena.h"
+
+namespace kbs {
+
+class Histogram;
+class JobSystem;
+struct ProfileReport;
+
+enum class SystemPriority : uint8_t {
+  kCritical,  // always runs (movement, combat, replication)
+  kNormal,    // always runs
+  kLow,       // may be deferred when the tick is over budget
+};
+
+struct TickContext {
+  uint64_t tick = 0;
+  double dt = 0;  // fixed step in seconds
+  std::chrono::steady_clock::time_point started;
+  // Scratch memory reclaimed when the tick ends.
+  TickArena* arena = nullptr;
+  // Worker pool for fanning a system out across cores; null unless one was
+  // attached with set_job_system().
+  JobSystem* jobs = nullptr;
+};
+
+// Point-in-time view of one system's timing history.
+struct SystemTimings {
+  std::string name;
+  SystemPriority priority = SystemPriority::kNormal;
+  uint32_t last_us = 0;
+  uint32_t avg_us = 0;  // over the retained history
+  uint32_t max_us = 0;  // over the retained history
+  uint64_t runs = 0;
+  uint64_t deferrals = 0;
+  std::vector<uint32_t> history_us;  // oldest first
+};
+
+// Per-system breakdown of one tick, handed to the overrun callback.
+struct TickReport {
+  uint64_t tick = 0;
+  uint32_t total_us = 0;
+  uint32_t budget_us = 0;
+  struct Entry {
+    size_t system;
+    uint32_t us;
+    bool deferred;
+  };
+  std::vector<Entry> systems;
+};
+
+struct TickSchedulerOptions {
+  uint32_t tick_hz = 20;
+  // Wall-time budget per tick; 0 means the full period.
+  std::chrono::microseconds budget{0};
+  // Samples kept per system.
+  size_t history = 256;
+  // A low-priority system is never skipped more than this many ticks in a
+  // row, so deferral degrades it instead of starving it.
+  uint32_t max_consecutive_deferrals = 4;
+  // When the loop falls further behind than this, the missed ticks are
+  // dropped instead of being run back to back.
+  uint32_t max_catch_up_ticks = 3;
+  // Initial block of the per-tick arena.
+  size_t arena_block_size = TickArena::kDefaultBlockSize;
+};
+
+// Fixed-timestep game loop.  Systems run in registration order on the
+// thread that calls run()/run_once().  Every run's wall time goes into a
+// lock-free per-system ring that snapshot() may read from any thread.
+// Once a tick has used up its budget the remaining low-priority systems are
+// deferred to a later tick, and the overrun callback gets the breakdown.
+class TickScheduler {
+ public:
+  using SystemFn = std::function<void(const TickContext&)>;
+  using OverrunCallback = std::function<void(const TickReport&)>;
+  using ProfileCallback = std::function<void(const ProfileReport&)>;
+
+  explicit TickScheduler(const TickSchedulerOptions& options = {});
+  ~TickScheduler();
+
+  TickScheduler(const TickScheduler&) = delete;
+  TickScheduler& operator=(const TickScheduler&) = delete;
+
+  // Register before run(); returns the system's index.
+  size_t add_system(std::string name, SystemPriority priority, SystemFn fn);
+  void set_overrun_callback(OverrunCallback cb) { on_overrun_ = std::move(cb); }
+  // While profiler() is enabled, called after every tick with the
+  // per-subsystem time and allocations since the previous one.
+  void set_profile_callback(ProfileCallback cb) { on_profile_ = std::move(cb); }
+  // Handed to systems in TickContext::jobs.  The JobSystem must have been
+  // created on the thread that runs the scheduler.
+  void set_job_system(JobSystem* jobs) { jobs_ = jobs; }
+
+  // Runs one tick immediately.
+  void run_once();
+  // Runs ticks at the fixed rate until stop() is called.
+  void run();
+  // Thread-safe.
+  void stop() { stop_.store(true, std::memory_order_release); }
+
+  uint64_t tick() const { return tick_.load(std::memory_order_acquire); }
+  std::chrono::microseconds period() const { return period_; }
+  std::chrono::microseconds budget() const { return budget_; }
+
+  // Thread-safe snapshot of every system's timings.
+  std::vector<SystemTimings> snapshot() const;
+  // Whole-tick wall times, oldest first.
+  std::vector<uint32_t> tick_history() const;
+  uint64_t overruns() const { return overruns_.load(std::memory_order_relaxed); }
+
+  // Scheduler thread only.
+  const TickArena& arena() const { return arena_; }
+
+ private:
+  // Single-writer ring of microsecond samples.
+  class TimingRing {
+   public:
+    explicit TimingRing(size_t capacity);
+    void push(uint32_t us);
+    std::vector<uint32_t> read() const;
+
+   private:
+    std::unique_ptr<std::atomic<uint32_t>[]> samples_;
+    size_t capacity_;
+    std::atomic<uint64_t> written_{0};
+  };
+
+  struct System {
+    std::string name;
+    const char* trace_name = nullptr;  // interned: spans may outlive the scheduler
+    SystemPriority priority;
+    SystemFn fn;
+    std::unique_ptr<TimingRing> ring;
+    Histogram* histogram = nullptr;  // kbs_system_duration_us{system=name}
+    std::atomic<uint64_t> runs{0};
+    std::atomic<uint64_t> deferrals{0};
+    uint32_t consecutive_deferrals = 0;
+  };
+
+  TickSchedulerOptions options_;
+  std::chrono::microseconds period_;
+  std::chrono::microseconds budget_;
+  std::vector<std::unique_ptr<System>> systems_;
+  TimingRing tick_ring_;
+  TickArena arena_;
+  JobSystem* jobs_ = nullptr;
+  OverrunCallback on_overrun_;
+  ProfileCallback on_profile_;
+  TickReport report_;
+  std::atomic<uint64_t> tick_{0};
+  std::atomic<uint64_t> overruns_{0};
+  std::atomic<bool> stop_{false};
+};
+
+}  // namespace kbs
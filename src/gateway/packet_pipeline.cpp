@@ -0,0 +1,530 @@
+#include "gateway/packet_pipeline.h"
+
+#include <openssl/evp.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+
+#include "metrics/trace.h"
+#include "net/event_loop.h"
+
+namespace kbs {
+
+namespace {
+
+// What Z_SYNC_FLUSH leaves at the end of every flush; dropped on the wire
+// and put back before inflating, as permessage-deflate does.
+constexpr char kFlushTail[4] = {0, 0, '\xff', '\xff'};
+
+struct GatewayMetrics {
+  Counter& outbound = metrics().counter("kbs_gateway_packets_total", "Packets sealed or opened",
+                                        {{"dir", "out"}});
+  Counter& inbound = metrics().counter("kbs_gateway_packets_total", "Packets sealed or opened",
+                                       {{"dir", "in"}});
+  Counter& payload_bytes =
+      metrics().counter("kbs_gateway_payload_bytes_total", "Plain payload bytes, both directions");
+  Counter& wire_bytes =
+      metrics().counter("kbs_gateway_wire_bytes_total", "Sealed frame bytes, both directions");
+  Counter& bad_frames =
+      metrics().counter("kbs_gateway_bad_frames_total", "Inbound frames that failed to open");
+  Histogram& batch = metrics().histogram("kbs_gateway_batch_packets", "Packets per worker batch",
+                                         Histogram::exponential(1, 2, 14));
+};
+
+GatewayMetrics& gateway_metrics() {
+  static GatewayMetrics m;
+  return m;
+}
+
+void make_nonce(const CipherKeys& keys, uint64_t seq, unsigned char nonce[12]) {
+  std::memcpy(nonce, keys.iv.data(), 12);
+  for (int i = 0; i < 8; ++i) nonce[11 - i] ^= static_cast<unsigned char>(seq >> (8 * i));
+}
+
+void put_u32(char* p, uint32_t v) {
+  for (int i = 0; i < 4; ++i) p[i] = static_cast<char>(v >> (8 * i));
+}
+
+uint32_t get_u32(const char* p) {
+  uint32_t v = 0;
+  for (int i = 0; i < 4; ++i) {
+    v |= static_cast<uint32_t>(static_cast<unsigned char>(p[i])) << (8 * i);
+  }
+  return v;
+}
+
+EVP_CIPHER_CTX* make_cipher(const CipherKeys& keys, bool encrypt) {
+  EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+  if (!ctx) return nullptr;
+  // Key schedule once; per packet only the nonce changes.
+  if (EVP_CipherInit_ex(ctx, EVP_aes_256_gcm(), nullptr, keys.key.data(), keys.iv.data(),
+                        encrypt ? 1 : 0) != 1) {
+    EVP_CIPHER_CTX_free(ctx);
+    return nullptr;
+  }
+  return ctx;
+}
+
+}  // namespace
+
+size_t max_sealed_frame(size_t max_payload) {
+  return kSealedHeaderSize + compressBound(static_cast<uLong>(max_payload)) + kSealedTagSize;
+}
+
+SealedFrameStatus sealed_frame_length(std::string_view data, size_t& length,
+                                      size_t max_payload) {
+  if (data.size() < 4) return SealedFrameStatus::kIncomplete;
+  const size_t n = 4 + static_cast<size_t>(get_u32(data.data()));
+  if (n > max_sealed_frame(max_payload)) return SealedFrameStatus::kTooLarge;
+  if (data.size() < n) return SealedFrameStatus::kIncomplete;
+  length = n;
+  return SealedFrameStatus::kOk;
+}
+
+struct PacketCodec::State {
+  PacketCodecOptions options;
+  CipherKeys tx;
+  CipherKeys rx;
+  uint64_t tx_seq = 0;
+  uint64_t rx_seq = 0;
+  EVP_CIPHER_CTX* enc = nullptr;
+  EVP_CIPHER_CTX* dec = nullptr;
+  z_stream def{};
+  z_stream inf{};
+  bool def_ready = false;
+  bool inf_ready = false;
+  bool broken = false;
+  std::string scratch;  // compressed payload on seal, decrypted one on open
+
+  ~State() {
+    if (def_ready) deflateEnd(&def);
+    if (inf_ready) inflateEnd(&inf);
+    EVP_CIPHER_CTX_free(enc);
+    EVP_CIPHER_CTX_free(dec);
+  }
+
+  bool deflate_into(std::string_view in, std::string& out) {
+    out.clear();
+    def.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+    def.avail_in = static_cast<uInt>(in.size());
+    size_t produced = 0;
+    do {
+      out.resize(produced + in.size() / 2 + 64);
+      def.next_out = reinterpret_cast<Bytef*>(out.data() + produced);
+      def.avail_out = static_cast<uInt>(out.size() - produced);
+      if (deflate(&def, Z_SYNC_FLUSH) == Z_STREAM_ERROR) return false;
+      produced = out.size() - def.avail_out;
+    } while (def.avail_out == 0);
+    if (produced < sizeof(kFlushTail)) return false;
+    out.resize(produced - sizeof(kFlushTail));
+    return true;
+  }
+
+  bool inflate_into(std::string& in, std::string& out) {
+    in.append(kFlushTail, sizeof(kFlushTail));
+    inf.next_in = reinterpret_cast<Bytef*>(in.data());
+    inf.avail_in = static_cast<uInt>(in.size());
+    const size_t start = out.size();
+    size_t produced = start;
+    // One byte of room past max_payload tells a payload of exactly
+    // max_payload (room left over) from a longer one (room used up).
+    const size_t limit = options.max_payload + 1;
+    for (;;) {
+      out.resize(produced + std::min(limit - (produced - start), in.size() * 4));
+      inf.next_out = reinterpret_cast<Bytef*>(out.data() + produced);
+      inf.avail_out = static_cast<uInt>(out.size() - produced);
+      const int rc = inflate(&inf, Z_SYNC_FLUSH);
+      produced = out.size() - inf.avail_out;
+      // Z_STREAM_END too: the stream never ends while the connection lives.
+      if (rc != Z_OK && rc != Z_BUF_ERROR) return false;
+      if (produced - start > options.max_payload) return false;
+      if (inf.avail_in == 0 && inf.avail_out != 0) break;
+      if (rc == Z_BUF_ERROR && inf.avail_out != 0) return false;
+    }
+    out.resize(produced);
+    return true;
+  }
+};
+
+PacketCodec::PacketCodec(const CipherKeys& tx, const CipherKeys& rx,
+                         const PacketCodecOptions& options)
+    : s_(std::make_unique<State>()) {
+  State& s = *s_;
+  s.options = options;
+  s.tx = tx;
+  s.rx = rx;
+  s.enc = make_cipher(tx, true);
+  s.dec = make_cipher(rx, false);
+  if (!s.enc || !s.dec) throw std::runtime_error("packet codec: AES-256-GCM unavailable");
+  // Raw deflate: no zlib header or checksum per stream, GCM already
+  // authenticates every byte.
+  s.def_ready =
+      deflateInit2(&s.def, options.level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+  s.inf_ready = inflateInit2(&s.inf, -15) == Z_OK;
+  if (!s.def_ready || !s.inf_ready) throw std::runtime_error("packet codec: zlib init failed");
+  if (!options.dictionary.empty()) {
+    const auto* dict = reinterpret_cast<const Bytef*>(options.dictionary.data());
+    const auto len = static_cast<uInt>(options.dictionary.size());
+    if (deflateSetDictionary(&s.def, dict, len) != Z_OK ||
+        inflateSetDictionary(&s.inf, dict, len) != Z_OK) {
+      throw std::runtime_error("packet codec: bad dictionary");
+    }
+  }
+}
+
+PacketCodec::~PacketCodec() = default;
+
+bool PacketCodec::seal(std::string_view payload, std::string& out) {
+  State& s = *s_;
+  if (s.broken || payload.size() > s.options.max_payload) return false;
+  uint8_t flags = 0;
+  std::string_view body = payload;
+  if (payload.size() >= s.options.min_compress_size) {
+    if (!s.deflate_into(payload, s.scratch)) {
+      s.broken = true;
+      return false;
+    }
+    // Sent compressed even if it grew: the peer's inflater has to see
+    // every block to keep its window in step.
+    flags |= kSealedCompressed;
+    body = s.scratch;
+  }
+  const size_t frame = kSealedHeaderSize + body.size() + kSealedTagSize;
+  if (frame - 4 > INT32_MAX) {
+    s.broken = true;
+    return false;
+  }
+  const size_t at = out.size();
+  out.resize(at + frame);
+  char* p = out.data() + at;
+  put_u32(p, static_cast<uint32_t>(frame - 4));
+  p[4] = static_cast<char>(flags);
+
+  unsigned char nonce[12];
+  make_nonce(s.tx, s.tx_seq, nonce);
+  int len = 0;
+  auto* cipher = reinterpret_cast<unsigned char*>(p + kSealedHeaderSize);
+  const bool ok =
+      EVP_EncryptInit_ex(s.enc, nullptr, nullptr, nullptr, nonce) == 1 &&
+      EVP_EncryptUpdate(s.enc, nullptr, &len, &flags, 1) == 1 &&
+      EVP_EncryptUpdate(s.enc, cipher, &len, reinterpret_cast<const unsigned char*>(body.data()),
+                        static_cast<int>(body.size())) == 1 &&
+      EVP_EncryptFinal_ex(s.enc, cipher + len, &len) == 1 &&
+      EVP_CIPHER_CTX_ctrl(s.enc, EVP_CTRL_GCM_GET_TAG, kSealedTagSize,
+                          cipher + body.size()) == 1;
+  if (!ok) {
+    out.resize(at);
+    s.broken = true;
+    return false;
+  }
+  ++s.tx_seq;
+  return true;
+}
+
+bool PacketCodec::open(std::string_view frame, std::string& out) {
+  State& s = *s_;
+  if (s.broken) return false;
+  size_t length = 0;
+  if (frame.size() < kSealedHeaderSize + kSealedTagSize ||
+      sealed_frame_length(frame, length, s.options.max_payload) != SealedFrameStatus::kOk ||
+      length != frame.size()) {
+    s.broken = true;
+    return false;
+  }
+  unsigned char flags = static_cast<unsigned char>(frame[4]);
+  const size_t body_len = frame.size() - kSealedHeaderSize - kSealedTagSize;
+  const auto* cipher = reinterpret_cast<const unsigned char*>(frame.data() + kSealedHeaderSize);
+  const bool compressed = flags & kSealedCompressed;
+  if (!compressed && body_len > s.options.max_payload) {
+    s.broken = true;
+    return false;
+  }
+  std::string& plain = compressed ? s.scratch : out;
+  const size_t at = compressed ? 0 : out.size();
+  if (compressed) s.scratch.clear();
+  plain.resize(at + body_len);
+
+  unsigned char nonce[12];
+  make_nonce(s.rx, s.rx_seq, nonce);
+  int len = 0;
+  auto* dst = reinterpret_cast<unsigned char*>(plain.data() + at);
+  bool ok = EVP_DecryptInit_ex(s.dec, nullptr, nullptr, nullptr, nonce) == 1 &&
+            EVP_DecryptUpdate(s.dec, nullptr, &len, &flags, 1) == 1 &&
+            EVP_DecryptUpdate(s.dec, dst, &len, cipher, static_cast<int>(body_len)) == 1 &&
+            EVP_CIPHER_CTX_ctrl(s.dec, EVP_CTRL_GCM_SET_TAG, kSealedTagSize,
+                                const_cast<unsigned char*>(cipher + body_len)) == 1 &&
+            EVP_DecryptFinal_ex(s.dec, dst + len, &len) == 1;
+  const size_t out_size = out.size();
+  if (ok && compressed) ok = s.inflate_into(s.scratch, out);
+  if (!ok) {
+    out.resize(compressed ? out_size : at);
+    s.broken = true;
+    return false;
+  }
+  ++s.rx_seq;
+  return true;
+}
+
+std::string train_packet_dictionary(std::span<const std::string> samples, size_t max_size) {
+  // Recurring 8-byte grams, counted once per sample so one long sample
+  // cannot dominate.
+  constexpr size_t kGram = 8;
+  struct GramCount {
+    uint32_t samples = 0;
+    uint32_t last = UINT32_MAX;
+    const char* where = nullptr;
+  };
+  std::unordered_map<uint64_t, GramCount> grams;
+  for (size_t i = 0; i < samples.size(); ++i) {
+    const std::string& s = samples[i];
+    for (size_t at = 0; at + kGram <= s.size(); ++at) {
+      uint64_t key;
+      std::memcpy(&key, s.data() + at, kGram);
+      GramCount& g = grams[key];
+      if (g.last == i) continue;
+      g.last = static_cast<uint32_t>(i);
+      ++g.samples;
+      g.where = s.data() + at;
+    }
+  }
+  std::vector<std::pair<uint32_t, const char*>> ranked;
+  for (const auto& [key, g] : grams) {
+    if (g.samples >= 2) ranked.emplace_back(g.samples, g.where);
+  }
+  std::sort(ranked.begin(), ranked.end(), [](const auto& a, const auto& b) {
+    return a.first != b.first ? a.first > b.first
+                              : std::memcmp(a.second, b.second, kGram) < 0;
+  });
+  // Most frequent first here; reversed below so they end up nearest the
+  // data.  Grams already covered by an earlier pick add nothing.
+  std::string picked;
+  std::vector<std::string_view> pieces;
+  for (const auto& [count, where] : ranked) {
+    if (picked.size() + kGram > max_size) break;
+    const std::string_view gram(where, kGram);
+    if (picked.find(gram) != std::string::npos) continue;
+    picked.append(gram);
+    pieces.push_back(gram);
+  }
+  std::string dict;
+  dict.reserve(picked.size());
+  for (size_t i = pieces.size(); i-- > 0;) dict.append(pieces[i]);
+  return dict;
+}
+
+struct PacketPipeline::Job {
+  enum class Kind : uint8_t { kOpen, kClose, kPacket };
+  Kind kind = Kind::kPacket;
+  PacketDirection dir = PacketDirection::kOutbound;
+  uint64_t conn = 0;
+  std::string bytes;
+  // kOpen only.
+  EventLoop* loop = nullptr;
+  CipherKeys tx;
+  CipherKeys rx;
+  std::shared_ptr<const Deliver> deliver;
+};
+
+struct PacketPipeline::Worker {
+  struct Session {
+    std::unique_ptr<PacketCodec> codec;
+    EventLoop* loop = nullptr;
+    std::shared_ptr<const Deliver> deliver;
+    bool failed = false;
+  };
+
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::vector<Job> queue;
+  size_t queued_packets = 0;
+  bool stop = false;
+  std::thread thread;
+  // Worker thread only.
+  std::unordered_map<uint64_t, Session> sessions;
+
+  void push(Job job, bool& accepted, size_t max_packets) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      const bool packet = job.kind == Job::Kind::kPacket;
+      accepted = !packet || queued_packets < max_packets;
+      if (!accepted) return;
+      if (packet) ++queued_packets;
+      queue.push_back(std::move(job));
+    }
+    wake.notify_one();
+  }
+};
+
+PacketPipeline::PacketPipeline(const PacketPipelineOptions& options) : options_(options) {
+  const size_t n = std::max<size_t>(options_.num_threads, 1);
+  for (size_t i = 0; i < n; ++i) workers_.push_back(std::make_unique<Worker>());
+  for (size_t i = 0; i < n; ++i) {
+    workers_[i]->thread = std::thread([this, i, &w = *workers_[i]] {
+      place_current_thread(options_.placement, i);
+      run(w);
+    });
+  }
+  queue_gauge_ = metrics().add_callback_gauge(
+      "kbs_gateway_queued_packets", "Packets waiting for a gateway crypto worker", [this] {
+        size_t total = 0;
+        for (auto& w : workers_) {
+          std::lock_guard<std::mutex> lock(w->mutex);
+          total += w->queued_packets;
+        }
+        return static_cast<double>(total);
+      });
+}
+
+PacketPipeline::~PacketPipeline() {
+  metrics().remove_callback_gauge(queue_gauge_);
+  for (auto& w : workers_) {
+    {
+      std::lock_guard<std::mutex> lock(w->mutex);
+      w->stop = true;
+    }
+    w->wake.notify_one();
+  }
+  for (auto& w : workers_) w->thread.join();
+}
+
+void PacketPipeline::open_session(uint64_t conn, EventLoop& loop, const CipherKeys& tx,
+                                  const CipherKeys& rx, Deliver deliver) {
+  Job job;
+  job.kind = Job::Kind::kOpen;
+  job.conn = conn;
+  job.loop = &loop;
+  job.tx = tx;
+  job.rx = rx;
+  job.deliver = std::make_shared<const Deliver>(std::move(deliver));
+  bool accepted;
+  workers_[conn % workers_.size()]->push(std::move(job), accepted, options_.max_queued);
+}
+
+void PacketPipeline::close_session(uint64_t conn) {
+  Job job;
+  job.kind = Job::Kind::kClose;
+  job.conn = conn;
+  bool accepted;
+  workers_[conn % workers_.size()]->push(std::move(job), accepted, options_.max_queued);
+}
+
+bool PacketPipeline::submit(uint64_t conn, PacketDirection dir, std::string bytes) {
+  Job job;
+  job.conn = conn;
+  job.dir = dir;
+  job.bytes = std::move(bytes);
+  bool accepted;
+  workers_[conn % workers_.size()]->push(std::move(job), accepted, options_.max_queued);
+  if (!accepted) rejected_.fetch_add(1, std::memory_order_relaxed);
+  return accepted;
+}
+
+void PacketPipeline::run(Worker& w) {
+  struct Result {
+    std::shared_ptr<const Deliver> deliver;
+    uint64_t conn;
+    PacketDirection dir;
+    bool ok;
+    std::string bytes;
+  };
+  GatewayMetrics& m = gateway_metrics();
+  std::vector<Job> batch;
+  // Results grouped by destination loop; usually a handful of loops.
+  std::vector<std::pair<EventLoop*, std::vector<Result>>> out;
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(w.mutex);
+      w.wake.wait(lock, [&w] { return w.stop || !w.queue.empty(); });
+      if (w.stop) return;
+      batch.swap(w.queue);
+      w.queued_packets = 0;
+    }
+    KBS_TRACE_SCOPE("gateway.batch");
+    size_t packets = 0;
+    uint64_t payload_bytes = 0;
+    uint64_t wire_bytes = 0;
+    for (Job& job : batch) {
+      if (job.kind == Job::Kind::kOpen) {
+        Worker::Session session;
+        session.loop = job.loop;
+        session.deliver = std::move(job.deliver);
+        try {
+          session.codec = std::make_unique<PacketCodec>(job.tx, job.rx, options_.codec);
+        } catch (const std::exception&) {
+          // No codec: the first packet reports failure, like a bad frame.
+        }
+        w.sessions.insert_or_assign(job.conn, std::move(session));
+        continue;
+      }
+      if (job.kind == Job::Kind::kClose) {
+        w.sessions.erase(job.conn);
+        continue;
+      }
+      ++packets;
+      const auto it = w.sessions.find(job.conn);
+      if (it == w.sessions.end() || it->second.failed) continue;
+      Worker::Session& session = it->second;
+      std::string result;
+      bool ok;
+      if (!session.codec) {
+        ok = false;
+      } else if (job.dir == PacketDirection::kOutbound) {
+        ok = session.codec->seal(job.bytes, result);
+        payload_bytes += job.bytes.size();
+        wire_bytes += result.size();
+        m.outbound.inc();
+      } else {
+        ok = session.codec->open(job.bytes, result);
+        payload_bytes += result.size();
+        wire_bytes += job.bytes.size();
+        m.inbound.inc();
+      }
+      if (!ok) {
+        session.failed = true;
+        failures_.fetch_add(1, std::memory_order_relaxed);
+        m.bad_frames.inc();
+      }
+      auto slot = std::find_if(out.begin(), out.end(),
+                               [&](const auto& e) { return e.first == session.loop; });
+      if (slot == out.end()) slot = out.emplace(out.end(), session.loop, std::vector<Result>{});
+      slot->second.push_back(Result{session.deliver, job.conn, job.dir, ok, std::move(result)});
+    }
+    batch.clear();
+    packets_.fetch_add(packets, std::memory_order_relaxed);
+    payload_bytes_.fetch_add(payload_bytes, std::memory_order_relaxed);
+    wire_bytes_.fetch_add(wire_bytes, std::memory_order_relaxed);
+    m.payload_bytes.inc(payload_bytes);
+    m.wire_bytes.inc(wire_bytes);
+    if (packets) m.batch.observe(static_cast<double>(packets));
+    for (auto& [loop, results] : out) {
+      if (results.empty()) continue;
+      batches_.fetch_add(1, std::memory_order_relaxed);
+      loop->post([results = std::move(results)]() mutable {
+        for (Result& r : results) (*r.deliver)(r.conn, r.dir, r.ok, r.bytes);
+      });
+      results = {};
+    }
+    // Stale loops only accumulate while sessions churn; keep the list short.
+    if (out.size() > 64) out.clear();
+  }
+}
+
+PacketPipelineStats PacketPipeline::stats() const {
+  PacketPipelineStats s;
+  s.packets = packets_.load(std::memory_order_relaxed);
+  s.rejected = rejected_.load(std::memory_order_relaxed);
+  s.failures = failures_.load(std::memory_order_relaxed);
+  s.batches = batches_.load(std::memory_order_relaxed);
+  s.payload_bytes = payload_bytes_.load(std::memory_order_relaxed);
+  s.wire_bytes = wire_bytes_.load(std::memory_order_relaxed);
+  return s;
+}
+
+}  // namespace kbs
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "common/thread_placement.h"
+#include "metrics/metrics.h"
+
+namespace kbs {
+
+class EventLoop;
+
+// Sealed frame on the wire, client <-> gateway:
+//
+//   u32 LE  length of everything after it
+//   u8      flags (kSealedCompressed)
+//   ...     AES-256-GCM ciphertext of the (possibly deflated) payload
+//   16      GCM tag; the flags byte is authenticated as AAD
+//
+// Nonces are never sent: each direction XORs a packet counter into its
+// 12-byte IV (as TLS 1.3 does), which works because a TCP stream delivers
+// frames in order.
+constexpr size_t kSealedHeaderSize = 5;
+constexpr size_t kSealedTagSize = 16;
+constexpr uint8_t kSealedCompressed = 0x01;
+
+// One direction's key material, from the login handshake.
+struct CipherKeys {
+  std::array<uint8_t, 32> key{};
+  std::array<uint8_t, 12> iv{};
+};
+
+struct PacketCodecOptions {
+  // zlib level; 1 is the right trade for game traffic at gateway rates.
+  int level = 1;
+  // Payloads shorter than this are sent uncompressed.
+  size_t min_compress_size = 64;
+  // Preset dictionary (see train_packet_dictionary()); both ends must use
+  // the same bytes.  Empty for none.
+  std::string dictionary;
+  // Larger payloads fail seal(), and open() of a frame that would inflate
+  // past it fails instead of allocating.
+  size_t max_payload = 1u << 20;
+};
+
+enum class SealedFrameStatus : uint8_t { kOk, kIncomplete, kTooLarge };
+
+// Largest sealed frame, length prefix included, a codec with this
+// max_payload produces: deflate's worst-case growth plus header and tag.
+size_t max_sealed_frame(size_t max_payload);
+
+// Finds the complete sealed frame at the front of data; on kOk, length is
+// its size.  kTooLarge when the prefix announces more than
+// max_sealed_frame(max_payload): the connection should be dropped rather
+// than buffered for.
+SealedFrameStatus sealed_frame_length(std::string_view data, size_t& length,
+                                      size_t max_payload = PacketCodecOptions{}.max_payload);
+
+// One connection's compression and encryption state.  Deflate is
+// stateful across packets (sync-flushed per packet, so each frame decodes
+// on arrival), which is what makes small, repetitive game messages
+// compress at all; the dictionary primes the window before the first one.
+//
+// Not thread-safe; PacketPipeline keeps each codec on one worker.
+class PacketCodec {
+ public:
+  // tx seals outgoing frames, rx opens incoming ones; the peer holds the
+  // same keys swapped.  Throws std::runtime_error when zlib or OpenSSL
+  // cannot set up.
+  PacketCodec(const CipherKeys& tx, const CipherKeys& rx, const PacketCodecOptions& options = {});
+  ~PacketCodec();
+
+  PacketCodec(const PacketCodec&) = delete;
+  PacketCodec& operator=(const PacketCodec&) = delete;
+
+  // Appends one sealed frame for payload to out.  false for a payload
+  // over max_payload (the peer would reject it; the codec stays usable).
+  bool seal(std::string_view payload, std::string& out);
+  // frame is one complete sealed frame (sealed_frame_length() bytes);
+  // appends the payload to out.  false on a bad tag or corrupt stream,
+  // after which the codec is unusable and the connection must go.
+  bool open(std::string_view frame, std::string& out);
+
+ private:
+  struct State;
+  std::unique_ptr<State> s_;
+};
+
+// Builds a preset dictionary of at most max_size bytes from sample
+// payloads: substrings that recur across samples, most frequent last
+// (where deflate reaches them with the shortest distances).
+std::string train_packet_dictionary(std::span<const std::string> samples,
+                                    size_t max_size = 16 * 1024);
+
+enum class PacketDirection : uint8_t {
+  kOutbound,  // payload -> sealed frame for the client
+  kInbound,   // sealed frame from the client -> payload
+};
+
+struct PacketPipelineOptions {
+  size_t num_threads = 2;
+  // Crypto workers are CPU-bound: pin them beside the loops they serve.
+  ThreadPlacement placement;
+  // Packets queued per worker before submit() refuses (the connection is
+  // then too far behind and should be dropped).
+  size_t max_queued = 1u << 16;
+  PacketCodecOptions codec;
+};
+
+struct PacketPipelineStats {
+  uint64_t packets = 0;
+  uint64_t rejected = 0;  // submit() over max_queued
+  uint64_t failures = 0;  // bad frames
+  uint64_t batches = 0;   // deliveries posted to loops
+  uint64_t payload_bytes = 0;
+  uint64_t wire_bytes = 0;
+};
+
+// Compression and encryption for the gateway, off the network and logic
+// threads.
+//
+// The gateway's loops submit() packets as they arrive from clients or
+// from cell servers; worker threads seal/open them with the connection's
+// PacketCodec and hand results back to the connection's EventLoop.  Each
+// connection is pinned to one worker, so its codec needs no lock and its
+// packets stay in order.  A worker takes its whole queue per wakeup
+// and posts one task per destination loop per batch, so at peak the cost
+// per packet is the crypto itself plus a share of one post().  AES-GCM
+// goes through OpenSSL's EVP interface, which uses AES-NI/PCLMUL (or the
+// ARMv8 crypto extensions) when the CPU has them.
+class PacketPipeline {
+ public:
+  // Runs on the connection's loop.  ok is false when a packet could not be
+  // processed (typically an inbound frame that failed to open); the
+  // connection should then be closed, and nothing more is delivered for it.
+  using Deliver =
+      std::function<void(uint64_t conn, PacketDirection dir, bool ok, std::string& bytes)>;
+
+  explicit PacketPipeline(const PacketPipelineOptions& options = {});
+  // Joins the workers; queued packets are dropped.
+  ~PacketPipeline();
+
+  PacketPipeline(const PacketPipeline&) = delete;
+  PacketPipeline& operator=(const PacketPipeline&) = delete;
+
+  // Any thread.  Packets for conn submitted after open_session() are
+  // processed after it; results for conn go to deliver on loop, which must
+  // outlive the session.
+  void open_session(uint64_t conn, EventLoop& loop, const CipherKeys& tx, const CipherKeys& rx,
+                    Deliver deliver);
+  // Results still in flight are delivered; later submits are dropped.
+  void close_session(uint64_t conn);
+
+  // Any thread.  false when the worker's queue is full.
+  bool submit(uint64_t conn, PacketDirection dir, std::string bytes);
+
+  PacketPipelineStats stats() const;
+
+ private:
+  struct Job;
+  struct Worker;
+
+  void run(Worker& w);
+
+  PacketPipelineOptions options_;
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::atomic<uint64_t> packets_{0};
+  std::atomic<uint64_t> rejected_{0};
+  std::atomic<uint64_t> failures_{0};
+  std::atomic<uint64_t> batches_{0};
+  std::atomic<uint64_t> payload_bytes_{0};
+  std::atomic<uint64_t> wire_bytes_{0};
+  CallbackGaugeId queue_gauge_ = 0;  // kbs_gateway_queued_packets
+};
+
+}  // namespace kbs
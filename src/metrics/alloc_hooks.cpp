@@ -0,0 +1,88 @@
+#include <cstdlib>
+#include <new>
+
+#include "metrics/profiler.h"
+
+namespace {
+
+// Global operator new/delete for KBS_WITH_ALLOC_PROFILER builds; see
+// Profiler.  Every block carries a 16-byte header just below the pointer
+// handed out, recording the requested size, the allocating subsystem and
+// how far below the header the underlying malloc() block starts.
+struct Header {
+  uint64_t size;
+  uint32_t offset;  // user pointer - malloc() pointer
+  uint8_t subsystem;
+};
+static_assert(sizeof(Header) == 16);
+
+constexpr size_t kHeaderAlign = 16;
+
+void* tracked_alloc(size_t size, size_t align) noexcept {
+  const size_t offset = align <= kHeaderAlign ? kHeaderAlign : align;
+  void* base = align <= kHeaderAlign
+                   ? std::malloc(size + offset)
+                   : std::aligned_alloc(align, (size + offset + align - 1) / align * align);
+  if (!base) return nullptr;
+  char* user = static_cast<char*>(base) + offset;
+  Header* h = reinterpret_cast<Header*>(user) - 1;
+  h->size = size;
+  h->offset = static_cast<uint32_t>(offset);
+  h->subsystem = static_cast<uint8_t>(kbs::profiler_detail::tls.current);
+  kbs::profiler_detail::note_alloc(kbs::profiler_detail::tls.current, size);
+  return user;
+}
+
+void tracked_free(void* p) noexcept {
+  if (!p) return;
+  const Header* h = static_cast<const Header*>(p) - 1;
+  kbs::profiler_detail::note_free(static_cast<kbs::Subsystem>(h->subsystem), h->size);
+  std::free(static_cast<char*>(p) - h->offset);
+}
+
+void* throwing_alloc(size_t size, size_t align) {
+  for (;;) {
+    if (void* p = tracked_alloc(size, align)) return p;
+    std::new_handler handler = std::get_new_handler();
+    if (!handler) throw std::bad_alloc();
+    handler();
+  }
+}
+
+}  // namespace
+
+void* operator new(size_t size) { return throwing_alloc(size, 0); }
+void* operator new[](size_t size) { return throwing_alloc(size, 0); }
+void* operator new(size_t size, std::align_val_t al) {
+  return throwing_alloc(size, static_cast<size_t>(al));
+}
+void* operator new[](size_t size, std::align_val_t al) {
+  return throwing_alloc(size, static_cast<size_t>(al));
+}
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return tracked_alloc(size, 0); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+  return tracked_alloc(size, 0);
+}
+void* operator new(size_t size, std::align_val_t al, const std::nothrow_t&) noexcept {
+  return tracked_alloc(size, static_cast<size_t>(al));
+}
+void* operator new[](size_t size, std::align_val_t al, const std::nothrow_t&) noexcept {
+  return tracked_alloc(size, static_cast<size_t>(al));
+}
+
+void operator delete(void* p) noexcept { tracked_free(p); }
+void operator delete[](void* p) noexcept { tracked_free(p); }
+void operator delete(void* p, size_t) noexcept { tracked_free(p); }
+void operator delete[](void* p, size_t) noexcept { tracked_free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { tracked_free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { tracked_free(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { tracked_free(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { tracked_free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { tracked_free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { tracked_free(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept {
+  tracked_free(p);
+}
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept {
+  tracked_free(p);
+}
@@ -0,0 +1,236 @@
+#include "metrics/metrics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <stdexcept>
+
+namespace kbs {
+
+namespace metrics_detail {
+
+size_t thread_shard() {
+  static std::atomic<size_t> next{0};
+  thread_local const size_t shard = next.fetch_add(1, std::memory_order_relaxed) % kShards;
+  return shard;
+}
+
+}  // namespace metrics_detail
+
+namespace {
+
+void append_number(std::string& out, double v) {
+  if (std::isinf(v)) {
+    out += v > 0 ? "+Inf" : "-Inf";
+    return;
+  }
+  char buf[32];
+  const int n = std::snprintf(buf, sizeof(buf), "%.17g", v);
+  out.append(buf, static_cast<size_t>(n));
+}
+
+void append_number(std::string& out, uint64_t v) { out += std::to_string(v); }
+
+std::string render_labels(const MetricLabels& labels) {
+  std::string out;
+  for (const auto& [key, value] : labels) {
+    if (!out.empty()) out += ',';
+    out += key;
+    out += "=\"";
+    for (char c : value) {
+      if (c == '\\' || c == '"') {
+        out += '\\';
+        out += c;
+      } else if (c == '\n') {
+        out += "\\n";
+      } else {
+        out += c;
+      }
+    }
+    out += '"';
+  }
+  return out;
+}
+
+void append_series_name(std::string& out, std::string_view name, std::string_view suffix,
+                        std::string_view labels, std::string_view extra = {}) {
+  out += name;
+  out += suffix;
+  if (labels.empty() && extra.empty()) return;
+  out += '{';
+  out += labels;
+  if (!labels.empty() && !extra.empty()) out += ',';
+  out += extra;
+  out += '}';
+}
+
+}  // namespace
+
+// --- Counter / Histogram ----------------------------------------------------
+
+uint64_t Counter::value() const {
+  uint64_t sum = 0;
+  for (const Shard& s : shards_) sum += s.value.load(std::memory_order_relaxed);
+  return sum;
+}
+
+Histogram::Histogram(std::vector<double> bounds)
+    : bounds_(std::move(bounds)), shards_(std::make_unique<Shard[]>(metrics_detail::kShards)) {
+  std::sort(bounds_.begin(), bounds_.end());
+  bounds_.erase(std::unique(bounds_.begin(), bounds_.end()), bounds_.end());
+  for (size_t i = 0; i < metrics_detail::kShards; ++i) {
+    shards_[i].counts = std::make_unique<std::atomic<uint64_t>[]>(bounds_.size() + 1);
+  }
+}
+
+void Histogram::observe(double v) {
+  const size_t bucket =
+      static_cast<size_t>(std::lower_bound(bounds_.begin(), bounds_.end(), v) - bounds_.begin());
+  Shard& s = shards_[metrics_detail::thread_shard()];
+  s.counts[bucket].fetch_add(1, std::memory_order_relaxed);
+  s.sum.fetch_add(v, std::memory_order_relaxed);
+}
+
+Histogram::Snapshot Histogram::snapshot() const {
+  Snapshot snap;
+  snap.bounds = bounds_;
+  snap.counts.assign(bounds_.size() + 1, 0);
+  for (size_t i = 0; i < metrics_detail::kShards; ++i) {
+    const Shard& s = shards_[i];
+    for (size_t b = 0; b <= bounds_.size(); ++b) {
+      snap.counts[b] += s.counts[b].load(std::memory_order_relaxed);
+    }
+    snap.sum += s.sum.load(std::memory_order_relaxed);
+  }
+  for (uint64_t c : snap.counts) snap.count += c;
+  return snap;
+}
+
+std::vector<double> Histogram::exponential(double start, double factor, size_t count) {
+  std::vector<double> bounds;
+  bounds.reserve(count);
+  double v = start;
+  for (size_t i = 0; i < count; ++i, v *= factor) bounds.push_back(v);
+  return bounds;
+}
+
+// --- MetricsRegistry --------------------------------------------------------
+
+MetricsRegistry::Series& MetricsRegistry::series(std::string_view name, std::string_view help,
+                                                 Type type, const MetricLabels& labels) {
+  auto it = families_.find(name);
+  if (it == families_.end()) {
+    it = families_.emplace(std::string(name), Family{std::string(help), type, {}}).first;
+  } else if (it->second.type != type) {
+    throw std::logic_error("metric " + std::string(name) + " registered with another type");
+  }
+  Family& family = it->second;
+  std::string rendered = render_labels(labels);
+  for (auto& s : family.series) {
+    if (s->labels == rendered) return *s;
+  }
+  family.series.push_back(std::make_unique<Series>());
+  family.series.back()->labels = std::move(rendered);
+  return *family.series.back();
+}
+
+Counter& MetricsRegistry::counter(std::string_view name, std::string_view help,
+                                  const MetricLabels& labels) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Series& s = series(name, help, Type::kCounter, labels);
+  if (!s.counter) s.counter = std::make_unique<Counter>();
+  return *s.counter;
+}
+
+Gauge& MetricsRegistry::gauge(std::string_view name, std::string_view help,
+                              const MetricLabels& labels) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Series& s = series(name, help, Type::kGauge, labels);
+  if (!s.gauge) s.gauge = std::make_unique<Gauge>();
+  return *s.gauge;
+}
+
+Histogram& MetricsRegistry::histogram(std::string_view name, std::string_view help,
+                                      std::vector<double> bounds, const MetricLabels& labels) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Series& s = series(name, help, Type::kHistogram, labels);
+  if (!s.histogram) s.histogram = std::make_unique<Histogram>(std::move(bounds));
+  return *s.histogram;
+}
+
+CallbackGaugeId MetricsRegistry::add_callback_gauge(std::string_view name, std::string_view help,
+                                                    std::function<double()> fn,
+                                                    const MetricLabels& labels) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Series& s = series(name, help, Type::kGauge, labels);
+  const CallbackGaugeId id = next_callback_++;
+  s.callbacks.emplace_back(id, std::move(fn));
+  return id;
+}
+
+void MetricsRegistry::remove_callback_gauge(CallbackGaugeId id) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto& [name, family] : families_) {
+    for (auto& s : family.series) {
+      std::erase_if(s->callbacks, [id](const auto& cb) { return cb.first == id; });
+    }
+  }
+}
+
+void MetricsRegistry::render(std::string& out) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const auto& [name, family] : families_) {
+    out += "# HELP ";
+    out += name;
+    out += ' ';
+    out += family.help;
+    out += "\n# TYPE ";
+    out += name;
+    out += family.type == Type::kCounter ? " counter\n"
+           : family.type == Type::kGauge ? " gauge\n"
+                                         : " histogram\n";
+    for (const auto& s : family.series) {
+      if (family.type == Type::kCounter) {
+        append_series_name(out, name, "", s->labels);
+        out += ' ';
+        append_number(out, s->counter ? s->counter->value() : 0);
+        out += '\n';
+      } else if (family.type == Type::kGauge) {
+        double v = s->gauge ? static_cast<double>(s->gauge->value()) : 0;
+        for (const auto& [id, fn] : s->callbacks) v += fn();
+        append_series_name(out, name, "", s->labels);
+        out += ' ';
+        append_number(out, v);
+        out += '\n';
+      } else if (s->histogram) {
+        const Histogram::Snapshot snap = s->histogram->snapshot();
+        uint64_t cumulative = 0;
+        for (size_t b = 0; b < snap.counts.size(); ++b) {
+          cumulative += snap.counts[b];
+          std::string le = "le=\"";
+          append_number(le, b < snap.bounds.size() ? snap.bounds[b] : INFINITY);
+          le += '"';
+          append_series_name(out, name, "_bucket", s->labels, le);
+          out += ' ';
+          append_number(out, cumulative);
+          out += '\n';
+        }
+        append_series_name(out, name, "_sum", s->labels);
+        out += ' ';
+        append_number(out, snap.sum);
+        out += '\n';
+        append_series_name(out, name, "_count", s->labels);
+        out += ' ';
+        append_number(out, snap.count);
+        out += '\n';
+      }
+    }
+  }
+}
+
+MetricsRegistry& metrics() {
+  static MetricsRegistry* registry = new MetricsRegistry;  // never destroyed: used by statics
+  return *registry;
+}
+
+}  // namespace kbs
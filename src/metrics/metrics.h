@@ -0,0 +1,156 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "common/mpsc_queue.h"
+
+namespace kbs {
+
+// Constant labels of one series, e.g. {{"system", "movement"}}.
+using MetricLabels = std::vector<std::pair<std::string, std::string>>;
+
+namespace metrics_detail {
+
+// Writers spread over this many cache-line-sized shards by thread, so hot
+// counters never bounce a line between cores; readers sum the shards.
+constexpr size_t kShards = 32;
+
+// This thread's shard, assigned round-robin on first use.
+size_t thread_shard();
+
+}  // namespace metrics_detail
+
+// Monotonic count.  inc() is one relaxed add on a line no other thread
+// normally writes.
+class Counter {
+ public:
+  void inc(uint64_t n = 1) {
+    shards_[metrics_detail::thread_shard()].value.fetch_add(n, std::memory_order_relaxed);
+  }
+  uint64_t value() const;
+
+ private:
+  struct alignas(kCacheLine) Shard {
+    std::atomic<uint64_t> value{0};
+  };
+  Shard shards_[metrics_detail::kShards];
+};
+
+// Value that goes up and down (connections, bytes reserved).  A single
+// atomic: gauges are set far less often than counters are bumped.
+class Gauge {
+ public:
+  void set(int64_t v) { value_.store(v, std::memory_order_relaxed); }
+  void add(int64_t n) { value_.fetch_add(n, std::memory_order_relaxed); }
+  int64_t value() const { return value_.load(std::memory_order_relaxed); }
+
+ private:
+  std::atomic<int64_t> value_{0};
+};
+
+// Distribution over fixed upper bounds, Prometheus-style (cumulative on
+// export).  observe() finds the bucket by binary search and bumps it plus
+// the sum in this thread's shard.
+class Histogram {
+ public:
+  explicit Histogram(std::vector<double> bounds);
+
+  void observe(double v);
+
+  struct Snapshot {
+    std::vector<double> bounds;
+    std::vector<uint64_t> counts;  // per bucket, not cumulative; last is +Inf
+    uint64_t count = 0;
+    double sum = 0;
+  };
+  Snapshot snapshot() const;
+
+  // start, start * factor, ... (count bounds).
+  static std::vector<double> exponential(double start, double factor, size_t count);
+  // 50 us .. ~1.6 s in powers of two, for latencies in microseconds.
+  static std::vector<double> latency_us() { return exponential(50, 2, 16); }
+
+ private:
+  struct alignas(kCacheLine) Shard {
+    std::unique_ptr<std::atomic<uint64_t>[]> counts;
+    std::atomic<double> sum{0};
+  };
+
+  std::vector<double> bounds_;
+  std::unique_ptr<Shard[]> shards_;
+};
+
+using CallbackGaugeId = uint64_t;
+
+// Process-wide set of named series rendered in the Prometheus text format.
+//
+// Registration takes a mutex and is meant for start-up or object creation;
+// keep the returned reference (it lives as long as the registry) and
+// update it on the hot path:
+//
+//   static Counter& frames = metrics().counter("kbs_frames_total", "Frames parsed");
+//   frames.inc();
+//
+// Asking for an existing name and label set returns the same series.
+// Callback gauges are sampled at scrape time, which suits queue depths and
+// other values that are cheap to read but pointless to push; several
+// callbacks on one series are summed.
+class MetricsRegistry {
+ public:
+  Counter& counter(std::string_view name, std::string_view help, const MetricLabels& labels = {});
+  Gauge& gauge(std::string_view name, std::string_view help, const MetricLabels& labels = {});
+  // bounds apply when the series is created; later lookups ignore them.
+  Histogram& histogram(std::string_view name, std::string_view help, std::vector<double> bounds,
+                       const MetricLabels& labels = {});
+
+  CallbackGaugeId add_callback_gauge(std::string_view name, std::string_view help,
+                                     std::function<double()> fn, const MetricLabels& labels = {});
+  void remove_callback_gauge(CallbackGaugeId id);
+
+  // Prometheus text exposition format 0.0.4.
+  void render(std::string& out) const;
+  std::string render() const {
+    std::string out;
+    render(out);
+    return out;
+  }
+
+ private:
+  enum class Type : uint8_t { kCounter, kGauge, kHistogram };
+
+  struct Series {
+    std::string labels;  // rendered: a="x",b="y"
+    std::unique_ptr<Counter> counter;
+    std::unique_ptr<Gauge> gauge;
+    std::unique_ptr<Histogram> histogram;
+    std::vector<std::pair<CallbackGaugeId, std::function<double()>>> callbacks;
+  };
+  struct Family {
+    std::string help;
+    Type type;
+    std::vector<std::unique_ptr<Series>> series;
+  };
+
+  Series& series(std::string_view name, std::string_view help, Type type,
+                 const MetricLabels& labels);
+
+  mutable std::mutex mutex_;
+  std::map<std::string, Family, std::less<>> families_;
+  CallbackGaugeId next_callback_ = 1;
+};
+
+// The registry the framework's own instrumentation reports to.
+MetricsRegistry& metrics();
+
+}  // namespace kbs
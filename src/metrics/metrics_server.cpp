@@ -0,0 +1,92 @@
+#include "metrics/metrics_server.h"
+
+namespace kbs {
+
+namespace {
+
+TcpServerOptions server_options(const InetAddress& addr) {
+  TcpServerOptions opts;
+  opts.listen_addr = addr;
+  opts.num_loops = 1;
+  opts.max_output_bytes = 256u << 20;  // trace dumps get large
+  return opts;
+}
+
+void send_response(TcpConnection& conn, std::string_view status, std::string_view type,
+                   std::string_view body) {
+  std::string head = "HTTP/1.0 ";
+  head += status;
+  head += "\r\nContent-Type: ";
+  head += type;
+  head += "\r\nContent-Length: ";
+  head += std::to_string(body.size());
+  head += "\r\nConnection: close\r\n\r\n";
+  conn.send(head);
+  conn.send(body);
+  conn.shutdown();
+}
+
+}  // namespace
+
+MetricsServer::MetricsServer(const InetAddress& listen_addr, MetricsRegistry& registry,
+                             Tracer& tracer, Profiler& profiler)
+    : registry_(registry),
+      tracer_(tracer),
+      profiler_(profiler),
+      server_(server_options(listen_addr)) {
+  server_.set_message_callback(
+      [this](TcpConnection& conn, ByteBuffer& in) { on_message(conn, in); });
+}
+
+void MetricsServer::on_message(TcpConnection& conn, ByteBuffer& in) {
+  const std::string_view data = in.view();
+  const size_t end = data.find("\r\n\r\n");
+  if (end == std::string_view::npos) {
+    if (data.size() > kMaxRequestBytes) conn.force_close();
+    return;
+  }
+  // Request line: METHOD SP PATH SP VERSION.
+  const std::string_view line = data.substr(0, data.find("\r\n"));
+  const size_t sp1 = line.find(' ');
+  const size_t sp2 = sp1 == std::string_view::npos ? sp1 : line.find(' ', sp1 + 1);
+  if (sp2 == std::string_view::npos) {
+    send_response(conn, "400 Bad Request", "text/plain", "bad request\n");
+  } else {
+    std::string_view path = line.substr(sp1 + 1, sp2 - sp1 - 1);
+    path = path.substr(0, path.find('?'));
+    respond(conn, line.substr(0, sp1), path);
+  }
+  in.retrieve_all();
+}
+
+void MetricsServer::respond(TcpConnection& conn, std::string_view method, std::string_view path) {
+  if (method != "GET") {
+    send_response(conn, "405 Method Not Allowed", "text/plain", "GET only\n");
+    return;
+  }
+  if (path == "/metrics") {
+    std::string body;
+    registry_.render(body);
+    send_response(conn, "200 OK", "text/plain; version=0.0.4", body);
+  } else if (path == "/trace/start") {
+    tracer_.start();
+    send_response(conn, "200 OK", "text/plain", "tracing\n");
+  } else if (path == "/trace/stop" || path == "/trace") {
+    if (path == "/trace/stop") tracer_.stop();
+    std::string body;
+    tracer_.dump_chrome(body);
+    send_response(conn, "200 OK", "application/json", body);
+  } else if (path == "/profile/start") {
+    profiler_.start();
+    send_response(conn, "200 OK", "text/plain", "profiling\n");
+  } else if (path == "/profile/stop" || path == "/profile") {
+    if (path == "/profile/stop") profiler_.stop();
+    std::string body;
+    profiler_.totals().format(body);
+    send_response(conn, "200 OK", "text/plain", body);
+  } else {
+    send_response(conn, "404 Not Found", "text/plain", "not found\n");
+  }
+}
+
+}  // namespace kbs
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "metrics/metrics.h"
+#include "metrics/profiler.h"
+#include "metrics/trace.h"
+#include "net/tcp_server.h"
+
+namespace kbs {
+
+// Minimal HTTP/1.0 endpoint on its own reactor thread, for scrapers and
+// operators:
+//
+//   GET /metrics      Prometheus text format
+//   GET /trace/start  clear and start recording trace spans
+//   GET /trace/stop   stop recording and return the Chrome trace JSON
+//   GET /trace        the trace so far, without stopping
+//   GET /profile/start  zero and start per-subsystem profiling
+//   GET /profile/stop   stop it and return the totals
+//   GET /profile        the totals so far, without stopping
+//
+// One request per connection; the response is written and the connection
+// shut down.  Not meant to face the internet: bind it to a private
+// interface.
+class MetricsServer {
+ public:
+  explicit MetricsServer(const InetAddress& listen_addr, MetricsRegistry& registry = metrics(),
+                         Tracer& tracer = kbs::tracer(), Profiler& profiler = kbs::profiler());
+
+  MetricsServer(const MetricsServer&) = delete;
+  MetricsServer& operator=(const MetricsServer&) = delete;
+
+  // Throws std::system_error when the address cannot be bound.
+  void start() { server_.start(); }
+  void stop() { server_.stop(); }
+  uint16_t port() const { return server_.port(); }
+
+ private:
+  static constexpr size_t kMaxRequestBytes = 8192;
+
+  void on_message(TcpConnection& conn, ByteBuffer& in);
+  void respond(TcpConnection& conn, std::string_view method, std::string_view path);
+
+  MetricsRegistry& registry_;
+  Tracer& tracer_;
+  Profiler& profiler_;
+  TcpServer server_;
+};
+
+}  // namespace kbs
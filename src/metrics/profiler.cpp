@@ -0,0 +1,249 @@
+#include "metrics/profiler.h"
+
+#include <signal.h>
+#include <sys/time.h>
+
+#include <algorithm>
+#include <cstdio>
+
+#include "metrics/metrics.h"
+#include "metrics/trace.h"
+
+namespace kbs {
+
+namespace profiler_detail {
+
+thread_local constinit ThreadState tls;
+constinit std::atomic<bool> enabled{false};
+
+}  // namespace profiler_detail
+
+namespace {
+
+using metrics_detail::kShards;
+using metrics_detail::thread_shard;
+
+// Zero-initialized before any constructor runs: the allocation hooks fire
+// during static initialization.
+struct alignas(kCacheLine) TimeShard {
+  std::atomic<uint64_t> self_ns[kSubsystems];
+  std::atomic<uint64_t> scopes[kSubsystems];
+};
+
+struct alignas(kCacheLine) AllocShard {
+  std::atomic<uint64_t> bytes[kSubsystems];
+  std::atomic<uint64_t> allocs[kSubsystems];
+  std::atomic<uint64_t> freed_bytes[kSubsystems];
+  std::atomic<uint64_t> frees[kSubsystems];
+};
+
+constinit TimeShard g_time[kShards];
+constinit AllocShard g_alloc[kShards];
+constinit std::atomic<uint64_t> g_samples[kSubsystems];
+constinit std::atomic<uint64_t> g_started_ns{0};
+
+void on_sigprof(int) {
+  g_samples[static_cast<size_t>(profiler_detail::tls.current)].fetch_add(
+      1, std::memory_order_relaxed);
+}
+
+void append_bytes(std::string& out, double bytes) {
+  char buf[32];
+  if (bytes >= 1 << 20) {
+    std::snprintf(buf, sizeof(buf), "%.1f MB", bytes / (1 << 20));
+  } else if (bytes >= 1 << 10) {
+    std::snprintf(buf, sizeof(buf), "%.1f KB", bytes / (1 << 10));
+  } else {
+    std::snprintf(buf, sizeof(buf), "%.0f B", bytes);
+  }
+  out += buf;
+}
+
+}  // namespace
+
+namespace profiler_detail {
+
+void switch_to(Subsystem next, bool opening) {
+  const uint64_t now = Tracer::now_ns();
+  TimeShard& shard = g_time[thread_shard()];
+  // Time from before the current start() is not charged.
+  if (tls.current != Subsystem::kOther &&
+      tls.since_ns >= g_started_ns.load(std::memory_order_relaxed)) {
+    shard.self_ns[static_cast<size_t>(tls.current)].fetch_add(now - tls.since_ns,
+                                                              std::memory_order_relaxed);
+  }
+  tls.current = next;
+  tls.since_ns = now;
+  if (opening) shard.scopes[static_cast<size_t>(next)].fetch_add(1, std::memory_order_relaxed);
+}
+
+void note_alloc(Subsystem s, size_t bytes) {
+  AllocShard& shard = g_alloc[thread_shard()];
+  shard.bytes[static_cast<size_t>(s)].fetch_add(bytes, std::memory_order_relaxed);
+  shard.allocs[static_cast<size_t>(s)].fetch_add(1, std::memory_order_relaxed);
+}
+
+void note_free(Subsystem s, size_t bytes) {
+  AllocShard& shard = g_alloc[thread_shard()];
+  shard.freed_bytes[static_cast<size_t>(s)].fetch_add(bytes, std::memory_order_relaxed);
+  shard.frees[static_cast<size_t>(s)].fetch_add(1, std::memory_order_relaxed);
+}
+
+}  // namespace profiler_detail
+
+const char* subsystem_name(Subsystem s) {
+  static constexpr const char* kNames[kSubsystems] = {"other", "network", "aoi",
+                                                      "script", "db",      "timers"};
+  const size_t i = static_cast<size_t>(s);
+  return i < kSubsystems ? kNames[i] : "other";
+}
+
+void ProfileReport::format(std::string& out) const {
+  char buf[128];
+  std::snprintf(buf, sizeof(buf), "tick %llu  %.1f ms\n", static_cast<unsigned long long>(tick),
+                static_cast<double>(wall_ns) / 1e6);
+  out += buf;
+  for (size_t i = 0; i < kSubsystems; ++i) {
+    const SubsystemProfile& p = subsystems[i];
+    std::snprintf(buf, sizeof(buf), "  %-8s self %.2f ms  scopes %llu  samples %llu",
+                  subsystem_name(static_cast<Subsystem>(i)), static_cast<double>(p.self_ns) / 1e6,
+                  static_cast<unsigned long long>(p.scopes),
+                  static_cast<unsigned long long>(p.cpu_samples));
+    out += buf;
+    if (alloc_tracking) {
+      out += "  alloc ";
+      append_bytes(out, static_cast<double>(p.alloc_bytes));
+      out += '/' + std::to_string(p.allocs) + "  live ";
+      append_bytes(out, static_cast<double>(p.live_bytes));
+      out += '/' + std::to_string(p.live_objects);
+    }
+    out += '\n';
+  }
+}
+
+Profiler::Profiler() {
+  MetricsRegistry& reg = metrics();
+  for (size_t i = 0; i < kSubsystems; ++i) {
+    const MetricLabels labels = {{"subsystem", subsystem_name(static_cast<Subsystem>(i))}};
+    reg.add_callback_gauge(
+        "kbs_profile_self_seconds", "Wall time in the subsystem's scopes since profiling started",
+        [this, i] { return static_cast<double>(totals().subsystems[i].self_ns) / 1e9; }, labels);
+    reg.add_callback_gauge(
+        "kbs_profile_cpu_samples", "SIGPROF samples since profiling started",
+        [this, i] { return static_cast<double>(totals().subsystems[i].cpu_samples); }, labels);
+    if (!alloc_tracking()) continue;
+    reg.add_callback_gauge(
+        "kbs_profile_alloc_bytes", "Bytes allocated by the subsystem since process start",
+        [this, i] { return static_cast<double>(totals().subsystems[i].alloc_bytes); }, labels);
+    reg.add_callback_gauge(
+        "kbs_profile_live_bytes", "Bytes allocated by the subsystem and not yet freed",
+        [this, i] { return static_cast<double>(totals().subsystems[i].live_bytes); }, labels);
+    reg.add_callback_gauge(
+        "kbs_profile_live_objects", "Allocations by the subsystem not yet freed",
+        [this, i] { return static_cast<double>(totals().subsystems[i].live_objects); }, labels);
+  }
+}
+
+Profiler& profiler() {
+  // Leaked: allocation hooks and gauge callbacks may outlive static
+  // destruction.
+  static Profiler* p = new Profiler;
+  return *p;
+}
+
+bool Profiler::alloc_tracking() {
+#ifdef KBS_HAVE_ALLOC_PROFILER
+  return true;
+#else
+  return false;
+#endif
+}
+
+void Profiler::start(const ProfilerOptions& options) {
+  std::lock_guard lock(mutex_);
+  for (TimeShard& s : g_time) {
+    for (size_t i = 0; i < kSubsystems; ++i) {
+      s.self_ns[i].store(0, std::memory_order_relaxed);
+      s.scopes[i].store(0, std::memory_order_relaxed);
+    }
+  }
+  for (auto& s : g_samples) s.store(0, std::memory_order_relaxed);
+  started_ns_ = Tracer::now_ns();
+  g_started_ns.store(started_ns_, std::memory_order_relaxed);
+  last_ = totals();
+  last_ns_ = started_ns_;
+
+  if (options.sample_hz > 0 && !sampling_) {
+    struct sigaction sa = {};
+    sa.sa_handler = on_sigprof;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    if (::sigaction(SIGPROF, &sa, nullptr) == 0) {
+      const long us = std::max<long>(1000000 / static_cast<long>(options.sample_hz), 1);
+      itimerval timer = {};
+      timer.it_interval.tv_sec = us / 1000000;
+      timer.it_interval.tv_usec = us % 1000000;
+      timer.it_value = timer.it_interval;
+      sampling_ = ::setitimer(ITIMER_PROF, &timer, nullptr) == 0;
+    }
+  }
+  profiler_detail::enabled.store(true, std::memory_order_relaxed);
+}
+
+void Profiler::stop() {
+  std::lock_guard lock(mutex_);
+  profiler_detail::enabled.store(false, std::memory_order_relaxed);
+  if (sampling_) {
+    const itimerval off = {};
+    ::setitimer(ITIMER_PROF, &off, nullptr);
+    // A sample already in flight still finds the handler.
+    sampling_ = false;
+  }
+}
+
+ProfileReport Profiler::totals() const {
+  ProfileReport r;
+  r.alloc_tracking = alloc_tracking();
+  const uint64_t started = g_started_ns.load(std::memory_order_relaxed);
+  if (started != 0) r.wall_ns = Tracer::now_ns() - started;
+  for (size_t i = 0; i < kSubsystems; ++i) {
+    SubsystemProfile& p = r.subsystems[i];
+    uint64_t freed_bytes = 0;
+    uint64_t frees = 0;
+    for (size_t s = 0; s < kShards; ++s) {
+      p.self_ns += g_time[s].self_ns[i].load(std::memory_order_relaxed);
+      p.scopes += g_time[s].scopes[i].load(std::memory_order_relaxed);
+      p.alloc_bytes += g_alloc[s].bytes[i].load(std::memory_order_relaxed);
+      p.allocs += g_alloc[s].allocs[i].load(std::memory_order_relaxed);
+      freed_bytes += g_alloc[s].freed_bytes[i].load(std::memory_order_relaxed);
+      frees += g_alloc[s].frees[i].load(std::memory_order_relaxed);
+    }
+    p.cpu_samples = g_samples[i].load(std::memory_order_relaxed);
+    p.live_bytes = static_cast<int64_t>(p.alloc_bytes - freed_bytes);
+    p.live_objects = static_cast<int64_t>(p.allocs - frees);
+  }
+  return r;
+}
+
+ProfileReport Profiler::report(uint64_t tick) {
+  std::lock_guard lock(mutex_);
+  const uint64_t now = Tracer::now_ns();
+  ProfileReport cur = totals();
+  ProfileReport delta = cur;
+  delta.tick = tick;
+  delta.wall_ns = now - last_ns_;
+  for (size_t i = 0; i < kSubsystems; ++i) {
+    SubsystemProfile& d = delta.subsystems[i];
+    const SubsystemProfile& prev = last_.subsystems[i];
+    d.self_ns -= prev.self_ns;
+    d.scopes -= prev.scopes;
+    d.cpu_samples -= prev.cpu_samples;
+    d.alloc_bytes -= prev.alloc_bytes;
+    d.allocs -= prev.allocs;
+  }
+  last_ = cur;
+  last_ns_ = now;
+  return delta;
+}
+
+}  // namespace kbs
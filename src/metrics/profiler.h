@@ -0,0 +1,163 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+namespace kbs {
+
+// Coarse owner of a stretch of work, for attributing time and memory.
+enum class Subsystem : uint8_t { kOther, kNetwork, kAoi, kScript, kDb, kTimers };
+constexpr size_t kSubsystems = 6;
+
+// "other", "network", "aoi", "script", "db", "timers".
+const char* subsystem_name(Subsystem s);
+
+struct ProfilerOptions {
+  // SIGPROF samples per second of process CPU time, attributed to the
+  // subsystem each interrupted thread was in; 0 leaves the signal alone
+  // (e.g. when perf or gperftools owns it).
+  uint32_t sample_hz = 97;
+};
+
+struct SubsystemProfile {
+  uint64_t self_ns = 0;      // wall time inside the subsystem's scopes, nested ones excluded
+  uint64_t scopes = 0;       // scopes entered
+  uint64_t cpu_samples = 0;  // SIGPROF samples that landed in it
+  uint64_t alloc_bytes = 0;  // operator new, by the allocating subsystem
+  uint64_t allocs = 0;
+  // Still allocated: what it allocated minus what has been freed of that,
+  // whoever freed it.  Always a total, also in per-tick reports.
+  int64_t live_bytes = 0;
+  int64_t live_objects = 0;
+};
+
+struct ProfileReport {
+  uint64_t tick = 0;
+  uint64_t wall_ns = 0;  // covered by this report
+  bool alloc_tracking = false;
+  std::array<SubsystemProfile, kSubsystems> subsystems{};
+
+  const SubsystemProfile& operator[](Subsystem s) const {
+    return subsystems[static_cast<size_t>(s)];
+  }
+  // One line per subsystem, for logs:
+  //   tick 1234 50.0 ms  network  self 3.1 ms  samples 2  alloc 58.2 KB/812  live 1.2 MB/9310
+  void format(std::string& out) const;
+};
+
+// Per-subsystem time and allocation attribution, cheap enough to leave on
+// one canary shard.
+//
+// Code declares which subsystem it works for with KBS_PROFILE_SCOPE, and
+// the innermost scope wins: the network loop tags its dispatch, AoiGrid
+// its update and queries, ScriptVm its calls, WriteBehindCache its I/O
+// thread and TimerWheel its expiry; a game callback reached from any of
+// those can open a scope of its own.  Outside every scope a thread is in
+// kOther.  The tag is a thread-local byte kept whether or not profiling
+// is on, so allocations are attributed from process start.
+//
+// Two layers, both off by default:
+//
+//  * Runtime (start()/stop(), or /profile/start on the MetricsServer):
+//    scopes charge exclusive wall time to their subsystem -- two clock
+//    reads per scope boundary -- and a SIGPROF timer samples where CPU
+//    time goes, including time outside any scope.
+//  * Build (cmake -DKBS_WITH_ALLOC_PROFILER=ON): global operator new and
+//    delete put a 16-byte header on every block recording the allocating
+//    subsystem and size, so each subsystem's bytes allocated and live
+//    objects are known and a leak shows up as one subsystem's live count
+//    growing tick over tick.  Costs the header plus two relaxed adds on a
+//    per-thread shard per call.  Memory from malloc() directly or from
+//    the Python heap is not seen.
+//
+// report() returns the delta since its previous call, so one call per
+// tick -- TickScheduler::set_profile_callback() does it -- gives per-tick
+// reports; totals are also exported as kbs_profile_* callback gauges.
+class Profiler {
+ public:
+  bool enabled() const;
+  // Zeroes the time counters and starts timing (and sampling).
+  void start(const ProfilerOptions& options = {});
+  void stop();
+
+  // Since start() for time, since process start for allocations.
+  ProfileReport totals() const;
+  // Difference from the previous report() (or start()).  One caller,
+  // normally the tick thread.
+  ProfileReport report(uint64_t tick);
+
+  // Whether this build tracks allocations (KBS_WITH_ALLOC_PROFILER).
+  static bool alloc_tracking();
+
+ private:
+  friend Profiler& profiler();
+  Profiler();
+
+  std::mutex mutex_;  // start/stop/report
+  bool sampling_ = false;
+  uint64_t started_ns_ = 0;
+  uint64_t last_ns_ = 0;
+  ProfileReport last_;
+};
+
+Profiler& profiler();
+
+namespace profiler_detail {
+
+struct ThreadState {
+  Subsystem current = Subsystem::kOther;
+  uint64_t since_ns = 0;  // when current was entered, while enabled
+};
+
+extern thread_local constinit ThreadState tls;
+extern constinit std::atomic<bool> enabled;
+
+// Charges the time since the last boundary to the subsystem being left.
+void switch_to(Subsystem next, bool opening);
+
+inline void enter(Subsystem s, bool opening) {
+  if (enabled.load(std::memory_order_relaxed)) {
+    switch_to(s, opening);
+  } else {
+    tls.current = s;
+  }
+}
+
+// Called by the allocation hooks.
+void note_alloc(Subsystem s, size_t bytes);
+void note_free(Subsystem s, size_t bytes);
+
+}  // namespace profiler_detail
+
+inline bool Profiler::enabled() const {
+  return profiler_detail::enabled.load(std::memory_order_relaxed);
+}
+
+// Sets the calling thread's subsystem for its lifetime.  Disabled, each end
+// of a scope is a relaxed load and a thread-local store.
+class SubsystemScope {
+ public:
+  explicit SubsystemScope(Subsystem s) : prev_(profiler_detail::tls.current) {
+    profiler_detail::enter(s, true);
+  }
+  ~SubsystemScope() { profiler_detail::enter(prev_, false); }
+
+  SubsystemScope(const SubsystemScope&) = delete;
+  SubsystemScope& operator=(const SubsystemScope&) = delete;
+
+ private:
+  Subsystem prev_;
+};
+
+}  // namespace kbs
+
+#define KBS_PROFILE_CONCAT_INNER(a, b) a##b
+#define KBS_PROFILE_CONCAT(a, b) KBS_PROFILE_CONCAT_INNER(a, b)
+// KBS_PROFILE_SCOPE(kAoi); attributes the rest of the enclosing block.
+#define KBS_PROFILE_SCOPE(subsystem)                                       \
+  ::kbs::SubsystemScope KBS_PROFILE_CONCAT(kbs_profile_scope_, __LINE__)( \
+      ::kbs::Subsystem::subsystem)
@@ -0,0 +1,118 @@
+#include "metrics/trace.h"
+
+#include <unistd.h>
+
+#include <cstdio>
+
+namespace kbs {
+
+namespace {
+
+void append_json_string(std::string& out, std::string_view s) {
+  out += '"';
+  for (char c : s) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char buf[8];
+      std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+      out += buf;
+    } else {
+      out += c;
+    }
+  }
+  out += '"';
+}
+
+}  // namespace
+
+Tracer::ThreadBuffer& Tracer::local() {
+  // One buffer per thread per process; the tracer is a singleton.
+  thread_local std::shared_ptr<ThreadBuffer> buffer;
+  if (!buffer) {
+    buffer = std::make_shared<ThreadBuffer>();
+    std::lock_guard<std::mutex> lock(mutex_);
+    buffer->tid = static_cast<uint32_t>(buffers_.size() + 1);
+    buffers_.push_back(buffer);
+  }
+  return *buffer;
+}
+
+void Tracer::start() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& b : buffers_) {
+      std::lock_guard<std::mutex> blk(b->mutex);
+      b->events.clear();
+    }
+  }
+  dropped_.store(0, std::memory_order_relaxed);
+  enabled_.store(true, std::memory_order_relaxed);
+}
+
+void Tracer::record(const char* name, uint64_t begin_ns, uint64_t end_ns) {
+  ThreadBuffer& b = local();
+  std::lock_guard<std::mutex> lock(b.mutex);
+  if (b.events.size() >= kMaxEventsPerThread) {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  b.events.push_back({name, begin_ns, end_ns});
+}
+
+const char* Tracer::intern(std::string_view name) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return interned_.emplace(name).first->c_str();
+}
+
+void Tracer::set_thread_name(std::string_view name) {
+  ThreadBuffer& b = local();
+  std::lock_guard<std::mutex> lock(b.mutex);
+  b.name.assign(name);
+}
+
+void Tracer::dump_chrome(std::string& out) const {
+  const int pid = static_cast<int>(::getpid());
+  std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    buffers = buffers_;
+  }
+  out += "{\"traceEvents\":[";
+  bool first = true;
+  char buf[128];
+  for (const auto& b : buffers) {
+    std::lock_guard<std::mutex> lock(b->mutex);
+    if (!b->name.empty()) {
+      if (!first) out += ',';
+      first = false;
+      std::snprintf(buf, sizeof(buf),
+                    "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,\"tid\":%u,"
+                    "\"args\":{\"name\":",
+                    pid, b->tid);
+      out += buf;
+      append_json_string(out, b->name);
+      out += "}}";
+    }
+    for (const Event& e : b->events) {
+      if (!first) out += ',';
+      first = false;
+      out += "{\"ph\":\"X\",\"name\":";
+      append_json_string(out, e.name);
+      // Chrome wants microseconds; keep the nanosecond part as decimals.
+      std::snprintf(buf, sizeof(buf), ",\"pid\":%d,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", pid,
+                    b->tid, static_cast<double>(e.begin_ns) / 1000.0,
+                    static_cast<double>(e.end_ns - e.begin_ns) / 1000.0);
+      out += buf;
+    }
+  }
+  out += "],\"displayTimeUnit\":\"ms\"}";
+}
+
+Tracer& tracer() {
+  static Tracer* instance = new Tracer;  // never destroyed: spans may run in static destructors
+  return *instance;
+}
+
+}  // namespace kbs
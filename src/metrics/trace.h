@@ -0,0 +1,103 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+namespace kbs {
+
+// Scoped trace spans dumped as Chrome trace JSON (chrome://tracing,
+// Perfetto).  Off by default: a disabled span costs one relaxed load and
+// a branch, so spans can stay in hot code permanently and be switched on
+// in production when a spike needs explaining.
+//
+// Each thread records into its own buffer (an uncontended mutex, taken
+// only while tracing); dump readers lock one buffer at a time.  Span names
+// must outlive the dump: string literals, or intern()ed copies of names
+// built at run time.
+class Tracer {
+ public:
+  struct Event {
+    const char* name;
+    uint64_t begin_ns;
+    uint64_t end_ns;
+  };
+
+  // Events kept per thread between dumps; later ones are counted as
+  // dropped.
+  static constexpr size_t kMaxEventsPerThread = 1u << 18;
+
+  bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+  // Clears what was recorded before and starts recording.
+  void start();
+  void stop() { enabled_.store(false, std::memory_order_relaxed); }
+
+  void record(const char* name, uint64_t begin_ns, uint64_t end_ns);
+  // A copy of name that lives as long as the process, for span names
+  // whose owner may go away first.  Equal names share one copy; meant for
+  // setup paths, not per span.
+  const char* intern(std::string_view name);
+  // Names the calling thread in the dump ("loop-0", "tick").
+  void set_thread_name(std::string_view name);
+
+  // {"traceEvents":[...]} with one complete ("X") event per span.
+  void dump_chrome(std::string& out) const;
+  uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+  static uint64_t now_ns() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                     std::chrono::steady_clock::now().time_since_epoch())
+                                     .count());
+  }
+
+ private:
+  struct ThreadBuffer {
+    std::mutex mutex;
+    uint32_t tid = 0;
+    std::string name;
+    std::vector<Event> events;
+  };
+
+  ThreadBuffer& local();
+
+  std::atomic<bool> enabled_{false};
+  std::atomic<uint64_t> dropped_{0};
+  mutable std::mutex mutex_;
+  // Buffers outlive their threads so a dump still shows them.
+  std::vector<std::shared_ptr<ThreadBuffer>> buffers_;
+  // Node-based, so interned pointers stay put as it grows.
+  std::unordered_set<std::string> interned_;
+};
+
+Tracer& tracer();
+
+// Records [construction, destruction) under name when tracing is on.
+class TraceSpan {
+ public:
+  explicit TraceSpan(const char* name)
+      : name_(tracer().enabled() ? name : nullptr), begin_ns_(name_ ? Tracer::now_ns() : 0) {}
+  ~TraceSpan() {
+    if (name_) tracer().record(name_, begin_ns_, Tracer::now_ns());
+  }
+
+  TraceSpan(const TraceSpan&) = delete;
+  TraceSpan& operator=(const TraceSpan&) = delete;
+
+ private:
+  const char* name_;
+  uint64_t begin_ns_;
+};
+
+}  // namespace kbs
+
+#define KBS_TRACE_CONCAT_INNER(a, b) a##b
+#define KBS_TRACE_CONCAT(a, b) KBS_TRACE_CONCAT_INNER(a, b)
+// KBS_TRACE_SCOPE("aoi.update"); traces the rest of the enclosing block.
+#define KBS_TRACE_SCOPE(name) ::kbs::TraceSpan KBS_TRACE_CONCAT(kbs_trace_span_, __LINE__)(name)
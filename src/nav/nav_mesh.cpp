@@ -0,0 +1,370 @@
+#include "nav/nav_mesh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+namespace kbs {
+
+namespace {
+
+constexpr float kEpsilon = 1e-5f;
+
+// > 0 when c lies left of a->b in the x/z plane (x right, z up).
+inline float side(Vec3 a, Vec3 b, Vec3 c) {
+  return (b.x - a.x) * (c.z - a.z) - (b.z - a.z) * (c.x - a.x);
+}
+
+inline bool same_xz(Vec3 a, Vec3 b) { return distance_sq_xz(a, b) < kEpsilon * kEpsilon; }
+
+inline Vec3 midpoint(Vec3 a, Vec3 b) { return (a + b) * 0.5f; }
+
+Vec3 closest_on_segment_xz(Vec3 p, Vec3 a, Vec3 b) {
+  const float dx = b.x - a.x;
+  const float dz = b.z - a.z;
+  const float len_sq = dx * dx + dz * dz;
+  float t = len_sq > 0 ? ((p.x - a.x) * dx + (p.z - a.z) * dz) / len_sq : 0;
+  t = std::clamp(t, 0.0f, 1.0f);
+  return a + (b - a) * t;
+}
+
+[[noreturn]] void invalid(size_t poly, const char* what) {
+  throw std::invalid_argument("navmesh polygon " + std::to_string(poly) + ": " + what);
+}
+
+}  // namespace
+
+NavMesh::NavMesh(NavMeshData data, float cell_size)
+    : vertices_(std::move(data.vertices)), cell_size_(cell_size) {
+  if (!(cell_size_ > 0)) throw std::invalid_argument("navmesh cell size must be positive");
+  polys_.reserve(data.polygons.size());
+  for (size_t pi = 0; pi < data.polygons.size(); ++pi) {
+    std::vector<uint32_t>& idx = data.polygons[pi];
+    if (idx.size() < 3 || idx.size() > kMaxVertsPerPoly) invalid(pi, "bad vertex count");
+    for (uint32_t v : idx) {
+      if (v >= vertices_.size()) invalid(pi, "vertex index out of range");
+    }
+    float area = 0;
+    for (size_t i = 0; i < idx.size(); ++i) {
+      const Vec3 a = vertices_[idx[i]];
+      const Vec3 b = vertices_[idx[(i + 1) % idx.size()]];
+      area += a.x * b.z - b.x * a.z;
+    }
+    if (std::fabs(area) < kEpsilon) invalid(pi, "degenerate");
+    if (area < 0) std::reverse(idx.begin(), idx.end());
+    for (size_t i = 0; i < idx.size(); ++i) {
+      const Vec3 a = vertices_[idx[i]];
+      const Vec3 b = vertices_[idx[(i + 1) % idx.size()]];
+      const Vec3 c = vertices_[idx[(i + 2) % idx.size()]];
+      if (side(a, b, c) < -kEpsilon) invalid(pi, "not convex");
+    }
+
+    Poly p;
+    p.first = static_cast<uint32_t>(verts_.size());
+    p.count = static_cast<uint8_t>(idx.size());
+    p.min_x = p.max_x = vertices_[idx[0]].x;
+    p.min_z = p.max_z = vertices_[idx[0]].z;
+    for (uint32_t v : idx) {
+      const Vec3 pos = vertices_[v];
+      p.center = p.center + pos;
+      p.min_x = std::min(p.min_x, pos.x);
+      p.max_x = std::max(p.max_x, pos.x);
+      p.min_z = std::min(p.min_z, pos.z);
+      p.max_z = std::max(p.max_z, pos.z);
+      verts_.push_back(v);
+    }
+    p.center = p.center * (1.0f / static_cast<float>(idx.size()));
+    polys_.push_back(p);
+  }
+
+  // Connect polygons through shared edges, keyed by their vertex pair.
+  neighbours_.assign(verts_.size(), kInvalidPoly);
+  std::unordered_map<uint64_t, uint32_t> open_edges;  // key -> slot in verts_
+  for (PolyRef pi = 0; pi < polys_.size(); ++pi) {
+    const Poly& p = polys_[pi];
+    for (uint32_t e = 0; e < p.count; ++e) {
+      const uint32_t a = verts_[p.first + e];
+      const uint32_t b = verts_[p.first + (e + 1) % p.count];
+      const uint64_t key = (static_cast<uint64_t>(std::min(a, b)) << 32) | std::max(a, b);
+      auto [it, inserted] = open_edges.emplace(key, p.first + e);
+      if (inserted) continue;
+      const uint32_t other = it->second;
+      if (neighbours_[other] != kInvalidPoly) invalid(pi, "edge shared by more than two polygons");
+      const auto owner =
+          std::upper_bound(polys_.begin(), polys_.end(), other,
+                           [](uint32_t slot, const Poly& q) { return slot < q.first; });
+      neighbours_[other] = pi;
+      neighbours_[p.first + e] = static_cast<PolyRef>(owner - polys_.begin() - 1);
+    }
+  }
+
+  if (polys_.empty()) return;
+  float max_x = polys_[0].max_x, max_z = polys_[0].max_z;
+  origin_x_ = polys_[0].min_x;
+  origin_z_ = polys_[0].min_z;
+  for (const Poly& p : polys_) {
+    origin_x_ = std::min(origin_x_, p.min_x);
+    origin_z_ = std::min(origin_z_, p.min_z);
+    max_x = std::max(max_x, p.max_x);
+    max_z = std::max(max_z, p.max_z);
+  }
+  grid_w_ = static_cast<int32_t>((max_x - origin_x_) / cell_size_) + 1;
+  grid_h_ = static_cast<int32_t>((max_z - origin_z_) / cell_size_) + 1;
+
+  // Counting sort of polygons into every cell their bounds overlap.
+  cell_start_.assign(static_cast<size_t>(grid_w_) * grid_h_ + 1, 0);
+  for (int pass = 0; pass < 2; ++pass) {
+    for (PolyRef pi = 0; pi < polys_.size(); ++pi) {
+      const Poly& p = polys_[pi];
+      int32_t x0, z0, x1, z1;
+      cells_for(p.min_x, p.min_z, p.max_x, p.max_z, x0, z0, x1, z1);
+      for (int32_t z = z0; z <= z1; ++z) {
+        for (int32_t x = x0; x <= x1; ++x) {
+          const size_t cell = static_cast<size_t>(z) * grid_w_ + x;
+          if (pass == 0) {
+            ++cell_start_[cell + 1];
+          } else {
+            cell_polys_[cell_start_[cell]++] = pi;
+          }
+        }
+      }
+    }
+    if (pass == 0) {
+      for (size_t c = 1; c < cell_start_.size(); ++c) cell_start_[c] += cell_start_[c - 1];
+      cell_polys_.resize(cell_start_.back());
+    } else {
+      // The fill advanced every start to the next cell's; shift back.
+      for (size_t c = cell_start_.size() - 1; c > 0; --c) cell_start_[c] = cell_start_[c - 1];
+      cell_start_[0] = 0;
+    }
+  }
+}
+
+void NavMesh::cells_for(float min_x, float min_z, float max_x, float max_z, int32_t& x0,
+                        int32_t& z0, int32_t& x1, int32_t& z1) const {
+  auto clamp_cell = [](float v, int32_t n) {
+    return std::clamp(static_cast<int32_t>(std::floor(v)), 0, n - 1);
+  };
+  x0 = clamp_cell((min_x - origin_x_) / cell_size_, grid_w_);
+  x1 = clamp_cell((max_x - origin_x_) / cell_size_, grid_w_);
+  z0 = clamp_cell((min_z - origin_z_) / cell_size_, grid_h_);
+  z1 = clamp_cell((max_z - origin_z_) / cell_size_, grid_h_);
+}
+
+bool NavMesh::contains_xz(const Poly& p, Vec3 pos) const {
+  if (pos.x < p.min_x - kEpsilon || pos.x > p.max_x + kEpsilon || pos.z < p.min_z - kEpsilon ||
+      pos.z > p.max_z + kEpsilon) {
+    return false;
+  }
+  for (size_t i = 0; i < p.count; ++i) {
+    if (side(vertex(p, i), vertex(p, i + 1), pos) < -kEpsilon) return false;
+  }
+  return true;
+}
+
+PolyRef NavMesh::find_poly(Vec3 pos) const {
+  if (polys_.empty()) return kInvalidPoly;
+  int32_t x0, z0, x1, z1;
+  cells_for(pos.x, pos.z, pos.x, pos.z, x0, z0, x1, z1);
+  const size_t cell = static_cast<size_t>(z0) * grid_w_ + x0;
+  PolyRef best = kInvalidPoly;
+  float best_dy = std::numeric_limits<float>::max();
+  for (uint32_t i = cell_start_[cell]; i < cell_start_[cell + 1]; ++i) {
+    const Poly& p = polys_[cell_polys_[i]];
+    if (!contains_xz(p, pos)) continue;
+    const float dy = std::fabs(p.center.y - pos.y);
+    if (dy < best_dy) {
+      best_dy = dy;
+      best = cell_polys_[i];
+    }
+  }
+  return best;
+}
+
+PolyRef NavMesh::find_nearest(Vec3 pos, float radius, Vec3* snapped) const {
+  if (const PolyRef p = find_poly(pos); p != kInvalidPoly) {
+    if (snapped) *snapped = pos;
+    return p;
+  }
+  if (polys_.empty()) return kInvalidPoly;
+  int32_t x0, z0, x1, z1;
+  cells_for(pos.x - radius, pos.z - radius, pos.x + radius, pos.z + radius, x0, z0, x1, z1);
+  PolyRef best = kInvalidPoly;
+  float best_d = radius * radius;
+  Vec3 best_point = pos;
+  for (int32_t z = z0; z <= z1; ++z) {
+    for (int32_t x = x0; x <= x1; ++x) {
+      const size_t cell = static_cast<size_t>(z) * grid_w_ + x;
+      for (uint32_t i = cell_start_[cell]; i < cell_start_[cell + 1]; ++i) {
+        const Poly& p = polys_[cell_polys_[i]];
+        for (size_t e = 0; e < p.count; ++e) {
+          const Vec3 q = closest_on_segment_xz(pos, vertex(p, e), vertex(p, e + 1));
+          const float d = distance_sq_xz(pos, q);
+          if (d <= best_d) {
+            best_d = d;
+            best = cell_polys_[i];
+            best_point = q;
+          }
+        }
+      }
+    }
+  }
+  if (best != kInvalidPoly && snapped) *snapped = best_point;
+  return best;
+}
+
+NavQuery::NavQuery(const NavMesh& mesh, size_t max_nodes)
+    : mesh_(mesh),
+      max_nodes_(max_nodes),
+      stamp_(mesh.poly_count(), 0),
+      closed_(mesh.poly_count(), 0),
+      g_(mesh.poly_count(), 0),
+      parent_(mesh.poly_count(), kInvalidPoly),
+      pos_(mesh.poly_count()) {}
+
+PathStatus NavQuery::find_corridor(PolyRef start, PolyRef goal, Vec3 start_pos, Vec3 goal_pos,
+                                   std::vector<PolyRef>& corridor) {
+  corridor.clear();
+  last_expanded_ = 0;
+  const size_t n = mesh_.poly_count();
+  if (start >= n || goal >= n) return PathStatus::kOffMesh;
+  if (start == goal) {
+    corridor.push_back(start);
+    return PathStatus::kOk;
+  }
+  if (++generation_ == 0) {
+    std::fill(stamp_.begin(), stamp_.end(), 0);
+    generation_ = 1;
+  }
+  auto touch = [this](PolyRef p) {
+    if (stamp_[p] == generation_) return;
+    stamp_[p] = generation_;
+    closed_[p] = 0;
+    g_[p] = std::numeric_limits<float>::max();
+    parent_[p] = kInvalidPoly;
+  };
+
+  open_.clear();
+  touch(start);
+  g_[start] = 0;
+  pos_[start] = start_pos;
+  open_.push_back({length(goal_pos - start_pos), start});
+
+  PolyRef best = start;
+  float best_h = open_.front().f;
+  bool found = false;
+  bool exhausted = true;
+  while (!open_.empty()) {
+    std::pop_heap(open_.begin(), open_.end(), std::greater<>());
+    const PolyRef cur = open_.back().poly;
+    open_.pop_back();
+    if (closed_[cur]) continue;  // stale entry
+    closed_[cur] = 1;
+    if (cur == goal) {
+      found = true;
+      break;
+    }
+    if (++last_expanded_ > max_nodes_) {
+      exhausted = false;
+      break;
+    }
+    const float h = length(goal_pos - pos_[cur]);
+    if (h < best_h) {
+      best_h = h;
+      best = cur;
+    }
+    const NavMesh::Poly& p = mesh_.polys_[cur];
+    for (uint32_t e = 0; e < p.count; ++e) {
+      const PolyRef nb = mesh_.neighbours_[p.first + e];
+      if (nb == kInvalidPoly) continue;
+      touch(nb);
+      if (closed_[nb]) continue;
+      const Vec3 entry = midpoint(mesh_.vertex(p, e), mesh_.vertex(p, e + 1));
+      float g = g_[cur] + length(entry - pos_[cur]);
+      float f_extra = length(goal_pos - entry);
+      if (nb == goal) {
+        g += f_extra;
+        f_extra = 0;
+      }
+      if (g >= g_[nb]) continue;
+      g_[nb] = g;
+      parent_[nb] = cur;
+      pos_[nb] = entry;
+      open_.push_back({g + f_extra, nb});
+      std::push_heap(open_.begin(), open_.end(), std::greater<>());
+    }
+  }
+
+  for (PolyRef p = found ? goal : best; p != kInvalidPoly; p = parent_[p]) corridor.push_back(p);
+  std::reverse(corridor.begin(), corridor.end());
+  if (found) return PathStatus::kOk;
+  return exhausted ? PathStatus::kNoPath : PathStatus::kPartial;
+}
+
+void NavQuery::string_pull(const std::vector<PolyRef>& corridor, Vec3 start_pos, Vec3 end_pos,
+                           std::vector<Vec3>& points) const {
+  points.clear();
+  points.push_back(start_pos);
+  if (corridor.size() <= 1) {
+    if (!same_xz(start_pos, end_pos)) points.push_back(end_pos);
+    return;
+  }
+  // Portals as (left, right) seen walking the corridor; the end point is
+  // a degenerate final portal.
+  std::vector<std::pair<Vec3, Vec3>> portals;
+  portals.reserve(corridor.size() + 1);
+  portals.emplace_back(start_pos, start_pos);
+  for (size_t i = 0; i + 1 < corridor.size(); ++i) {
+    const NavMesh::Poly& p = mesh_.polys_[corridor[i]];
+    for (uint32_t e = 0; e < p.count; ++e) {
+      if (mesh_.neighbours_[p.first + e] != corridor[i + 1]) continue;
+      // Counter-clockwise winding: leaving through edge e, its second
+      // vertex is on the left.
+      portals.emplace_back(mesh_.vertex(p, e + 1), mesh_.vertex(p, e));
+      break;
+    }
+  }
+  portals.emplace_back(end_pos, end_pos);
+
+  Vec3 apex = start_pos, left = start_pos, right = start_pos;
+  size_t apex_index = 0, left_index = 0, right_index = 0;
+  for (size_t i = 1; i < portals.size(); ++i) {
+    const auto [pl, pr] = portals[i];
+    if (side(apex, right, pr) >= 0) {  // narrows the funnel from the right
+      if (same_xz(apex, right) || side(apex, left, pr) < 0) {
+        right = pr;
+        right_index = i;
+      } else {
+        // Crossed the left edge: its corner is on the path.
+        apex = left;
+        apex_index = left_index;
+        points.push_back(apex);
+        left = right = apex;
+        left_index = right_index = apex_index;
+        i = apex_index;
+        continue;
+      }
+    }
+    if (side(apex, left, pl) <= 0) {  // narrows from the left
+      if (same_xz(apex, left) || side(apex, right, pl) > 0) {
+        left = pl;
+        left_index = i;
+      } else {
+        apex = right;
+        apex_index = right_index;
+        points.push_back(apex);
+        left = right = apex;
+        left_index = right_index = apex_index;
+        i = apex_index;
+        continue;
+      }
+    }
+  }
+  if (!same_xz(points.back(), end_pos)) points.push_back(end_pos);
+}
+
+}  // namespace kbs
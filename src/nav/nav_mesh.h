@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "common/vec3.h"
+
+namespace kbs {
+
+using PolyRef = uint32_t;
+constexpr PolyRef kInvalidPoly = UINT32_MAX;
+
+struct NavMeshData {
+  std::vector<Vec3> vertices;
+  // Convex polygons as indices into vertices, either winding, at most
+  // NavMesh::kMaxVertsPerPoly each.  Polygons sharing an edge (the same
+  // two vertex indices) are connected.
+  std::vector<std::vector<uint32_t>> polygons;
+};
+
+// Walkable surface as convex polygons with edge adjacency, in the spirit
+// of a Detour tile: A* runs over polygons rather than grid cells, and the
+// resulting corridor is string-pulled into a handful of corner points.
+//
+// Immutable once built, so any number of NavQuery objects on any threads
+// may search one mesh concurrently.  Polygon lookup goes through a uniform
+// x/z grid of polygon bounds.
+class NavMesh {
+ public:
+  static constexpr size_t kMaxVertsPerPoly = 8;
+
+  // Throws std::invalid_argument for out-of-range indices, polygons that
+  // are degenerate or not convex in x/z, and edges shared by more than two
+  // polygons.
+  explicit NavMesh(NavMeshData data, float cell_size = 8.0f);
+
+  NavMesh(const NavMesh&) = delete;
+  NavMesh& operator=(const NavMesh&) = delete;
+
+  size_t poly_count() const { return polys_.size(); }
+
+  // The polygon whose x/z footprint contains pos and whose height is
+  // closest to pos.y, or kInvalidPoly.
+  PolyRef find_poly(Vec3 pos) const;
+  // As find_poly(), falling back to the closest polygon edge within radius
+  // (x/z); *snapped receives the point on the mesh.
+  PolyRef find_nearest(Vec3 pos, float radius, Vec3* snapped) const;
+
+  Vec3 center(PolyRef p) const { return polys_[p].center; }
+
+ private:
+  friend class NavQuery;
+
+  struct Poly {
+    uint32_t first = 0;  // into verts_/neighbours_
+    uint8_t count = 0;
+    Vec3 center;
+    float min_x = 0, min_z = 0, max_x = 0, max_z = 0;
+  };
+
+  // Edge e of p runs from vertex e to vertex e+1, counter-clockwise in x/z.
+  Vec3 vertex(const Poly& p, size_t i) const { return vertices_[verts_[p.first + i % p.count]]; }
+  bool contains_xz(const Poly& p, Vec3 pos) const;
+  void cells_for(float min_x, float min_z, float max_x, float max_z, int32_t& x0, int32_t& z0,
+                 int32_t& x1, int32_t& z1) const;
+
+  std::vector<Vec3> vertices_;
+  std::vector<Poly> polys_;
+  std::vector<uint32_t> verts_;       // vertex indices, per polygon
+  std::vector<PolyRef> neighbours_;   // across each edge, or kInvalidPoly
+  float cell_size_;
+  float origin_x_ = 0, origin_z_ = 0;
+  int32_t grid_w_ = 0, grid_h_ = 0;
+  std::vector<uint32_t> cell_start_;  // grid_w_ * grid_h_ + 1 offsets into cell_polys_
+  std::vector<PolyRef> cell_polys_;
+};
+
+enum class PathStatus : uint8_t {
+  kOk,
+  // The search hit its node limit; the path leads to the explored polygon
+  // closest to the goal.
+  kPartial,
+  kNoPath,
+  // Start or goal is not on the mesh.
+  kOffMesh,
+};
+
+// Per-thread search state over one NavMesh.  Node bookkeeping is stamped
+// with a query generation, so nothing is cleared or allocated between
+// queries once the buffers have grown to the mesh size.
+class NavQuery {
+ public:
+  explicit NavQuery(const NavMesh& mesh, size_t max_nodes = 4096);
+
+  // A* from start to goal polygon; corridor receives the polygons walked,
+  // start first.  start_pos/goal_pos are points inside them, used for
+  // edge-midpoint costs.
+  PathStatus find_corridor(PolyRef start, PolyRef goal, Vec3 start_pos, Vec3 goal_pos,
+                           std::vector<PolyRef>& corridor);
+  // Funnel-algorithm string pulling: replaces points with the corners of
+  // the shortest path through corridor, start and end point included.
+  void string_pull(const std::vector<PolyRef>& corridor, Vec3 start_pos, Vec3 end_pos,
+                   std::vector<Vec3>& points) const;
+
+  // Polygons expanded by the last find_corridor().
+  size_t last_expanded() const { return last_expanded_; }
+
+ private:
+  struct OpenEntry {
+    float f;
+    PolyRef poly;
+    bool operator>(const OpenEntry& o) const { return f > o.f; }
+  };
+
+  const NavMesh& mesh_;
+  size_t max_nodes_;
+  uint32_t generation_ = 0;
+  size_t last_expanded_ = 0;
+  std::vector<uint32_t> stamp_;  // generation in which g_/parent_ were set
+  std::vector<uint8_t> closed_;  // valid when stamp_ matches
+  std::vector<float> g_;
+  std::vector<PolyRef> parent_;
+  std::vector<Vec3> pos_;        // entry point into the polygon
+  std::vector<OpenEntry> open_;  // binary heap, lazy deletion
+};
+
+}  // namespace kbs
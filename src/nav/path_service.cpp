@@ -0,0 +1,190 @@
+#include "nav/path_service.h"
+
+#include <algorithm>
+
+#include "metrics/trace.h"
+
+namespace kbs {
+
+namespace {
+
+struct PathMetrics {
+  Counter& queries = metrics().counter("kbs_path_queries_total", "Path queries answered");
+  Counter& cache_hits = metrics().counter("kbs_path_cache_hits_total", "Corridors from the cache");
+  Histogram& query_us = metrics().histogram("kbs_path_query_us", "Worker time per path query",
+                                            Histogram::exponential(5, 2, 16));
+};
+
+PathMetrics& path_metrics() {
+  static PathMetrics m;
+  return m;
+}
+
+uint64_t cache_key(PolyRef start, PolyRef goal) {
+  return static_cast<uint64_t>(start) << 32 | goal;
+}
+
+}  // namespace
+
+PathService::PathService(const NavMesh& mesh, const PathServiceOptions& options)
+    : mesh_(mesh),
+      options_(options),
+      shard_capacity_(std::max<size_t>(options.cache_capacity / kCacheShards, 1)),
+      results_(MailboxOptions{options.max_in_flight, 0}),
+      cache_(std::make_unique<CacheShard[]>(kCacheShards)) {
+  const size_t n = std::max<size_t>(options_.num_threads, 1);
+  for (size_t i = 0; i < n; ++i) {
+    threads_.emplace_back([this, i] {
+      place_current_thread(options_.placement, i);
+      run();
+    });
+  }
+  queue_gauge_ = metrics().add_callback_gauge(
+      "kbs_path_queued_requests", "Path requests waiting for a worker", [this] {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return static_cast<double>(queue_.size());
+      });
+}
+
+PathService::~PathService() {
+  metrics().remove_callback_gauge(queue_gauge_);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  wake_.notify_all();
+  for (auto& t : threads_) t.join();
+}
+
+bool PathService::submit(const PathRequest& request) {
+  return submit(std::span<const PathRequest>(&request, 1)) == 1;
+}
+
+size_t PathService::submit(std::span<const PathRequest> requests) {
+  const size_t in_flight = in_flight_.load(std::memory_order_relaxed);
+  const size_t room = options_.max_in_flight > in_flight ? options_.max_in_flight - in_flight : 0;
+  const size_t n = std::min(room, requests.size());
+  if (n < requests.size()) rejected_.fetch_add(requests.size() - n, std::memory_order_relaxed);
+  if (n == 0) return 0;
+  in_flight_.fetch_add(n, std::memory_order_relaxed);
+  submitted_.fetch_add(n, std::memory_order_relaxed);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queue_.insert(queue_.end(), requests.begin(), requests.begin() + n);
+  }
+  if (n == 1) {
+    wake_.notify_one();
+  } else {
+    wake_.notify_all();
+  }
+  return n;
+}
+
+void PathService::run() {
+  NavQuery query(mesh_, options_.max_search_nodes);
+  std::vector<PathRequest> batch;
+  std::vector<PolyRef> corridor;
+  batch.reserve(kWorkerBatch);
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      wake_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+      if (stop_) return;
+      // Leave work for the other threads when the queue is short.
+      const size_t share = std::max<size_t>(queue_.size() / threads_.size(), 1);
+      const size_t take = std::min({kWorkerBatch, share, queue_.size()});
+      batch.assign(queue_.begin(), queue_.begin() + take);
+      queue_.erase(queue_.begin(), queue_.begin() + take);
+    }
+    for (const PathRequest& r : batch) process(query, r, corridor);
+  }
+}
+
+void PathService::process(NavQuery& query, const PathRequest& request,
+                          std::vector<PolyRef>& corridor) {
+  KBS_TRACE_SCOPE("path.query");
+  PathMetrics& m = path_metrics();
+  const uint64_t begin_ns = Tracer::now_ns();
+  PathResult result;
+  result.id = request.id;
+  Vec3 start = request.start;
+  Vec3 goal = request.goal;
+  const PolyRef start_poly = mesh_.find_nearest(request.start, options_.snap_radius, &start);
+  const PolyRef goal_poly = mesh_.find_nearest(request.goal, options_.snap_radius, &goal);
+  if (start_poly == kInvalidPoly || goal_poly == kInvalidPoly) {
+    result.status = PathStatus::kOffMesh;
+  } else {
+    const uint64_t key = cache_key(start_poly, goal_poly);
+    CacheEntry entry;
+    if (cache_lookup(key, entry)) {
+      cache_hits_.fetch_add(1, std::memory_order_relaxed);
+      m.cache_hits.inc();
+      result.cached = true;
+    } else {
+      cache_misses_.fetch_add(1, std::memory_order_relaxed);
+      entry.status = query.find_corridor(start_poly, goal_poly, start, goal, corridor);
+      nodes_expanded_.fetch_add(query.last_expanded(), std::memory_order_relaxed);
+      entry.corridor = std::make_shared<const std::vector<PolyRef>>(corridor);
+      if (entry.status != PathStatus::kPartial) cache_insert(key, entry);
+    }
+    result.status = entry.status;
+    // A corridor that stops short ends at its last polygon's centre.
+    const Vec3 end = entry.status == PathStatus::kOk ? goal : mesh_.center(entry.corridor->back());
+    query.string_pull(*entry.corridor, start, end, result.points);
+  }
+  m.queries.inc();
+  m.query_us.observe(static_cast<double>(Tracer::now_ns() - begin_ns) / 1000.0);
+  completed_.fetch_add(1, std::memory_order_relaxed);
+  // in_flight_ never exceeds the mailbox capacity, so this cannot fail;
+  // yield rather than drop if a poll() is momentarily behind.
+  while (results_.send(std::move(result)) == SendResult::kFull) std::this_thread::yield();
+}
+
+bool PathService::cache_lookup(uint64_t key, CacheEntry& out) {
+  CacheShard& shard = cache_[key % kCacheShards];
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  auto it = shard.index.find(key);
+  if (it == shard.index.end()) return false;
+  shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+  out = it->second->second;
+  return true;
+}
+
+void PathService::cache_insert(uint64_t key, const CacheEntry& entry) {
+  CacheShard& shard = cache_[key % kCacheShards];
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  auto it = shard.index.find(key);
+  if (it != shard.index.end()) {
+    // Another worker raced us to the same pair.
+    it->second->second = entry;
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+    return;
+  }
+  shard.lru.emplace_front(key, entry);
+  shard.index.emplace(key, shard.lru.begin());
+  if (shard.lru.size() > shard_capacity_) {
+    shard.index.erase(shard.lru.back().first);
+    shard.lru.pop_back();
+  }
+}
+
+void PathService::clear_cache() {
+  for (size_t i = 0; i < kCacheShards; ++i) {
+    std::lock_guard<std::mutex> lock(cache_[i].mutex);
+    cache_[i].lru.clear();
+    cache_[i].index.clear();
+  }
+}
+
+PathServiceStats PathService::stats() const {
+  PathServiceStats st;
+  st.submitted = submitted_.load(std::memory_order_relaxed);
+  st.rejected = rejected_.load(std::memory_order_relaxed);
+  st.completed = completed_.load(std::memory_order_relaxed);
+  st.cache_hits = cache_hits_.load(std::memory_order_relaxed);
+  st.cache_misses = cache_misses_.load(std::memory_order_relaxed);
+  st.nodes_expanded = nodes_expanded_.load(std::memory_order_relaxed);
+  return st;
+}
+
+}  // namespace kbs
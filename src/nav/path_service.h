@@ -0,0 +1,145 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "common/thread_placement.h"
+#include "game/mailbox.h"
+#include "metrics/metrics.h"
+#include "nav/nav_mesh.h"
+
+namespace kbs {
+
+struct PathServiceOptions {
+  // Query threads, each with its own NavQuery.
+  size_t num_threads = 2;
+  ThreadPlacement placement;
+  // Requests accepted but not yet poll()ed; submit() refuses beyond it.
+  size_t max_in_flight = 1u << 14;
+  // Corridors remembered per (start polygon, goal polygon), across all
+  // cache shards.
+  size_t cache_capacity = 4096;
+  size_t max_search_nodes = 4096;
+  // Start/goal points this far (x/z) off the mesh are snapped onto it.
+  float snap_radius = 2.0f;
+};
+
+struct PathRequest {
+  // Caller's token, echoed in the result (an EntityId, or an id plus a
+  // re-path generation so stale answers can be told apart).
+  uint64_t id = 0;
+  Vec3 start;
+  Vec3 goal;
+};
+
+struct PathResult {
+  uint64_t id = 0;
+  PathStatus status = PathStatus::kNoPath;
+  bool cached = false;
+  // Corners from (snapped) start to goal; for kPartial and kNoPath, to the
+  // reachable point closest to the goal.
+  std::vector<Vec3> points;
+};
+
+struct PathServiceStats {
+  uint64_t submitted = 0;
+  uint64_t rejected = 0;  // submit() over max_in_flight
+  uint64_t completed = 0;
+  uint64_t cache_hits = 0;
+  uint64_t cache_misses = 0;
+  uint64_t nodes_expanded = 0;
+};
+
+// Asynchronous path queries against one NavMesh, so AI systems never run
+// A* on the tick.
+//
+// The tick submit()s requests (singly or as a batch, one lock either way)
+// and poll()s finished results on a later tick; worker threads search with
+// their own NavQuery and hand results back through a Mailbox, so the tick
+// side takes no lock to collect them.  Searches produce a polygon corridor
+// that is cached in a sharded LRU keyed by (start polygon, goal polygon):
+// mobs re-pathing to the same target from the same area skip A* entirely
+// and only redo the cheap string pulling from their exact positions.
+// kPartial corridors depend on the node limit and are not cached.
+class PathService {
+ public:
+  // mesh must outlive the service.
+  explicit PathService(const NavMesh& mesh, const PathServiceOptions& options = {});
+  // Joins the workers; requests still queued are dropped.
+  ~PathService();
+
+  PathService(const PathService&) = delete;
+  PathService& operator=(const PathService&) = delete;
+
+  // Tick thread.  false when max_in_flight requests are outstanding.
+  bool submit(const PathRequest& request);
+  // Accepts a prefix of requests; returns how many.
+  size_t submit(std::span<const PathRequest> requests);
+
+  // Tick thread.  Calls fn(PathResult&) for up to max finished queries.
+  template <typename F>
+  size_t poll(F&& fn, size_t max = SIZE_MAX) {
+    const size_t n = results_.drain(std::forward<F>(fn), max);
+    in_flight_.fetch_sub(n, std::memory_order_relaxed);
+    return n;
+  }
+
+  size_t in_flight() const { return in_flight_.load(std::memory_order_relaxed); }
+  void clear_cache();
+  PathServiceStats stats() const;
+
+ private:
+  struct CacheEntry {
+    PathStatus status;
+    std::shared_ptr<const std::vector<PolyRef>> corridor;
+  };
+  struct CacheShard {
+    std::mutex mutex;
+    // Front is most recently used.
+    std::list<std::pair<uint64_t, CacheEntry>> lru;
+    std::unordered_map<uint64_t, std::list<std::pair<uint64_t, CacheEntry>>::iterator> index;
+  };
+
+  static constexpr size_t kCacheShards = 16;
+  // Requests a worker takes per wakeup.
+  static constexpr size_t kWorkerBatch = 32;
+
+  void run();
+  void process(NavQuery& query, const PathRequest& request, std::vector<PolyRef>& corridor);
+  bool cache_lookup(uint64_t key, CacheEntry& out);
+  void cache_insert(uint64_t key, const CacheEntry& entry);
+
+  const NavMesh& mesh_;
+  PathServiceOptions options_;
+  size_t shard_capacity_;
+  Mailbox<PathResult> results_;
+  std::unique_ptr<CacheShard[]> cache_;
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::deque<PathRequest> queue_;
+  bool stop_ = false;
+  std::vector<std::thread> threads_;
+
+  std::atomic<size_t> in_flight_{0};
+  std::atomic<uint64_t> submitted_{0};
+  std::atomic<uint64_t> rejected_{0};
+  std::atomic<uint64_t> completed_{0};
+  std::atomic<uint64_t> cache_hits_{0};
+  std::atomic<uint64_t> cache_misses_{0};
+  std::atomic<uint64_t> nodes_expanded_{0};
+  CallbackGaugeId queue_gauge_ = 0;  // kbs_path_queued_requests
+};
+
+}  // namespace kbs
@@ -0,0 +1,51 @@
+#include "net/acceptor.h"
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+
+namespace kbs {
+
+Acceptor::Acceptor(EventLoop& loop, int listen_fd, NewConnectionCallback cb)
+    : loop_(loop),
+      listen_fd_(listen_fd),
+      idle_fd_(::open("/dev/null", O_RDONLY | O_CLOEXEC)),
+      on_new_connection_(std::move(cb)) {}
+
+Acceptor::~Acceptor() {
+  if (listening_) loop_.remove_handler(listen_fd_);
+  ::close(listen_fd_);
+  if (idle_fd_ >= 0) ::close(idle_fd_);
+}
+
+void Acceptor::listen() {
+  loop_.add_handler(listen_fd_, this, kPollReadable);
+  listening_ = true;
+}
+
+void Acceptor::handle_events(uint32_t) {
+  for (int i = 0; i < kMaxAcceptsPerEvent; ++i) {
+    sockaddr_storage ss{};
+    socklen_t len = sizeof(ss);
+    int fd = ::accept4(listen_fd_, reinterpret_cast<sockaddr*>(&ss), &len,
+                       SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd >= 0) {
+      on_new_connection_(fd, InetAddress::from_sockaddr(reinterpret_cast<sockaddr*>(&ss), len));
+      continue;
+    }
+    if (errno == EINTR || errno == ECONNABORTED) continue;
+    if ((errno == EMFILE || errno == ENFILE) && idle_fd_ >= 0) {
+      // Out of descriptors: accept and drop the peer instead of letting the
+      // level-triggered listener spin.
+      ::close(idle_fd_);
+      idle_fd_ = ::accept(listen_fd_, nullptr, nullptr);
+      if (idle_fd_ >= 0) ::close(idle_fd_);
+      idle_fd_ = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+    }
+    return;  // EAGAIN or unrecoverable
+  }
+}
+
+}  // namespace kbs
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <functional>
+
+#include "net/event_loop.h"
+#include "net/inet_address.h"
+
+namespace kbs {
+
+// Accepts connections from one listening socket on its owning loop.  With
+// SO_REUSEPORT every loop has its own Acceptor and the kernel load-balances
+// the handshakes, so no accept lock or hand-off queue is needed.
+class Acceptor final : public IoHandler {
+ public:
+  using NewConnectionCallback = std::function<void(int fd, const InetAddress& peer)>;
+
+  // Takes ownership of listen_fd.
+  Acceptor(EventLoop& loop, int listen_fd, NewConnectionCallback cb);
+  ~Acceptor() override;
+
+  Acceptor(const Acceptor&) = delete;
+  Acceptor& operator=(const Acceptor&) = delete;
+
+  void listen();
+  int fd() const { return listen_fd_; }
+
+  void handle_events(uint32_t events) override;
+
+ private:
+  // Upper bound on accepts per readiness event so a connect storm cannot
+  // starve the established sessions sharing this loop.
+  static constexpr int kMaxAcceptsPerEvent = 64;
+
+  EventLoop& loop_;
+  int listen_fd_;
+  int idle_fd_;  // reserved descriptor released to shed connections on EMFILE
+  bool listening_ = false;
+  NewConnectionCallback on_new_connection_;
+};
+
+}  // namespace kbs
@@ -0,0 +1,52 @@
+#include "net/byte_buffer.h"
+
+#include <sys/uio.h>
+
+#include <algorithm>
+
+namespace kbs {
+
+void ByteBuffer::ensure_writable(size_t n) {
+  if (writable_bytes() >= n) return;
+  size_t readable = readable_bytes();
+  if (read_index_ + writable_bytes() >= n) {
+    std::memmove(buf_.data(), peek(), readable);
+  } else {
+    std::vector<char> grown(std::max(buf_.size() * 2, readable + n));
+    std::memcpy(grown.data(), peek(), readable);
+    buf_.swap(grown);
+  }
+  read_index_ = 0;
+  write_index_ = readable;
+}
+
+ssize_t ByteBuffer::read_from_fd(int fd) {
+  char extra[65536];
+  struct iovec vec[2];
+  const size_t writable = writable_bytes();
+  vec[0].iov_base = begin_write();
+  vec[0].iov_len = writable;
+  vec[1].iov_base = extra;
+  vec[1].iov_len = sizeof(extra);
+  const int iovcnt = writable < sizeof(extra) ? 2 : 1;
+  const ssize_t n = ::readv(fd, vec, iovcnt);
+  if (n <= 0) return n;
+  if (static_cast<size_t>(n) <= writable) {
+    write_index_ += n;
+  } else {
+    write_index_ = buf_.size();
+    append(extra, n - writable);
+  }
+  return n;
+}
+
+void ByteBuffer::shrink_to_fit(size_t keep) {
+  size_t readable = readable_bytes();
+  std::vector<char> shrunk(std::max(keep, readable));
+  std::memcpy(shrunk.data(), peek(), readable);
+  buf_.swap(shrunk);
+  read_index_ = 0;
+  write_index_ = readable;
+}
+
+}  // namespace kbs
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+namespace kbs {
+
+// Contiguous growable byte buffer with separate read and write cursors.
+// Used as the per-connection input buffer: the reactor appends whatever the
+// socket delivers and the protocol layer consumes complete frames from the
+// front.
+//
+//   +-------------------+------------------+------------------+
+//   | consumed (slack)  |  readable bytes  |  writable bytes  |
+//   +-------------------+------------------+------------------+
+//   0             read_index_        write_index_          size
+class ByteBuffer {
+ public:
+  static constexpr size_t kInitialSize = 4096;
+
+  explicit ByteBuffer(size_t initial_size = kInitialSize) : buf_(initial_size) {}
+
+  size_t readable_bytes() const { return write_index_ - read_index_; }
+  size_t writable_bytes() const { return buf_.size() - write_index_; }
+
+  const char* peek() const { return buf_.data() + read_index_; }
+  char* begin_write() { return buf_.data() + write_index_; }
+  std::string_view view() const { return {peek(), readable_bytes()}; }
+
+  void retrieve(size_t n) {
+    if (n < readable_bytes()) {
+      read_index_ += n;
+    } else {
+      retrieve_all();
+    }
+  }
+  void retrieve_all() { read_index_ = write_index_ = 0; }
+
+  void has_written(size_t n) { write_index_ += n; }
+
+  void append(const void* data, size_t n) {
+    ensure_writable(n);
+    std::memcpy(begin_write(), data, n);
+    write_index_ += n;
+  }
+  void append(std::string_view s) { append(s.data(), s.size()); }
+
+  // Guarantees at least n writable bytes, compacting before growing.
+  void ensure_writable(size_t n);
+
+  // Reads as much as is available from fd in one readv() call, spilling
+  // into a stack buffer so a mostly empty buffer does not need to grow up
+  // front.  Returns the readv() result; errno is preserved on failure.
+  ssize_t read_from_fd(int fd);
+
+  // Releases memory held by a buffer that grew for a burst of traffic.
+  void shrink_to_fit(size_t keep = kInitialSize);
+
+ private:
+  std::vector<char> buf_;
+  size_t read_index_ = 0;
+  size_t write_index_ = 0;
+};
+
+}  // namespace kbs
@@ -0,0 +1,67 @@
+#include "net/connector.h"
+
+#include <cerrno>
+#include <system_error>
+
+#include "net/socket_ops.h"
+
+namespace kbs {
+
+Connector::Connector(EventLoop& loop, const InetAddress& addr, Callback cb)
+    : loop_(loop), addr_(addr), cb_(std::move(cb)) {}
+
+Connector::~Connector() {
+  loop_.cancel_timer(timer_);
+  if (fd_ >= 0) {
+    loop_.remove_handler(fd_);
+    sockets::close_fd(fd_);
+  }
+}
+
+void Connector::start(uint32_t timeout_ms) {
+  try {
+    fd_ = sockets::connect_nonblocking(addr_);
+  } catch (const std::system_error& e) {
+    // Refused synchronously (e.g. unreachable); report from a timer so the
+    // callback never runs inside start() and the destructor can cancel it.
+    const int error = e.code().value();
+    timer_ = loop_.run_after(0, [this, error] {
+      timer_ = kInvalidTimerId;
+      finish(-1, error);
+    });
+    return;
+  }
+  loop_.add_handler(fd_, this, kPollWritable);
+  timer_ = loop_.run_after(timeout_ms, [this] {
+    timer_ = kInvalidTimerId;
+    loop_.remove_handler(fd_);
+    sockets::close_fd(std::exchange(fd_, -1));
+    finish(-1, ETIMEDOUT);
+  });
+}
+
+void Connector::handle_events(uint32_t) {
+  loop_.cancel_timer(timer_);
+  timer_ = kInvalidTimerId;
+  loop_.remove_handler(fd_);
+  const int fd = std::exchange(fd_, -1);
+  const int error = sockets::socket_error(fd);
+  if (error != 0) {
+    sockets::close_fd(fd);
+    finish(-1, error);
+    return;
+  }
+  finish(fd, 0);
+}
+
+void Connector::finish(int fd, int error) {
+  // The callback may destroy this Connector.
+  Callback cb = std::move(cb_);
+  if (cb) {
+    cb(fd, error);
+  } else if (fd >= 0) {
+    sockets::close_fd(fd);
+  }
+}
+
+}  // namespace kbs
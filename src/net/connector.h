@@ -0,0 +1,42 @@
+#pragma once
+
+#include <functional>
+
+#include "net/event_loop.h"
+#include "net/inet_address.h"
+
+namespace kbs {
+
+// One outbound non-blocking connect on the owning loop.  The callback fires
+// exactly once with either a connected fd (error == 0; the callee takes
+// ownership, typically by wrapping it in a TcpConnection) or fd == -1 and
+// an errno value (ETIMEDOUT when the timeout expired).  Destroying the
+// Connector before then cancels the attempt without a callback.
+class Connector final : public IoHandler {
+ public:
+  using Callback = std::function<void(int fd, int error)>;
+
+  Connector(EventLoop& loop, const InetAddress& addr, Callback cb);
+  ~Connector() override;
+
+  Connector(const Connector&) = delete;
+  Connector& operator=(const Connector&) = delete;
+
+  // Loop thread only.
+  void start(uint32_t timeout_ms = 3000);
+
+  const InetAddress& address() const { return addr_; }
+
+  void handle_events(uint32_t events) override;
+
+ private:
+  void finish(int fd, int error);
+
+  EventLoop& loop_;
+  InetAddress addr_;
+  Callback cb_;
+  int fd_ = -1;
+  TimerId timer_ = kInvalidTimerId;
+};
+
+}  // namespace kbs
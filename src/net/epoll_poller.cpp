@@ -0,0 +1,78 @@
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <system_error>
+
+#include "net/poller.h"
+
+namespace kbs {
+
+namespace {
+
+uint32_t to_epoll(uint32_t interest) {
+  uint32_t ev = EPOLLRDHUP;
+  if (interest & kPollReadable) ev |= EPOLLIN;
+  if (interest & kPollWritable) ev |= EPOLLOUT;
+  return ev;
+}
+
+uint32_t from_epoll(uint32_t ev) {
+  uint32_t out = kPollNone;
+  if (ev & (EPOLLIN | EPOLLPRI)) out |= kPollReadable;
+  if (ev & EPOLLOUT) out |= kPollWritable;
+  if (ev & (EPOLLHUP | EPOLLRDHUP)) out |= kPollHangup;
+  if (ev & EPOLLERR) out |= kPollError;
+  return out;
+}
+
+class EpollPoller final : public Poller {
+ public:
+  EpollPoller() : epfd_(::epoll_create1(EPOLL_CLOEXEC)), events_(kInitialEvents) {
+    if (epfd_ < 0) throw std::system_error(errno, std::generic_category(), "epoll_create1");
+  }
+  ~EpollPoller() override { ::close(epfd_); }
+
+  void add(int fd, uint32_t interest) override { ctl(EPOLL_CTL_ADD, fd, interest); }
+  void modify(int fd, uint32_t interest) override { ctl(EPOLL_CTL_MOD, fd, interest); }
+  void remove(int fd) override { ::epoll_ctl(epfd_, EPOLL_CTL_DEL, fd, nullptr); }
+
+  int wait(std::vector<PollEvent>& out, int timeout_ms) override {
+    out.clear();
+    int n = ::epoll_wait(epfd_, events_.data(), static_cast<int>(events_.size()), timeout_ms);
+    if (n < 0) {
+      if (errno == EINTR) return 0;
+      throw std::system_error(errno, std::generic_category(), "epoll_wait");
+    }
+    for (int i = 0; i < n; ++i) {
+      out.push_back({events_[i].data.fd, from_epoll(events_[i].events)});
+    }
+    // A full batch means more descriptors are probably ready; grow so the
+    // next call drains them in one syscall.
+    if (static_cast<size_t>(n) == events_.size()) events_.resize(events_.size() * 2);
+    return n;
+  }
+
+  PollerBackend backend() const override { return PollerBackend::kEpoll; }
+
+ private:
+  static constexpr size_t kInitialEvents = 256;
+
+  void ctl(int op, int fd, uint32_t interest) {
+    epoll_event ev{};
+    ev.events = to_epoll(interest);
+    ev.data.fd = fd;
+    if (::epoll_ctl(epfd_, op, fd, &ev) < 0) {
+      throw std::system_error(errno, std::generic_category(), "epoll_ctl");
+    }
+  }
+
+  int epfd_;
+  std::vector<epoll_event> events_;
+};
+
+}  // namespace
+
+std::unique_ptr<Poller> make_epoll_poller() { return std::make_unique<EpollPoller>(); }
+
+}  // namespace kbs
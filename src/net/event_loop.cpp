@@ -0,0 +1,145 @@
+#include "net/event_loop.h"
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <chrono>
+#include <system_error>
+
+#include "metrics/profiler.h"
+
+namespace kbs {
+
+namespace {
+
+uint64_t monotonic_ms() {
+  return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                                   std::chrono::steady_clock::now().time_since_epoch())
+                                   .count());
+}
+
+}  // namespace
+
+// eventfd registered with the poller so post()/quit() can interrupt wait().
+class EventLoop::Waker final : public IoHandler {
+ public:
+  Waker() : fd_(::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {
+    if (fd_ < 0) throw std::system_error(errno, std::generic_category(), "eventfd");
+  }
+  ~Waker() override { ::close(fd_); }
+
+  int fd() const { return fd_; }
+
+  void wake() {
+    uint64_t one = 1;
+    [[maybe_unused]] ssize_t n = ::write(fd_, &one, sizeof(one));
+  }
+
+  void handle_events(uint32_t) override {
+    uint64_t value;
+    [[maybe_unused]] ssize_t n = ::read(fd_, &value, sizeof(value));
+  }
+
+ private:
+  int fd_;
+};
+
+EventLoop::EventLoop(PollerBackend backend)
+    : poller_(Poller::create(backend)),
+      waker_(std::make_unique<Waker>()),
+      thread_id_(std::this_thread::get_id()) {
+  add_handler(waker_->fd(), waker_.get(), kPollReadable);
+}
+
+EventLoop::~EventLoop() { poller_->remove(waker_->fd()); }
+
+void EventLoop::run() {
+  thread_id_ = std::this_thread::get_id();
+  timer_epoch_ms_ = monotonic_ms() - timers_.now();
+  while (!quit_.load(std::memory_order_acquire)) {
+    poller_->wait(ready_, next_timeout());
+    {
+      KBS_PROFILE_SCOPE(kNetwork);
+      for (const PollEvent& ev : ready_) {
+        // A handler earlier in the batch may have removed this fd.
+        if (static_cast<size_t>(ev.fd) < handlers_.size()) {
+          if (IoHandler* h = handlers_[ev.fd]) h->handle_events(ev.events);
+        }
+      }
+      run_deferred();
+    }
+    advance_timers();
+    run_posted();
+    run_deferred();
+    ++iterations_;
+  }
+}
+
+void EventLoop::quit() {
+  quit_.store(true, std::memory_order_release);
+  waker_->wake();
+}
+
+void EventLoop::post(Task fn) {
+  if (!posted_.try_push(std::move(fn))) {
+    std::lock_guard<std::mutex> lock(overflow_mutex_);
+    overflow_.push_back(std::move(fn));
+    has_overflow_.store(true, std::memory_order_release);
+  }
+  if (wake_armed_.exchange(false, std::memory_order_acq_rel)) waker_->wake();
+}
+
+void EventLoop::add_handler(int fd, IoHandler* handler, uint32_t interest) {
+  if (static_cast<size_t>(fd) >= handlers_.size()) handlers_.resize(fd * 2 + 64, nullptr);
+  assert(handlers_[fd] == nullptr);
+  handlers_[fd] = handler;
+  poller_->add(fd, interest);
+}
+
+void EventLoop::update_handler(int fd, uint32_t interest) { poller_->modify(fd, interest); }
+
+void EventLoop::remove_handler(int fd) {
+  if (static_cast<size_t>(fd) >= handlers_.size() || handlers_[fd] == nullptr) return;
+  handlers_[fd] = nullptr;
+  poller_->remove(fd);
+}
+
+int EventLoop::next_timeout() const {
+  const uint64_t t = timers_.ticks_until_next();
+  if (t == UINT64_MAX) return poll_timeout_ms_;
+  const int timer_ms = static_cast<int>(std::min<uint64_t>(t, INT32_MAX));
+  return poll_timeout_ms_ < 0 ? timer_ms : std::min(timer_ms, poll_timeout_ms_);
+}
+
+void EventLoop::advance_timers() {
+  const uint64_t now = monotonic_ms() - timer_epoch_ms_;
+  if (now > timers_.now()) timers_.advance(now - timers_.now());
+}
+
+void EventLoop::run_posted() {
+  // Re-arm first: anything posted from here on wakes the next wait().
+  wake_armed_.store(true, std::memory_order_seq_cst);
+  posted_.drain([](Task& t) { t(); });
+  if (has_overflow_.load(std::memory_order_acquire)) {
+    std::vector<Task> batch;
+    {
+      std::lock_guard<std::mutex> lock(overflow_mutex_);
+      batch.swap(overflow_);
+      has_overflow_.store(false, std::memory_order_relaxed);
+    }
+    for (Task& t : batch) t();
+  }
+}
+
+void EventLoop::run_deferred() {
+  while (!deferred_.empty()) {
+    std::vector<Task> batch;
+    batch.swap(deferred_);
+    for (Task& t : batch) t();
+  }
+}
+
+}  // namespace kbs
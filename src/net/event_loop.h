@@ -0,0 +1,102 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "common/mpsc_queue.h"
+#include "common/timer_wheel.h"
+#include "net/poller.h"
+
+namespace kbs {
+
+// Receives readiness notifications for one descriptor.
+class IoHandler {
+ public:
+  virtual ~IoHandler() = default;
+  virtual void handle_events(uint32_t events) = 0;
+};
+
+// Single-threaded reactor.  One EventLoop runs per core; every socket it
+// polls belongs to it, so the read/write path never takes a lock.  The only
+// cross-thread entry points are post() and quit().
+class EventLoop {
+ public:
+  using Task = std::function<void()>;
+
+  explicit EventLoop(PollerBackend backend = PollerBackend::kEpoll);
+  ~EventLoop();
+
+  EventLoop(const EventLoop&) = delete;
+  EventLoop& operator=(const EventLoop&) = delete;
+
+  // Runs until quit() is called.  The calling thread becomes the loop thread.
+  void run();
+  void quit();
+
+  // Thread-safe: queues fn for the loop thread and wakes it.  Goes through a
+  // lock-free ring; only when that is full does it fall back to a mutex, so
+  // ordering is FIFO except under overflow.
+  void post(Task fn);
+  // Loop thread only: runs fn after the current batch of events has been
+  // dispatched.  Used to destroy objects whose handler is still on the stack.
+  void defer(Task fn) { deferred_.push_back(std::move(fn)); }
+
+  // Loop thread only.
+  void add_handler(int fd, IoHandler* handler, uint32_t interest);
+  void update_handler(int fd, uint32_t interest);
+  void remove_handler(int fd);
+
+  // Loop thread only.  Millisecond timers driven by the loop's own wheel.
+  TimerId run_after(uint64_t delay_ms, TimerWheel::Callback cb) {
+    return timers_.schedule(delay_ms, std::move(cb));
+  }
+  TimerId run_every(uint64_t period_ms, TimerWheel::Callback cb) {
+    return timers_.schedule(period_ms, std::move(cb), period_ms);
+  }
+  bool cancel_timer(TimerId id) { return timers_.cancel(id); }
+  TimerWheel& timers() { return timers_; }
+
+  // Upper bound on how long the loop sleeps in the poller.
+  void set_poll_timeout(int timeout_ms) { poll_timeout_ms_ = timeout_ms; }
+
+  bool in_loop_thread() const { return std::this_thread::get_id() == thread_id_; }
+  PollerBackend backend() const { return poller_->backend(); }
+  uint64_t iterations() const { return iterations_; }
+  // Any thread: tasks sitting in the post() ring, not counting overflow.
+  size_t posted_depth() const { return posted_.size_approx(); }
+
+ private:
+  class Waker;
+
+  void run_posted();
+  void run_deferred();
+  int next_timeout() const;
+  void advance_timers();
+
+  std::unique_ptr<Poller> poller_;
+  std::unique_ptr<Waker> waker_;
+  std::vector<PollEvent> ready_;
+  std::vector<IoHandler*> handlers_;  // indexed by fd
+  std::vector<Task> deferred_;
+  TimerWheel timers_;
+  uint64_t timer_epoch_ms_ = 0;
+
+  static constexpr size_t kPostedCapacity = 1u << 14;
+  MpscQueue<Task> posted_{kPostedCapacity};
+  std::atomic<bool> wake_armed_{true};
+  std::atomic<bool> has_overflow_{false};
+  std::mutex overflow_mutex_;
+  std::vector<Task> overflow_;
+
+  std::atomic<bool> quit_{false};
+  std::thread::id thread_id_;
+  int poll_timeout_ms_ = -1;
+  uint64_t iterations_ = 0;
+};
+
+}  // namespace kbs
@@ -0,0 +1,66 @@
+#include "net/inet_address.h"
+
+#include <arpa/inet.h>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace kbs {
+
+InetAddress::InetAddress(uint16_t port, bool loopback, bool ipv6) {
+  if (ipv6) {
+    auto* a = reinterpret_cast<sockaddr_in6*>(&addr_);
+    a->sin6_family = AF_INET6;
+    a->sin6_addr = loopback ? in6addr_loopback : in6addr_any;
+    a->sin6_port = htons(port);
+  } else {
+    auto* a = reinterpret_cast<sockaddr_in*>(&addr_);
+    a->sin_family = AF_INET;
+    a->sin_addr.s_addr = htonl(loopback ? INADDR_LOOPBACK : INADDR_ANY);
+    a->sin_port = htons(port);
+  }
+}
+
+InetAddress InetAddress::parse(std::string_view host, uint16_t port) {
+  InetAddress out;
+  std::string h(host);
+  auto* a4 = reinterpret_cast<sockaddr_in*>(&out.addr_);
+  auto* a6 = reinterpret_cast<sockaddr_in6*>(&out.addr_);
+  if (::inet_pton(AF_INET, h.c_str(), &a4->sin_addr) == 1) {
+    a4->sin_family = AF_INET;
+    a4->sin_port = htons(port);
+  } else if (::inet_pton(AF_INET6, h.c_str(), &a6->sin6_addr) == 1) {
+    a6->sin6_family = AF_INET6;
+    a6->sin6_port = htons(port);
+  } else {
+    throw std::invalid_argument("InetAddress: not a numeric address: " + h);
+  }
+  return out;
+}
+
+InetAddress InetAddress::from_sockaddr(const sockaddr* sa, socklen_t len) {
+  InetAddress out;
+  std::memcpy(&out.addr_, sa, std::min<size_t>(len, sizeof(out.addr_)));
+  return out;
+}
+
+uint16_t InetAddress::port() const {
+  if (family() == AF_INET6) {
+    return ntohs(reinterpret_cast<const sockaddr_in6*>(&addr_)->sin6_port);
+  }
+  return ntohs(reinterpret_cast<const sockaddr_in*>(&addr_)->sin_port);
+}
+
+std::string InetAddress::to_string() const {
+  char buf[INET6_ADDRSTRLEN] = {};
+  if (family() == AF_INET6) {
+    ::inet_ntop(AF_INET6, &reinterpret_cast<const sockaddr_in6*>(&addr_)->sin6_addr, buf,
+                sizeof(buf));
+    return "[" + std::string(buf) + "]:" + std::to_string(port());
+  }
+  ::inet_ntop(AF_INET, &reinterpret_cast<const sockaddr_in*>(&addr_)->sin_addr, buf, sizeof(buf));
+  return std::string(buf) + ":" + std::to_string(port());
+}
+
+}  // namespace kbs
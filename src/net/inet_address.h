@@ -0,0 +1,38 @@
+#pragma once
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace kbs {
+
+// IPv4/IPv6 socket address.
+class InetAddress {
+ public:
+  InetAddress() = default;
+  // Wildcard (or loopback) address on the given port.
+  explicit InetAddress(uint16_t port, bool loopback = false, bool ipv6 = false);
+
+  // Parses a numeric host ("0.0.0.0", "::1", ...).  Throws
+  // std::invalid_argument when the host is not a numeric address.
+  static InetAddress parse(std::string_view host, uint16_t port);
+  static InetAddress from_sockaddr(const sockaddr* sa, socklen_t len);
+
+  int family() const { return addr_.ss_family; }
+  uint16_t port() const;
+  std::string to_string() const;
+
+  const sockaddr* sockaddr_ptr() const { return reinterpret_cast<const sockaddr*>(&addr_); }
+  sockaddr* sockaddr_ptr() { return reinterpret_cast<sockaddr*>(&addr_); }
+  socklen_t length() const {
+    return family() == AF_INET6 ? sizeof(sockaddr_in6) : sizeof(sockaddr_in);
+  }
+
+ private:
+  sockaddr_storage addr_{};
+};
+
+}  // namespace kbs
@@ -0,0 +1,180 @@
+#include "net/message_buffer.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <new>
+#include <string>
+
+#include "metrics/metrics.h"
+
+namespace kbs {
+
+namespace {
+
+struct BufferMetrics {
+  Counter& chunk_allocs =
+      metrics().counter("kbs_buffer_chunk_allocs_total", "Chunks taken from the heap");
+  Counter& chunk_alloc_bytes =
+      metrics().counter("kbs_buffer_chunk_alloc_bytes_total", "Chunk bytes taken from the heap");
+  Counter& chunk_reuses =
+      metrics().counter("kbs_buffer_chunk_reuses_total", "Chunks served from the thread cache");
+  Counter& frames_encoded = metrics().counter("kbs_frames_encoded_total", "Frames built");
+  Counter& frames_decoded = metrics().counter("kbs_frames_decoded_total", "Frames parsed");
+};
+
+BufferMetrics& buffer_metrics() {
+  static BufferMetrics m;
+  return m;
+}
+
+// Only default-sized chunks are cached; oversized ones go straight back to
+// the allocator.
+constexpr size_t kMaxCachedChunks = 256;
+
+struct ChunkCache {
+  std::vector<Chunk*> free;
+  ~ChunkCache() {
+    for (Chunk* c : free) ::operator delete(c);
+  }
+};
+
+thread_local ChunkCache t_cache;
+
+void store_le(char* p, uint64_t v, size_t n) {
+  for (size_t i = 0; i < n; ++i) p[i] = static_cast<char>(v >> (8 * i));
+}
+
+uint64_t load_le(const char* p, size_t n) {
+  uint64_t v = 0;
+  for (size_t i = 0; i < n; ++i) v |= static_cast<uint64_t>(static_cast<uint8_t>(p[i])) << (8 * i);
+  return v;
+}
+
+}  // namespace
+
+Chunk* Chunk::allocate(size_t min_capacity) {
+  if (min_capacity <= kDefaultCapacity && !t_cache.free.empty()) {
+    Chunk* c = t_cache.free.back();
+    t_cache.free.pop_back();
+    c->refs_.store(1, std::memory_order_relaxed);
+    c->used = 0;
+    buffer_metrics().chunk_reuses.inc();
+    return c;
+  }
+  const size_t cap = std::max(min_capacity, kDefaultCapacity);
+  buffer_metrics().chunk_allocs.inc();
+  buffer_metrics().chunk_alloc_bytes.inc(sizeof(Chunk) + cap);
+  void* mem = ::operator new(sizeof(Chunk) + cap);
+  return new (mem) Chunk(static_cast<uint32_t>(cap));
+}
+
+void Chunk::recycle(Chunk* c) {
+  if (c->capacity_ == kDefaultCapacity && t_cache.free.size() < kMaxCachedChunks) {
+    t_cache.free.push_back(c);
+    return;
+  }
+  c->~Chunk();
+  ::operator delete(c);
+}
+
+char* MessageBuffer::reserve(size_t n) {
+  if (!slices_.empty()) {
+    Slice& tail = slices_.back();
+    Chunk* c = tail.chunk.get();
+    // Grow in place only while nobody else can see this chunk and our slice
+    // is the one at its write frontier.
+    if (c->unique() && tail.offset + tail.length == c->used && c->capacity() - c->used >= n) {
+      char* p = c->data() + c->used;
+      c->used += static_cast<uint32_t>(n);
+      tail.length += static_cast<uint32_t>(n);
+      size_ += n;
+      return p;
+    }
+  }
+  ChunkRef c(Chunk::allocate(n));
+  c->used = static_cast<uint32_t>(n);
+  char* p = c->data();
+  slices_.push_back(Slice{std::move(c), 0, static_cast<uint32_t>(n)});
+  size_ += n;
+  return p;
+}
+
+void MessageBuffer::append(const void* data, size_t len) {
+  const char* src = static_cast<const char*>(data);
+  while (len > 0) {
+    // Fill whatever is left in the tail chunk before starting a new one so
+    // large payloads are split across default-sized (cacheable) chunks.
+    size_t room = 0;
+    if (!slices_.empty()) {
+      const Slice& tail = slices_.back();
+      Chunk* c = tail.chunk.get();
+      if (c->unique() && tail.offset + tail.length == c->used) room = c->capacity() - c->used;
+    }
+    const size_t n = std::min(len, room > 0 ? room : Chunk::kDefaultCapacity);
+    std::memcpy(reserve(n), src, n);
+    src += n;
+    len -= n;
+  }
+}
+
+void MessageBuffer::append(const MessageBuffer& other) {
+  for (const Slice& s : other.slices_) slices_.push_back(s);
+  size_ += other.size_;
+}
+
+size_t MessageBuffer::begin_frame(uint16_t msg_id) {
+  const size_t token = size_;
+  char header[kFrameHeaderSize];
+  store_le(header, 0, 4);
+  store_le(header + 4, msg_id, 2);
+  append(header, sizeof(header));
+  return token;
+}
+
+void MessageBuffer::end_frame(size_t token) {
+  assert(size_ >= token + kFrameHeaderSize);
+  char len[4];
+  store_le(len, size_ - token - kFrameHeaderSize, 4);
+  patch(token, len, sizeof(len));
+  buffer_metrics().frames_encoded.inc();
+}
+
+void MessageBuffer::patch(size_t pos, const void* data, size_t len) {
+  const char* src = static_cast<const char*>(data);
+  size_t base = 0;
+  for (Slice& s : slices_) {
+    if (len == 0) break;
+    if (pos < base + s.length) {
+      assert(s.chunk->unique());
+      const size_t off = pos - base;
+      const size_t n = std::min<size_t>(len, s.length - off);
+      std::memcpy(s.chunk->data() + s.offset + off, src, n);
+      src += n;
+      pos += n;
+      len -= n;
+    }
+    base += s.length;
+  }
+}
+
+std::string MessageBuffer::to_string() const {
+  std::string out;
+  out.reserve(size_);
+  for (const Slice& s : slices_) out.append(s.data(), s.length);
+  return out;
+}
+
+FrameStatus parse_frame(std::string_view data, Frame& out, size_t& consumed, size_t max_body) {
+  if (data.size() < kFrameHeaderSize) return FrameStatus::kIncomplete;
+  const size_t body = load_le(data.data(), 4);
+  if (body > max_body) return FrameStatus::kTooLarge;
+  if (data.size() < kFrameHeaderSize + body) return FrameStatus::kIncomplete;
+  out.msg_id = static_cast<uint16_t>(load_le(data.data() + 4, 2));
+  out.body = data.substr(kFrameHeaderSize, body);
+  consumed = kFrameHeaderSize + body;
+  buffer_metrics().frames_decoded.inc();
+  return FrameStatus::kOk;
+}
+
+}  // namespace kbs
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace kbs {
+
+// Fixed-size, reference-counted slab that backs MessageBuffer slices.
+// Chunks are recycled through a small per-thread free list, so steady-state
+// encoding does not touch the allocator.
+class alignas(16) Chunk {
+ public:
+  static constexpr size_t kDefaultCapacity = 16 * 1024 - 64;
+
+  // Returns a chunk with refcount 1 and at least min_capacity bytes.
+  static Chunk* allocate(size_t min_capacity = kDefaultCapacity);
+
+  void add_ref() { refs_.fetch_add(1, std::memory_order_relaxed); }
+  void release() {
+    if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) recycle(this);
+  }
+  bool unique() const { return refs_.load(std::memory_order_acquire) == 1; }
+
+  char* data() { return reinterpret_cast<char*>(this + 1); }
+  const char* data() const { return reinterpret_cast<const char*>(this + 1); }
+  size_t capacity() const { return capacity_; }
+
+  // Bytes handed out to slices so far; only the unique owner advances it.
+  uint32_t used = 0;
+
+ private:
+  explicit Chunk(uint32_t capacity) : capacity_(capacity) {}
+  static void recycle(Chunk* c);
+
+  std::atomic<uint32_t> refs_{1};
+  uint32_t capacity_;
+};
+
+// Intrusive owning pointer to a Chunk.
+class ChunkRef {
+ public:
+  ChunkRef() = default;
+  // Adopts an existing reference (e.g. from Chunk::allocate()).
+  explicit ChunkRef(Chunk* c) : c_(c) {}
+  ChunkRef(const ChunkRef& o) : c_(o.c_) {
+    if (c_) c_->add_ref();
+  }
+  ChunkRef(ChunkRef&& o) noexcept : c_(std::exchange(o.c_, nullptr)) {}
+  ChunkRef& operator=(ChunkRef o) noexcept {
+    std::swap(c_, o.c_);
+    return *this;
+  }
+  ~ChunkRef() {
+    if (c_) c_->release();
+  }
+
+  Chunk* get() const { return c_; }
+  Chunk* operator->() const { return c_; }
+  explicit operator bool() const { return c_ != nullptr; }
+
+ private:
+  Chunk* c_ = nullptr;
+};
+
+// A view of bytes inside a chunk that keeps the chunk alive.
+struct Slice {
+  ChunkRef chunk;
+  uint32_t offset = 0;
+  uint32_t length = 0;
+
+  const char* data() const { return chunk->data() + offset; }
+};
+
+// Wire framing: little-endian u32 body length, then u16 message id.
+constexpr size_t kFrameHeaderSize = 6;
+constexpr size_t kMaxFrameBody = 1u << 24;
+
+// Chained buffer of ref-counted chunks.  Copying a MessageBuffer shares the
+// underlying bytes instead of duplicating them, so one packet encoded for a
+// broadcast can sit in N connections' output queues at the cost of N
+// refcount bumps.  Once copied, a buffer should be treated as immutable;
+// appends after sharing go to fresh chunks and never disturb other holders.
+class MessageBuffer {
+ public:
+  MessageBuffer() = default;
+
+  void append(const void* data, size_t len);
+  void append(std::string_view s) { append(s.data(), s.size()); }
+  // Shares other's slices (no byte copy).
+  void append(const MessageBuffer& other);
+
+  template <typename T>
+  void append_pod(const T& v) {
+    append(&v, sizeof(T));
+  }
+
+  // Returns n contiguous writable bytes at the end of the buffer.  The bytes
+  // count towards size() immediately.
+  char* reserve(size_t n);
+
+  // Starts a frame and returns a token for end_frame(), which patches the
+  // body length into the header once the body has been appended.
+  size_t begin_frame(uint16_t msg_id);
+  void end_frame(size_t token);
+
+  // Overwrites bytes already in the buffer (buffer must not be shared yet).
+  void patch(size_t pos, const void* data, size_t len);
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  const std::vector<Slice>& slices() const { return slices_; }
+  void clear() {
+    slices_.clear();
+    size_ = 0;
+  }
+
+  // Flattened copy; for tests and logging, not the send path.
+  std::string to_string() const;
+
+ private:
+  std::vector<Slice> slices_;
+  size_t size_ = 0;
+};
+
+// A parsed inbound frame; body points into the connection's input buffer
+// and is only valid until the buffer is consumed.
+struct Frame {
+  uint16_t msg_id = 0;
+  std::string_view body;
+};
+
+enum class FrameStatus { kOk, kIncomplete, kTooLarge };
+
+// Parses one frame from the front of data.  On kOk, consumed is the total
+// frame size (header included).
+FrameStatus parse_frame(std::string_view data, Frame& out, size_t& consumed,
+                        size_t max_body = kMaxFrameBody);
+
+}  // namespace kbs
@@ -0,0 +1,80 @@
+#include "net/output_queue.h"
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+namespace kbs {
+
+void OutputQueue::push(const MessageBuffer& buf) {
+  for (const Slice& s : buf.slices()) push(s);
+}
+
+void OutputQueue::push(const Slice& s) {
+  if (s.length == 0) return;
+  slices_.push_back(s);
+  bytes_ += s.length;
+}
+
+void OutputQueue::push_copy(const void* data, size_t len) {
+  MessageBuffer tmp;
+  tmp.append(data, len);
+  push(tmp);
+}
+
+ssize_t OutputQueue::write_to(int fd) {
+  iovec iov[kMaxIov];
+  int n = 0;
+  size_t skip = head_offset_;
+  for (auto it = slices_.begin(); it != slices_.end() && n < kMaxIov; ++it) {
+    iov[n].iov_base = const_cast<char*>(it->data()) + skip;
+    iov[n].iov_len = it->length - skip;
+    skip = 0;
+    ++n;
+  }
+  if (n == 0) return 0;
+  msghdr msg{};
+  msg.msg_iov = iov;
+  msg.msg_iovlen = static_cast<size_t>(n);
+  // sendmsg() rather than writev() so a reset peer does not raise SIGPIPE.
+  ssize_t written = ::sendmsg(fd, &msg, MSG_NOSIGNAL);
+  if (written > 0) consume(static_cast<size_t>(written));
+  return written;
+}
+
+void OutputQueue::consume(size_t n) {
+  bytes_ -= n;
+  while (n > 0) {
+    Slice& front = slices_.front();
+    const size_t left = front.length - head_offset_;
+    if (n < left) {
+      head_offset_ += n;
+      return;
+    }
+    n -= left;
+    head_offset_ = 0;
+    slices_.pop_front();
+  }
+}
+
+ssize_t write_buffer(int fd, const MessageBuffer& buf, size_t skip) {
+  iovec iov[OutputQueue::kMaxIov];
+  int n = 0;
+  for (const Slice& s : buf.slices()) {
+    if (n == OutputQueue::kMaxIov) break;
+    if (skip >= s.length) {
+      skip -= s.length;
+      continue;
+    }
+    iov[n].iov_base = const_cast<char*>(s.data()) + skip;
+    iov[n].iov_len = s.length - skip;
+    skip = 0;
+    ++n;
+  }
+  if (n == 0) return 0;
+  msghdr msg{};
+  msg.msg_iov = iov;
+  msg.msg_iovlen = static_cast<size_t>(n);
+  return ::sendmsg(fd, &msg, MSG_NOSIGNAL);
+}
+
+}  // namespace kbs
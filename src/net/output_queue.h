@@ -0,0 +1,48 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstddef>
+#include <deque>
+
+#include "net/message_buffer.h"
+
+namespace kbs {
+
+// Per-connection queue of outgoing slices drained with writev().  Shared
+// broadcast buffers are queued by reference, never copied.
+class OutputQueue {
+ public:
+  // Slices gathered per writev(); Linux's IOV_MAX is 1024 but a few dozen
+  // already fill a socket send buffer.
+  static constexpr int kMaxIov = 64;
+
+  void push(const MessageBuffer& buf);
+  void push(const Slice& s);
+  // Copies bytes into a private chunk (for callers without a MessageBuffer).
+  void push_copy(const void* data, size_t len);
+
+  size_t bytes() const { return bytes_; }
+  bool empty() const { return bytes_ == 0; }
+  void clear() {
+    slices_.clear();
+    bytes_ = 0;
+    head_offset_ = 0;
+  }
+
+  // One writev() of as much as fits; returns its result (errno preserved).
+  ssize_t write_to(int fd);
+
+ private:
+  void consume(size_t n);
+
+  std::deque<Slice> slices_;
+  size_t head_offset_ = 0;  // bytes of slices_.front() already written
+  size_t bytes_ = 0;
+};
+
+// Writes buf starting at byte skip with a single writev(); used to try an
+// immediate send before anything is queued.
+ssize_t write_buffer(int fd, const MessageBuffer& buf, size_t skip = 0);
+
+}  // namespace kbs
@@ -0,0 +1,16 @@
+#include "net/poller.h"
+
+namespace kbs {
+
+std::unique_ptr<Poller> Poller::create(PollerBackend backend) {
+#if defined(KBS_HAVE_IO_URING)
+  if (backend == PollerBackend::kIoUring) {
+    if (auto p = make_uring_poller()) return p;
+  }
+#else
+  (void)backend;
+#endif
+  return make_epoll_poller();
+}
+
+}  // namespace kbs
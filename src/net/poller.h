@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace kbs {
+
+// Readiness bits shared by every poller backend.
+enum PollFlags : uint32_t {
+  kPollNone = 0,
+  kPollReadable = 1u << 0,
+  kPollWritable = 1u << 1,
+  kPollHangup = 1u << 2,
+  kPollError = 1u << 3,
+};
+
+struct PollEvent {
+  int fd;
+  uint32_t events;
+};
+
+enum class PollerBackend {
+  kEpoll,
+  kIoUring,
+};
+
+// Level-triggered readiness multiplexer owned by exactly one EventLoop.
+// Not thread-safe: every call happens on the owning loop's thread.
+class Poller {
+ public:
+  virtual ~Poller() = default;
+
+  virtual void add(int fd, uint32_t interest) = 0;
+  virtual void modify(int fd, uint32_t interest) = 0;
+  virtual void remove(int fd) = 0;
+
+  // Blocks for at most timeout_ms (-1 waits forever) and replaces the
+  // contents of out with the ready descriptors.  Returns out.size().
+  virtual int wait(std::vector<PollEvent>& out, int timeout_ms) = 0;
+
+  virtual PollerBackend backend() const = 0;
+
+  // Builds the requested backend.  kIoUring falls back to epoll when the
+  // library was built without it or the kernel refuses io_uring_setup().
+  static std::unique_ptr<Poller> create(PollerBackend backend);
+};
+
+std::unique_ptr<Poller> make_epoll_poller();
+#if defined(KBS_HAVE_IO_URING)
+// Returns nullptr when the kernel does not support io_uring.
+std::unique_ptr<Poller> make_uring_poller();
+#endif
+
+}  // namespace kbs
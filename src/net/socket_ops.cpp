@@ -0,0 +1,100 @@
+#include "net/socket_ops.h"
+
+#include <netinet/tcp.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <system_error>
+
+namespace kbs::sockets {
+
+namespace {
+
+[[noreturn]] void throw_errno(const char* what) {
+  throw std::system_error(errno, std::generic_category(), what);
+}
+
+void set_opt(int fd, int level, int name, int value, const char* what) {
+  if (::setsockopt(fd, level, name, &value, sizeof(value)) < 0) throw_errno(what);
+}
+
+}  // namespace
+
+int create_listener(const InetAddress& addr, bool reuse_port, int backlog) {
+  int fd = ::socket(addr.family(), SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP);
+  if (fd < 0) throw_errno("socket");
+  try {
+    set_opt(fd, SOL_SOCKET, SO_REUSEADDR, 1, "setsockopt(SO_REUSEADDR)");
+    if (reuse_port) set_opt(fd, SOL_SOCKET, SO_REUSEPORT, 1, "setsockopt(SO_REUSEPORT)");
+    if (::bind(fd, addr.sockaddr_ptr(), addr.length()) < 0) throw_errno("bind");
+    if (::listen(fd, backlog) < 0) throw_errno("listen");
+  } catch (...) {
+    ::close(fd);
+    throw;
+  }
+  return fd;
+}
+
+int create_udp_socket(const InetAddress& addr, bool reuse_port) {
+  int fd = ::socket(addr.family(), SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_UDP);
+  if (fd < 0) throw_errno("socket");
+  try {
+    set_opt(fd, SOL_SOCKET, SO_REUSEADDR, 1, "setsockopt(SO_REUSEADDR)");
+    if (reuse_port) set_opt(fd, SOL_SOCKET, SO_REUSEPORT, 1, "setsockopt(SO_REUSEPORT)");
+    if (::bind(fd, addr.sockaddr_ptr(), addr.length()) < 0) throw_errno("bind");
+  } catch (...) {
+    ::close(fd);
+    throw;
+  }
+  return fd;
+}
+
+int connect_nonblocking(const InetAddress& addr) {
+  int fd = ::socket(addr.family(), SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP);
+  if (fd < 0) throw_errno("socket");
+  if (::connect(fd, addr.sockaddr_ptr(), addr.length()) < 0 && errno != EINPROGRESS) {
+    int saved = errno;
+    ::close(fd);
+    throw std::system_error(saved, std::generic_category(), "connect");
+  }
+  return fd;
+}
+
+void set_tcp_nodelay(int fd, bool on) {
+  set_opt(fd, IPPROTO_TCP, TCP_NODELAY, on ? 1 : 0, "setsockopt(TCP_NODELAY)");
+}
+
+void set_keepalive(int fd, bool on) {
+  set_opt(fd, SOL_SOCKET, SO_KEEPALIVE, on ? 1 : 0, "setsockopt(SO_KEEPALIVE)");
+}
+
+void set_incoming_cpu(int fd, int cpu) {
+  set_opt(fd, SOL_SOCKET, SO_INCOMING_CPU, cpu, "setsockopt(SO_INCOMING_CPU)");
+}
+
+int socket_error(int fd) {
+  int err = 0;
+  socklen_t len = sizeof(err);
+  if (::getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0) return errno;
+  return err;
+}
+
+InetAddress local_address(int fd) {
+  sockaddr_storage ss{};
+  socklen_t len = sizeof(ss);
+  if (::getsockname(fd, reinterpret_cast<sockaddr*>(&ss), &len) < 0) throw_errno("getsockname");
+  return InetAddress::from_sockaddr(reinterpret_cast<sockaddr*>(&ss), len);
+}
+
+InetAddress peer_address(int fd) {
+  sockaddr_storage ss{};
+  socklen_t len = sizeof(ss);
+  if (::getpeername(fd, reinterpret_cast<sockaddr*>(&ss), &len) < 0) throw_errno("getpeername");
+  return InetAddress::from_sockaddr(reinterpret_cast<sockaddr*>(&ss), len);
+}
+
+void close_fd(int fd) {
+  if (fd >= 0) ::close(fd);
+}
+
+}  // namespace kbs::sockets
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "net/inet_address.h"
+
+namespace kbs::sockets {
+
+// Setup-path helpers throw std::system_error; hot-path helpers return the
+// raw syscall result and leave errno alone so callers can branch on EAGAIN.
+
+// Non-blocking, close-on-exec listening socket.  With reuse_port every
+// reactor thread binds its own listener to the same address and the kernel
+// spreads incoming connections across them.
+int create_listener(const InetAddress& addr, bool reuse_port, int backlog = 1024);
+
+// Non-blocking, close-on-exec UDP socket bound to addr.  reuse_port lets
+// several reactor threads share one port as for listeners.
+int create_udp_socket(const InetAddress& addr, bool reuse_port);
+
+// Non-blocking connect; returns the fd with the connect in progress.
+int connect_nonblocking(const InetAddress& addr);
+
+void set_tcp_nodelay(int fd, bool on);
+void set_keepalive(int fd, bool on);
+// SO_INCOMING_CPU: among SO_REUSEPORT listeners, the kernel prefers the
+// one whose CPU matches the CPU that processed the SYN, so with NIC RSS
+// queues steered to the reactors' CPUs a connection is accepted by the
+// loop already running where its packets arrive.
+void set_incoming_cpu(int fd, int cpu);
+
+// Pending SO_ERROR on fd (0 when none).
+int socket_error(int fd);
+
+InetAddress local_address(int fd);
+InetAddress peer_address(int fd);
+
+void close_fd(int fd);
+
+}  // namespace kbs::sockets
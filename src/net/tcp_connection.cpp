@@ -0,0 +1,184 @@
+#include "net/tcp_connection.h"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cassert>
+#include <cerrno>
+
+#include "metrics/metrics.h"
+#include "net/traffic_recorder.h"
+
+namespace kbs {
+
+namespace {
+
+struct TcpMetrics {
+  Counter& received =
+      metrics().counter("kbs_tcp_received_bytes_total", "Bytes read from TCP connections");
+  Counter& sent =
+      metrics().counter("kbs_tcp_sent_bytes_total", "Bytes written to TCP connections");
+  Gauge& open = metrics().gauge("kbs_tcp_connections", "Open TCP connections");
+};
+
+TcpMetrics& tcp_metrics() {
+  static TcpMetrics m;
+  return m;
+}
+
+}  // namespace
+
+TcpConnection::TcpConnection(EventLoop& loop, int fd, uint64_t id, const InetAddress& peer)
+    : loop_(loop), fd_(fd), id_(id), peer_(peer) {}
+
+TcpConnection::~TcpConnection() {
+  if (state_ != State::kDisconnected && state_ != State::kIdle) {
+    loop_.remove_handler(fd_);
+    tcp_metrics().open.add(-1);
+  }
+  ::close(fd_);
+}
+
+void TcpConnection::start() {
+  assert(state_ == State::kIdle);
+  state_ = State::kConnected;
+  loop_.add_handler(fd_, this, kPollReadable);
+  tcp_metrics().open.add(1);
+}
+
+bool TcpConnection::send(const void* data, size_t len) {
+  assert(loop_.in_loop_thread());
+  if (state_ != State::kConnected) return false;
+
+  size_t written = 0;
+  if (output_.empty()) {
+    ssize_t n = ::send(fd_, data, len, MSG_NOSIGNAL);
+    if (n >= 0) {
+      written = static_cast<size_t>(n);
+      tcp_metrics().sent.inc(written);
+    } else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+      handle_close();
+      return false;
+    }
+  }
+  if (written == len) return true;
+  if (!check_output_limit(len - written)) return false;
+  output_.push_copy(static_cast<const char*>(data) + written, len - written);
+  update_interest();
+  return true;
+}
+
+bool TcpConnection::send(const MessageBuffer& buf) {
+  assert(loop_.in_loop_thread());
+  if (state_ != State::kConnected) return false;
+
+  size_t written = 0;
+  if (output_.empty()) {
+    ssize_t n = write_buffer(fd_, buf);
+    if (n >= 0) {
+      written = static_cast<size_t>(n);
+      tcp_metrics().sent.inc(written);
+    } else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+      handle_close();
+      return false;
+    }
+  }
+  if (written == buf.size()) return true;
+  if (!check_output_limit(buf.size() - written)) return false;
+  for (const Slice& s : buf.slices()) {
+    if (written >= s.length) {
+      written -= s.length;
+      continue;
+    }
+    output_.push(Slice{s.chunk, s.offset + static_cast<uint32_t>(written),
+                       s.length - static_cast<uint32_t>(written)});
+    written = 0;
+  }
+  update_interest();
+  return true;
+}
+
+bool TcpConnection::check_output_limit(size_t extra) {
+  if (output_.bytes() + extra <= max_output_bytes_) return true;
+  handle_close();
+  return false;
+}
+
+void TcpConnection::shutdown() {
+  if (state_ != State::kConnected) return;
+  state_ = State::kDisconnecting;
+  if (output_.empty()) ::shutdown(fd_, SHUT_WR);
+}
+
+void TcpConnection::force_close() {
+  if (state_ == State::kConnected || state_ == State::kDisconnecting) handle_close();
+}
+
+void TcpConnection::handle_events(uint32_t events) {
+  if (events & kPollError) {
+    handle_close();
+    return;
+  }
+  if (events & (kPollReadable | kPollHangup)) handle_read();
+  if ((events & kPollWritable) && state_ != State::kDisconnected) handle_write();
+}
+
+void TcpConnection::handle_read() {
+  ssize_t n = input_.read_from_fd(fd_);
+  if (n > 0) {
+    tcp_metrics().received.inc(static_cast<uint64_t>(n));
+    if (recorder_) {
+      recorder_->record_data(id_, std::string_view(input_.peek() + input_.readable_bytes() - n,
+                                                   static_cast<size_t>(n)));
+    }
+    if (on_message_) {
+      // A local copy: the callback may replace or clear itself (as
+      // RpcChannel::close() does) while it runs.
+      const MessageCallback cb = on_message_;
+      cb(*this, input_);
+    }
+  } else if (n == 0) {
+    handle_close();
+  } else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+    handle_close();
+  }
+}
+
+void TcpConnection::handle_write() {
+  // Drain until the socket pushes back so one writable event empties as
+  // much of the queue as the kernel will take.
+  while (!output_.empty()) {
+    ssize_t n = output_.write_to(fd_);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      if (errno != EAGAIN && errno != EWOULDBLOCK) handle_close();
+      return;
+    }
+    tcp_metrics().sent.inc(static_cast<uint64_t>(n));
+  }
+  update_interest();
+  if (state_ == State::kDisconnecting) ::shutdown(fd_, SHUT_WR);
+}
+
+void TcpConnection::set_recorder(TrafficRecorder* r) {
+  recorder_ = r;
+  if (recorder_) recorder_->record_open(id_);
+}
+
+void TcpConnection::handle_close() {
+  if (state_ == State::kDisconnected) return;
+  state_ = State::kDisconnected;
+  loop_.remove_handler(fd_);
+  tcp_metrics().open.add(-1);
+  if (recorder_) recorder_->record_close(id_);
+  if (on_close_) on_close_(*this);
+}
+
+void TcpConnection::update_interest() {
+  const bool want = !output_.empty();
+  if (want == want_write_ || state_ == State::kDisconnected) return;
+  want_write_ = want;
+  loop_.update_handler(fd_, kPollReadable | (want ? kPollWritable : kPollNone));
+}
+
+}  // namespace kbs
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string_view>
+
+#include "net/byte_buffer.h"
+#include "net/event_loop.h"
+#include "net/inet_address.h"
+#include "net/message_buffer.h"
+#include "net/output_queue.h"
+
+namespace kbs {
+
+class TrafficRecorder;
+
+// One established TCP stream.  Owned by the loop that accepted it; every
+// method must be called on that loop's thread.
+class TcpConnection final : public IoHandler {
+ public:
+  using MessageCallback = std::function<void(TcpConnection&, ByteBuffer&)>;
+  using CloseCallback = std::function<void(TcpConnection&)>;
+
+  // Takes ownership of fd.
+  TcpConnection(EventLoop& loop, int fd, uint64_t id, const InetAddress& peer);
+  ~TcpConnection() override;
+
+  TcpConnection(const TcpConnection&) = delete;
+  TcpConnection& operator=(const TcpConnection&) = delete;
+
+  // Safe to call from inside the message callback itself.
+  void set_message_callback(MessageCallback cb) { on_message_ = std::move(cb); }
+  void set_close_callback(CloseCallback cb) { on_close_ = std::move(cb); }
+  // Outgoing bytes allowed to queue before the peer is treated as too slow
+  // and disconnected.
+  void set_max_output_bytes(size_t n) { max_output_bytes_ = n; }
+  // Journals this connection's open, every read and its close into r,
+  // which must outlive the connection.  Set before start().
+  void set_recorder(TrafficRecorder* r);
+
+  // Registers with the loop and starts reading.
+  void start();
+
+  // Writes immediately when nothing is queued; otherwise appends and waits
+  // for writability.  Returns false when the connection is gone or the
+  // output limit was exceeded (the connection is then closed).
+  bool send(const void* data, size_t len);
+  bool send(std::string_view s) { return send(s.data(), s.size()); }
+  // Zero-copy variant: whatever cannot be written right away is queued by
+  // reference to buf's chunks.
+  bool send(const MessageBuffer& buf);
+
+  // Half-closes once queued output has drained.
+  void shutdown();
+  // Drops the connection immediately, discarding queued output.
+  void force_close();
+
+  uint64_t id() const { return id_; }
+  int fd() const { return fd_; }
+  EventLoop& loop() const { return loop_; }
+  const InetAddress& peer() const { return peer_; }
+  bool connected() const { return state_ == State::kConnected; }
+  size_t pending_output() const { return output_.bytes(); }
+
+  void* context() const { return context_; }
+  void set_context(void* ctx) { context_ = ctx; }
+
+  void handle_events(uint32_t events) override;
+
+ private:
+  enum class State { kIdle, kConnected, kDisconnecting, kDisconnected };
+
+  void handle_read();
+  void handle_write();
+  void handle_close();
+  void update_interest();
+  bool check_output_limit(size_t extra);
+
+  EventLoop& loop_;
+  int fd_;
+  uint64_t id_;
+  InetAddress peer_;
+  State state_ = State::kIdle;
+  bool want_write_ = false;
+  size_t max_output_bytes_ = 8u << 20;
+  void* context_ = nullptr;
+  TrafficRecorder* recorder_ = nullptr;
+
+  ByteBuffer input_;
+  OutputQueue output_;
+  MessageCallback on_message_;
+  CloseCallback on_close_;
+};
+
+}  // namespace kbs
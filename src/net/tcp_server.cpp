@@ -0,0 +1,141 @@
+#include "net/tcp_server.h"
+
+#include <algorithm>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "net/socket_ops.h"
+
+namespace kbs {
+
+TcpServer::TcpServer(TcpServerOptions options) : options_(std::move(options)) {
+  if (options_.num_loops == 0) {
+    options_.num_loops = std::max(1u, std::thread::hardware_concurrency());
+  }
+}
+
+TcpServer::~TcpServer() { stop(); }
+
+void TcpServer::start() {
+  if (started_) return;
+  // The first listener resolves an ephemeral port; the rest join it.
+  InetAddress addr = options_.listen_addr;
+  for (size_t i = 0; i < options_.num_loops; ++i) {
+    auto w = std::make_unique<Worker>();
+    w->index = i;
+    w->loop = std::make_unique<EventLoop>(options_.backend);
+    int fd = sockets::create_listener(addr, /*reuse_port=*/true);
+    if (const int cpu = options_.placement.cpu_for(i); cpu >= 0) {
+      try {
+        sockets::set_incoming_cpu(fd, cpu);
+      } catch (const std::system_error&) {
+        // Pre-4.4 kernel: listeners are still spread, just not by CPU.
+      }
+    }
+    if (i == 0) {
+      addr = sockets::local_address(fd);
+      port_ = addr.port();
+    }
+    Worker* raw = w.get();
+    w->acceptor = std::make_unique<Acceptor>(
+        *w->loop, fd, [this, raw](int cfd, const InetAddress& peer) { on_accept(*raw, cfd, peer); });
+    w->acceptor->listen();
+    workers_.push_back(std::move(w));
+  }
+  for (auto& w : workers_) {
+    w->posted_gauge = metrics().add_callback_gauge(
+        "kbs_loop_posted_tasks", "Cross-thread tasks waiting for a reactor",
+        [loop = w->loop.get()] { return static_cast<double>(loop->posted_depth()); },
+        {{"loop", std::to_string(w->index)}});
+    w->thread = std::thread([this, index = w->index, loop = w->loop.get()] {
+      place_current_thread(options_.placement, index);
+      loop->run();
+    });
+  }
+  started_ = true;
+}
+
+void TcpServer::stop() {
+  if (!started_) return;
+  for (auto& w : workers_) w->loop->quit();
+  for (auto& w : workers_) {
+    if (w->thread.joinable()) w->thread.join();
+  }
+  // Loops are stopped: tear down on this thread in ownership order.
+  for (auto& w : workers_) {
+    metrics().remove_callback_gauge(w->posted_gauge);
+    w->connections.clear();
+    w->acceptor.reset();
+  }
+  workers_.clear();
+  started_ = false;
+}
+
+void TcpServer::send_to(uint64_t conn_id, std::string_view data) {
+  MessageBuffer buf;
+  buf.append(data);
+  send_to(conn_id, buf);
+}
+
+void TcpServer::send_to(uint64_t conn_id, const MessageBuffer& buf) {
+  size_t idx = loop_index(conn_id);
+  if (idx >= workers_.size()) return;
+  Worker* w = workers_[idx].get();
+  w->loop->post([w, conn_id, buf] {
+    if (TcpConnection* c = w->find(conn_id)) c->send(buf);
+  });
+}
+
+void TcpServer::broadcast(std::span<const uint64_t> conn_ids, const MessageBuffer& buf) {
+  std::vector<std::vector<uint64_t>> per_loop(workers_.size());
+  for (uint64_t id : conn_ids) {
+    size_t idx = loop_index(id);
+    if (idx < per_loop.size()) per_loop[idx].push_back(id);
+  }
+  for (size_t i = 0; i < per_loop.size(); ++i) {
+    if (per_loop[i].empty()) continue;
+    Worker* w = workers_[i].get();
+    w->loop->post([w, ids = std::move(per_loop[i]), buf] {
+      for (uint64_t id : ids) {
+        if (TcpConnection* c = w->find(id)) c->send(buf);
+      }
+    });
+  }
+}
+
+void TcpServer::on_accept(Worker& w, int fd, const InetAddress& peer) {
+  if (options_.tcp_nodelay) {
+    try {
+      sockets::set_tcp_nodelay(fd, true);
+    } catch (const std::system_error&) {
+      // Peer already gone; the first read will notice.
+    }
+  }
+  const ConnectionHandle handle = w.connections.emplace();
+  if (!handle) {
+    sockets::close_fd(fd);  // 2^20 connections on this loop
+    return;
+  }
+  const uint64_t id = (static_cast<uint64_t>(w.index + 1) << kLoopShift) | handle.bits();
+  std::unique_ptr<TcpConnection>& conn = *w.connections.get(handle);
+  conn = std::make_unique<TcpConnection>(*w.loop, fd, id, peer);
+  conn->set_max_output_bytes(options_.max_output_bytes);
+  if (options_.recorder) conn->set_recorder(options_.recorder);
+  conn->set_message_callback(on_message_);
+  conn->set_close_callback([this, &w](TcpConnection& c) { on_close(w, c); });
+  TcpConnection& ref = *conn;
+  ref.start();
+  if (on_connection_) on_connection_(ref);
+}
+
+void TcpServer::on_close(Worker& w, TcpConnection& conn) {
+  if (on_connection_) on_connection_(conn);
+  // The connection's handler frame is still live; destroy it afterwards.
+  const uint64_t id = conn.id();
+  w.loop->defer([&w, id] {
+    w.connections.erase(ConnectionHandle::from_bits(static_cast<uint32_t>(id)));
+  });
+}
+
+}  // namespace kbs
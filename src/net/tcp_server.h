@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <span>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "common/handle_pool.h"
+#include "common/thread_placement.h"
+#include "metrics/metrics.h"
+#include "net/acceptor.h"
+#include "net/event_loop.h"
+#include "net/inet_address.h"
+#include "net/message_buffer.h"
+#include "net/tcp_connection.h"
+
+namespace kbs {
+
+struct TcpServerOptions {
+  InetAddress listen_addr{0};
+  // Reactor threads; 0 means one per hardware thread.
+  size_t num_loops = 0;
+  PollerBackend backend = PollerBackend::kEpoll;
+  bool tcp_nodelay = true;
+  size_t max_output_bytes = 8u << 20;
+  // Loop i runs on placement.cpu_for(i) and its listener asks the kernel
+  // for connections whose packets that CPU receives (SO_INCOMING_CPU), so
+  // mapping NIC RSS queues / IRQs to the same CPUs keeps each connection's
+  // softirq, reactor and memory on one core and node.
+  ThreadPlacement placement;
+  // Records every accepted connection's inbound traffic; must outlive the
+  // server.
+  TrafficRecorder* recorder = nullptr;
+};
+
+// Multi-reactor TCP server.  Each loop thread owns a SO_REUSEPORT listener
+// and every connection accepted on it, so connection state is never shared
+// between threads.  Callbacks run on the owning loop's thread.
+class TcpServer {
+ public:
+  using ConnectionCallback = std::function<void(TcpConnection&)>;
+  using MessageCallback = TcpConnection::MessageCallback;
+
+  explicit TcpServer(TcpServerOptions options);
+  ~TcpServer();
+
+  TcpServer(const TcpServer&) = delete;
+  TcpServer& operator=(const TcpServer&) = delete;
+
+  // Set before start().  on_connection fires after accept and again after
+  // the connection has closed (connected() tells which).
+  void set_connection_callback(ConnectionCallback cb) { on_connection_ = std::move(cb); }
+  void set_message_callback(MessageCallback cb) { on_message_ = std::move(cb); }
+
+  // Binds every listener and spawns the loop threads.  Throws
+  // std::system_error when the address cannot be bound.
+  void start();
+  void stop();
+
+  // Port actually bound; useful when listening on port 0.
+  uint16_t port() const { return port_; }
+  size_t num_loops() const { return workers_.size(); }
+  EventLoop& loop(size_t index) { return *workers_[index]->loop; }
+
+  // Thread-safe: delivers data to the connection on its own loop.  Silently
+  // dropped if the connection has gone away by then.
+  void send_to(uint64_t conn_id, std::string_view data);
+  void send_to(uint64_t conn_id, const MessageBuffer& buf);
+
+  // Thread-safe fan-out of one encoded buffer.  Recipients are grouped by
+  // owning loop so each loop gets a single task, and every connection
+  // queues a reference to the same chunks.
+  void broadcast(std::span<const uint64_t> conn_ids, const MessageBuffer& buf);
+
+  // Loop that owns conn_id, derived from the id itself.
+  static size_t loop_index(uint64_t conn_id) { return (conn_id >> kLoopShift) - 1; }
+
+ private:
+  static constexpr int kLoopShift = 48;
+
+  // Low 32 bits of a connection id; up to 2^20 connections per loop, and
+  // a slot is reused 4095 times before it retires, so ids never repeat.
+  using ConnectionHandle = Handle<TcpConnection, uint32_t, 20>;
+
+  struct Worker {
+    size_t index = 0;
+    std::unique_ptr<EventLoop> loop;
+    std::unique_ptr<Acceptor> acceptor;
+    HandlePool<std::unique_ptr<TcpConnection>, ConnectionHandle> connections;
+    // Loop thread only.  nullptr for ids of closed connections.
+    TcpConnection* find(uint64_t conn_id) {
+      auto* c = connections.get(ConnectionHandle::from_bits(static_cast<uint32_t>(conn_id)));
+      return c ? c->get() : nullptr;
+    }
+    std::thread thread;
+    CallbackGaugeId posted_gauge = 0;  // kbs_loop_posted_tasks{loop=index}
+  };
+
+  void on_accept(Worker& w, int fd, const InetAddress& peer);
+  void on_close(Worker& w, TcpConnection& conn);
+
+  TcpServerOptions options_;
+  uint16_t port_ = 0;
+  bool started_ = false;
+  ConnectionCallback on_connection_;
+  MessageCallback on_message_;
+  std::vector<std::unique_ptr<Worker>> workers_;
+};
+
+}  // namespace kbs
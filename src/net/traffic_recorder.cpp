@@ -0,0 +1,205 @@
+#include "net/traffic_recorder.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+
+#include "metrics/metrics.h"
+#include "metrics/trace.h"
+
+namespace kbs {
+
+namespace {
+
+constexpr char kMagic[4] = {'K', 'B', 'S', 'R'};
+// Version 1 had no kGap records; it reads the same.
+constexpr uint32_t kVersion = 2;
+
+void put_varint(std::string& out, uint64_t v) {
+  while (v >= 0x80) {
+    out.push_back(static_cast<char>(v | 0x80));
+    v >>= 7;
+  }
+  out.push_back(static_cast<char>(v));
+}
+
+bool take_varint(std::string_view& in, uint64_t& v) {
+  v = 0;
+  for (int shift = 0; shift < 64 && !in.empty(); shift += 7) {
+    const auto b = static_cast<uint8_t>(in.front());
+    in.remove_prefix(1);
+    v |= uint64_t{b & 0x7Fu} << shift;
+    if (!(b & 0x80)) return true;
+  }
+  return false;
+}
+
+struct RecorderMetrics {
+  Counter& bytes =
+      metrics().counter("kbs_traffic_recorded_bytes_total", "Bytes written to traffic recordings");
+  Counter& dropped = metrics().counter("kbs_traffic_dropped_records_total",
+                                       "Records dropped because the recorder fell behind");
+};
+
+RecorderMetrics& recorder_metrics() {
+  static RecorderMetrics m;
+  return m;
+}
+
+}  // namespace
+
+TrafficRecorder::TrafficRecorder(TrafficRecorderOptions options) : options_(std::move(options)) {
+  fd_ = ::open(options_.path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd_ < 0) throw std::system_error(errno, std::generic_category(), "open " + options_.path);
+  std::string header(kMagic, sizeof(kMagic));
+  header.append(reinterpret_cast<const char*>(&kVersion), sizeof(kVersion));
+  if (!write_all(header)) {
+    const int saved = errno;
+    ::close(fd_);
+    throw std::system_error(saved, std::generic_category(), "write " + options_.path);
+  }
+  recorder_metrics();
+  writer_ = std::thread([this] { run_writer(); });
+}
+
+TrafficRecorder::~TrafficRecorder() {
+  {
+    std::lock_guard lock(mutex_);
+    stop_ = true;
+  }
+  wake_.notify_one();
+  writer_.join();
+  ::close(fd_);
+}
+
+void TrafficRecorder::append(RecordType type, uint64_t conn_id, std::string_view data) {
+  std::lock_guard lock(mutex_);
+  if (type == RecordType::kData && buffer_.size() + data.size() > options_.max_buffer_bytes) {
+    lost_[conn_id] += data.size();
+    ++stats_.dropped;
+    recorder_metrics().dropped.inc();
+    return;
+  }
+  // Stamped under the lock, so deltas never go negative across threads.
+  const uint64_t now = Tracer::now_ns();
+  if (auto it = lost_.find(conn_id); it != lost_.end()) {
+    put_header(RecordType::kGap, conn_id, now);
+    put_varint(buffer_, it->second);
+    lost_.erase(it);
+    ++stats_.gaps;
+  }
+  put_header(type, conn_id, now);
+  if (type == RecordType::kData) {
+    put_varint(buffer_, data.size());
+    buffer_.append(data);
+  }
+  ++stats_.records;
+}
+
+void TrafficRecorder::put_header(RecordType type, uint64_t conn_id, uint64_t now) {
+  buffer_.push_back(static_cast<char>(type));
+  put_varint(buffer_, last_ns_ == 0 ? 0 : now - last_ns_);
+  last_ns_ = now;
+  put_varint(buffer_, conn_id);
+}
+
+TrafficRecorderStats TrafficRecorder::stats() const {
+  std::lock_guard lock(mutex_);
+  return stats_;
+}
+
+void TrafficRecorder::run_writer() {
+  std::string batch;
+  std::unique_lock lock(mutex_);
+  for (;;) {
+    wake_.wait_for(lock, std::chrono::milliseconds(options_.flush_ms), [this] { return stop_; });
+    batch.swap(buffer_);
+    const bool stopping = stop_;
+    lock.unlock();
+    const bool ok = batch.empty() || write_all(batch);
+    if (ok) recorder_metrics().bytes.inc(batch.size());
+    lock.lock();
+    if (ok) {
+      stats_.bytes += batch.size();
+    } else {
+      ++stats_.write_errors;
+    }
+    batch.clear();
+    if (stopping) return;
+  }
+}
+
+bool TrafficRecorder::write_all(const std::string& data) {
+  size_t done = 0;
+  while (done < data.size()) {
+    const ssize_t n = ::write(fd_, data.data() + done, data.size() - done);
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0) return false;
+    done += static_cast<size_t>(n);
+  }
+  return true;
+}
+
+size_t TrafficRecorder::read(const std::string& path, const RecordFn& fn) {
+  const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) throw std::system_error(errno, std::generic_category(), "open " + path);
+  std::string data;
+  char buf[1 << 16];
+  for (;;) {
+    const ssize_t n = ::read(fd, buf, sizeof(buf));
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0) {
+      const int saved = errno;
+      ::close(fd);
+      throw std::system_error(saved, std::generic_category(), "read " + path);
+    }
+    if (n == 0) break;
+    data.append(buf, static_cast<size_t>(n));
+  }
+  ::close(fd);
+
+  std::string_view in = data;
+  uint32_t version = 0;
+  if (in.size() < sizeof(kMagic) + sizeof(version) ||
+      std::memcmp(in.data(), kMagic, sizeof(kMagic)) != 0) {
+    throw std::runtime_error(path + ": not a traffic recording");
+  }
+  std::memcpy(&version, in.data() + sizeof(kMagic), sizeof(version));
+  if (version == 0 || version > kVersion) {
+    throw std::runtime_error(path + ": unsupported recording version");
+  }
+  in.remove_prefix(sizeof(kMagic) + sizeof(version));
+
+  size_t records = 0;
+  uint64_t time_ns = 0;
+  while (!in.empty()) {
+    const auto type = static_cast<RecordType>(in.front());
+    in.remove_prefix(1);
+    uint64_t delta = 0;
+    uint64_t conn = 0;
+    if (!take_varint(in, delta) || !take_varint(in, conn)) break;
+    std::string_view body;
+    uint64_t lost = 0;
+    if (type == RecordType::kData) {
+      uint64_t len = 0;
+      if (!take_varint(in, len) || in.size() < len) break;
+      body = in.substr(0, len);
+      in.remove_prefix(len);
+    } else if (type == RecordType::kGap) {
+      if (!take_varint(in, lost)) break;
+    } else if (type != RecordType::kOpen && type != RecordType::kClose) {
+      break;
+    }
+    time_ns += delta;
+    fn(Record{type, time_ns, conn, body, lost});
+    ++records;
+  }
+  return records;
+}
+
+}  // namespace kbs
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+
+namespace kbs {
+
+struct TrafficRecorderOptions {
+  std::string path;
+  // The writer thread drains the buffer at least this often.
+  uint32_t flush_ms = 100;
+  // Data arriving while this much is still unwritten is dropped (and
+  // counted) rather than stalling the loops behind a slow disk.  Open and
+  // close records are always kept.
+  size_t max_buffer_bytes = 64u << 20;
+};
+
+struct TrafficRecorderStats {
+  uint64_t records = 0;  // accepted
+  uint64_t bytes = 0;    // written to the file
+  uint64_t dropped = 0;  // data records over max_buffer_bytes
+  uint64_t gaps = 0;     // kGap records written for them
+  uint64_t write_errors = 0;
+};
+
+// Captures the inbound side of every connection it is attached to --
+// client packets and server-to-server RPC alike, since both arrive as
+// bytes on a TcpConnection -- with the time each read returned, so a
+// replay (bench/replay_client.cpp, kbs_replay) can feed a new build
+// exactly the traffic shape that caused a production spike.
+//
+// Recording happens below framing: each record is what one read()
+// returned, so partial frames, coalesced frames and the gaps between them
+// replay as they happened.  Loop threads append under a mutex into a
+// memory buffer (one lock per read, no syscalls); a writer thread owns
+// the file.
+//
+// File: "KBSR", u32 version, then records
+//
+//   u8 type | varint ns since previous record | varint conn id |
+//   varint length | bytes          (length and bytes for kData only)
+//
+// so a typical small packet costs about 8 bytes of overhead.  When data
+// had to be dropped, the connection's next record is preceded by a kGap
+// whose varint length is the number of bytes lost, so a replay knows the
+// stream after it is not what the server saw.
+class TrafficRecorder {
+ public:
+  enum class RecordType : uint8_t { kOpen = 1, kData = 2, kClose = 3, kGap = 4 };
+
+  struct Record {
+    RecordType type;
+    uint64_t time_ns;  // since the first record
+    uint64_t conn_id;
+    std::string_view data;
+    uint64_t lost_bytes = 0;  // kGap
+  };
+  using RecordFn = std::function<void(const Record&)>;
+
+  // Creates or truncates options.path.  Throws std::system_error.
+  explicit TrafficRecorder(TrafficRecorderOptions options);
+  // Writes everything still buffered.
+  ~TrafficRecorder();
+
+  TrafficRecorder(const TrafficRecorder&) = delete;
+  TrafficRecorder& operator=(const TrafficRecorder&) = delete;
+
+  // Any thread.  TcpConnection::set_recorder() and TcpServerOptions wire
+  // these up; call them directly for transports of your own.
+  void record_open(uint64_t conn_id) { append(RecordType::kOpen, conn_id, {}); }
+  void record_data(uint64_t conn_id, std::string_view data) {
+    append(RecordType::kData, conn_id, data);
+  }
+  void record_close(uint64_t conn_id) { append(RecordType::kClose, conn_id, {}); }
+
+  TrafficRecorderStats stats() const;
+
+  // Calls fn for every intact record of path in order and returns how many
+  // there were; a torn tail ends the read.  Throws std::runtime_error when
+  // path is not a recording, std::system_error when it cannot be read.
+  static size_t read(const std::string& path, const RecordFn& fn);
+
+ private:
+  void append(RecordType type, uint64_t conn_id, std::string_view data);
+  void put_header(RecordType type, uint64_t conn_id, uint64_t now);
+  void run_writer();
+  bool write_all(const std::string& data);
+
+  TrafficRecorderOptions options_;
+  int fd_ = -1;
+
+  mutable std::mutex mutex_;
+  std::condition_variable wake_;
+  std::string buffer_;
+  uint64_t last_ns_ = 0;  // 0 until the first record
+  // Bytes dropped per connection since its last record.
+  std::unordered_map<uint64_t, uint64_t> lost_;
+  bool stop_ = false;
+  TrafficRecorderStats stats_;
+  std::thread writer_;
+};
+
+}  // namespace kbs
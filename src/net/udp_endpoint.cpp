@@ -0,0 +1,158 @@
+#include "net/udp_endpoint.h"
+
+#include <chrono>
+#include <cstring>
+
+namespace kbs {
+
+namespace {
+
+uint64_t now_ms() {
+  return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                                   std::chrono::steady_clock::now().time_since_epoch())
+                                   .count());
+}
+
+bool same_address(const InetAddress& a, const InetAddress& b) {
+  return a.length() == b.length() &&
+         std::memcmp(a.sockaddr_ptr(), b.sockaddr_ptr(), a.length()) == 0;
+}
+
+}  // namespace
+
+UdpEndpoint::UdpEndpoint(EventLoop& loop, const InetAddress& bind_addr,
+                         const UdpEndpointOptions& options)
+    : loop_(loop),
+      options_(options),
+      socket_(loop, bind_addr, options.reuse_port),
+      rng_(std::random_device{}()) {}
+
+UdpEndpoint::~UdpEndpoint() { loop_.cancel_timer(timer_); }
+
+void UdpEndpoint::start() {
+  socket_.set_datagram_callback(
+      [this](const InetAddress& from, std::string_view data) { on_datagram(from, data); });
+  socket_.set_batch_callback([this] { on_batch(); });
+  socket_.start();
+  timer_ = loop_.run_every(std::max<uint32_t>(options_.interval_ms, 1), [this] { on_timer(); });
+}
+
+uint32_t UdpEndpoint::random_conv() {
+  for (;;) {
+    const uint32_t conv = static_cast<uint32_t>(rng_());
+    if (conv != 0 && !sessions_.count(conv)) return conv;
+  }
+}
+
+UdpSession& UdpEndpoint::add_session(uint32_t conv, const InetAddress& peer) {
+  auto owned = std::make_unique<UdpSession>(conv, peer, options_.session);
+  UdpSession* s = owned.get();
+  s->set_output([this, s](std::string_view datagram) { socket_.send_to(s->peer(), datagram); });
+  s->set_message_callback([this, s](UdpChannel channel, std::string_view message) {
+    if (on_message_) on_message_(*s, channel, message);
+  });
+  sessions_.emplace(conv, std::move(owned));
+  return *s;
+}
+
+UdpSession& UdpEndpoint::connect(const InetAddress& peer, uint32_t conv) {
+  if (conv == 0 || sessions_.count(conv)) conv = random_conv();
+  return add_session(conv, peer);
+}
+
+UdpSession* UdpEndpoint::find(uint32_t conv) {
+  auto it = sessions_.find(conv);
+  return it == sessions_.end() ? nullptr : it->second.get();
+}
+
+void UdpEndpoint::close(UdpSession& session) {
+  session.close();
+  retire(session, now_ms());
+}
+
+void UdpEndpoint::retire(UdpSession& session, uint64_t now) {
+  if (session.close_pending()) session.flush(now);  // sends the close notification
+  doomed_.push_back(session.conv());
+}
+
+void UdpEndpoint::on_datagram(const InetAddress& from, std::string_view data) {
+  const uint32_t conv = UdpSession::peek_conv(data);
+  if (conv == 0) return;
+  UdpSession* s = find(conv);
+  if (!s) {
+    if (!options_.accept || sessions_.size() >= options_.max_sessions ||
+        data.size() < UdpSession::kHeaderSize) {
+      return;
+    }
+    s = &add_session(conv, from);
+    if (on_accept_) on_accept_(*s);
+  }
+  if (s->closed()) return;
+  if (!s->input(data, now_ms())) return;
+  if (!same_address(from, s->peer())) s->set_peer(from);
+  if (s->closed()) {
+    // The peer closed, or a message callback (or an oversized message)
+    // closed it.
+    retire(*s, now_ms());
+    return;
+  }
+  if (touched_.empty() || touched_.back() != s) touched_.push_back(s);
+}
+
+void UdpEndpoint::on_batch() {
+  // Acknowledge promptly instead of waiting for the next timer tick, and
+  // send whatever the message callbacks queued in reply.
+  const uint64_t now = now_ms();
+  for (UdpSession* s : touched_) {
+    if (s->closed()) {
+      retire(*s, now);
+    } else {
+      s->flush(now);
+    }
+  }
+  touched_.clear();
+  socket_.flush();
+  reap();
+}
+
+void UdpEndpoint::on_timer() {
+  const uint64_t now = now_ms();
+  for (auto& [conv, s] : sessions_) {
+    if (s->closed()) {
+      retire(*s, now);
+      continue;
+    }
+    s->flush(now);
+    if (s->dead(now)) doomed_.push_back(conv);
+  }
+  socket_.flush();
+  reap();
+}
+
+void UdpEndpoint::flush() {
+  const uint64_t now = now_ms();
+  for (auto& [conv, s] : sessions_) {
+    if (s->closed()) {
+      retire(*s, now);
+    } else {
+      s->flush(now);
+    }
+  }
+  socket_.flush();
+}
+
+void UdpEndpoint::reap() {
+  while (!doomed_.empty()) {
+    std::vector<uint32_t> doomed;
+    doomed.swap(doomed_);
+    for (uint32_t conv : doomed) {
+      auto it = sessions_.find(conv);
+      if (it == sessions_.end()) continue;
+      std::unique_ptr<UdpSession> s = std::move(it->second);
+      sessions_.erase(it);
+      if (on_close_) on_close_(*s);
+    }
+  }
+}
+
+}  // namespace kbs
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "net/event_loop.h"
+#include "net/inet_address.h"
+#include "net/udp_session.h"
+#include "net/udp_socket.h"
+
+namespace kbs {
+
+struct UdpEndpointOptions {
+  UdpSessionOptions session;
+  // Period of the flush/retransmit timer.  Output is also flushed after
+  // every received batch and on flush().
+  uint32_t interval_ms = 10;
+  // Servers create a session for the first datagram carrying an unknown
+  // conv; clients only talk to the sessions they connect().
+  bool accept = true;
+  size_t max_sessions = 65536;
+  bool reuse_port = false;
+};
+
+// UdpSessions multiplexed over one UdpSocket on one loop, usable as the
+// server side (accept), the client side (connect()) or both.
+//
+// Sessions are keyed by conv.  A datagram for a known conv from a new
+// address moves the session there, so a phone switching from Wi-Fi to
+// cellular keeps its session; conv is random so it is not guessable by
+// third parties.  Loop thread only.
+class UdpEndpoint {
+ public:
+  using SessionCallback = std::function<void(UdpSession&)>;
+  using MessageCallback = std::function<void(UdpSession&, UdpChannel, std::string_view)>;
+
+  // Throws std::system_error if the socket cannot be bound.
+  UdpEndpoint(EventLoop& loop, const InetAddress& bind_addr,
+              const UdpEndpointOptions& options = {});
+  ~UdpEndpoint();
+
+  UdpEndpoint(const UdpEndpoint&) = delete;
+  UdpEndpoint& operator=(const UdpEndpoint&) = delete;
+
+  // A peer opened a session (accept mode).
+  void set_accept_callback(SessionCallback cb) { on_accept_ = std::move(cb); }
+  void set_message_callback(MessageCallback cb) { on_message_ = std::move(cb); }
+  // The session is about to be destroyed: closed by either side, link dead
+  // or idle.
+  void set_close_callback(SessionCallback cb) { on_close_ = std::move(cb); }
+
+  void start();
+
+  // Opens a session to peer; the peer learns of it from the first datagram.
+  // conv 0 picks a random unused one.
+  UdpSession& connect(const InetAddress& peer, uint32_t conv = 0);
+  // Sends the close notification; the session is destroyed (with the close
+  // callback) once the current callback returns.  UdpSession::close() on an
+  // endpoint's session has the same effect, from the next batch or timer.
+  void close(UdpSession& session);
+
+  // Flushes every session and hands the datagrams to the socket as one
+  // sendmmsg() batch.  Call at the end of a tick after queueing updates.
+  void flush();
+
+  UdpSession* find(uint32_t conv);
+  size_t session_count() const { return sessions_.size(); }
+  UdpSocket& socket() { return socket_; }
+  const InetAddress& local_address() const { return socket_.local_address(); }
+
+ private:
+  UdpSession& add_session(uint32_t conv, const InetAddress& peer);
+  void on_datagram(const InetAddress& from, std::string_view data);
+  void on_batch();
+  void on_timer();
+  // Sends a pending close notification and queues the session for reap().
+  void retire(UdpSession& session, uint64_t now);
+  void reap();
+  uint32_t random_conv();
+
+  EventLoop& loop_;
+  UdpEndpointOptions options_;
+  UdpSocket socket_;
+  TimerId timer_ = kInvalidTimerId;
+  std::unordered_map<uint32_t, std::unique_ptr<UdpSession>> sessions_;
+  std::vector<UdpSession*> touched_;  // got input in the current batch
+  std::vector<uint32_t> doomed_;      // convs to destroy in reap()
+  std::mt19937 rng_;
+  SessionCallback on_accept_;
+  MessageCallback on_message_;
+  SessionCallback on_close_;
+};
+
+}  // namespace kbs
@@ -0,0 +1,332 @@
+#include "net/udp_session.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+namespace kbs {
+
+namespace {
+
+// Serial-number comparison, so sequences may wrap.
+bool before(uint32_t a, uint32_t b) { return static_cast<int32_t>(a - b) < 0; }
+
+template <typename T>
+void put(std::string& out, T v) {
+  out.append(reinterpret_cast<const char*>(&v), sizeof(T));
+}
+
+template <typename T>
+bool take(std::string_view& in, T& v) {
+  if (in.size() < sizeof(T)) return false;
+  std::memcpy(&v, in.data(), sizeof(T));
+  in.remove_prefix(sizeof(T));
+  return true;
+}
+
+}  // namespace
+
+UdpSession::UdpSession(uint32_t conv, const InetAddress& peer, const UdpSessionOptions& options)
+    : conv_(conv), peer_(peer), options_(options) {
+  options_.mtu = std::clamp<size_t>(options_.mtu, kHeaderSize + kSegmentHeaderSize + 1, 1500);
+  options_.recv_window = std::bit_ceil(std::clamp<uint32_t>(options_.recv_window, 32, 32768));
+  options_.send_window = std::max<uint32_t>(options_.send_window, 1);
+  remote_window_ = options_.recv_window;
+  rcv_buf_.resize(options_.recv_window);
+  rto_ = std::clamp<uint32_t>(rto_, options_.min_rto_ms, options_.max_rto_ms);
+  stats_.rto_ms = rto_;
+}
+
+uint32_t UdpSession::peek_conv(std::string_view datagram) {
+  uint32_t conv = 0;
+  take(datagram, conv);
+  return conv;
+}
+
+bool UdpSession::dead(uint64_t now_ms) const {
+  return closed_ || dead_ ||
+         (started_ && now_ms - last_input_ms_ > options_.idle_timeout_ms);
+}
+
+bool UdpSession::send(UdpChannel channel, std::string_view message) {
+  if (closed_) return false;
+  const size_t mss = max_payload();
+  if (channel == UdpChannel::kUnreliable) {
+    if (message.size() > mss) return false;
+    unreliable_out_.emplace_back(unreliable_next_++, std::string(message));
+    return true;
+  }
+  if (message.size() > options_.max_message) return false;
+  const size_t fragments = std::max<size_t>(1, (message.size() + mss - 1) / mss);
+  if (pending_segments() + fragments > options_.max_queued_segments) return false;
+  for (size_t i = 0; i < fragments; ++i) {
+    OutSegment seg;
+    seg.seq = snd_next_++;
+    seg.more = i + 1 < fragments;
+    seg.data.assign(message.substr(i * mss, mss));
+    snd_queue_.push_back(std::move(seg));
+  }
+  return true;
+}
+
+void UdpSession::close() {
+  if (closed_) return;
+  closed_ = true;
+  close_pending_ = true;
+}
+
+bool UdpSession::input(std::string_view datagram, uint64_t now_ms) {
+  uint32_t conv = 0, ack = 0;
+  uint8_t flags = 0;
+  uint16_t window = 0;
+  if (!take(datagram, conv) || conv != conv_ || !take(datagram, flags) || !take(datagram, ack) ||
+      !take(datagram, window)) {
+    return false;
+  }
+  if (closed_) return true;
+  started_ = true;
+  now_ms_ = now_ms;
+  last_input_ms_ = now_ms;
+  ++stats_.datagrams_in;
+  remote_window_ = std::max<uint32_t>(window, 1);
+  acked_any_ = false;
+  ack_below(ack);
+  if (flags & kFlagClose) {
+    closed_ = true;
+    return true;
+  }
+
+  const uint32_t w = options_.recv_window;
+  bool ok = true;
+  while (!datagram.empty() && !closed_) {
+    uint8_t kind = 0;
+    uint32_t seq = 0;
+    uint16_t len = 0;
+    if (!take(datagram, kind) || !take(datagram, seq) || !take(datagram, len) ||
+        datagram.size() < len) {
+      ok = false;
+      break;
+    }
+    std::string_view payload = datagram.substr(0, len);
+    datagram.remove_prefix(len);
+    switch (kind & ~kMoreFragments) {
+      case kReliableSegment: {
+        ack_pending_ = true;
+        if (before(seq, rcv_next_) || seq - rcv_next_ >= w) break;  // duplicate / beyond window
+        InSegment& slot = rcv_buf_[seq & (w - 1)];
+        if (!slot.present) {
+          slot.present = true;
+          slot.more = (kind & kMoreFragments) != 0;
+          slot.data.assign(payload);
+        }
+        break;
+      }
+      case kUnreliableSegment:
+        if (have_unreliable_ && !before(last_unreliable_, seq)) {
+          ++stats_.unreliable_dropped;
+          break;
+        }
+        have_unreliable_ = true;
+        last_unreliable_ = seq;
+        if (on_message_) on_message_(UdpChannel::kUnreliable, payload);
+        break;
+      case kAckRange: {
+        uint16_t count = 0;
+        if (!take(payload, count)) {
+          ok = false;
+          break;
+        }
+        ack_range(seq, count);
+        break;
+      }
+      default:
+        ok = false;
+        datagram = {};
+        break;
+    }
+  }
+  finish_acks();
+  deliver_reliable();
+  return ok;
+}
+
+void UdpSession::deliver_reliable() {
+  const uint32_t w = options_.recv_window;
+  while (!closed_) {
+    InSegment& slot = rcv_buf_[rcv_next_ & (w - 1)];
+    if (!slot.present) break;
+    if (assembling_.size() + slot.data.size() > options_.max_message) {
+      ++stats_.oversized;
+      close();
+      break;
+    }
+    assembling_.append(slot.data);
+    const bool more = slot.more;
+    slot.present = false;
+    slot.data.clear();
+    ++rcv_next_;
+    if (more) continue;
+    const std::string message = std::move(assembling_);
+    assembling_.clear();
+    if (on_message_) on_message_(UdpChannel::kReliable, message);
+  }
+}
+
+void UdpSession::ack_below(uint32_t ack) {
+  for (OutSegment& seg : snd_buf_) {
+    if (!before(seg.seq, ack)) break;
+    on_acked(seg);
+  }
+}
+
+void UdpSession::ack_range(uint32_t first, uint16_t count) {
+  // snd_buf_ holds consecutive sequences (acknowledged ones stay until they
+  // reach the front), so a sequence's slot is its distance from the front.
+  // count comes from the peer: walk only its overlap with snd_buf_, and
+  // ignore a range that does not start inside it (stale or forged).
+  if (snd_buf_.empty()) return;
+  const uint32_t offset = first - snd_buf_.front().seq;
+  if (offset >= snd_buf_.size()) return;
+  const size_t end = std::min<size_t>(snd_buf_.size(), size_t{offset} + count);
+  for (size_t i = offset; i < end; ++i) on_acked(snd_buf_[i]);
+}
+
+void UdpSession::on_acked(OutSegment& seg) {
+  if (seg.acked) return;
+  seg.acked = true;
+  // Karn: only segments sent once give an unambiguous sample.
+  if (seg.xmit == 1) update_rtt(static_cast<uint32_t>(now_ms_ - seg.sent_ms));
+  if (!acked_any_ || before(acked_highest_, seg.seq)) acked_highest_ = seg.seq;
+  acked_any_ = true;
+}
+
+void UdpSession::finish_acks() {
+  // Everything still missing below the highest sequence just acknowledged
+  // was overtaken; enough of that means it was lost.
+  if (acked_any_) {
+    for (OutSegment& seg : snd_buf_) {
+      if (!before(seg.seq, acked_highest_)) break;
+      if (!seg.acked && seg.xmit > 0) ++seg.fast_skips;
+    }
+  }
+  while (!snd_buf_.empty() && snd_buf_.front().acked) snd_buf_.pop_front();
+}
+
+void UdpSession::update_rtt(uint32_t rtt) {
+  // RFC 6298 smoothing.
+  if (srtt_ == 0) {
+    srtt_ = std::max<uint32_t>(rtt, 1);
+    rttvar_ = rtt / 2;
+  } else {
+    const uint32_t delta = rtt > srtt_ ? rtt - srtt_ : srtt_ - rtt;
+    rttvar_ = (3 * rttvar_ + delta) / 4;
+    srtt_ = std::max<uint32_t>((7 * srtt_ + rtt) / 8, 1);
+  }
+  rto_ = std::clamp(srtt_ + std::max<uint32_t>(4 * rttvar_, 1), options_.min_rto_ms,
+                    options_.max_rto_ms);
+  stats_.srtt_ms = srtt_;
+  stats_.rto_ms = rto_;
+}
+
+void UdpSession::append_ack_ranges() {
+  const uint32_t w = options_.recv_window;
+  size_t ranges = 0;
+  uint32_t i = 1;
+  while (i < w && ranges < kMaxAckRanges) {
+    if (!rcv_buf_[(rcv_next_ + i) & (w - 1)].present) {
+      ++i;
+      continue;
+    }
+    const uint32_t first = i;
+    while (i < w && rcv_buf_[(rcv_next_ + i) & (w - 1)].present) ++i;
+    const uint16_t count = static_cast<uint16_t>(i - first);
+    append_segment(kAckRange, rcv_next_ + first,
+                   std::string_view(reinterpret_cast<const char*>(&count), sizeof(count)));
+    ++ranges;
+  }
+}
+
+void UdpSession::begin_datagram() {
+  datagram_.clear();
+  put(datagram_, conv_);
+  put(datagram_, static_cast<uint8_t>(close_pending_ ? kFlagClose : 0));
+  put(datagram_, rcv_next_);
+  put(datagram_, static_cast<uint16_t>(std::min<uint32_t>(options_.recv_window, UINT16_MAX)));
+  segments_in_datagram_ = 0;
+}
+
+void UdpSession::append_segment(uint8_t kind, uint32_t seq, std::string_view payload) {
+  if (datagram_.size() + kSegmentHeaderSize + payload.size() > options_.mtu) {
+    emit_datagram();
+    begin_datagram();
+  }
+  put(datagram_, kind);
+  put(datagram_, seq);
+  put(datagram_, static_cast<uint16_t>(payload.size()));
+  datagram_.append(payload);
+  ++segments_in_datagram_;
+}
+
+void UdpSession::emit_datagram() {
+  ++stats_.datagrams_out;
+  last_output_ms_ = now_ms_;
+  if (output_) output_(datagram_);
+}
+
+void UdpSession::flush(uint64_t now_ms) {
+  now_ms_ = now_ms;
+  if (!started_) {
+    started_ = true;
+    last_input_ms_ = now_ms;
+  }
+  if (close_pending_) {
+    begin_datagram();
+    emit_datagram();
+    close_pending_ = false;
+    return;
+  }
+  if (closed_) return;
+
+  begin_datagram();
+  if (ack_pending_) append_ack_ranges();
+  for (auto& [seq, data] : unreliable_out_) append_segment(kUnreliableSegment, seq, data);
+  unreliable_out_.clear();
+
+  // Admit queued segments while they fit the peer's receive window.
+  const uint32_t window = std::min(options_.send_window, remote_window_);
+  while (!snd_queue_.empty()) {
+    const uint32_t una = snd_buf_.empty() ? snd_queue_.front().seq : snd_buf_.front().seq;
+    if (snd_queue_.front().seq - una >= window) break;
+    snd_buf_.push_back(std::move(snd_queue_.front()));
+    snd_queue_.pop_front();
+  }
+
+  for (OutSegment& seg : snd_buf_) {
+    if (seg.acked) continue;
+    if (seg.xmit == 0) {
+      seg.rto = rto_;
+    } else if (now_ms >= seg.resend_ms) {
+      seg.rto = std::min(seg.rto + seg.rto / 2, options_.max_rto_ms);
+      ++stats_.retransmits;
+    } else if (seg.fast_skips >= options_.fast_resend) {
+      ++stats_.fast_retransmits;
+    } else {
+      continue;
+    }
+    seg.fast_skips = 0;
+    ++seg.xmit;
+    seg.sent_ms = now_ms;
+    seg.resend_ms = now_ms + seg.rto;
+    if (seg.xmit > options_.dead_link) dead_ = true;
+    append_segment(static_cast<uint8_t>(kReliableSegment | (seg.more ? kMoreFragments : 0)),
+                   seg.seq, seg.data);
+  }
+
+  if (segments_in_datagram_ > 0 || ack_pending_ ||
+      now_ms - last_output_ms_ >= options_.keepalive_ms) {
+    emit_datagram();
+  }
+  ack_pending_ = false;
+}
+
+}  // namespace kbs
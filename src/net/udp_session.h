@@ -0,0 +1,218 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "net/inet_address.h"
+
+namespace kbs {
+
+// Delivery guarantees of a UdpSession message.
+enum class UdpChannel : uint8_t {
+  // Reliable and ordered, fragmented to the MTU as needed (chat, RPC, item
+  // changes).  Retransmitted on RTO or after fast_resend later segments
+  // were acknowledged.
+  kReliable,
+  // Newest-wins: delivered at most once and never after a newer message on
+  // the same channel, never retransmitted, so a lost movement update costs
+  // nothing but itself.  Must fit in one datagram.
+  kUnreliable,
+};
+
+struct UdpSessionOptions {
+  // Largest datagram sent; 1200 stays under the path MTU of practically
+  // every mobile network.
+  size_t mtu = 1200;
+  // Reliable segments in flight / buffered out of order.  The smaller of
+  // our send window and the peer's advertised receive window applies.
+  // recv_window is rounded up to a power of two.
+  uint32_t send_window = 256;
+  uint32_t recv_window = 256;
+  uint32_t min_rto_ms = 30;
+  uint32_t max_rto_ms = 2000;
+  // A segment is resent early once this many later segments have been
+  // selectively acknowledged.
+  uint32_t fast_resend = 2;
+  // Transmissions of one segment before the link is declared dead.
+  uint32_t dead_link = 20;
+  // No datagram from the peer for this long also kills the session.
+  uint32_t idle_timeout_ms = 10000;
+  // An empty datagram is sent after this long without sending anything so
+  // the peer's idle timer and NAT bindings stay fresh.
+  uint32_t keepalive_ms = 1000;
+  // Reliable segments queued (in flight or waiting for window) before
+  // send() reports backpressure.
+  size_t max_queued_segments = 8192;
+  // Largest reassembled reliable message.  A peer that keeps sending
+  // fragments past it is closed instead of growing the reassembly buffer
+  // without bound; send() refuses longer messages.
+  size_t max_message = 1 << 20;
+};
+
+struct UdpSessionStats {
+  uint64_t datagrams_out = 0;
+  uint64_t datagrams_in = 0;
+  uint64_t retransmits = 0;       // on RTO
+  uint64_t fast_retransmits = 0;  // on selective ACKs
+  uint64_t unreliable_dropped = 0;  // arrived after a newer one
+  uint64_t oversized = 0;  // reassembly passed max_message; the session was closed
+  uint32_t srtt_ms = 0;
+  uint32_t rto_ms = 0;
+};
+
+// Protocol state of one KCP-style session, with no I/O of its own: the
+// owner feeds received datagrams to input(), calls flush() periodically
+// (every few milliseconds, and after sending) and transmits what comes out
+// of the output callback.  UdpEndpoint does all of that over a UdpSocket.
+//
+// Every datagram carries an 11-byte header: conv u32 (session id), flags
+// u8, ack u32 (next reliable sequence expected) and window u16 (receive
+// window in segments); then segments of kind u8 (+ 0x80 when more
+// fragments follow), seq u32, length u16 and the payload.  Selective ACKs
+// are segments too: seq is the first of a run of out-of-order sequences
+// received and the payload its u16 length.  Acknowledgements ride on
+// every datagram, so there are no separate ACK packets while traffic flows
+// both ways.
+class UdpSession {
+ public:
+  using OutputFn = std::function<void(std::string_view datagram)>;
+  using MessageFn = std::function<void(UdpChannel, std::string_view message)>;
+
+  static constexpr size_t kHeaderSize = 11;
+  static constexpr size_t kSegmentHeaderSize = 7;
+
+  UdpSession(uint32_t conv, const InetAddress& peer, const UdpSessionOptions& options = {});
+
+  UdpSession(const UdpSession&) = delete;
+  UdpSession& operator=(const UdpSession&) = delete;
+
+  void set_output(OutputFn fn) { output_ = std::move(fn); }
+  void set_message_callback(MessageFn fn) { on_message_ = std::move(fn); }
+
+  // Queues a message for the next flush().  False when the session is
+  // closed, an unreliable message does not fit in one datagram, a reliable
+  // one is over max_message, or the reliable queue is at
+  // max_queued_segments.
+  bool send(UdpChannel channel, std::string_view message);
+
+  // Applies one datagram; false if it is malformed or for another conv.
+  // Messages are delivered through the message callback before it returns.
+  bool input(std::string_view datagram, uint64_t now_ms);
+
+  // Emits acknowledgements, new segments the window allows, retransmits
+  // and keepalives.
+  void flush(uint64_t now_ms);
+
+  // Sends a close notification on the next flush(); nothing more is sent
+  // or delivered afterwards.
+  void close();
+
+  // True once the peer closed, the link died or close() was called.
+  bool closed() const { return closed_; }
+  // close() was called and the notification has not been flushed yet.
+  bool close_pending() const { return close_pending_; }
+  // closed(), too many retransmissions, or the idle timeout expired.
+  bool dead(uint64_t now_ms) const;
+
+  uint32_t conv() const { return conv_; }
+  const InetAddress& peer() const { return peer_; }
+  void set_peer(const InetAddress& peer) { peer_ = peer; }
+  // Reliable segments not yet acknowledged, including those still waiting
+  // for window.
+  size_t pending_segments() const { return snd_buf_.size() + snd_queue_.size(); }
+  const UdpSessionStats& stats() const { return stats_; }
+
+  void* context() const { return context_; }
+  void set_context(void* ctx) { context_ = ctx; }
+
+  // Reads the conv of a datagram without parsing the rest; 0 if too short.
+  static uint32_t peek_conv(std::string_view datagram);
+
+ private:
+  enum SegmentKind : uint8_t {
+    kReliableSegment = 1,
+    kUnreliableSegment = 2,
+    kAckRange = 3,
+    kMoreFragments = 0x80,
+  };
+  enum Flags : uint8_t { kFlagClose = 1 };
+  // Selective-ACK runs per flush; later holes wait for the next one.
+  static constexpr size_t kMaxAckRanges = 16;
+
+  struct OutSegment {
+    uint32_t seq = 0;
+    bool more = false;
+    bool acked = false;
+    uint32_t xmit = 0;
+    uint32_t fast_skips = 0;
+    uint32_t rto = 0;
+    uint64_t sent_ms = 0;
+    uint64_t resend_ms = 0;
+    std::string data;
+  };
+  struct InSegment {
+    bool present = false;
+    bool more = false;
+    std::string data;
+  };
+
+  void ack_below(uint32_t ack);
+  void ack_range(uint32_t first, uint16_t count);
+  void on_acked(OutSegment& seg);
+  void finish_acks();
+  void update_rtt(uint32_t rtt_ms);
+  void deliver_reliable();
+  size_t max_payload() const { return options_.mtu - kHeaderSize - kSegmentHeaderSize; }
+
+  void append_ack_ranges();
+  void begin_datagram();
+  void append_segment(uint8_t kind, uint32_t seq, std::string_view payload);
+  void emit_datagram();
+
+  uint32_t conv_;
+  InetAddress peer_;
+  UdpSessionOptions options_;
+  OutputFn output_;
+  MessageFn on_message_;
+  void* context_ = nullptr;
+
+  // Send side.
+  uint32_t snd_next_ = 0;
+  uint32_t unreliable_next_ = 0;
+  uint32_t remote_window_;
+  std::deque<OutSegment> snd_queue_;  // waiting for window
+  std::deque<OutSegment> snd_buf_;    // in flight, by seq
+  std::vector<std::pair<uint32_t, std::string>> unreliable_out_;
+  uint32_t srtt_ = 0;
+  uint32_t rttvar_ = 0;
+  uint32_t rto_ = 200;
+
+  // Receive side.
+  uint32_t rcv_next_ = 0;
+  std::vector<InSegment> rcv_buf_;  // ring indexed by seq % recv_window
+  std::string assembling_;          // fragments of the next reliable message
+  bool have_unreliable_ = false;
+  uint32_t last_unreliable_ = 0;
+  bool ack_pending_ = false;
+  bool acked_any_ = false;  // during input()
+  uint32_t acked_highest_ = 0;
+
+  uint64_t last_input_ms_ = 0;
+  uint64_t last_output_ms_ = 0;
+  bool started_ = false;
+  bool closed_ = false;
+  bool close_pending_ = false;
+  bool dead_ = false;
+
+  uint64_t now_ms_ = 0;  // of the input() or flush() in progress
+  std::string datagram_;
+  size_t segments_in_datagram_ = 0;
+  UdpSessionStats stats_;
+};
+
+}  // namespace kbs
@@ -0,0 +1,139 @@
+#include "net/udp_socket.h"
+
+#include <cerrno>
+#include <cstring>
+
+#include "metrics/metrics.h"
+#include "net/socket_ops.h"
+
+namespace kbs {
+
+namespace {
+
+struct UdpMetrics {
+  Counter& received = metrics().counter("kbs_udp_received_datagrams_total", "Datagrams read");
+  Counter& sent = metrics().counter("kbs_udp_sent_datagrams_total", "Datagrams written");
+  Counter& dropped =
+      metrics().counter("kbs_udp_dropped_datagrams_total", "Outgoing datagrams discarded");
+};
+
+UdpMetrics& udp_metrics() {
+  static UdpMetrics m;
+  return m;
+}
+
+// recvmmsg() rounds per readiness event, so one flooded socket cannot keep
+// the loop from its other descriptors.
+constexpr int kMaxBatchesPerEvent = 4;
+
+}  // namespace
+
+UdpSocket::UdpSocket(EventLoop& loop, const InetAddress& bind_addr, bool reuse_port)
+    : loop_(loop),
+      fd_(sockets::create_udp_socket(bind_addr, reuse_port)),
+      local_(sockets::local_address(fd_)),
+      in_buf_(kBatch * kMaxDatagram),
+      in_msgs_(kBatch),
+      in_iov_(kBatch),
+      in_addrs_(kBatch),
+      out_msgs_(kBatch),
+      out_iov_(kBatch) {}
+
+UdpSocket::~UdpSocket() {
+  if (started_) loop_.remove_handler(fd_);
+  sockets::close_fd(fd_);
+}
+
+void UdpSocket::start() {
+  loop_.add_handler(fd_, this, kPollReadable);
+  started_ = true;
+}
+
+bool UdpSocket::send_to(const InetAddress& to, const void* data, size_t len) {
+  if (len > kMaxDatagram || out_count_ >= max_queued_) {
+    stats_.send_dropped.fetch_add(1, std::memory_order_relaxed);
+    udp_metrics().dropped.inc();
+    return false;
+  }
+  if (out_count_ == out_.size()) {
+    out_.emplace_back();
+    out_buf_.resize(out_.size() * kMaxDatagram);
+  }
+  OutSlot& slot = out_[out_count_];
+  slot.to = to;
+  slot.len = static_cast<uint16_t>(len);
+  std::memcpy(out_buf_.data() + out_count_ * kMaxDatagram, data, len);
+  ++out_count_;
+  return true;
+}
+
+void UdpSocket::flush() {
+  size_t next = 0;
+  while (next < out_count_) {
+    const size_t n = std::min(kBatch, out_count_ - next);
+    for (size_t i = 0; i < n; ++i) {
+      OutSlot& slot = out_[next + i];
+      out_iov_[i] = {out_buf_.data() + (next + i) * kMaxDatagram, slot.len};
+      msghdr& h = out_msgs_[i].msg_hdr;
+      h = {};
+      h.msg_name = slot.to.sockaddr_ptr();
+      h.msg_namelen = slot.to.length();
+      h.msg_iov = &out_iov_[i];
+      h.msg_iovlen = 1;
+    }
+    stats_.send_syscalls.fetch_add(1, std::memory_order_relaxed);
+    const int sent = ::sendmmsg(fd_, out_msgs_.data(), static_cast<unsigned>(n), 0);
+    if (sent > 0) {
+      stats_.datagrams_out.fetch_add(static_cast<uint64_t>(sent), std::memory_order_relaxed);
+      udp_metrics().sent.inc(static_cast<uint64_t>(sent));
+      next += static_cast<size_t>(sent);
+      continue;
+    }
+    if (sent < 0 && errno == EINTR) continue;
+    if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS)) {
+      stats_.send_dropped.fetch_add(out_count_ - next, std::memory_order_relaxed);
+      udp_metrics().dropped.inc(out_count_ - next);
+      break;
+    }
+    // Per-destination failure (unreachable, refused): skip that datagram.
+    stats_.send_dropped.fetch_add(1, std::memory_order_relaxed);
+    udp_metrics().dropped.inc();
+    ++next;
+  }
+  out_count_ = 0;
+}
+
+void UdpSocket::handle_events(uint32_t) {
+  for (int round = 0; round < kMaxBatchesPerEvent; ++round) {
+    for (size_t i = 0; i < kBatch; ++i) {
+      in_iov_[i] = {in_buf_.data() + i * kMaxDatagram, kMaxDatagram};
+      msghdr& h = in_msgs_[i].msg_hdr;
+      h = {};
+      h.msg_name = &in_addrs_[i];
+      h.msg_namelen = sizeof(sockaddr_storage);
+      h.msg_iov = &in_iov_[i];
+      h.msg_iovlen = 1;
+    }
+    stats_.recv_syscalls.fetch_add(1, std::memory_order_relaxed);
+    const int n = ::recvmmsg(fd_, in_msgs_.data(), kBatch, MSG_DONTWAIT, nullptr);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      break;  // EAGAIN, or an error queued by an earlier send (ECONNREFUSED)
+    }
+    stats_.datagrams_in.fetch_add(static_cast<uint64_t>(n), std::memory_order_relaxed);
+    udp_metrics().received.inc(static_cast<uint64_t>(n));
+    for (int i = 0; i < n; ++i) {
+      const mmsghdr& m = in_msgs_[i];
+      // Truncated datagrams are larger than anything we send; drop them.
+      if (m.msg_hdr.msg_flags & MSG_TRUNC) continue;
+      if (!on_datagram_) continue;
+      const InetAddress from = InetAddress::from_sockaddr(
+          reinterpret_cast<const sockaddr*>(&in_addrs_[i]), m.msg_hdr.msg_namelen);
+      on_datagram_(from, std::string_view(in_buf_.data() + i * kMaxDatagram, m.msg_len));
+    }
+    if (on_batch_) on_batch_();
+    if (static_cast<size_t>(n) < kBatch) break;
+  }
+}
+
+}  // namespace kbs
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <sys/socket.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string_view>
+#include <vector>
+
+#include "net/event_loop.h"
+#include "net/inet_address.h"
+
+namespace kbs {
+
+struct UdpSocketStats {
+  std::atomic<uint64_t> datagrams_in{0};
+  std::atomic<uint64_t> datagrams_out{0};
+  std::atomic<uint64_t> recv_syscalls{0};
+  std::atomic<uint64_t> send_syscalls{0};
+  // Datagrams discarded because the socket buffer was full (EAGAIN) or the
+  // send queue was.
+  std::atomic<uint64_t> send_dropped{0};
+};
+
+// Non-blocking UDP socket on one loop, batched in both directions: reads
+// drain up to kBatch datagrams per recvmmsg() and send_to() only queues,
+// with flush() handing the whole queue to sendmmsg().  Owners flush once
+// per tick or per input batch, so a burst of small datagrams costs one
+// syscall rather than one each.  Loop thread only.
+class UdpSocket final : public IoHandler {
+ public:
+  using DatagramCallback = std::function<void(const InetAddress& from, std::string_view data)>;
+  // After each recvmmsg() batch has been delivered; a good place to flush
+  // replies.
+  using BatchCallback = std::function<void()>;
+
+  static constexpr size_t kBatch = 64;
+  static constexpr size_t kMaxDatagram = 1500;
+
+  // Throws std::system_error if the socket cannot be bound.
+  UdpSocket(EventLoop& loop, const InetAddress& bind_addr, bool reuse_port = false);
+  ~UdpSocket() override;
+
+  UdpSocket(const UdpSocket&) = delete;
+  UdpSocket& operator=(const UdpSocket&) = delete;
+
+  void set_datagram_callback(DatagramCallback cb) { on_datagram_ = std::move(cb); }
+  void set_batch_callback(BatchCallback cb) { on_batch_ = std::move(cb); }
+
+  // Registers with the loop and starts reading.
+  void start();
+
+  // Queues one datagram (at most kMaxDatagram bytes); false if too large or
+  // the queue already holds max_queued datagrams.
+  bool send_to(const InetAddress& to, const void* data, size_t len);
+  bool send_to(const InetAddress& to, std::string_view s) { return send_to(to, s.data(), s.size()); }
+  // Sends everything queued.  Datagrams the kernel will not take right now
+  // are dropped, as they would be on the wire.
+  void flush();
+  size_t queued() const { return out_count_; }
+  void set_max_queued(size_t n) { max_queued_ = n; }
+
+  int fd() const { return fd_; }
+  const InetAddress& local_address() const { return local_; }
+  const UdpSocketStats& stats() const { return stats_; }
+
+  void handle_events(uint32_t events) override;
+
+ private:
+  struct OutSlot {
+    InetAddress to;
+    uint16_t len = 0;
+  };
+
+  EventLoop& loop_;
+  int fd_;
+  InetAddress local_;
+  bool started_ = false;
+  DatagramCallback on_datagram_;
+  BatchCallback on_batch_;
+
+  // Receive side: kBatch fixed buffers reused by every recvmmsg().
+  std::vector<char> in_buf_;
+  std::vector<mmsghdr> in_msgs_;
+  std::vector<iovec> in_iov_;
+  std::vector<sockaddr_storage> in_addrs_;
+
+  // Send side: datagrams laid out back to back in out_buf_.
+  std::vector<char> out_buf_;
+  std::vector<OutSlot> out_;
+  size_t out_count_ = 0;
+  size_t max_queued_ = 4096;
+  std::vector<mmsghdr> out_msgs_;
+  std::vector<iovec> out_iov_;
+
+  UdpSocketStats stats_;
+};
+
+}  // namespace kbs
@@ -0,0 +1,217 @@
+#include "rpc/rpc_channel.h"
+
+#include <cstring>
+#include <exception>
+
+#include "metrics/metrics.h"
+#include "metrics/trace.h"
+
+namespace kbs {
+
+namespace {
+
+struct RpcMetrics {
+  Histogram& latency_us = metrics().histogram(
+      "kbs_rpc_call_latency_us", "Request to response, answered calls", Histogram::latency_us());
+  Counter& timeouts = metrics().counter("kbs_rpc_timeouts_total", "Calls that timed out");
+};
+
+RpcMetrics& rpc_metrics() {
+  static RpcMetrics m;
+  return m;
+}
+
+constexpr size_t kRequestHeader = sizeof(uint32_t) + sizeof(uint16_t);
+constexpr size_t kResponseHeader = sizeof(uint32_t) + sizeof(uint8_t);
+
+template <typename T>
+void put(std::string& out, T v) {
+  out.append(reinterpret_cast<const char*>(&v), sizeof(T));
+}
+
+template <typename T>
+T get(const char* p) {
+  T v;
+  std::memcpy(&v, p, sizeof(T));
+  return v;
+}
+
+// Frame header followed by an RPC header; the caller appends the payload.
+void begin_frame(std::string& out, uint16_t msg_id, size_t body_len) {
+  out.clear();
+  out.reserve(kFrameHeaderSize + body_len);
+  put(out, static_cast<uint32_t>(body_len));
+  put(out, msg_id);
+}
+
+}  // namespace
+
+std::shared_ptr<RpcChannel> RpcChannel::create(TcpConnection& conn,
+                                               const RpcChannelOptions& options) {
+  std::shared_ptr<RpcChannel> ch(new RpcChannel(conn, options));
+  conn.set_message_callback([raw = ch.get()](TcpConnection&, ByteBuffer& in) {
+    raw->on_message(in);
+  });
+  return ch;
+}
+
+RpcChannel::RpcChannel(TcpConnection& conn, const RpcChannelOptions& options)
+    : conn_(&conn), loop_(conn.loop()), options_(options) {}
+
+RpcChannel::~RpcChannel() { close(); }
+
+void RpcChannel::register_method(uint16_t method, Handler handler) {
+  handlers_[method] = std::make_shared<Handler>(std::move(handler));
+}
+
+RpcChannel::Call RpcChannel::call(uint16_t method, std::string_view payload,
+                                  uint32_t timeout_ms) {
+  auto state = std::make_shared<Call::State>();
+  if (!conn_ || !conn_->connected()) {
+    state->result = RpcResult{RpcStatus::kDisconnected, {}};
+    return Call(std::move(state));
+  }
+  if (pending_.size() >= options_.max_in_flight) {
+    state->result = RpcResult{RpcStatus::kOverloaded, {}};
+    return Call(std::move(state));
+  }
+  if (payload.size() > kMaxPayload) {
+    state->result = RpcResult{RpcStatus::kTooLarge, {}};
+    return Call(std::move(state));
+  }
+  uint32_t id = next_call_id_++;
+  if (id == kNoReplyId) id = next_call_id_++;
+
+  begin_frame(scratch_, kMsgRpcRequest, kRequestHeader + payload.size());
+  put(scratch_, id);
+  put(scratch_, method);
+  scratch_.append(payload);
+  if (!conn_->send(scratch_)) {
+    state->result = RpcResult{RpcStatus::kDisconnected, {}};
+    return Call(std::move(state));
+  }
+  state->timer = loop_.run_after(timeout_ms ? timeout_ms : options_.default_timeout_ms,
+                                 [this, id] { on_timeout(id); });
+  state->sent_ns = Tracer::now_ns();
+  pending_.emplace(id, state);
+  return Call(std::move(state));
+}
+
+bool RpcChannel::notify(uint16_t method, std::string_view payload) {
+  if (!conn_ || payload.size() > kMaxPayload) return false;
+  begin_frame(scratch_, kMsgRpcRequest, kRequestHeader + payload.size());
+  put(scratch_, kNoReplyId);
+  put(scratch_, method);
+  scratch_.append(payload);
+  return conn_->send(scratch_);
+}
+
+void RpcChannel::close() {
+  if (conn_) {
+    conn_->set_message_callback(nullptr);
+    conn_ = nullptr;
+  }
+  // Fail everything outstanding.  Move the table out first: resuming a
+  // caller may issue new calls (which now fail fast) or drop the channel.
+  auto pending = std::move(pending_);
+  pending_.clear();
+  std::vector<std::coroutine_handle<>> ready;
+  for (auto& [id, state] : pending) {
+    loop_.cancel_timer(state->timer);
+    state->result = RpcResult{RpcStatus::kDisconnected, {}};
+    if (state->waiter) ready.push_back(std::exchange(state->waiter, nullptr));
+  }
+  for (auto h : ready) h.resume();
+}
+
+void RpcChannel::on_message(ByteBuffer& in) {
+  // A handler or resumed caller may release the last owner mid-batch.
+  const std::shared_ptr<RpcChannel> self = shared_from_this();
+  std::vector<std::coroutine_handle<>> ready;
+  Frame frame;
+  size_t consumed = 0;
+  while (conn_) {
+    const FrameStatus status = parse_frame(in.view(), frame, consumed);
+    if (status == FrameStatus::kIncomplete) break;
+    if (status == FrameStatus::kTooLarge) {
+      conn_->force_close();
+      break;
+    }
+    if (frame.msg_id == kMsgRpcRequest) {
+      on_request(frame.body);
+    } else if (frame.msg_id == kMsgRpcResponse) {
+      on_response(frame.body, ready);
+    } else if (on_frame_) {
+      on_frame_(frame);
+    }
+    in.retrieve(consumed);
+  }
+  // Resume callers only once the input buffer is no longer being walked.
+  for (auto h : ready) h.resume();
+}
+
+void RpcChannel::on_request(std::string_view body) {
+  if (body.size() < kRequestHeader) return;
+  const uint32_t call_id = get<uint32_t>(body.data());
+  const uint16_t method = get<uint16_t>(body.data() + sizeof(uint32_t));
+  auto it = handlers_.find(method);
+  if (it == handlers_.end()) {
+    if (call_id != kNoReplyId) reply(call_id, RpcResult{RpcStatus::kNoSuchMethod, {}});
+    return;
+  }
+  co_spawn(serve(weak_from_this(), it->second, call_id,
+                 std::string(body.substr(kRequestHeader))));
+}
+
+void RpcChannel::on_response(std::string_view body,
+                             std::vector<std::coroutine_handle<>>& ready) {
+  if (body.size() < kResponseHeader) return;
+  const uint32_t call_id = get<uint32_t>(body.data());
+  const auto status = static_cast<RpcStatus>(get<uint8_t>(body.data() + sizeof(uint32_t)));
+  auto it = pending_.find(call_id);
+  if (it == pending_.end()) return;  // timed out already
+  std::shared_ptr<Call::State> state = std::move(it->second);
+  pending_.erase(it);
+  loop_.cancel_timer(state->timer);
+  rpc_metrics().latency_us.observe(static_cast<double>(Tracer::now_ns() - state->sent_ns) / 1000.0);
+  state->result = RpcResult{status, std::string(body.substr(kResponseHeader))};
+  if (state->waiter) ready.push_back(std::exchange(state->waiter, nullptr));
+}
+
+void RpcChannel::on_timeout(uint32_t call_id) {
+  auto it = pending_.find(call_id);
+  if (it == pending_.end()) return;
+  std::shared_ptr<Call::State> state = std::move(it->second);
+  pending_.erase(it);
+  state->timer = kInvalidTimerId;
+  rpc_metrics().timeouts.inc();
+  state->result = RpcResult{RpcStatus::kTimeout, {}};
+  if (auto h = std::exchange(state->waiter, nullptr)) h.resume();
+}
+
+void RpcChannel::reply(uint32_t call_id, const RpcResult& result) {
+  if (!conn_) return;
+  if (result.payload.size() > kMaxFrameBody - kResponseHeader) {
+    reply(call_id, RpcResult::error("response too large"));
+    return;
+  }
+  begin_frame(scratch_, kMsgRpcResponse, kResponseHeader + result.payload.size());
+  put(scratch_, call_id);
+  put(scratch_, static_cast<uint8_t>(result.status));
+  scratch_.append(result.payload);
+  conn_->send(scratch_);
+}
+
+Task<void> RpcChannel::serve(std::weak_ptr<RpcChannel> self, std::shared_ptr<Handler> handler,
+                             uint32_t call_id, std::string payload) {
+  RpcResult result;
+  try {
+    result = co_await (*handler)(std::move(payload));
+  } catch (const std::exception& e) {
+    result = RpcResult::error(e.what());
+  }
+  if (call_id == kNoReplyId) co_return;
+  if (auto ch = self.lock()) ch->reply(call_id, result);
+}
+
+}  // namespace kbs
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "common/task.h"
+#include "common/timer_wheel.h"
+#include "net/message_buffer.h"
+#include "net/tcp_connection.h"
+
+namespace kbs {
+
+// Frame ids reserved for RPC traffic; anything else is handed to the
+// channel's frame callback.
+constexpr uint16_t kMsgRpcRequest = 0xFF00;
+constexpr uint16_t kMsgRpcResponse = 0xFF01;
+
+enum class RpcStatus : uint8_t {
+  kOk,
+  kNoSuchMethod,
+  kError,         // the handler reported failure; payload carries details
+  kTimeout,       // local: no response within the call's timeout
+  kDisconnected,  // local: the channel closed with the call outstanding
+  kOverloaded,    // local: max_in_flight calls already outstanding
+  kTooLarge,      // local: payload over RpcChannel::kMaxPayload; nothing was sent
+};
+
+struct RpcResult {
+  RpcStatus status = RpcStatus::kOk;
+  std::string payload;
+
+  bool ok() const { return status == RpcStatus::kOk; }
+  static RpcResult error(std::string message) { return {RpcStatus::kError, std::move(message)}; }
+};
+
+struct RpcChannelOptions {
+  uint32_t default_timeout_ms = 5000;
+  // Outstanding outbound calls allowed before call() fails fast.
+  size_t max_in_flight = 4096;
+};
+
+// Request/response RPC multiplexed over one TcpConnection between two
+// server processes.  Both ends may call and serve.
+//
+// Calls are pipelined: call() writes the request immediately and returns
+// an awaitable, so several calls can be in flight before any is awaited,
+// and responses are matched by call id in whatever order they arrive.
+// Handlers are coroutines too, so serving one request may itself co_await
+// calls to other processes without blocking the loop:
+//
+//   channel->register_method(kTrade, [&](std::string req) -> Task<RpcResult> {
+//     RpcResult hold = co_await bank->call(kEscrow, req);
+//     if (!hold.ok()) co_return hold;
+//     co_return co_await inventory->call(kTransfer, req);
+//   });
+//
+// Wire format (inside the usual frame): request = u32 call id, u16 method,
+// payload; response = u32 call id, u8 RpcStatus, payload.
+//
+// Everything runs on the connection's loop thread.  The owner forwards the
+// connection's close to close(), which fails outstanding calls with
+// kDisconnected; handlers still running then finish without replying.
+class RpcChannel : public std::enable_shared_from_this<RpcChannel> {
+ public:
+  using Handler = std::function<Task<RpcResult>(std::string payload)>;
+  using FrameCallback = std::function<void(const Frame&)>;
+
+  // Largest request payload that still fits in one frame.  Larger ones
+  // are refused locally: the peer would drop the whole connection.
+  static constexpr size_t kMaxPayload = kMaxFrameBody - sizeof(uint32_t) - sizeof(uint16_t);
+
+  // Installs itself as conn's message callback.
+  static std::shared_ptr<RpcChannel> create(TcpConnection& conn,
+                                            const RpcChannelOptions& options = {});
+  ~RpcChannel();
+
+  RpcChannel(const RpcChannel&) = delete;
+  RpcChannel& operator=(const RpcChannel&) = delete;
+
+  void register_method(uint16_t method, Handler handler);
+  // Non-RPC frames arriving on the same connection.
+  void set_frame_callback(FrameCallback cb) { on_frame_ = std::move(cb); }
+
+  // Outcome of one call; co_await it (at most once) for the RpcResult.
+  class Call {
+   public:
+    bool await_ready() const noexcept { return state_->result.has_value(); }
+    void await_suspend(std::coroutine_handle<> h) noexcept { state_->waiter = h; }
+    RpcResult await_resume() { return std::move(*state_->result); }
+
+   private:
+    friend class RpcChannel;
+    struct State {
+      std::optional<RpcResult> result;
+      std::coroutine_handle<> waiter;
+      TimerId timer = kInvalidTimerId;
+      uint64_t sent_ns = 0;  // for the call latency histogram
+    };
+    explicit Call(std::shared_ptr<State> s) : state_(std::move(s)) {}
+    std::shared_ptr<State> state_;
+  };
+
+  // timeout_ms == 0 uses options.default_timeout_ms.
+  Call call(uint16_t method, std::string_view payload, uint32_t timeout_ms = 0);
+  // Fire-and-forget: the peer runs the handler but sends no response.
+  // false when disconnected or the payload is over kMaxPayload.
+  bool notify(uint16_t method, std::string_view payload);
+
+  void close();
+  bool connected() const { return conn_ != nullptr; }
+  size_t in_flight() const { return pending_.size(); }
+  TcpConnection* connection() const { return conn_; }
+
+ private:
+  static constexpr uint32_t kNoReplyId = 0;
+
+  RpcChannel(TcpConnection& conn, const RpcChannelOptions& options);
+
+  void on_message(ByteBuffer& in);
+  void on_request(std::string_view body);
+  void on_response(std::string_view body, std::vector<std::coroutine_handle<>>& ready);
+  void on_timeout(uint32_t call_id);
+  void reply(uint32_t call_id, const RpcResult& result);
+  // Runs one handler; holds the handler and only a weak reference to the
+  // channel, so either may go away while the handler is suspended.
+  static Task<void> serve(std::weak_ptr<RpcChannel> self, std::shared_ptr<Handler> handler,
+                          uint32_t call_id, std::string payload);
+
+  TcpConnection* conn_;
+  EventLoop& loop_;
+  RpcChannelOptions options_;
+  std::unordered_map<uint16_t, std::shared_ptr<Handler>> handlers_;
+  std::unordered_map<uint32_t, std::shared_ptr<Call::State>> pending_;
+  uint32_t next_call_id_ = 1;
+  FrameCallback on_frame_;
+  std::string scratch_;  // outgoing frame being assembled
+};
+
+}  // namespace kbs
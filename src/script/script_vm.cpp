@@ -0,0 +1,305 @@
+// Python.h must precede the standard headers.
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include "script/script_vm.h"
+
+#include <atomic>
+#include <stdexcept>
+
+#include "metrics/metrics.h"
+#include "metrics/profiler.h"
+#include "metrics/trace.h"
+
+namespace kbs {
+
+namespace {
+
+std::atomic<bool> vm_exists{false};
+
+// Arguments that fit here are passed without touching the heap.
+constexpr size_t kStackArgs = 8;
+
+struct ScriptMetrics {
+  Counter& calls = metrics().counter("kbs_script_calls_total", "Calls into scripts");
+  Counter& errors = metrics().counter("kbs_script_errors_total", "Script calls that raised");
+  Counter& batched =
+      metrics().counter("kbs_script_batched_events_total", "Events delivered in batches");
+};
+
+ScriptMetrics& script_metrics() {
+  static ScriptMetrics m;
+  return m;
+}
+
+// A memoryview over caller memory, released once the call returns so a
+// script that keeps a reference gets ValueError rather than freed memory.
+struct ViewHolder {
+  Py_ssize_t shape[2];
+  Py_ssize_t strides[2];
+  PyObject* view = nullptr;
+
+  PyObject* make(const ScriptArg& a) {
+    Py_buffer buf{};
+    buf.buf = a.data;
+    buf.itemsize = static_cast<Py_ssize_t>(a.item_size);
+    buf.len = static_cast<Py_ssize_t>(a.items * a.columns * a.item_size);
+    buf.readonly = a.writable ? 0 : 1;
+    buf.format = const_cast<char*>(a.format);
+    buf.ndim = a.columns > 1 ? 2 : 1;
+    shape[0] = static_cast<Py_ssize_t>(a.items);
+    shape[1] = static_cast<Py_ssize_t>(a.columns);
+    strides[0] = static_cast<Py_ssize_t>(a.columns * a.item_size);
+    strides[1] = static_cast<Py_ssize_t>(a.item_size);
+    buf.shape = shape;
+    buf.strides = strides;
+    view = PyMemoryView_FromBuffer(&buf);
+    return view;
+  }
+
+  void release() {
+    if (!view) return;
+    PyObject* r = PyObject_CallMethod(view, "release", nullptr);
+    // BufferError: the script exported it (e.g. numpy.frombuffer); it
+    // then owns the consequences.
+    if (r) {
+      Py_DECREF(r);
+    } else {
+      PyErr_Clear();
+    }
+    Py_DECREF(view);
+    view = nullptr;
+  }
+};
+
+PyObject* to_python(const ScriptArg& a, ViewHolder& holder) {
+  switch (a.kind) {
+    case ScriptArg::Kind::kNone: Py_RETURN_NONE;
+    case ScriptArg::Kind::kBool: return PyBool_FromLong(a.i != 0);
+    case ScriptArg::Kind::kInt: return PyLong_FromLongLong(a.i);
+    case ScriptArg::Kind::kUInt: return PyLong_FromUnsignedLongLong(a.u);
+    case ScriptArg::Kind::kFloat: return PyFloat_FromDouble(a.f);
+    case ScriptArg::Kind::kString:
+      return PyUnicode_FromStringAndSize(a.str.data(), static_cast<Py_ssize_t>(a.str.size()));
+    case ScriptArg::Kind::kObject:
+      if (!a.obj) Py_RETURN_NONE;
+      Py_INCREF(a.obj);
+      return a.obj;
+    case ScriptArg::Kind::kView: return holder.make(a);
+  }
+  Py_RETURN_NONE;
+}
+
+}  // namespace
+
+ScriptObject::ScriptObject(const ScriptObject& o) : obj_(o.obj_) { Py_XINCREF(obj_); }
+
+ScriptObject::~ScriptObject() { Py_XDECREF(obj_); }
+
+ScriptVm::ScriptVm(const ScriptVmOptions& options) {
+  if (vm_exists.exchange(true)) throw std::logic_error("only one ScriptVm per process");
+  PyConfig config;
+  PyConfig_InitIsolatedConfig(&config);
+  config.install_signal_handlers = 0;  // signals belong to the server
+  const PyStatus status = Py_InitializeFromConfig(&config);
+  PyConfig_Clear(&config);
+  if (PyStatus_Exception(status)) {
+    vm_exists = false;
+    throw std::runtime_error(std::string("python init failed: ") +
+                             (status.err_msg ? status.err_msg : "unknown"));
+  }
+  try {
+    PyObject* path = PySys_GetObject("path");  // borrowed
+    for (size_t i = options.module_paths.size(); i-- > 0;) {
+      PyObject* p = PyUnicode_FromString(options.module_paths[i].c_str());
+      if (p) {
+        PyList_Insert(path, 0, p);
+        Py_DECREF(p);
+      }
+    }
+    ScriptObject traceback = import("traceback");
+    format_exception_ = attr(traceback, "format_exception");
+  } catch (...) {
+    // The destructor will not run: undo the init so a later ScriptVm can.
+    format_exception_ = ScriptObject();
+    Py_FinalizeEx();
+    vm_exists = false;
+    throw;
+  }
+}
+
+ScriptVm::~ScriptVm() {
+  format_exception_ = ScriptObject();
+  Py_FinalizeEx();
+  vm_exists = false;
+}
+
+std::string ScriptVm::error_text() {
+  PyObject *type, *value, *tb;
+  PyErr_Fetch(&type, &value, &tb);
+  PyErr_NormalizeException(&type, &value, &tb);
+  std::string text;
+  PyObject* lines = nullptr;
+  if (format_exception_ && type) {
+    lines = PyObject_CallFunctionObjArgs(format_exception_.get(), type, value ? value : Py_None,
+                                         tb ? tb : Py_None, nullptr);
+  }
+  if (lines && PyList_Check(lines)) {
+    for (Py_ssize_t i = 0; i < PyList_GET_SIZE(lines); ++i) {
+      if (const char* s = PyUnicode_AsUTF8(PyList_GET_ITEM(lines, i))) text += s;
+    }
+  } else if (value) {
+    PyErr_Clear();
+    if (PyObject* s = PyObject_Str(value)) {
+      if (const char* c = PyUnicode_AsUTF8(s)) text = c;
+      Py_DECREF(s);
+    }
+  }
+  Py_XDECREF(lines);
+  Py_XDECREF(type);
+  Py_XDECREF(value);
+  Py_XDECREF(tb);
+  PyErr_Clear();
+  if (text.empty()) text = "unknown python error";
+  return text;
+}
+
+void ScriptVm::capture_error() {
+  ++stats_.errors;
+  script_metrics().errors.inc();
+  last_error_ = error_text();
+}
+
+ScriptObject ScriptVm::import(std::string_view module) {
+  KBS_PROFILE_SCOPE(kScript);
+  PyObject* name =
+      PyUnicode_FromStringAndSize(module.data(), static_cast<Py_ssize_t>(module.size()));
+  PyObject* mod = name ? PyImport_Import(name) : nullptr;
+  Py_XDECREF(name);
+  if (!mod) throw std::runtime_error("import " + std::string(module) + ": " + error_text());
+  return ScriptObject::adopt(mod);
+}
+
+ScriptObject ScriptVm::attr(const ScriptObject& obj, std::string_view name) {
+  const std::string n(name);
+  PyObject* a = obj ? PyObject_GetAttrString(obj.get(), n.c_str()) : nullptr;
+  if (!a) {
+    throw std::runtime_error("attribute " + n + ": " +
+                             (obj ? error_text() : std::string("null object")));
+  }
+  return ScriptObject::adopt(a);
+}
+
+std::vector<ScriptObject> ScriptVm::methods(const ScriptObject& obj,
+                                            std::initializer_list<std::string_view> names) {
+  std::vector<ScriptObject> out;
+  out.reserve(names.size());
+  for (std::string_view name : names) {
+    const std::string n(name);
+    PyObject* a = obj ? PyObject_GetAttrString(obj.get(), n.c_str()) : nullptr;
+    if (!a) PyErr_Clear();
+    out.push_back(ScriptObject::adopt(a));
+  }
+  return out;
+}
+
+bool ScriptVm::call(const ScriptObject& fn, std::initializer_list<ScriptArg> args,
+                    ScriptObject* result) {
+  return call(fn, std::span<const ScriptArg>(args.begin(), args.size()), result);
+}
+
+bool ScriptVm::call(const ScriptObject& fn, std::span<const ScriptArg> args,
+                    ScriptObject* result) {
+  if (!fn) return false;
+  KBS_PROFILE_SCOPE(kScript);
+  ++stats_.calls;
+  script_metrics().calls.inc();
+  PyObject* stack_args[kStackArgs];
+  ViewHolder stack_views[kStackArgs];
+  std::vector<PyObject*> heap_args;
+  std::vector<ViewHolder> heap_views;
+  PyObject** argv = stack_args;
+  ViewHolder* views = stack_views;
+  if (args.size() > kStackArgs) {
+    heap_args.resize(args.size());
+    heap_views.resize(args.size());
+    argv = heap_args.data();
+    views = heap_views.data();
+  }
+  size_t built = 0;
+  bool ok = true;
+  for (; built < args.size(); ++built) {
+    if (args[built].kind == ScriptArg::Kind::kView) ++stats_.views;
+    argv[built] = to_python(args[built], views[built]);
+    if (!argv[built]) {
+      ok = false;
+      break;
+    }
+  }
+  PyObject* ret = nullptr;
+  if (ok) {
+    ret = PyObject_Vectorcall(fn.get(), argv, args.size(), nullptr);
+    ok = ret != nullptr;
+  }
+  if (!ok) capture_error();
+  for (size_t i = 0; i < built; ++i) {
+    views[i].release();
+    if (args[i].kind != ScriptArg::Kind::kView) Py_DECREF(argv[i]);
+  }
+  if (result) {
+    *result = ScriptObject::adopt(ret);
+  } else {
+    Py_XDECREF(ret);
+  }
+  return ok;
+}
+
+bool ScriptVm::exec(std::string_view source) {
+  KBS_PROFILE_SCOPE(kScript);
+  const std::string src(source);
+  PyObject* main = PyImport_AddModule("__main__");  // borrowed
+  PyObject* globals = main ? PyModule_GetDict(main) : nullptr;
+  PyObject* r = globals ? PyRun_String(src.c_str(), Py_file_input, globals, globals) : nullptr;
+  if (!r) {
+    capture_error();
+    return false;
+  }
+  Py_DECREF(r);
+  return true;
+}
+
+bool ScriptVm::as_int(const ScriptObject& obj, int64_t& out) {
+  if (!obj || !PyLong_Check(obj.get())) return false;
+  const long long v = PyLong_AsLongLong(obj.get());
+  if (v == -1 && PyErr_Occurred()) {
+    PyErr_Clear();
+    return false;
+  }
+  out = v;
+  return true;
+}
+
+bool ScriptVm::as_double(const ScriptObject& obj, double& out) {
+  if (!obj) return false;
+  const double v = PyFloat_AsDouble(obj.get());
+  if (v == -1.0 && PyErr_Occurred()) {
+    PyErr_Clear();
+    return false;
+  }
+  out = v;
+  return true;
+}
+
+bool ScriptEventBatch::flush(ScriptVm& vm, const ScriptObject& handler) {
+  if (empty()) return true;
+  KBS_TRACE_SCOPE("script.batch");
+  script_metrics().batched.inc(size());
+  const bool ok = vm.call(handler, {ScriptArg::view(std::span<const EntityId>(entities_)),
+                                    ScriptArg::view(std::span<const uint32_t>(kinds_)),
+                                    ScriptArg::view(std::span<const int64_t>(a_)),
+                                    ScriptArg::view(std::span<const int64_t>(b_))});
+  clear();
+  return ok;
+}
+
+}  // namespace kbs
@@ -0,0 +1,234 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "common/types.h"
+#include "common/vec3.h"
+
+// CPython's PyObject, without dragging Python.h into every includer.
+struct _object;
+
+namespace kbs {
+
+// Owned reference to a Python object.  Like everything in this file, only
+// for the thread that owns the ScriptVm.
+class ScriptObject {
+ public:
+  ScriptObject() = default;
+  ScriptObject(const ScriptObject& o);
+  ScriptObject(ScriptObject&& o) noexcept : obj_(std::exchange(o.obj_, nullptr)) {}
+  ScriptObject& operator=(ScriptObject o) noexcept {
+    std::swap(obj_, o.obj_);
+    return *this;
+  }
+  ~ScriptObject();
+
+  // Takes over a new reference.
+  static ScriptObject adopt(_object* obj) {
+    ScriptObject o;
+    o.obj_ = obj;
+    return o;
+  }
+
+  explicit operator bool() const { return obj_ != nullptr; }
+  _object* get() const { return obj_; }
+
+ private:
+  _object* obj_ = nullptr;
+};
+
+// One argument of ScriptVm::call().  Scalars and strings are converted
+// per call; view() arguments become writable memoryviews straight over the
+// caller's memory (an SoA column, a data table) that are released when
+// the call returns, so scripts read and update entity properties in place
+// without a copy in either direction.
+struct ScriptArg {
+  enum class Kind : uint8_t { kNone, kBool, kInt, kUInt, kFloat, kString, kObject, kView };
+
+  ScriptArg() = default;
+  ScriptArg(bool v) : kind(Kind::kBool), i(v) {}
+  template <typename T>
+    requires(std::is_integral_v<T> && std::is_signed_v<T>)
+  ScriptArg(T v) : kind(Kind::kInt), i(v) {}
+  template <typename T>
+    requires(std::is_integral_v<T> && std::is_unsigned_v<T> && !std::is_same_v<T, bool>)
+  ScriptArg(T v) : kind(Kind::kUInt), u(v) {}
+  ScriptArg(double v) : kind(Kind::kFloat), f(v) {}
+  ScriptArg(std::string_view v) : kind(Kind::kString), str(v) {}
+  ScriptArg(const char* v) : ScriptArg(std::string_view(v)) {}
+  ScriptArg(const ScriptObject& o) : kind(Kind::kObject), obj(o.get()) {}
+
+  // A memoryview of items (or items x columns) elements of format, e.g.
+  // "f" with columns 3 for Vec3.  Prefer the typed overloads below.
+  static ScriptArg view(void* data, size_t items, const char* format, size_t item_size,
+                        size_t columns = 1, bool writable = true) {
+    ScriptArg a;
+    a.kind = Kind::kView;
+    a.data = data;
+    a.items = items;
+    a.format = format;
+    a.item_size = item_size;
+    a.columns = columns;
+    a.writable = writable;
+    return a;
+  }
+  template <typename T>
+  static ScriptArg view(std::span<T> s);
+  static ScriptArg view(std::span<Vec3> s) {
+    return view(s.data(), s.size(), "f", sizeof(float), 3);
+  }
+  static ScriptArg view(std::span<const Vec3> s) {
+    return view(const_cast<Vec3*>(s.data()), s.size(), "f", sizeof(float), 3, false);
+  }
+
+  Kind kind = Kind::kNone;
+  int64_t i = 0;
+  uint64_t u = 0;
+  double f = 0;
+  std::string_view str;
+  _object* obj = nullptr;
+  void* data = nullptr;
+  size_t items = 0;
+  const char* format = nullptr;
+  size_t item_size = 0;
+  size_t columns = 1;
+  bool writable = false;
+};
+
+// struct-module format character of an arithmetic type.
+template <typename T>
+constexpr const char* script_format() {
+  using U = std::remove_const_t<T>;
+  if constexpr (std::is_same_v<U, float>) return "f";
+  else if constexpr (std::is_same_v<U, double>) return "d";
+  else if constexpr (std::is_integral_v<U> && std::is_signed_v<U> && sizeof(U) == 1) return "b";
+  else if constexpr (std::is_integral_v<U> && sizeof(U) == 1) return "B";
+  else if constexpr (std::is_integral_v<U> && std::is_signed_v<U> && sizeof(U) == 2) return "h";
+  else if constexpr (std::is_integral_v<U> && sizeof(U) == 2) return "H";
+  else if constexpr (std::is_integral_v<U> && std::is_signed_v<U> && sizeof(U) == 4) return "i";
+  else if constexpr (std::is_integral_v<U> && sizeof(U) == 4) return "I";
+  else if constexpr (std::is_integral_v<U> && std::is_signed_v<U> && sizeof(U) == 8) return "q";
+  else if constexpr (std::is_integral_v<U> && sizeof(U) == 8) return "Q";
+  else static_assert(sizeof(U) == 0, "no memoryview format for this type");
+}
+
+template <typename T>
+ScriptArg ScriptArg::view(std::span<T> s) {
+  return view(const_cast<std::remove_const_t<T>*>(s.data()), s.size(), script_format<T>(),
+              sizeof(T), 1, !std::is_const_v<T>);
+}
+
+struct ScriptVmOptions {
+  // Prepended to sys.path, in order.
+  std::vector<std::string> module_paths;
+};
+
+struct ScriptVmStats {
+  uint64_t calls = 0;
+  uint64_t errors = 0;
+  uint64_t views = 0;  // memoryviews handed to scripts
+};
+
+// Embedded CPython interpreter for gameplay scripts.
+//
+// What makes script-heavy servers slow is the boundary, not the script:
+// attribute lookups by name on every event, tuples and bound methods
+// allocated per call, property values copied into Python objects and back.
+// So lookups happen once (import()/attr()/methods() at load time, cached
+// in ScriptObjects); call() goes through vectorcall with the arguments on
+// the stack and calls plain functions with the instance passed
+// explicitly; bulk data crosses as memoryviews; and per-event callbacks
+// are collected in a ScriptEventBatch and delivered with one call per
+// tick.
+//
+// One per process (CPython has one main interpreter), created, used and
+// destroyed on the logic thread, which holds the GIL throughout.  Setup
+// calls throw; call() returns false and keeps the formatted traceback in
+// last_error(), so one broken script cannot take the tick down.
+class ScriptVm {
+ public:
+  // Throws std::logic_error when another ScriptVm exists and
+  // std::runtime_error when the interpreter fails to start.
+  explicit ScriptVm(const ScriptVmOptions& options = {});
+  ~ScriptVm();
+
+  ScriptVm(const ScriptVm&) = delete;
+  ScriptVm& operator=(const ScriptVm&) = delete;
+
+  // Throw std::runtime_error with the Python traceback.
+  ScriptObject import(std::string_view module);
+  ScriptObject attr(const ScriptObject& obj, std::string_view name);
+  // Resolves several names at once (a class's event handlers); missing
+  // ones come back empty instead of throwing.
+  std::vector<ScriptObject> methods(const ScriptObject& obj,
+                                    std::initializer_list<std::string_view> names);
+
+  // fn(args...).  result, when given, receives the return value.
+  bool call(const ScriptObject& fn, std::initializer_list<ScriptArg> args,
+            ScriptObject* result = nullptr);
+  bool call(const ScriptObject& fn, std::span<const ScriptArg> args,
+            ScriptObject* result = nullptr);
+
+  // Runs source in __main__ (consoles, tests).
+  bool exec(std::string_view source);
+
+  static bool as_int(const ScriptObject& obj, int64_t& out);
+  static bool as_double(const ScriptObject& obj, double& out);
+
+  const std::string& last_error() const { return last_error_; }
+  ScriptVmStats stats() const { return stats_; }
+
+ private:
+  void capture_error();
+  std::string error_text();
+
+  ScriptObject format_exception_;  // traceback.format_exception
+  std::string last_error_;
+  ScriptVmStats stats_;
+};
+
+// Events for one script handler, accumulated during a tick and delivered
+// in one crossing:
+//
+//   def on_events(entities, kinds, a, b):   # parallel memoryviews
+//       for i in range(len(entities)): ...
+//
+// Columns are stored SoA so each reaches the script as a zero-copy view.
+class ScriptEventBatch {
+ public:
+  void push(EntityId entity, uint32_t kind, int64_t a = 0, int64_t b = 0) {
+    entities_.push_back(entity);
+    kinds_.push_back(kind);
+    a_.push_back(a);
+    b_.push_back(b);
+  }
+
+  size_t size() const { return entities_.size(); }
+  bool empty() const { return entities_.empty(); }
+  void clear() {
+    entities_.clear();
+    kinds_.clear();
+    a_.clear();
+    b_.clear();
+  }
+
+  // Calls handler once with the queued events and clears the batch; an
+  // empty batch makes no call.
+  bool flush(ScriptVm& vm, const ScriptObject& handler);
+
+ private:
+  std::vector<EntityId> entities_;
+  std::vector<uint32_t> kinds_;
+  std::vector<int64_t> a_;
+  std::vector<int64_t> b_;
+};
+
+}  // namespace kbs
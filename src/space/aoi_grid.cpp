@@ -0,0 +1,202 @@
+#include "space/aoi_grid.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "metrics/profiler.h"
+
+namespace kbs {
+
+AoiGrid::AoiGrid(const AoiGridOptions& options)
+    : options_(options),
+      cell_size_(options.view_radius + options.hysteresis),
+      enter_sq_(options.view_radius * options.view_radius),
+      leave_sq_(cell_size_ * cell_size_) {
+  cols_ = std::max<uint32_t>(1, static_cast<uint32_t>(
+                                    std::ceil((options.max_x - options.min_x) / cell_size_)));
+  rows_ = std::max<uint32_t>(1, static_cast<uint32_t>(
+                                    std::ceil((options.max_z - options.min_z) / cell_size_)));
+  cells_.resize(static_cast<size_t>(cols_) * rows_);
+}
+
+uint32_t AoiGrid::cell_of(Vec3 pos) const {
+  const float fx = (pos.x - options_.min_x) / cell_size_;
+  const float fz = (pos.z - options_.min_z) / cell_size_;
+  const uint32_t cx = static_cast<uint32_t>(std::clamp(fx, 0.0f, static_cast<float>(cols_ - 1)));
+  const uint32_t cz = static_cast<uint32_t>(std::clamp(fz, 0.0f, static_cast<float>(rows_ - 1)));
+  return cz * cols_ + cx;
+}
+
+void AoiGrid::insert_into_cell(uint32_t slot, uint32_t cell) {
+  auto& members = cells_[cell];
+  slots_[slot].cell = cell;
+  slots_[slot].index_in_cell = static_cast<uint32_t>(members.size());
+  members.push_back(slot);
+}
+
+void AoiGrid::erase_from_cell(uint32_t slot) {
+  auto& members = cells_[slots_[slot].cell];
+  const uint32_t idx = slots_[slot].index_in_cell;
+  const uint32_t last = members.back();
+  members[idx] = last;
+  slots_[last].index_in_cell = idx;
+  members.pop_back();
+}
+
+void AoiGrid::add(EntityId id, Vec3 pos) {
+  KBS_PROFILE_SCOPE(kAoi);
+  if (index_.count(id)) return;
+  uint32_t s;
+  if (!free_slots_.empty()) {
+    s = free_slots_.back();
+    free_slots_.pop_back();
+  } else {
+    s = static_cast<uint32_t>(slots_.size());
+    slots_.emplace_back();
+  }
+  Slot& slot = slots_[s];
+  slot.id = id;
+  slot.pos = pos;
+  slot.live = true;
+  slot.dirty = true;
+  slot.neighbors.clear();
+  insert_into_cell(s, cell_of(pos));
+  index_.emplace(id, s);
+  dirty_.push_back(s);
+}
+
+void AoiGrid::move(EntityId id, Vec3 pos) {
+  KBS_PROFILE_SCOPE(kAoi);
+  auto it = index_.find(id);
+  if (it == index_.end()) return;
+  const uint32_t s = it->second;
+  Slot& slot = slots_[s];
+  slot.pos = pos;
+  const uint32_t cell = cell_of(pos);
+  if (cell != slot.cell) {
+    erase_from_cell(s);
+    insert_into_cell(s, cell);
+  }
+  if (!slot.dirty) {
+    slot.dirty = true;
+    dirty_.push_back(s);
+  }
+}
+
+void AoiGrid::remove(EntityId id) {
+  KBS_PROFILE_SCOPE(kAoi);
+  auto it = index_.find(id);
+  if (it == index_.end()) return;
+  const uint32_t s = it->second;
+  Slot& slot = slots_[s];
+  for (uint32_t n : slot.neighbors) {
+    erase_sorted(slots_[n].neighbors, s);
+    pending_.push_back({AoiEventType::kLeave, slots_[n].id, id});
+    pending_.push_back({AoiEventType::kLeave, id, slots_[n].id});
+  }
+  slot.neighbors.clear();
+  erase_from_cell(s);
+  slot.live = false;
+  slot.dirty = false;
+  slot.id = kInvalidEntityId;
+  index_.erase(it);
+  free_slots_.push_back(s);
+}
+
+void AoiGrid::update(std::vector<AoiEvent>& out) {
+  KBS_PROFILE_SCOPE(kAoi);
+  out.insert(out.end(), pending_.begin(), pending_.end());
+  pending_.clear();
+  for (uint32_t s : dirty_) {
+    // Slots removed (and possibly reused) since they were queued are
+    // either skipped or refreshed harmlessly a second time.
+    if (slots_[s].live && slots_[s].dirty) refresh(s, out);
+  }
+  dirty_.clear();
+}
+
+void AoiGrid::gather(uint32_t s, std::vector<uint32_t>& out) const {
+  out.clear();
+  const Slot& self = slots_[s];
+  const int cx = static_cast<int>(self.cell % cols_);
+  const int cz = static_cast<int>(self.cell / cols_);
+  for (int dz = -1; dz <= 1; ++dz) {
+    const int z = cz + dz;
+    if (z < 0 || z >= static_cast<int>(rows_)) continue;
+    for (int dx = -1; dx <= 1; ++dx) {
+      const int x = cx + dx;
+      if (x < 0 || x >= static_cast<int>(cols_)) continue;
+      for (uint32_t o : cells_[static_cast<size_t>(z) * cols_ + x]) {
+        if (o == s) continue;
+        const float d2 = distance_sq_xz(self.pos, slots_[o].pos);
+        if (d2 > leave_sq_) continue;
+        // Inside the hysteresis band only existing neighbours stay.
+        if (d2 <= enter_sq_ ||
+            std::binary_search(self.neighbors.begin(), self.neighbors.end(), o)) {
+          out.push_back(o);
+        }
+      }
+    }
+  }
+  std::sort(out.begin(), out.end());
+}
+
+void AoiGrid::refresh(uint32_t s, std::vector<AoiEvent>& out) {
+  gather(s, scratch_);
+  Slot& self = slots_[s];
+  self.dirty = false;
+  const auto& old_n = self.neighbors;
+  const auto& new_n = scratch_;
+  size_t i = 0;
+  size_t j = 0;
+  while (i < old_n.size() || j < new_n.size()) {
+    if (j == new_n.size() || (i < old_n.size() && old_n[i] < new_n[j])) {
+      const uint32_t o = old_n[i++];
+      erase_sorted(slots_[o].neighbors, s);
+      out.push_back({AoiEventType::kLeave, self.id, slots_[o].id});
+      out.push_back({AoiEventType::kLeave, slots_[o].id, self.id});
+    } else if (i == old_n.size() || new_n[j] < old_n[i]) {
+      const uint32_t o = new_n[j++];
+      insert_sorted(slots_[o].neighbors, s);
+      out.push_back({AoiEventType::kEnter, self.id, slots_[o].id});
+      out.push_back({AoiEventType::kEnter, slots_[o].id, self.id});
+    } else {
+      ++i;
+      ++j;
+    }
+  }
+  self.neighbors.assign(new_n.begin(), new_n.end());
+}
+
+size_t AoiGrid::neighbor_count(EntityId id) const {
+  auto it = index_.find(id);
+  return it == index_.end() ? 0 : slots_[it->second].neighbors.size();
+}
+
+void AoiGrid::query_radius(Vec3 pos, float radius, std::vector<EntityId>& out) const {
+  KBS_PROFILE_SCOPE(kAoi);
+  const float r2 = radius * radius;
+  const int span = static_cast<int>(std::ceil(radius / cell_size_));
+  const uint32_t center = cell_of(pos);
+  const int cx = static_cast<int>(center % cols_);
+  const int cz = static_cast<int>(center / cols_);
+  for (int z = std::max(0, cz - span); z <= std::min<int>(rows_ - 1, cz + span); ++z) {
+    for (int x = std::max(0, cx - span); x <= std::min<int>(cols_ - 1, cx + span); ++x) {
+      for (uint32_t o : cells_[static_cast<size_t>(z) * cols_ + x]) {
+        if (distance_sq_xz(pos, slots_[o].pos) <= r2) out.push_back(slots_[o].id);
+      }
+    }
+  }
+}
+
+void AoiGrid::erase_sorted(std::vector<uint32_t>& v, uint32_t value) {
+  auto it = std::lower_bound(v.begin(), v.end(), value);
+  if (it != v.end() && *it == value) v.erase(it);
+}
+
+void AoiGrid::insert_sorted(std::vector<uint32_t>& v, uint32_t value) {
+  auto it = std::lower_bound(v.begin(), v.end(), value);
+  if (it == v.end() || *it != value) v.insert(it, value);
+}
+
+}  // namespace kbs
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "common/types.h"
+#include "common/vec3.h"
+
+namespace kbs {
+
+enum class AoiEventType : uint8_t { kEnter, kLeave };
+
+// watcher started (kEnter) or stopped (kLeave) seeing target.  Visibility
+// is symmetric, so events come in mirrored pairs.
+struct AoiEvent {
+  AoiEventType type;
+  EntityId watcher;
+  EntityId target;
+};
+
+struct AoiGridOptions {
+  // World bounds on the ground (x/z) plane; positions are clamped into it.
+  float min_x = -8192;
+  float min_z = -8192;
+  float max_x = 8192;
+  float max_z = 8192;
+  // Entities closer than view_radius become visible to each other...
+  float view_radius = 50;
+  // ...and stop being visible beyond view_radius + hysteresis, so an entity
+  // pacing along the edge does not generate an enter/leave pair per tick.
+  float hysteresis = 5;
+};
+
+// Uniform-grid area-of-interest index.
+//
+// Cells are as wide as the leave radius, so everyone an entity can see lies
+// in the 3x3 block around its cell.  Each entity keeps a sorted list of its
+// current neighbours; update() re-examines only entities that moved since
+// the previous call and diffs their fresh neighbour list against the old
+// one, so the cost per tick is proportional to movers times local density
+// instead of all pairs.
+class AoiGrid {
+ public:
+  explicit AoiGrid(const AoiGridOptions& options = {});
+
+  AoiGrid(const AoiGrid&) = delete;
+  AoiGrid& operator=(const AoiGrid&) = delete;
+
+  // The entity is resolved on the next update().  Adding an id twice is a
+  // no-op.
+  void add(EntityId id, Vec3 pos);
+  void move(EntityId id, Vec3 pos);
+  // Leave events for everyone who saw the entity are emitted by the next
+  // update().
+  void remove(EntityId id);
+
+  // Resolves pending adds, moves and removes and appends the resulting
+  // enter/leave events to out.
+  void update(std::vector<AoiEvent>& out);
+
+  bool contains(EntityId id) const { return index_.count(id) != 0; }
+  size_t size() const { return index_.size(); }
+
+  // Everyone currently in id's view (as of the last update()).
+  template <typename F>
+  void for_each_neighbor(EntityId id, F&& fn) const {
+    auto it = index_.find(id);
+    if (it == index_.end()) return;
+    for (uint32_t n : slots_[it->second].neighbors) fn(slots_[n].id);
+  }
+  size_t neighbor_count(EntityId id) const;
+
+  // Entities within radius of pos, using the grid but not the neighbour
+  // lists.  For one-off queries such as AoE targeting.
+  void query_radius(Vec3 pos, float radius, std::vector<EntityId>& out) const;
+
+ private:
+  static constexpr uint32_t kNoSlot = UINT32_MAX;
+
+  struct Slot {
+    EntityId id = kInvalidEntityId;
+    Vec3 pos;
+    uint32_t cell = 0;
+    uint32_t index_in_cell = 0;
+    bool dirty = false;
+    bool live = false;
+    std::vector<uint32_t> neighbors;  // sorted slot indices
+  };
+
+  uint32_t cell_of(Vec3 pos) const;
+  void insert_into_cell(uint32_t slot, uint32_t cell);
+  void erase_from_cell(uint32_t slot);
+  void refresh(uint32_t slot, std::vector<AoiEvent>& out);
+  void gather(uint32_t slot, std::vector<uint32_t>& out) const;
+  static void erase_sorted(std::vector<uint32_t>& v, uint32_t value);
+  static void insert_sorted(std::vector<uint32_t>& v, uint32_t value);
+
+  AoiGridOptions options_;
+  float cell_size_;
+  float enter_sq_;
+  float leave_sq_;
+  uint32_t cols_;
+  uint32_t rows_;
+
+  std::vector<std::vector<uint32_t>> cells_;
+  std::vector<Slot> slots_;
+  std::vector<uint32_t> free_slots_;
+  std::unordered_map<EntityId, uint32_t> index_;
+  std::vector<uint32_t> dirty_;
+  std::vector<AoiEvent> pending_;  // leave events produced by remove()
+  std::vector<uint32_t> scratch_;
+};
+
+}  // namespace kbs
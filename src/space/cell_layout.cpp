@@ -0,0 +1,235 @@
+#include "space/cell_layout.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace kbs {
+
+float CellRect::distance_sq(Vec3 p) const {
+  const float dx = std::max({min_x - p.x, 0.0f, p.x - max_x});
+  const float dz = std::max({min_z - p.z, 0.0f, p.z - max_z});
+  return dx * dx + dz * dz;
+}
+
+CellLayout::CellLayout(const CellRect& bounds, CellId root) {
+  Node n;
+  n.cell = root;
+  n.rect = bounds;
+  nodes_.push_back(n);
+}
+
+int32_t CellLayout::leaf_of(CellId cell) const {
+  for (size_t i = 0; i < nodes_.size(); ++i) {
+    if (nodes_[i].leaf() && nodes_[i].cell == cell) return static_cast<int32_t>(i);
+  }
+  return kNone;
+}
+
+bool CellLayout::split(CellId cell, Axis axis, float at, CellId new_cell, float min_size) {
+  const int32_t idx = leaf_of(cell);
+  if (idx == kNone || leaf_of(new_cell) != kNone) return false;
+  const CellRect r = nodes_[idx].rect;
+  const float lo = axis == Axis::kX ? r.min_x : r.min_z;
+  const float hi = axis == Axis::kX ? r.max_x : r.max_z;
+  if (at - lo < min_size || hi - at < min_size || at <= lo || at >= hi) return false;
+
+  Node lower;
+  lower.cell = cell;
+  Node upper;
+  upper.cell = new_cell;
+  const int32_t base = static_cast<int32_t>(nodes_.size());
+  nodes_.push_back(lower);
+  nodes_.push_back(upper);
+  Node& parent = nodes_[idx];
+  parent.child[0] = base;
+  parent.child[1] = base + 1;
+  parent.axis = axis;
+  parent.split = at;
+  parent.cell = kInvalidCellId;
+  update_rects(idx);
+  ++version_;
+  return true;
+}
+
+void CellLayout::update_rects(int32_t node) {
+  const Node& n = nodes_[node];
+  if (n.leaf()) return;
+  CellRect lower = n.rect;
+  CellRect upper = n.rect;
+  if (n.axis == Axis::kX) {
+    lower.max_x = upper.min_x = n.split;
+  } else {
+    lower.max_z = upper.min_z = n.split;
+  }
+  nodes_[n.child[0]].rect = lower;
+  nodes_[n.child[1]].rect = upper;
+  update_rects(n.child[0]);
+  update_rects(n.child[1]);
+}
+
+CellId CellLayout::cell_at(Vec3 pos) const {
+  if (nodes_.empty()) return kInvalidCellId;
+  int32_t i = 0;
+  while (!nodes_[i].leaf()) {
+    const Node& n = nodes_[i];
+    const float v = n.axis == Axis::kX ? pos.x : pos.z;
+    i = n.child[v < n.split ? 0 : 1];
+  }
+  return nodes_[i].cell;
+}
+
+std::optional<CellRect> CellLayout::rect_of(CellId cell) const {
+  const int32_t i = leaf_of(cell);
+  if (i == kNone) return std::nullopt;
+  return nodes_[i].rect;
+}
+
+void CellLayout::cells_within(Vec3 pos, float distance, std::vector<CellId>& out) const {
+  if (nodes_.empty()) return;
+  const float d_sq = distance * distance;
+  const auto visit = [&](const auto& self, int32_t i) -> void {
+    const Node& n = nodes_[i];
+    if (n.rect.distance_sq(pos) > d_sq) return;
+    if (n.leaf()) {
+      out.push_back(n.cell);
+      return;
+    }
+    self(self, n.child[0]);
+    self(self, n.child[1]);
+  };
+  visit(visit, 0);
+}
+
+void CellLayout::cells(std::vector<CellId>& out) const {
+  for (const Node& n : nodes_) {
+    if (n.leaf()) out.push_back(n.cell);
+  }
+}
+
+void CellLayout::descendant_splits(int32_t node, Axis axis, float& lo, float& hi) const {
+  const Node& n = nodes_[node];
+  if (n.leaf()) return;
+  if (n.axis == axis) {
+    lo = std::min(lo, n.split);
+    hi = std::max(hi, n.split);
+  }
+  descendant_splits(n.child[0], axis, lo, hi);
+  descendant_splits(n.child[1], axis, lo, hi);
+}
+
+bool CellLayout::rebalance(const std::function<float(CellId)>& load,
+                           const RebalanceOptions& options) {
+  if (nodes_.size() < 3) return false;
+  // Children follow parents, so a reverse sweep sums subtrees bottom-up.
+  std::vector<float> total(nodes_.size(), 0);
+  for (size_t i = nodes_.size(); i-- > 0;) {
+    const Node& n = nodes_[i];
+    total[i] = n.leaf() ? std::max(load(n.cell), 0.0f) : total[n.child[0]] + total[n.child[1]];
+  }
+
+  bool moved = false;
+  for (size_t i = 0; i < nodes_.size(); ++i) {
+    Node& n = nodes_[i];
+    if (n.leaf()) continue;
+    const float l = total[n.child[0]];
+    const float r = total[n.child[1]];
+    if (l + r <= 0) continue;
+    const float imbalance = (l - r) / (l + r);  // > 0: lower side heavier
+    if (std::fabs(imbalance) <= options.tolerance) continue;
+
+    const float lo = n.axis == Axis::kX ? n.rect.min_x : n.rect.min_z;
+    const float hi = n.axis == Axis::kX ? n.rect.max_x : n.rect.max_z;
+    // Assume load is spread evenly across each side: moving the split by
+    // half the imbalance times the heavy side's width evens it out.
+    const float heavy_width = imbalance > 0 ? n.split - lo : hi - n.split;
+    float step = -imbalance * 0.5f * heavy_width;
+    step = std::clamp(step, -options.max_step, options.max_step);
+
+    // Respect min_cell_size against this node's bounds and against nested
+    // splits on the same axis on either side.
+    float lower_lo = lo, lower_hi = lo;
+    descendant_splits(n.child[0], n.axis, lower_lo, lower_hi);
+    float upper_lo = hi, upper_hi = hi;
+    descendant_splits(n.child[1], n.axis, upper_lo, upper_hi);
+    const float min_split = std::max(lo, lower_hi) + options.min_cell_size;
+    const float max_split = std::min(hi, upper_lo) - options.min_cell_size;
+    if (min_split > max_split) continue;
+    const float next = std::clamp(n.split + step, min_split, max_split);
+    if (next == n.split) continue;
+    n.split = next;
+    update_rects(static_cast<int32_t>(i));
+    moved = true;
+  }
+  if (moved) ++version_;
+  return moved;
+}
+
+namespace {
+
+template <typename T>
+bool take(std::string_view& in, T& v) {
+  if (in.size() < sizeof(T)) return false;
+  std::memcpy(&v, in.data(), sizeof(T));
+  in.remove_prefix(sizeof(T));
+  return true;
+}
+
+}  // namespace
+
+// version u64, bounds 4 x f32, node count u32, then per node in order:
+// child0 i32, child1 i32, axis u8, split f32, cell u32.
+void CellLayout::encode(MessageBuffer& buf) const {
+  buf.append_pod(version_);
+  const CellRect b = nodes_.empty() ? CellRect{} : bounds();
+  buf.append_pod(b.min_x);
+  buf.append_pod(b.min_z);
+  buf.append_pod(b.max_x);
+  buf.append_pod(b.max_z);
+  buf.append_pod(static_cast<uint32_t>(nodes_.size()));
+  for (const Node& n : nodes_) {
+    buf.append_pod(n.child[0]);
+    buf.append_pod(n.child[1]);
+    buf.append_pod(static_cast<uint8_t>(n.axis));
+    buf.append_pod(n.split);
+    buf.append_pod(n.cell);
+  }
+}
+
+std::optional<CellLayout> CellLayout::decode(std::string_view in) {
+  CellLayout layout;
+  CellRect b;
+  uint32_t count = 0;
+  if (!take(in, layout.version_) || !take(in, b.min_x) || !take(in, b.min_z) ||
+      !take(in, b.max_x) || !take(in, b.max_z) || !take(in, count)) {
+    return std::nullopt;
+  }
+  if (count == 0 || count > 65536) return std::nullopt;
+  layout.nodes_.resize(count);
+  std::vector<bool> referenced(count, false);
+  for (uint32_t i = 0; i < count; ++i) {
+    Node& n = layout.nodes_[i];
+    uint8_t axis = 0;
+    if (!take(in, n.child[0]) || !take(in, n.child[1]) || !take(in, axis) ||
+        !take(in, n.split) || !take(in, n.cell)) {
+      return std::nullopt;
+    }
+    n.axis = axis ? Axis::kZ : Axis::kX;
+    // Both children or neither, each node referenced once and only from
+    // before it, so decoding bad input cannot build a cycle or a DAG.
+    const bool leaf = n.child[0] == kNone && n.child[1] == kNone;
+    const auto valid_child = [&](int32_t c) {
+      if (c <= static_cast<int32_t>(i) || c >= static_cast<int32_t>(count) || referenced[c]) {
+        return false;
+      }
+      referenced[c] = true;
+      return true;
+    };
+    if (!leaf && !(valid_child(n.child[0]) && valid_child(n.child[1]))) return std::nullopt;
+  }
+  layout.nodes_[0].rect = b;
+  layout.update_rects(0);
+  return layout;
+}
+
+}  // namespace kbs
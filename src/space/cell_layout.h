@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include "common/vec3.h"
+#include "net/message_buffer.h"
+
+namespace kbs {
+
+// Identifies a cell, and with it the cell-server process that owns it.
+using CellId = uint32_t;
+constexpr CellId kInvalidCellId = UINT32_MAX;
+
+// Axis-aligned region of the ground (x/z) plane.
+struct CellRect {
+  float min_x = 0;
+  float min_z = 0;
+  float max_x = 0;
+  float max_z = 0;
+
+  bool contains(Vec3 p) const {
+    return p.x >= min_x && p.x < max_x && p.z >= min_z && p.z < max_z;
+  }
+  // Squared distance from p to the nearest point of the rect (0 inside).
+  float distance_sq(Vec3 p) const;
+  CellRect expanded(float by) const { return {min_x - by, min_z - by, max_x + by, max_z + by}; }
+};
+
+struct RebalanceOptions {
+  // Load imbalance between the two sides of a split, as a fraction of
+  // their total, tolerated before the split moves.
+  float tolerance = 0.1f;
+  // Largest move of one split per rebalance() call, so entities migrate a
+  // strip at a time rather than all at once.
+  float max_step = 32;
+  // No cell is squeezed narrower than this.
+  float min_cell_size = 128;
+};
+
+// Partition of one space into cells: a binary tree of axis-aligned splits
+// whose leaves are cells (the BSP layout BigWorld popularised).  A layout is
+// small and versioned; the coordinator owns the authoritative copy,
+// rebalances it from per-cell load reports and broadcasts encode()d
+// snapshots that every cell server applies with CellSpace::set_layout().
+class CellLayout {
+ public:
+  enum class Axis : uint8_t { kX, kZ };
+
+  CellLayout() = default;
+  CellLayout(const CellRect& bounds, CellId root);
+
+  // Splits cell's region at coordinate at along axis; the upper half goes
+  // to new_cell.  Returns false if cell is unknown, new_cell already exists
+  // or at leaves either half narrower than min_size.
+  bool split(CellId cell, Axis axis, float at, CellId new_cell, float min_size = 0);
+
+  CellId cell_at(Vec3 pos) const;
+  std::optional<CellRect> rect_of(CellId cell) const;
+  // Every cell whose region lies within distance of pos, excluding none.
+  void cells_within(Vec3 pos, float distance, std::vector<CellId>& out) const;
+  void cells(std::vector<CellId>& out) const;
+
+  // Moves split lines towards the heavier side wherever the two sides'
+  // loads differ by more than the tolerance.  load(cell) is any additive
+  // measure (entity count, tick milliseconds).  Returns true and bumps
+  // version() when a boundary moved.
+  bool rebalance(const std::function<float(CellId)>& load, const RebalanceOptions& options = {});
+
+  uint64_t version() const { return version_; }
+  const CellRect& bounds() const { return nodes_.front().rect; }
+  bool empty() const { return nodes_.empty(); }
+
+  void encode(MessageBuffer& buf) const;
+  static std::optional<CellLayout> decode(std::string_view data);
+
+ private:
+  static constexpr int32_t kNone = -1;
+
+  struct Node {
+    int32_t child[2] = {kNone, kNone};  // lower / upper side; leaf if kNone
+    Axis axis = Axis::kX;
+    float split = 0;
+    CellId cell = kInvalidCellId;  // leaves only
+    CellRect rect;                 // derived from the splits above
+    bool leaf() const { return child[0] == kNone; }
+  };
+
+  int32_t leaf_of(CellId cell) const;
+  void update_rects(int32_t node);
+  // Tightest bound the descendants of node place on a split along axis.
+  void descendant_splits(int32_t node, Axis axis, float& lo, float& hi) const;
+
+  std::vector<Node> nodes_;  // children always follow their parent
+  uint64_t version_ = 0;
+};
+
+}  // namespace kbs
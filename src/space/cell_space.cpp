@@ -0,0 +1,316 @@
+#include "space/cell_space.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace kbs {
+
+namespace {
+
+template <typename T>
+bool take(std::string_view& in, T& v) {
+  if (in.size() < sizeof(T)) return false;
+  std::memcpy(&v, in.data(), sizeof(T));
+  in.remove_prefix(sizeof(T));
+  return true;
+}
+
+bool contains_sorted(const std::vector<CellId>& v, CellId c) {
+  return std::binary_search(v.begin(), v.end(), c);
+}
+
+}  // namespace
+
+CellSpace::CellSpace(CellId self, CellLayout layout, CellSpaceCallbacks callbacks,
+                     const CellSpaceOptions& options)
+    : self_(self),
+      layout_(std::move(layout)),
+      rect_(layout_.rect_of(self).value_or(CellRect{})),
+      cb_(std::move(callbacks)),
+      options_(options),
+      aoi_(options.aoi) {
+  // The destination of a handoff must already hold a ghost.
+  options_.ghost_distance = std::max(options_.ghost_distance, options_.handoff_margin);
+}
+
+void CellSpace::touch(EntityId id, Entry& e) {
+  if (e.dirty) return;
+  e.dirty = true;
+  touched_.push_back(id);
+}
+
+void CellSpace::add_real(EntityId id, Vec3 pos) {
+  auto [it, inserted] = entities_.try_emplace(id);
+  if (!inserted) return;
+  Entry& e = it->second;
+  e.pos = pos;
+  e.owner = self_;
+  e.real = true;
+  ++real_count_;
+  aoi_.add(id, pos);
+  touch(id, e);
+}
+
+void CellSpace::move_real(EntityId id, Vec3 pos) {
+  auto it = entities_.find(id);
+  if (it == entities_.end() || !it->second.real) return;
+  it->second.pos = pos;
+  aoi_.move(id, pos);
+  touch(id, it->second);
+}
+
+void CellSpace::mark_dirty(EntityId id) {
+  auto it = entities_.find(id);
+  if (it != entities_.end() && it->second.real) touch(id, it->second);
+}
+
+void CellSpace::remove_real(EntityId id) {
+  auto it = entities_.find(id);
+  if (it == entities_.end() || !it->second.real) return;
+  for (CellId c : it->second.ghosts) send_simple(c, kMsgGhostDestroy, id, nullptr, 0);
+  aoi_.remove(id);
+  entities_.erase(it);
+  --real_count_;
+}
+
+void CellSpace::set_layout(CellLayout layout) {
+  layout_ = std::move(layout);
+  rect_ = layout_.rect_of(self_).value_or(CellRect{});
+  layout_changed_ = true;
+}
+
+void CellSpace::update(std::vector<AoiEvent>& aoi_events) {
+  if (layout_changed_) {
+    layout_changed_ = false;
+    for (auto& [id, e] : entities_) {
+      if (e.real) touch(id, e);
+    }
+  }
+  // refresh_real() never adds to touched_, but migrations arriving from a
+  // send callback could, so iterate by index.
+  for (size_t i = 0; i < touched_.size(); ++i) {
+    const EntityId id = touched_[i];
+    auto it = entities_.find(id);
+    if (it == entities_.end()) continue;
+    it->second.dirty = false;
+    if (it->second.real) refresh_real(id, it->second);
+  }
+  touched_.clear();
+  aoi_.update(aoi_events);
+}
+
+void CellSpace::refresh_real(EntityId id, Entry& e) {
+  if (!rect_.expanded(options_.handoff_margin).contains(e.pos)) {
+    const CellId to = layout_.cell_at(e.pos);
+    if (to != self_ && to != kInvalidCellId) {
+      migrate(id, e, to);
+      return;
+    }
+  }
+
+  // Cells that should hold a ghost, and the wider set allowed to keep one.
+  std::vector<CellId>& want = scratch_;
+  want.clear();
+  layout_.cells_within(e.pos, options_.ghost_distance, want);
+  std::erase(want, self_);
+  std::sort(want.begin(), want.end());
+  std::vector<CellId> keep;
+  layout_.cells_within(e.pos, options_.ghost_distance + options_.ghost_hysteresis, keep);
+  std::sort(keep.begin(), keep.end());
+
+  // Existing ghosts that stay get the move and the delta; the rest go.
+  if (!e.ghosts.empty()) {
+    const std::string delta = cb_.state ? cb_.state(id, CellStateKind::kGhostDelta) : std::string();
+    std::vector<CellId> kept;
+    kept.reserve(e.ghosts.size());
+    for (CellId c : e.ghosts) {
+      if (contains_sorted(keep, c)) {
+        out_.clear();
+        const size_t token = out_.begin_frame(kMsgGhostUpdate);
+        out_.append_pod(id);
+        out_.append_pod(e.pos);
+        out_.append(delta);
+        out_.end_frame(token);
+        cb_.send(c, out_);
+        kept.push_back(c);
+      } else {
+        send_simple(c, kMsgGhostDestroy, id, nullptr, 0);
+      }
+    }
+    e.ghosts.swap(kept);
+  }
+  for (CellId c : want) {
+    if (contains_sorted(e.ghosts, c)) continue;
+    send_ghost_create(c, id, e);
+    e.ghosts.insert(std::lower_bound(e.ghosts.begin(), e.ghosts.end(), c), c);
+  }
+}
+
+void CellSpace::migrate(EntityId id, Entry& e, CellId to) {
+  const std::string state = cb_.state ? cb_.state(id, CellStateKind::kMigration) : std::string();
+  // Ghost holders the destination inherits: ours, minus itself, plus us
+  // (we keep a ghost until the new owner decides otherwise).
+  std::vector<CellId> holders;
+  holders.reserve(e.ghosts.size() + 1);
+  for (CellId c : e.ghosts) {
+    if (c != to) holders.push_back(c);
+  }
+  holders.push_back(self_);
+
+  out_.clear();
+  const size_t token = out_.begin_frame(kMsgMigrate);
+  out_.append_pod(id);
+  out_.append_pod(e.pos);
+  out_.append_pod(static_cast<uint16_t>(holders.size()));
+  for (CellId c : holders) out_.append_pod(c);
+  out_.append(state);
+  out_.end_frame(token);
+  cb_.send(to, out_);
+
+  e.real = false;
+  e.owner = to;
+  e.ghosts.clear();
+  --real_count_;
+  if (cb_.on_real_departed) cb_.on_real_departed(id, to);
+}
+
+void CellSpace::send_simple(CellId to, uint16_t msg_id, EntityId id, const void* extra,
+                            size_t extra_len) {
+  out_.clear();
+  const size_t token = out_.begin_frame(msg_id);
+  out_.append_pod(id);
+  if (extra_len > 0) out_.append(extra, extra_len);
+  out_.end_frame(token);
+  cb_.send(to, out_);
+}
+
+void CellSpace::send_ghost_create(CellId to, EntityId id, const Entry& e) {
+  const std::string state = cb_.state ? cb_.state(id, CellStateKind::kGhostFull) : std::string();
+  out_.clear();
+  const size_t token = out_.begin_frame(kMsgGhostCreate);
+  out_.append_pod(id);
+  out_.append_pod(self_);
+  out_.append_pod(e.pos);
+  out_.append(state);
+  out_.end_frame(token);
+  cb_.send(to, out_);
+}
+
+bool CellSpace::handle_frame(const Frame& frame) {
+  std::string_view body = frame.body;
+  EntityId id = kInvalidEntityId;
+  if (!take(body, id)) return false;
+  switch (frame.msg_id) {
+    case kMsgGhostCreate:
+      on_ghost_create(id, body);
+      return true;
+    case kMsgGhostUpdate:
+      on_ghost_update(id, body);
+      return true;
+    case kMsgGhostDestroy:
+      on_ghost_destroy(id);
+      return true;
+    case kMsgMigrate:
+      on_migrate(id, body);
+      return true;
+    case kMsgOwnerChanged:
+      on_owner_changed(id, body);
+      return true;
+    default:
+      return false;
+  }
+}
+
+void CellSpace::on_ghost_create(EntityId id, std::string_view body) {
+  CellId owner = kInvalidCellId;
+  Vec3 pos;
+  if (!take(body, owner) || !take(body, pos)) return;
+  auto [it, inserted] = entities_.try_emplace(id);
+  Entry& e = it->second;
+  if (!inserted && e.real) return;  // stale: the entity has since moved here
+  e.owner = owner;
+  e.pos = pos;
+  if (inserted) {
+    aoi_.add(id, pos);
+  } else {
+    aoi_.move(id, pos);
+  }
+  if (cb_.on_ghost_created) cb_.on_ghost_created(id, pos, body);
+}
+
+void CellSpace::on_ghost_update(EntityId id, std::string_view body) {
+  Vec3 pos;
+  if (!take(body, pos)) return;
+  auto it = entities_.find(id);
+  if (it == entities_.end() || it->second.real) return;
+  it->second.pos = pos;
+  aoi_.move(id, pos);
+  if (cb_.on_ghost_updated) cb_.on_ghost_updated(id, pos, body);
+}
+
+void CellSpace::on_ghost_destroy(EntityId id) {
+  auto it = entities_.find(id);
+  if (it == entities_.end() || it->second.real) return;
+  entities_.erase(it);
+  aoi_.remove(id);
+  if (cb_.on_ghost_destroyed) cb_.on_ghost_destroyed(id);
+}
+
+void CellSpace::on_migrate(EntityId id, std::string_view body) {
+  Vec3 pos;
+  uint16_t n = 0;
+  if (!take(body, pos) || !take(body, n) || body.size() < n * sizeof(CellId)) return;
+  std::vector<CellId> holders(n);
+  for (CellId& c : holders) take(body, c);
+
+  auto [it, inserted] = entities_.try_emplace(id);
+  Entry& e = it->second;
+  if (!inserted && e.real) return;
+  if (inserted) {
+    aoi_.add(id, pos);
+  } else {
+    aoi_.move(id, pos);  // promote the ghost we already had
+  }
+  e.pos = pos;
+  e.owner = self_;
+  e.real = true;
+  ++real_count_;
+  std::erase(holders, self_);
+  std::sort(holders.begin(), holders.end());
+  holders.erase(std::unique(holders.begin(), holders.end()), holders.end());
+  e.ghosts = std::move(holders);
+  for (CellId c : e.ghosts) send_simple(c, kMsgOwnerChanged, id, &self_, sizeof(self_));
+  if (cb_.on_real_arrived) cb_.on_real_arrived(id, pos, body);
+  // Next update() brings the ghost set in line with the new position.
+  touch(id, e);
+}
+
+void CellSpace::on_owner_changed(EntityId id, std::string_view body) {
+  CellId owner = kInvalidCellId;
+  if (!take(body, owner)) return;
+  auto it = entities_.find(id);
+  if (it != entities_.end() && !it->second.real) it->second.owner = owner;
+}
+
+bool CellSpace::is_real(EntityId id) const {
+  auto it = entities_.find(id);
+  return it != entities_.end() && it->second.real;
+}
+
+bool CellSpace::is_ghost(EntityId id) const {
+  auto it = entities_.find(id);
+  return it != entities_.end() && !it->second.real;
+}
+
+CellId CellSpace::owner_of(EntityId id) const {
+  auto it = entities_.find(id);
+  return it == entities_.end() ? kInvalidCellId : it->second.owner;
+}
+
+std::span<const CellId> CellSpace::ghost_cells(EntityId id) const {
+  auto it = entities_.find(id);
+  if (it == entities_.end()) return {};
+  return it->second.ghosts;
+}
+
+}  // namespace kbs
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "common/types.h"
+#include "common/vec3.h"
+#include "net/message_buffer.h"
+#include "space/aoi_grid.h"
+#include "space/cell_layout.h"
+
+namespace kbs {
+
+// Frame ids of the cell-to-cell protocol.
+constexpr uint16_t kMsgGhostCreate = 0x0201;
+constexpr uint16_t kMsgGhostUpdate = 0x0202;
+constexpr uint16_t kMsgGhostDestroy = 0x0203;
+constexpr uint16_t kMsgMigrate = 0x0204;
+constexpr uint16_t kMsgOwnerChanged = 0x0205;
+
+struct CellSpaceOptions {
+  // A real entity is ghosted onto every other cell within this distance,
+  // so entities near a boundary see across it.  Normally the AOI leave
+  // radius.
+  float ghost_distance = 55;
+  // Ghosts are torn down only beyond ghost_distance + ghost_hysteresis, and
+  // an entity migrates only once it is handoff_margin past its cell's
+  // edge, so walking along a boundary does not thrash.
+  float ghost_hysteresis = 5;
+  float handoff_margin = 4;
+  AoiGridOptions aoi;
+};
+
+// What a serialized entity blob is being requested for.
+enum class CellStateKind : uint8_t {
+  kGhostFull,   // everything a ghost needs, sent when it is created
+  kGhostDelta,  // changes since the last call, sent to existing ghosts
+  kMigration,   // the full server-side state, for a handoff
+};
+
+// Hooks into the game.  send is the transport (an RpcChannel::notify() or
+// raw frames to the cell server owning a CellId); the on_* callbacks report
+// entities appearing, disappearing or changing role on this cell.
+struct CellSpaceCallbacks {
+  std::function<void(CellId to, const MessageBuffer& frame)> send;
+  std::function<std::string(EntityId, CellStateKind)> state;
+
+  std::function<void(EntityId, Vec3, std::string_view state)> on_real_arrived;
+  std::function<void(EntityId, CellId new_owner)> on_real_departed;
+  std::function<void(EntityId, Vec3, std::string_view state)> on_ghost_created;
+  std::function<void(EntityId, Vec3, std::string_view delta)> on_ghost_updated;
+  std::function<void(EntityId)> on_ghost_destroyed;
+};
+
+// One cell server's share of a distributed space.
+//
+// The cell owns the real copy of every entity inside its region and keeps
+// read-only ghosts of reals that other cells own near its edges.  update()
+// drives the protocol each tick:
+//
+//  * a real within ghost_distance of another cell gets a ghost there
+//    (kMsgGhostCreate with kGhostFull state), which then receives its moves
+//    and property deltas (kMsgGhostUpdate) until it drifts away again;
+//  * a real that has crossed handoff_margin past the boundary migrates
+//    (kMsgMigrate with kMigration state and the list of cells holding its
+//    ghosts).  The destination normally already has a ghost, promotes it
+//    and tells the other ghost holders the new owner, so the handoff is a
+//    role change rather than a despawn/respawn.  The source keeps a ghost
+//    and forwards anything addressed to the entity to owner_of().
+//
+// Layout changes from rebalancing arrive through set_layout(); the next
+// update() migrates whatever now lies in another cell's region.  Reals and
+// ghosts are both indexed in aoi(), so AOI works across boundaries.
+// Single-threaded, like the rest of a cell's tick.
+class CellSpace {
+ public:
+  CellSpace(CellId self, CellLayout layout, CellSpaceCallbacks callbacks,
+            const CellSpaceOptions& options = {});
+
+  CellSpace(const CellSpace&) = delete;
+  CellSpace& operator=(const CellSpace&) = delete;
+
+  // Reals created on this cell (spawns, logins).
+  void add_real(EntityId id, Vec3 pos);
+  void move_real(EntityId id, Vec3 pos);
+  // Property changes without movement still need to reach the ghosts.
+  void mark_dirty(EntityId id);
+  // Destroys the real and every ghost it has.
+  void remove_real(EntityId id);
+
+  void set_layout(CellLayout layout);
+  const CellLayout& layout() const { return layout_; }
+
+  // Sends ghost creates/updates/destroys and migrations for everything that
+  // changed since the previous call, then resolves AOI.
+  void update(std::vector<AoiEvent>& aoi_events);
+
+  // Applies one cell-protocol frame from a peer; false if malformed or not
+  // a cell message.
+  bool handle_frame(const Frame& frame);
+
+  bool is_real(EntityId id) const;
+  bool is_ghost(EntityId id) const;
+  // This cell for reals, the owning cell for ghosts, kInvalidCellId if
+  // unknown.
+  CellId owner_of(EntityId id) const;
+  // Cells currently holding a ghost of real id.
+  std::span<const CellId> ghost_cells(EntityId id) const;
+
+  CellId self() const { return self_; }
+  size_t real_count() const { return real_count_; }
+  size_t ghost_count() const { return entities_.size() - real_count_; }
+  // Load figure for CellLayout::rebalance().
+  float load() const { return static_cast<float>(real_count_); }
+
+  AoiGrid& aoi() { return aoi_; }
+  const AoiGrid& aoi() const { return aoi_; }
+
+ private:
+  struct Entry {
+    Vec3 pos;
+    CellId owner = kInvalidCellId;
+    bool real = false;
+    bool dirty = false;
+    std::vector<CellId> ghosts;  // sorted; reals only
+  };
+
+  void touch(EntityId id, Entry& e);
+  void refresh_real(EntityId id, Entry& e);
+  void migrate(EntityId id, Entry& e, CellId to);
+  void send_simple(CellId to, uint16_t msg_id, EntityId id, const void* extra, size_t extra_len);
+  void send_ghost_create(CellId to, EntityId id, const Entry& e);
+
+  void on_ghost_create(EntityId id, std::string_view body);
+  void on_ghost_update(EntityId id, std::string_view body);
+  void on_ghost_destroy(EntityId id);
+  void on_migrate(EntityId id, std::string_view body);
+  void on_owner_changed(EntityId id, std::string_view body);
+
+  CellId self_;
+  CellLayout layout_;
+  CellRect rect_;
+  bool layout_changed_ = false;
+  CellSpaceCallbacks cb_;
+  CellSpaceOptions options_;
+  AoiGrid aoi_;
+  std::unordered_map<EntityId, Entry> entities_;
+  size_t real_count_ = 0;
+  std::vector<EntityId> touched_;
+  std::vector<CellId> scratch_;
+  MessageBuffer out_;
+};
+
+}  // namespace kbs
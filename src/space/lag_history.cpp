@@ -0,0 +1,203 @@
+#include "space/lag_history.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "metrics/metrics.h"
+
+namespace kbs {
+
+namespace {
+
+constexpr float kQuantizeSteps = 65535.0f;
+
+struct LagMetrics {
+  Counter& ok = metrics().counter("kbs_lag_rewinds_total", "Lag-compensated queries",
+                                  {{"result", "ok"}});
+  Counter& clamped = metrics().counter("kbs_lag_rewinds_total", "Lag-compensated queries",
+                                       {{"result", "clamped"}});
+  Histogram& depth_ms =
+      metrics().histogram("kbs_lag_rewind_ms", "How far behind the newest frame queries rewound",
+                          Histogram::exponential(10, 2, 8));
+};
+
+LagMetrics& lag_metrics() {
+  static LagMetrics m;
+  return m;
+}
+
+uint16_t quantize_axis(float v, float min, float inv_step) {
+  return static_cast<uint16_t>(std::round(std::clamp((v - min) * inv_step, 0.0f, kQuantizeSteps)));
+}
+
+float axis_step(float min, float max) { return std::max(max - min, 1e-3f) / kQuantizeSteps; }
+
+}  // namespace
+
+LagHistory::LagHistory(const LagHistoryOptions& options) : options_(options) {
+  min_ = Vec3{options_.min_x, options_.min_y, options_.min_z};
+  step_ = Vec3{axis_step(options_.min_x, options_.max_x), axis_step(options_.min_y, options_.max_y),
+               axis_step(options_.min_z, options_.max_z)};
+  inv_step_ = Vec3{1 / step_.x, 1 / step_.y, 1 / step_.z};
+  // One frame being built, plus enough committed ones that the oldest
+  // still brackets a time history_ms back.
+  const uint32_t tick = std::max<uint32_t>(options_.tick_ms, 1);
+  frames_.resize((options_.history_ms + tick - 1) / tick + 2);
+  lag_metrics();
+}
+
+void LagHistory::add(EntityId id, Vec3 pos) {
+  auto [it, inserted] = slot_of_.try_emplace(id, 0);
+  if (inserted) {
+    uint32_t slot;
+    if (!free_.empty()) {
+      slot = free_.back();
+      free_.pop_back();
+    } else {
+      slot = static_cast<uint32_t>(ids_.size());
+      ids_.push_back(kInvalidEntityId);
+      since_.push_back(kNotCommitted);
+      for (Frame& f : frames_) {
+        f.x.push_back(0);
+        f.y.push_back(0);
+        f.z.push_back(0);
+      }
+    }
+    it->second = slot;
+    ids_[slot] = id;
+    since_[slot] = kNotCommitted;
+    fresh_.push_back(slot);
+  }
+  set(id, pos);
+}
+
+void LagHistory::remove(EntityId id) {
+  auto it = slot_of_.find(id);
+  if (it == slot_of_.end()) return;
+  ids_[it->second] = kInvalidEntityId;
+  since_[it->second] = kNotCommitted;
+  free_.push_back(it->second);
+  slot_of_.erase(it);
+}
+
+bool LagHistory::set(EntityId id, Vec3 pos) {
+  auto it = slot_of_.find(id);
+  if (it == slot_of_.end()) return false;
+  Frame& f = frames_[head_];
+  f.x[it->second] = quantize_axis(pos.x, min_.x, inv_step_.x);
+  f.y[it->second] = quantize_axis(pos.y, min_.y, inv_step_.y);
+  f.z[it->second] = quantize_axis(pos.z, min_.z, inv_step_.z);
+  return true;
+}
+
+void LagHistory::commit(uint64_t time_ms) {
+  if (count_ > 0) time_ms = std::max(time_ms, newest_ms());
+  frames_[head_].time_ms = time_ms;
+  for (uint32_t slot : fresh_) {
+    if (ids_[slot] != kInvalidEntityId && since_[slot] == kNotCommitted) since_[slot] = time_ms;
+  }
+  fresh_.clear();
+  const Frame& sealed = frames_[head_];
+  head_ = (head_ + 1) % frames_.size();
+  count_ = std::min(count_ + 1, frames_.size() - 1);
+  Frame& next = frames_[head_];
+  std::copy(sealed.x.begin(), sealed.x.end(), next.x.begin());
+  std::copy(sealed.y.begin(), sealed.y.end(), next.y.begin());
+  std::copy(sealed.z.begin(), sealed.z.end(), next.z.begin());
+  ++stats_.commits;
+}
+
+const LagHistory::Frame& LagHistory::committed(size_t i) const {
+  return frames_[(head_ + frames_.size() - count_ + i) % frames_.size()];
+}
+
+uint64_t LagHistory::oldest_ms() const { return count_ == 0 ? 0 : committed(0).time_ms; }
+
+uint64_t LagHistory::newest_ms() const { return count_ == 0 ? 0 : committed(count_ - 1).time_ms; }
+
+bool LagHistory::bracket(uint64_t time_ms, Bracket& out) const {
+  if (count_ == 0) return false;
+  LagMetrics& m = lag_metrics();
+  ++stats_.rewinds;
+  const Frame& newest = committed(count_ - 1);
+  const Frame& oldest = committed(0);
+  if (time_ms >= newest.time_ms) {
+    out = Bracket{&newest, &newest, 0};
+    m.ok.inc();
+    m.depth_ms.observe(0);
+    return true;
+  }
+  m.depth_ms.observe(static_cast<double>(newest.time_ms - time_ms));
+  const uint64_t floor = newest.time_ms > options_.history_ms
+                             ? newest.time_ms - options_.history_ms
+                             : 0;
+  if (time_ms < floor || time_ms < oldest.time_ms) {
+    ++stats_.clamped;
+    m.clamped.inc();
+  } else {
+    m.ok.inc();
+  }
+  time_ms = std::max(time_ms, floor);
+  if (time_ms <= oldest.time_ms) {
+    out = Bracket{&oldest, &oldest, 0};
+    return true;
+  }
+  // First frame at or after time_ms; frame 0 is before it.
+  size_t lo = 1;
+  size_t hi = count_ - 1;
+  while (lo < hi) {
+    const size_t mid = (lo + hi) / 2;
+    if (committed(mid).time_ms < time_ms) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  const Frame& a = committed(lo - 1);
+  const Frame& b = committed(lo);
+  const float span = static_cast<float>(b.time_ms - a.time_ms);
+  out = Bracket{&a, &b, static_cast<float>(time_ms - a.time_ms) / span};
+  return true;
+}
+
+bool LagHistory::position_at(EntityId id, uint64_t time_ms, Vec3& out) const {
+  auto it = slot_of_.find(id);
+  if (it == slot_of_.end()) return false;
+  Bracket br;
+  if (!bracket(time_ms, br)) return false;
+  const uint32_t s = it->second;
+  if (since_[s] > br.b->time_ms) return false;
+  // Spawned between the two frames: no earlier position to blend with.
+  const Frame& a = since_[s] > br.a->time_ms ? *br.b : *br.a;
+  const float t = br.t;
+  out = Vec3{min_.x + (a.x[s] + (br.b->x[s] - a.x[s]) * t) * step_.x,
+             min_.y + (a.y[s] + (br.b->y[s] - a.y[s]) * t) * step_.y,
+             min_.z + (a.z[s] + (br.b->z[s] - a.z[s]) * t) * step_.z};
+  return true;
+}
+
+size_t LagHistory::query_radius_at(uint64_t time_ms, Vec3 center, float radius,
+                                   std::vector<EntityId>& out) const {
+  Bracket br;
+  if (!bracket(time_ms, br)) return 0;
+  const Frame& a = *br.a;
+  const Frame& b = *br.b;
+  const float t = br.t;
+  // Compare in quantized units, scaled back per axis.
+  const float cx = (center.x - min_.x) * inv_step_.x;
+  const float cz = (center.z - min_.z) * inv_step_.z;
+  const float r2 = radius * radius;
+  const size_t before = out.size();
+  for (size_t s = 0; s < ids_.size(); ++s) {
+    const uint64_t since = since_[s];
+    if (since > b.time_ms) continue;  // free, or not yet born
+    const float ax = since > a.time_ms ? b.x[s] : a.x[s];
+    const float az = since > a.time_ms ? b.z[s] : a.z[s];
+    const float dx = (ax + (b.x[s] - ax) * t - cx) * step_.x;
+    const float dz = (az + (b.z[s] - az) * t - cz) * step_.z;
+    if (dx * dx + dz * dz <= r2) out.push_back(ids_[s]);
+  }
+  return out.size() - before;
+}
+
+}  // namespace kbs
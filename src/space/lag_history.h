@@ -0,0 +1,129 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "common/types.h"
+#include "common/vec3.h"
+
+namespace kbs {
+
+struct LagHistoryOptions {
+  // Bounds of the space; positions are stored as 16-bit fixed point across
+  // them and clamped into them.  The step is extent / 65535 per axis, ~6 cm
+  // on the ground and ~1.6 cm vertically with these defaults; a cell server
+  // should pass its own region so the step stays small on a large world.
+  float min_x = -2048;
+  float min_y = -512;
+  float min_z = -2048;
+  float max_x = 2048;
+  float max_y = 512;
+  float max_z = 2048;
+  // How far back a client may rewind.  Older timestamps are clamped to the
+  // oldest frame, so a client cannot claim arbitrary lag to hit things that
+  // have long since moved away.
+  uint32_t history_ms = 1000;
+  // Expected commit interval; sizes the ring to cover history_ms.
+  uint32_t tick_ms = 50;
+};
+
+struct LagHistoryStats {
+  uint64_t commits = 0;
+  uint64_t rewinds = 0;  // queries answered from the history
+  uint64_t clamped = 0;  // of which asked for a time older than the ring
+};
+
+// Recent transforms of every entity in one space, for server-side lag
+// compensation.
+//
+// A client aims at what it sees, which is the server's state from one RTT
+// and its interpolation delay ago.  Hit validation for a skill cast
+// therefore rewinds to the time the client saw -- normally the tick it
+// echoes in the cast request, minus its interpolation delay -- and tests
+// against where targets were then, not where they are now.
+//
+// Each tick the game set()s the positions of entities that moved and then
+// commit()s the frame.  Frames live in a ring covering history_ms, and each
+// is a structure of arrays: one u16 column per axis, indexed by a slot the
+// entity keeps for its lifetime, quantized across the space's bounds.  An
+// entity costs 6 bytes per frame, so a second at 20 Hz for 5000 entities is
+// ~630 KB, and commit() is three column copies rather than a snapshot of
+// the world.  Entities that did not move need no set(); their previous
+// position carries forward.
+//
+// A rewind finds the two frames bracketing the time by binary search and
+// interpolates between them.  position_at() is O(1) after that;
+// query_radius_at() is a linear pass over the two frames' columns, which
+// for a few thousand entities takes microseconds -- cheap enough for every
+// cast, and with no allocation beyond the output vector.
+//
+// An entity added after the requested time is not found at it; a removed
+// entity is forgotten immediately.  Single-threaded, like the rest of a
+// space's tick.
+class LagHistory {
+ public:
+  explicit LagHistory(const LagHistoryOptions& options = {});
+
+  LagHistory(const LagHistory&) = delete;
+  LagHistory& operator=(const LagHistory&) = delete;
+
+  // Starts tracking id at pos; it enters the history with the next commit.
+  void add(EntityId id, Vec3 pos);
+  void remove(EntityId id);
+  // Position of id for the frame being built.  false if id is not tracked.
+  bool set(EntityId id, Vec3 pos);
+  // Seals the frame being built at time_ms (the tick's server time,
+  // non-decreasing) and starts the next one from a copy of it.
+  void commit(uint64_t time_ms);
+
+  // Where id was at time_ms, interpolated between frames.  Times after the
+  // newest frame answer with the newest; times older than the history are
+  // clamped to the oldest.  false if id is unknown or did not exist then.
+  bool position_at(EntityId id, uint64_t time_ms, Vec3& out) const;
+  // Appends every entity within radius of center on the x/z plane at
+  // time_ms; returns how many were appended.
+  size_t query_radius_at(uint64_t time_ms, Vec3 center, float radius,
+                         std::vector<EntityId>& out) const;
+
+  // Server time of the oldest / newest committed frame; 0 before the first
+  // commit.
+  uint64_t oldest_ms() const;
+  uint64_t newest_ms() const;
+  size_t size() const { return slot_of_.size(); }
+  LagHistoryStats stats() const { return stats_; }
+
+ private:
+  struct Frame {
+    uint64_t time_ms = 0;
+    std::vector<uint16_t> x, y, z;  // by slot
+  };
+  // Frames a and b around a time, with b weighted by t.
+  struct Bracket {
+    const Frame* a;
+    const Frame* b;
+    float t;
+  };
+
+  static constexpr uint64_t kNotCommitted = ~uint64_t{0};
+
+  bool bracket(uint64_t time_ms, Bracket& out) const;
+  const Frame& committed(size_t i) const;  // 0 = oldest
+
+  LagHistoryOptions options_;
+  Vec3 min_;
+  Vec3 step_;  // metres per quantization step, by axis
+  Vec3 inv_step_;
+  std::vector<Frame> frames_;  // ring; frames_[head_] is being built
+  size_t head_ = 0;
+  size_t count_ = 0;  // committed frames
+  std::unordered_map<EntityId, uint32_t> slot_of_;
+  std::vector<EntityId> ids_;    // by slot; kInvalidEntityId when free
+  std::vector<uint64_t> since_;  // by slot: time of the first frame holding it
+  std::vector<uint32_t> free_;
+  std::vector<uint32_t> fresh_;  // slots added since the last commit
+  mutable LagHistoryStats stats_;
+};
+
+}  // namespace kbs
@@ -0,0 +1,128 @@
+#include "space/update_scheduler.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace kbs {
+
+namespace {
+
+constexpr float kQuantizeSteps = 32767.0f;
+
+int16_t quantize_axis(float v, float range) {
+  const float q = std::round(std::clamp(v / range, -1.0f, 1.0f) * kQuantizeSteps);
+  return static_cast<int16_t>(q);
+}
+
+}  // namespace
+
+QuantizedVec3 quantize_relative(Vec3 pos, Vec3 origin, float range) {
+  const Vec3 d = pos - origin;
+  return {quantize_axis(d.x, range), quantize_axis(d.y, range), quantize_axis(d.z, range)};
+}
+
+Vec3 dequantize_relative(QuantizedVec3 q, Vec3 origin, float range) {
+  const float s = range / kQuantizeSteps;
+  return origin + Vec3{q.x * s, q.y * s, q.z * s};
+}
+
+UpdateScheduler::UpdateScheduler(const UpdateSchedulerOptions& options) : options_(options) {
+  options_.max_interval = std::max<uint32_t>(options_.max_interval, 1);
+  options_.far_distance = std::max(options_.far_distance, options_.near_distance);
+  credit_ = static_cast<int64_t>(options_.bytes_per_tick);
+}
+
+UpdateScheduler::Entry* UpdateScheduler::find(EntityId id) {
+  auto it = index_.find(id);
+  return it == index_.end() ? nullptr : &entries_[it->second];
+}
+
+void UpdateScheduler::add(EntityId id) {
+  auto [it, inserted] = index_.try_emplace(id, static_cast<uint32_t>(entries_.size()));
+  if (!inserted) return;
+  Entry e;
+  e.id = id;
+  entries_.push_back(e);
+}
+
+void UpdateScheduler::remove(EntityId id) {
+  auto it = index_.find(id);
+  if (it == index_.end()) return;
+  const uint32_t idx = it->second;
+  index_.erase(it);
+  if (idx != entries_.size() - 1) {
+    entries_[idx] = entries_.back();
+    index_[entries_[idx].id] = idx;
+  }
+  entries_.pop_back();
+}
+
+void UpdateScheduler::mark_changed(EntityId id, uint64_t fields) {
+  if (Entry* e = find(id)) e->fields |= fields;
+}
+
+void UpdateScheduler::set_party(EntityId id, bool in_party) {
+  if (Entry* e = find(id)) e->in_party = in_party;
+}
+
+void UpdateScheduler::set_threat(EntityId id, float threat) {
+  if (Entry* e = find(id)) e->threat = std::max(threat, 0.0f);
+}
+
+void UpdateScheduler::begin_tick() {
+  candidates_.clear();
+  pending_this_tick_ = 0;
+  sent_this_tick_ = 0;
+  // Token bucket: debt from an overshooting update is paid back first.
+  credit_ = std::min(credit_ + static_cast<int64_t>(options_.bytes_per_tick),
+                     static_cast<int64_t>(std::max(options_.burst_bytes, options_.bytes_per_tick)));
+}
+
+void UpdateScheduler::consider(uint32_t index, float distance_sq) {
+  Entry& e = entries_[index];
+  ++pending_this_tick_;
+
+  const float d = std::sqrt(distance_sq);
+  const float span = options_.far_distance - options_.near_distance;
+  const float t = span > 0 ? std::clamp((d - options_.near_distance) / span, 0.0f, 1.0f)
+                           : (d > options_.near_distance ? 1.0f : 0.0f);
+  const float floor = 1.0f / static_cast<float>(options_.max_interval);
+  float relevance = 1.0f - t * (1.0f - floor);
+  if (e.in_party) relevance = std::max(relevance, options_.party_weight);
+  relevance += e.threat * options_.threat_weight;
+
+  e.priority += relevance;
+  // Spawns go out as soon as budget allows: the client has nothing to show.
+  if (e.spawn) {
+    candidates_.push_back({e.priority + 1.0f, index, UpdateLod::kFull});
+    return;
+  }
+  const uint32_t interval =
+      relevance >= 1.0f ? 1 : static_cast<uint32_t>(std::ceil(1.0f / relevance));
+  if (e.waited < interval) return;
+  const bool important = e.in_party || e.threat > 0;
+  const UpdateLod lod =
+      !important && d > options_.full_lod_distance ? UpdateLod::kReduced : UpdateLod::kFull;
+  candidates_.push_back({e.priority, index, lod});
+}
+
+void UpdateScheduler::select() {
+  std::sort(candidates_.begin(), candidates_.end(),
+            [](const Candidate& a, const Candidate& b) { return a.priority > b.priority; });
+}
+
+void UpdateScheduler::mark_sent(Entry& e) {
+  e.fields = 0;
+  e.spawn = false;
+  e.priority = 0;
+  e.waited = 0;
+  ++sent_this_tick_;
+}
+
+void UpdateScheduler::end_tick(size_t bytes) {
+  stats_.sent += sent_this_tick_;
+  stats_.bytes += bytes;
+  stats_.deferred += pending_this_tick_ - sent_this_tick_;
+}
+
+}  // namespace kbs
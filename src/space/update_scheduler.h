@@ -0,0 +1,162 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "common/types.h"
+#include "common/vec3.h"
+#include "entity/wire_codec.h"
+
+namespace kbs {
+
+// Position as 16-bit fixed point relative to an origin (normally the
+// viewing client), for entities far enough away that centimetre accuracy
+// is wasted.  With range 64 the step is ~2 mm; everything outside
+// [-range, range] on an axis is clamped.
+struct QuantizedVec3 {
+  int16_t x = 0;
+  int16_t y = 0;
+  int16_t z = 0;
+};
+
+template <>
+struct WireCodec<QuantizedVec3> : RawWireCodec<QuantizedVec3> {};
+
+QuantizedVec3 quantize_relative(Vec3 pos, Vec3 origin, float range);
+Vec3 dequantize_relative(QuantizedVec3 q, Vec3 origin, float range);
+
+// Precision an update should be encoded at.
+enum class UpdateLod : uint8_t {
+  kFull,     // float position, every dirty field
+  kReduced,  // QuantizedVec3 position; cosmetic fields may be dropped
+};
+
+struct UpdateSchedulerOptions {
+  // Steady-state bytes the client may be sent per tick, and the most that
+  // unspent budget may accumulate to for a burst (e.g. a zone-in).
+  size_t bytes_per_tick = 1024;
+  size_t burst_bytes = 8192;
+  // Relevance falls from 1 at near_distance to 1 / max_interval at
+  // far_distance (normally the AOI leave radius), and an entity is
+  // considered at most every 1 / relevance ticks.
+  float near_distance = 10;
+  float far_distance = 55;
+  uint32_t max_interval = 8;
+  // Party members and entities threatening the client stay at full rate.
+  // Threat is game-defined; each unit adds threat_weight to relevance.
+  float party_weight = 1;
+  float threat_weight = 0.25f;
+  // Beyond this distance, and unless in the party or threatening, updates
+  // are sent at UpdateLod::kReduced.
+  float full_lod_distance = 20;
+};
+
+// One update the scheduler picked for this tick.  fields accumulates every
+// change since the client last heard about the entity, so a delta skipped
+// on earlier ticks is not lost.
+struct ScheduledUpdate {
+  EntityId id;
+  uint64_t fields;
+  UpdateLod lod;
+  bool spawn;  // first update since add(): send the full state
+};
+
+struct UpdateSchedulerStats {
+  uint64_t sent = 0;
+  uint64_t bytes = 0;
+  // Entities with pending changes left for a later tick, by budget or by
+  // their update interval.
+  uint64_t deferred = 0;
+};
+
+// Per-client priority scheduler for entity updates.
+//
+// Instead of encoding a delta for every visible entity every tick, the
+// game ORs each change into the scheduler of every client watching the
+// entity (mark_changed(), a few instructions) and once a tick lets run()
+// pick what to send.  Every entity with pending changes accrues priority
+// equal to its relevance each tick it waits; run() hands out updates in
+// priority order until the client's byte budget is spent, and the rest
+// keep accruing, so distant entities still get through, just less often.
+// Only the updates picked are ever encoded.
+//
+// One instance per client connection, driven from the tick thread.
+class UpdateScheduler {
+ public:
+  explicit UpdateScheduler(const UpdateSchedulerOptions& options = {});
+
+  // AOI enter/leave for this client.
+  void add(EntityId id);
+  void remove(EntityId id);
+  bool contains(EntityId id) const { return index_.count(id) != 0; }
+  size_t size() const { return entries_.size(); }
+
+  void mark_changed(EntityId id, uint64_t fields);
+  void set_party(EntityId id, bool in_party);
+  void set_threat(EntityId id, float threat);
+
+  // Picks this tick's updates for a client at viewer.  position(id) -> Vec3
+  // gives each tracked entity's position; write(const ScheduledUpdate&)
+  // encodes one update into the client's send buffer and returns the bytes
+  // it wrote (0 if it wrote nothing).  Returns the bytes written.
+  template <typename PositionFn, typename WriteFn>
+  size_t run(Vec3 viewer, PositionFn&& position, WriteFn&& write) {
+    begin_tick();
+    for (uint32_t i = 0; i < entries_.size(); ++i) {
+      Entry& e = entries_[i];
+      ++e.waited;
+      if (e.pending()) consider(i, distance_sq_xz(viewer, position(e.id)));
+    }
+    select();
+    size_t total = 0;
+    for (const Candidate& c : candidates_) {
+      if (credit_ <= 0) break;
+      Entry& e = entries_[c.index];
+      const size_t n = write(ScheduledUpdate{e.id, e.fields, c.lod, e.spawn});
+      credit_ -= static_cast<int64_t>(n);
+      total += n;
+      mark_sent(e);
+    }
+    end_tick(total);
+    return total;
+  }
+
+  const UpdateSchedulerStats& stats() const { return stats_; }
+
+ private:
+  struct Entry {
+    EntityId id;
+    uint64_t fields = 0;
+    float priority = 0;   // accrued while waiting with pending changes
+    uint32_t waited = 0;  // ticks since last sent
+    float threat = 0;
+    bool in_party = false;
+    bool spawn = true;
+    bool pending() const { return spawn || fields != 0; }
+  };
+  struct Candidate {
+    float priority;
+    uint32_t index;
+    UpdateLod lod;
+  };
+
+  Entry* find(EntityId id);
+  void begin_tick();
+  void consider(uint32_t index, float distance_sq);
+  void select();
+  void mark_sent(Entry& e);
+  void end_tick(size_t bytes);
+
+  UpdateSchedulerOptions options_;
+  std::vector<Entry> entries_;
+  std::unordered_map<EntityId, uint32_t> index_;
+  std::vector<Candidate> candidates_;
+  int64_t credit_ = 0;
+  uint32_t pending_this_tick_ = 0;
+  uint32_t sent_this_tick_ = 0;
+  UpdateSchedulerStats stats_;
+};
+
+}  // namespace kbs
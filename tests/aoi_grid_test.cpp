@@ -0,0 +1,126 @@
+#include "space/aoi_grid.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <map>
+#include <random>
+#include <set>
+#include <utility>
+#include <vector>
+
+namespace kbs {
+namespace {
+
+using Pair = std::pair<EntityId, EntityId>;
+
+AoiGridOptions small_world() {
+  AoiGridOptions o;
+  o.min_x = o.min_z = -200;
+  o.max_x = o.max_z = 200;
+  o.view_radius = 50;
+  o.hysteresis = 5;
+  return o;
+}
+
+// Events of one update as (watcher, target) sets.
+struct Diff {
+  std::set<Pair> enter;
+  std::set<Pair> leave;
+};
+
+Diff run(AoiGrid& grid) {
+  std::vector<AoiEvent> events;
+  grid.update(events);
+  Diff d;
+  for (const AoiEvent& e : events) {
+    auto& set = e.type == AoiEventType::kEnter ? d.enter : d.leave;
+    EXPECT_TRUE(set.insert({e.watcher, e.target}).second) << "duplicate event";
+  }
+  return d;
+}
+
+TEST(AoiGrid, EnterLeaveWithHysteresis) {
+  AoiGrid grid(small_world());
+  grid.add(1, {0, 0, 0});
+  grid.add(2, {40, 0, 0});
+  grid.add(3, {52, 0, 0});  // in the band: not seen yet
+  Diff d = run(grid);
+  EXPECT_EQ(d.enter, (std::set<Pair>{{1, 2}, {2, 1}, {2, 3}, {3, 2}}));
+  EXPECT_EQ(grid.neighbor_count(1), 1u);
+
+  grid.move(2, {53, 0, 0});  // still within view + hysteresis of 1
+  d = run(grid);
+  EXPECT_TRUE(d.enter.empty());
+  EXPECT_TRUE(d.leave.empty());
+  grid.move(2, {56, 0, 0});
+  d = run(grid);
+  EXPECT_EQ(d.leave, (std::set<Pair>{{1, 2}, {2, 1}}));
+
+  grid.remove(3);
+  d = run(grid);
+  EXPECT_EQ(d.leave, (std::set<Pair>{{2, 3}, {3, 2}}));
+  EXPECT_FALSE(grid.contains(3));
+  std::vector<EntityId> near;
+  grid.query_radius({50, 0, 0}, 10, near);
+  EXPECT_EQ(near, std::vector<EntityId>{2});
+}
+
+// Random walkers against a brute-force model of the same rule: a pair
+// touched by a mover becomes visible within view_radius, invisible beyond
+// view_radius + hysteresis, and keeps its state in between.
+TEST(AoiGrid, MatchesBruteForceUnderRandomMoves) {
+  const AoiGridOptions o = small_world();
+  AoiGrid grid(o);
+  std::mt19937 rng(3);
+  std::uniform_real_distribution<float> coord(-190, 190);
+  std::uniform_real_distribution<float> step(-15, 15);
+  std::map<EntityId, Vec3> pos;
+  std::set<Pair> visible;
+  for (EntityId id = 1; id <= 60; ++id) pos[id] = {coord(rng), 0, coord(rng)};
+  for (auto& [id, p] : pos) grid.add(id, p);
+
+  const float enter = o.view_radius * o.view_radius;
+  const float leave = (o.view_radius + o.hysteresis) * (o.view_radius + o.hysteresis);
+  std::set<EntityId> moved;
+  for (auto& [id, p] : pos) moved.insert(id);
+  for (int tick = 0; tick < 50; ++tick) {
+    Diff expected;
+    for (auto& [a, pa] : pos) {
+      for (auto& [b, pb] : pos) {
+        if (a == b || (!moved.count(a) && !moved.count(b))) continue;
+        const float dx = pa.x - pb.x;
+        const float dz = pa.z - pb.z;
+        const float d2 = dx * dx + dz * dz;
+        const bool was = visible.count({a, b}) != 0;
+        if (!was && d2 <= enter) expected.enter.insert({a, b});
+        if (was && d2 > leave) expected.leave.insert({a, b});
+      }
+    }
+    const Diff got = run(grid);
+    ASSERT_EQ(got.enter, expected.enter) << "tick " << tick;
+    ASSERT_EQ(got.leave, expected.leave) << "tick " << tick;
+    for (const Pair& p : got.enter) visible.insert(p);
+    for (const Pair& p : got.leave) visible.erase(p);
+    for (auto& [id, p] : pos) {
+      size_t n = 0;
+      grid.for_each_neighbor(id, [&](EntityId other) {
+        EXPECT_TRUE(visible.count({id, other}));
+        ++n;
+      });
+      EXPECT_EQ(n, grid.neighbor_count(id));
+    }
+
+    moved.clear();
+    for (auto& [id, p] : pos) {
+      if (rng() % 3 != 0) continue;
+      p.x = std::clamp(p.x + step(rng), -190.0f, 190.0f);
+      p.z = std::clamp(p.z + step(rng), -190.0f, 190.0f);
+      grid.move(id, p);
+      moved.insert(id);
+    }
+  }
+}
+
+}  // namespace
+}  // namespace kbs
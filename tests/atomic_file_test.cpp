@@ -0,0 +1,50 @@
+#include "common/atomic_file.h"
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <system_error>
+
+namespace kbs {
+namespace {
+
+namespace fs = std::filesystem;
+
+std::string slurp(const fs::path& p) {
+  std::ifstream in(p, std::ios::binary);
+  std::stringstream ss;
+  ss << in.rdbuf();
+  return ss.str();
+}
+
+TEST(AtomicFile, ReplacesContentAndLeavesNoTemporary) {
+  const fs::path dir = fs::temp_directory_path() / ("kbs_atomic_" + std::to_string(::getpid()));
+  fs::remove_all(dir);
+  fs::create_directories(dir);
+  const std::string path = (dir / "f.bin").string();
+
+  write_file_atomic(path, "first");
+  EXPECT_EQ(slurp(path), "first");
+  std::ifstream held(path);  // an open reader keeps the old inode
+  write_file_atomic(path, std::string(100000, 'z'));
+  EXPECT_EQ(slurp(path), std::string(100000, 'z'));
+  std::string old;
+  held >> old;
+  EXPECT_EQ(old, "first");
+  EXPECT_FALSE(fs::exists(path + ".tmp"));
+
+  // A directory where the file should go: the rename fails, the
+  // temporary is cleaned up and the error carries errno.
+  fs::create_directories(dir / "taken" / "x");
+  EXPECT_THROW(write_file_atomic((dir / "taken").string(), "data"), std::system_error);
+  EXPECT_FALSE(fs::exists(dir / "taken.tmp"));
+  EXPECT_THROW(write_file_atomic((dir / "missing" / "f").string(), "data"), std::system_error);
+  fs::remove_all(dir);
+}
+
+}  // namespace
+}  // namespace kbs
@@ -0,0 +1,204 @@
+#include "data/data_file.h"
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "common/atomic_file.h"
+
+namespace kbs {
+namespace {
+
+namespace fs = std::filesystem;
+
+struct ItemRow {
+  static constexpr std::string_view kTable = "items";
+  static constexpr std::string_view kSchema = "id:u32,name:str,price:i32";
+  uint32_t id;
+  DataString name;
+  int32_t price;
+};
+
+struct NpcRow {
+  static constexpr std::string_view kTable = "npcs";
+  static constexpr std::string_view kSchema = "id:u64,level:u16";
+  uint64_t id;
+  uint16_t level;
+};
+
+// Same table as ItemRow, built against an older layout.
+struct OldItemRow {
+  static constexpr std::string_view kTable = "items";
+  static constexpr std::string_view kSchema = "id:u32,name:str";
+  uint32_t id;
+  DataString name;
+  int32_t price;
+};
+
+// Not in the sample file.
+struct QuestRow {
+  static constexpr std::string_view kTable = "quests";
+  static constexpr std::string_view kSchema = "id:u32";
+  uint32_t id;
+};
+
+// Byte offsets into the format, for corrupting files.
+constexpr size_t kFileSizeOffset = offsetof(DataFileHeader, file_size);
+constexpr size_t kFirstTable = sizeof(DataFileHeader);
+constexpr size_t kRowCountOffset = kFirstTable + offsetof(DataTableEntry, row_count);
+
+class DataFileTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    const auto* info = ::testing::UnitTest::GetInstance()->current_test_info();
+    dir_ = fs::temp_directory_path() /
+           ("kbs_data_" + std::to_string(::getpid()) + "_" + info->name());
+    fs::remove_all(dir_);
+    fs::create_directories(dir_);
+  }
+  void TearDown() override { fs::remove_all(dir_); }
+
+  std::string path(const std::string& name) const { return (dir_ / name).string(); }
+
+  // Items 1..3 (dense, added out of order) and three sparse NPCs.
+  static DataFileWriter sample(uint64_t version) {
+    DataFileWriter w(version);
+    const std::vector<ItemRow> items = {
+        {3, w.intern("shield"), 30}, {1, w.intern("sword"), 10}, {2, w.intern("sword"), 20}};
+    w.add_table(std::span<const ItemRow>(items), [](const ItemRow& r) { return r.id; });
+    const std::vector<NpcRow> npcs = {{500, 50}, {7, 1}, {10, 5}};
+    w.add_table(std::span<const NpcRow>(npcs), [](const NpcRow& r) { return r.id; });
+    return w;
+  }
+
+  // Opening path throws std::runtime_error mentioning what.
+  static void expect_malformed(const std::string& path, bool verify, const std::string& what) {
+    try {
+      DataFile::open(path, verify);
+      ADD_FAILURE() << "opened " << path;
+    } catch (const std::runtime_error& e) {
+      EXPECT_NE(std::string(e.what()).find(what), std::string::npos) << e.what();
+    }
+  }
+
+  fs::path dir_;
+};
+
+TEST_F(DataFileTest, LooksUpDenseAndSparseTables) {
+  sample(7).write(path("d.kbd"));
+  const std::shared_ptr<const DataFile> f = DataFile::open(path("d.kbd"));
+  EXPECT_EQ(f->version(), 7u);
+  ASSERT_EQ(f->tables().size(), 2u);
+
+  const DataTable<ItemRow> items = f->table<ItemRow>();
+  ASSERT_EQ(items.size(), 3u);
+  EXPECT_EQ(f->find_table("items")->flags & DataTableEntry::kDenseIds, DataTableEntry::kDenseIds);
+  EXPECT_EQ(items.ids()[0], 1u);
+  ASSERT_NE(items.find(2), nullptr);
+  EXPECT_EQ(items.find(2)->price, 20);
+  EXPECT_EQ(f->str(items.find(3)->name), "shield");
+  // Interned strings share one slice of the pool.
+  EXPECT_EQ(items.find(1)->name.offset, items.find(2)->name.offset);
+  EXPECT_EQ(items.find(0), nullptr);
+  EXPECT_EQ(items.find(4), nullptr);
+
+  const DataTable<NpcRow> npcs = f->table<NpcRow>();
+  EXPECT_EQ(f->find_table("npcs")->flags & DataTableEntry::kDenseIds, 0u);
+  ASSERT_NE(npcs.find(500), nullptr);
+  EXPECT_EQ(npcs.find(500)->level, 50);
+  EXPECT_EQ(npcs.find(10)->level, 5);
+  EXPECT_EQ(npcs.find(8), nullptr);
+  EXPECT_EQ(npcs.find(501), nullptr);
+
+  EXPECT_TRUE(f->str(DataString{1u << 30, 4}).empty());
+  EXPECT_EQ(f->find_table("quests"), nullptr);
+}
+
+TEST_F(DataFileTest, TablesMustMatchTheirSchema) {
+  sample(1).write(path("d.kbd"));
+  const std::shared_ptr<const DataFile> f = DataFile::open(path("d.kbd"));
+  EXPECT_THROW(f->table<OldItemRow>(), std::runtime_error);
+  EXPECT_THROW(f->table<QuestRow>(), std::runtime_error);
+}
+
+TEST_F(DataFileTest, RejectsMalformedFiles) {
+  const std::string good = sample(1).finish();
+  const auto write = [&](const std::string& name, std::string bytes) {
+    write_file_atomic(path(name), bytes);
+    return path(name);
+  };
+
+  std::string bad_magic = good;
+  bad_magic[0] ^= 0x20;
+  expect_malformed(write("magic.kbd", bad_magic), false, "bad magic");
+
+  expect_malformed(write("short.kbd", good.substr(0, good.size() - 8)), false, "size mismatch");
+  expect_malformed(write("header.kbd", good.substr(0, 10)), false, "truncated header");
+
+  // A flipped byte past the directory is only caught by the checksum.
+  std::string flipped = good;
+  flipped[good.size() - 20] ^= 0x01;
+  const std::string flipped_path = write("flipped.kbd", flipped);
+  expect_malformed(flipped_path, true, "checksum mismatch");
+  EXPECT_NO_THROW(DataFile::open(flipped_path, false));
+
+  // Directory bounds are checked even without verify.
+  std::string huge = good;
+  const uint32_t rows = 1u << 30;
+  std::memcpy(&huge[kRowCountOffset], &rows, sizeof(rows));
+  expect_malformed(write("huge.kbd", huge), false, "table out of bounds");
+
+  std::string grown = good + std::string(16, '\0');
+  const uint64_t size = grown.size();
+  std::memcpy(&grown[kFileSizeOffset], &size, sizeof(size));
+  expect_malformed(write("grown.kbd", grown), true, "checksum mismatch");
+
+  EXPECT_THROW(DataFile::open(path("missing.kbd")), std::system_error);
+}
+
+TEST_F(DataFileTest, WriterRejectsBadTables) {
+  DataFileWriter w(1);
+  const std::vector<NpcRow> dup = {{1, 1}, {1, 2}};
+  EXPECT_THROW(w.add_table(std::span<const NpcRow>(dup), [](const NpcRow& r) { return r.id; }),
+               std::invalid_argument);
+  const uint64_t ids[] = {1};
+  const uint8_t row[4] = {};
+  EXPECT_THROW(w.add_table(std::string(32, 'n'), "id:u32", 4, ids, row), std::invalid_argument);
+  EXPECT_THROW(w.add_table("short", "id:u32", 4, ids, {row, 2}), std::invalid_argument);
+  w.add_table("t", "id:u32", 4, ids, row);
+  EXPECT_THROW(w.add_table("t", "id:u32", 4, ids, row), std::invalid_argument);
+}
+
+TEST_F(DataFileTest, ReloadSwapsVersionsAndKeepsOldSnapshots) {
+  sample(1).write(path("d.kbd"));
+  GameData data(path("d.kbd"));
+  const std::shared_ptr<const DataFile> v1 = data.current();
+  const DataTable<ItemRow> old_items = v1->table<ItemRow>();
+
+  DataFileWriter next(2);
+  const std::vector<ItemRow> items = {{1, next.intern("axe"), 99}};
+  next.add_table(std::span<const ItemRow>(items), [](const ItemRow& r) { return r.id; });
+  next.write(path("d.kbd"));
+  EXPECT_EQ(data.reload(), 2u);
+  EXPECT_EQ(data.current()->table<ItemRow>().find(1)->price, 99);
+  // The old mapping is still whole for whoever holds it.
+  EXPECT_EQ(old_items.find(1)->price, 10);
+  EXPECT_EQ(v1->str(old_items.find(3)->name), "shield");
+
+  // A broken file leaves the current version in place.
+  write_file_atomic(path("bad.kbd"), "nope");
+  EXPECT_THROW(data.reload(path("bad.kbd")), std::runtime_error);
+  EXPECT_EQ(data.current()->version(), 2u);
+}
+
+}  // namespace
+}  // namespace kbs
@@ -0,0 +1,134 @@
+#include "common/handle_pool.h"
+
+#include <gtest/gtest.h>
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace kbs {
+namespace {
+
+// Counts live instances, and throws from its constructor on request.
+struct Tracked {
+  static inline int live = 0;
+  explicit Tracked(int v, bool fail = false) : value(v) {
+    if (fail) throw std::runtime_error("constructor failed");
+    ++live;
+  }
+  ~Tracked() { --live; }
+  int value;
+};
+
+TEST(Handle, PacksIndexAndGeneration) {
+  using H = Handle<struct HTag, uint32_t, 20>;
+  EXPECT_FALSE(H());
+  EXPECT_EQ(H::kMaxGeneration, (1u << 12) - 1);
+  const H h = H::make(0xABCDE, 7);
+  EXPECT_TRUE(h);
+  EXPECT_EQ(h.index(), 0xABCDEu);
+  EXPECT_EQ(h.generation(), 7u);
+  EXPECT_EQ(H::from_bits(h.bits()), h);
+  EXPECT_LT(H::make(5, 1), H::make(5, 2));
+}
+
+TEST(HandlePool, StaleHandlesResolveToNull) {
+  HandlePool<std::string> pool;
+  const auto a = pool.emplace("a");
+  const auto b = pool.emplace("b");
+  ASSERT_NE(pool.get(a), nullptr);
+  EXPECT_EQ(*pool.get(b), "b");
+  EXPECT_EQ(pool.size(), 2u);
+
+  EXPECT_TRUE(pool.erase(a));
+  EXPECT_FALSE(pool.erase(a));
+  EXPECT_EQ(pool.get(a), nullptr);
+  // The slot is reused under a new generation; the old handle stays dead.
+  const auto c = pool.emplace("c");
+  EXPECT_EQ(c.index(), a.index());
+  EXPECT_NE(c.generation(), a.generation());
+  EXPECT_EQ(pool.get(a), nullptr);
+  EXPECT_EQ(*pool.get(c), "c");
+
+  // Forged handles: the free slot's next generation, and an index never
+  // allocated.
+  pool.erase(c);
+  using H = decltype(c);
+  EXPECT_EQ(pool.get(H::make(c.index(), c.generation() + 1)), nullptr);
+  EXPECT_EQ(pool.get(H::make(1000, 1)), nullptr);
+  EXPECT_EQ(pool.get(H()), nullptr);
+  EXPECT_EQ(pool.size(), 1u);
+}
+
+TEST(HandlePool, ObjectsNeverMove) {
+  HandlePool<int, Handle<int>, 16> pool;
+  std::vector<Handle<int>> handles;
+  std::vector<int*> ptrs;
+  for (int i = 0; i < 1000; ++i) {
+    handles.push_back(pool.emplace(i));
+    ptrs.push_back(pool.get(handles.back()));
+  }
+  for (int i = 0; i < 1000; i += 2) pool.erase(handles[i]);
+  for (int i = 0; i < 500; ++i) pool.emplace(-i);
+  EXPECT_EQ(pool.capacity(), 1000u);
+  for (int i = 1; i < 1000; i += 2) {
+    ASSERT_EQ(pool.get(handles[i]), ptrs[i]);
+    EXPECT_EQ(*ptrs[i], i);
+  }
+}
+
+TEST(HandlePool, ExhaustedGenerationsRetireTheSlot) {
+  // Two generation bits: generations 1..3.
+  using H = Handle<struct RTag, uint32_t, 30>;
+  HandlePool<int, H> pool;
+  std::vector<H> issued;
+  for (int i = 0; i < 3; ++i) {
+    issued.push_back(pool.emplace(i));
+    EXPECT_EQ(issued.back().index(), 0u);
+    pool.erase(issued.back());
+  }
+  EXPECT_EQ(pool.retired(), 1u);
+  const H next = pool.emplace(9);
+  EXPECT_EQ(next.index(), 1u);
+  for (H h : issued) EXPECT_FALSE(pool.contains(h));
+  EXPECT_TRUE(pool.contains(next));
+}
+
+TEST(HandlePool, FullIndexSpaceRefusesEmplace) {
+  using H = Handle<struct FTag, uint32_t, 2>;
+  HandlePool<int, H> pool;
+  for (int i = 0; i < 4; ++i) ASSERT_TRUE(pool.emplace(i));
+  EXPECT_FALSE(pool.emplace(4));
+  EXPECT_EQ(pool.size(), 4u);
+}
+
+TEST(HandlePool, ThrowingConstructorLeavesSlotFree) {
+  Tracked::live = 0;
+  {
+    HandlePool<Tracked> pool;
+    const auto a = pool.emplace(1);
+    pool.erase(a);
+    EXPECT_THROW(pool.emplace(2, true), std::runtime_error);  // from the free list
+    EXPECT_EQ(pool.size(), 0u);
+    const auto b = pool.emplace(4);
+    EXPECT_EQ(b.index(), a.index());
+    EXPECT_THROW(pool.emplace(3, true), std::runtime_error);  // from a fresh slot
+    EXPECT_EQ(pool.capacity(), 1u);
+    EXPECT_EQ(pool.emplace(5).index(), 1u);
+    pool.emplace(6);
+    EXPECT_EQ(Tracked::live, 3);
+
+    std::vector<int> seen;
+    pool.for_each([&](auto, Tracked& t) { seen.push_back(t.value); });
+    EXPECT_EQ(seen, (std::vector<int>{4, 5, 6}));
+
+    pool.clear();
+    EXPECT_EQ(Tracked::live, 0);
+    EXPECT_FALSE(pool.contains(b));
+    pool.emplace(7);
+  }
+  EXPECT_EQ(Tracked::live, 0);  // the destructor clears too
+}
+
+}  // namespace
+}  // namespace kbs
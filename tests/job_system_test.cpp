@@ -0,0 +1,144 @@
+#include "game/job_system.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "metrics/metrics.h"
+#include "metrics/trace.h"
+
+namespace kbs {
+namespace {
+
+TEST(JobSystem, NodeSpansOutliveTheirGraph) {
+  Histogram& duration = metrics().histogram("kbs_job_node_duration_us", "",
+                                            Histogram::exponential(10, 2, 16),
+                                            {{"node", "job_system_test.node"}});
+  const uint64_t runs_before = duration.snapshot().count;
+  tracer().start();
+  {
+    JobSystem jobs(1);
+    JobGraph g;
+    std::string name = "job_system_test.node";
+    g.add(name, [] {});
+    name.assign(name.size(), 'x');  // the graph must have kept its own copy
+    for (int i = 0; i < 16; ++i) g.add("job_system_test.filler", [] {});  // reallocates nodes_
+    jobs.run(g);
+  }
+  tracer().stop();
+  std::string json;
+  tracer().dump_chrome(json);
+  EXPECT_NE(json.find("\"job_system_test.node\""), std::string::npos);
+
+  EXPECT_EQ(duration.snapshot().count, runs_before + 1);
+}
+
+TEST(JobSystem, GraphRunsNodesAfterTheirPredecessors) {
+  JobSystem jobs(4);
+  std::mutex mu;
+  std::vector<int> order;
+  const auto log = [&](int n) {
+    return [&, n] {
+      std::lock_guard<std::mutex> lock(mu);
+      order.push_back(n);
+    };
+  };
+  // Diamond 0 -> {1, 2} -> 3, plus 4 depending on 3.
+  JobGraph g;
+  for (int i = 0; i < 5; ++i) g.add("job_system_test.diamond", log(i));
+  g.precede(0, 1);
+  g.precede(0, 2);
+  g.precede(1, 3);
+  g.precede(2, 3);
+  g.precede(3, 4);
+  for (int run = 0; run < 50; ++run) {
+    order.clear();
+    jobs.run(g);
+    ASSERT_EQ(order.size(), 5u);
+    EXPECT_EQ(order.front(), 0);
+    EXPECT_EQ(order[3], 3);
+    EXPECT_EQ(order[4], 4);
+  }
+}
+
+TEST(JobSystem, CyclicGraphIsRejected) {
+  JobSystem jobs(2);
+  JobGraph g;
+  int ran = 0;
+  const JobGraph::NodeId a = g.add("job_system_test.cycle", [&] { ++ran; });
+  const JobGraph::NodeId b = g.add("job_system_test.cycle", [&] { ++ran; });
+  g.precede(a, b);
+  g.precede(b, a);
+  EXPECT_THROW(jobs.run(g), std::logic_error);
+  EXPECT_EQ(ran, 0);
+}
+
+TEST(JobSystem, ParallelForCoversRangeExactlyOnce) {
+  JobSystem jobs(4);
+  for (size_t grain : {1u, 7u, 64u, 1000u, 5000u}) {
+    std::vector<std::atomic<int>> hits(1000);
+    jobs.parallel_for(0, hits.size(), grain, [&](size_t b, size_t e) {
+      EXPECT_LE(e - b, grain);
+      for (size_t i = b; i < e; ++i) hits[i].fetch_add(1, std::memory_order_relaxed);
+    });
+    for (size_t i = 0; i < hits.size(); ++i) {
+      ASSERT_EQ(hits[i].load(), 1) << "grain " << grain << " item " << i;
+    }
+  }
+  int calls = 0;
+  jobs.parallel_for(5, 5, 1, [&](size_t, size_t) { ++calls; });
+  EXPECT_EQ(calls, 0);
+}
+
+TEST(JobSystem, NestedParallelismCompletes) {
+  JobSystem jobs(4);
+  std::atomic<uint64_t> sum{0};
+  JobGraph g;
+  for (int n = 0; n < 4; ++n) {
+    g.add("job_system_test.nested", [&] {
+      jobs.parallel_for(0, 64, 4, [&](size_t b, size_t e) {
+        jobs.parallel_for(b * 100, e * 100, 10, [&](size_t ib, size_t ie) {
+          for (size_t i = ib; i < ie; ++i) sum.fetch_add(i, std::memory_order_relaxed);
+        });
+      });
+    });
+  }
+  jobs.run(g);
+  const uint64_t n = 6400;
+  EXPECT_EQ(sum.load(), 4 * n * (n - 1) / 2);
+  EXPECT_GE(jobs.stats().executed, 4u);
+}
+
+TEST(JobSystem, FullDequeRunsJobsInPlace) {
+  JobSystem jobs(1);
+  std::vector<int> hits(10000);
+  jobs.parallel_for(0, hits.size(), 1, [&](size_t b, size_t e) {
+    for (size_t i = b; i < e; ++i) ++hits[i];
+  });
+  EXPECT_EQ(std::count(hits.begin(), hits.end(), 1), 10000);
+  const JobSystemStats s = jobs.stats();
+  EXPECT_GT(s.inline_overflow, 0u);
+  EXPECT_EQ(s.stolen, 0u);
+}
+
+TEST(JobSystem, ForeignThreadIsRefused) {
+  JobSystem jobs(2);
+  bool threw = false;
+  std::thread([&] {
+    try {
+      jobs.parallel_for(0, 10, 1, [](size_t, size_t) {});
+    } catch (const std::logic_error&) {
+      threw = true;
+    }
+  }).join();
+  EXPECT_TRUE(threw);
+}
+
+}  // namespace
+}  // namespace kbs
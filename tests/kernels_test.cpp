@@ -0,0 +1,138 @@
+#include "game/kernels.h"
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstring>
+#include <numbers>
+#include <random>
+#include <vector>
+
+namespace kbs {
+namespace {
+
+using namespace kernels;
+
+// Lengths around every vector width, so both main loops and tails run.
+constexpr size_t kSizes[] = {0, 1, 3, 4, 7, 8, 9, 15, 16, 17, 31, 33, 1000, 1003};
+
+// Restores the dispatched level after a test forces another.
+class KernelsTest : public ::testing::Test {
+ protected:
+  void SetUp() override { best_ = simd_level(); }
+  void TearDown() override { set_simd_level(best_); }
+
+  std::vector<Vec3> positions(size_t n) {
+    std::uniform_real_distribution<float> coord(-60, 60);
+    std::vector<Vec3> out(n);
+    for (size_t i = 0; i < n; ++i) {
+      out[i] = {coord(rng_), coord(rng_), coord(rng_)};
+      // Some exactly on the 25 m boundary, where a rounding difference
+      // between implementations would flip the answer.
+      const float a = static_cast<float>(i);
+      if (i % 5 == 0) out[i] = {3 + 25 * std::cos(a), 0, -4 + 25 * std::sin(a)};
+      if (i % 11 == 0) out[i] = {3, 0, -4};
+    }
+    return out;
+  }
+
+  std::vector<float> floats(size_t n, float lo, float hi) {
+    std::uniform_real_distribution<float> v(lo, hi);
+    std::vector<float> out(n);
+    for (float& f : out) f = v(rng_);
+    return out;
+  }
+
+  // Every result of every kernel at the current level, as raw bytes.
+  std::vector<uint8_t> run_all(size_t n) {
+    rng_.seed(n + 1);
+    const std::vector<Vec3> pos = positions(n);
+    std::vector<uint8_t> bytes;
+    const auto append = [&](const void* p, size_t size) {
+      const auto* b = static_cast<const uint8_t*>(p);
+      bytes.insert(bytes.end(), b, b + size);
+    };
+    std::vector<uint32_t> idx(n);
+    size_t count = select_in_range(pos, {3, 0, -4}, 25, idx);
+    append(idx.data(), count * sizeof(uint32_t));
+    count = select_in_cone(pos, {3, 0, -4}, {1, 5, 1}, 40, 0.6f, idx);
+    append(idx.data(), count * sizeof(uint32_t));
+
+    std::vector<float> d(n);
+    distances_sq_xz(pos, {-7, 100, 2}, d);
+    append(d.data(), n * sizeof(float));
+
+    std::vector<Vec3> moved = pos;
+    rng_.seed(n + 2);
+    const std::vector<Vec3> vel = positions(n);
+    integrate(moved, vel, 0.05f);
+    append(moved.data(), n * sizeof(Vec3));
+
+    const std::vector<float> armor = floats(n, 0, 500);
+    const std::vector<float> scale = floats(n, 0, 3);
+    evaluate_damage({120, 100, 1}, armor, scale, d);
+    append(d.data(), n * sizeof(float));
+    return bytes;
+  }
+
+  SimdLevel best_ = SimdLevel::kScalar;
+  std::mt19937 rng_;
+};
+
+TEST_F(KernelsTest, DispatchedLevelMatchesScalarBitForBit) {
+  if (best_ == SimdLevel::kScalar) GTEST_SKIP() << "no SIMD level on this CPU";
+  for (size_t n : kSizes) {
+    ASSERT_EQ(set_simd_level(SimdLevel::kScalar), SimdLevel::kScalar);
+    const std::vector<uint8_t> scalar = run_all(n);
+    ASSERT_EQ(set_simd_level(best_), best_);
+    const std::vector<uint8_t> simd = run_all(n);
+    ASSERT_EQ(scalar.size(), simd.size()) << simd_level_name(best_) << " n=" << n;
+    EXPECT_EQ(std::memcmp(scalar.data(), simd.data(), scalar.size()), 0)
+        << simd_level_name(best_) << " n=" << n;
+  }
+}
+
+TEST_F(KernelsTest, ForcedLevelIsClampedToTheCpu) {
+  EXPECT_EQ(set_simd_level(SimdLevel::kScalar), SimdLevel::kScalar);
+  EXPECT_EQ(simd_level(), SimdLevel::kScalar);
+  // Asking for more than the CPU has gives the best it does have.
+  EXPECT_EQ(set_simd_level(SimdLevel::kAvx2), best_);
+  EXPECT_STREQ(simd_level_name(SimdLevel::kScalar), "scalar");
+}
+
+TEST_F(KernelsTest, SelectionsFollowTheirDefinitions) {
+  for (SimdLevel level : {SimdLevel::kScalar, best_}) {
+    set_simd_level(level);
+    const std::vector<Vec3> pos = {
+        {5, 0, 1},    // in range, inside the cone
+        {0, 0, 5},    // in range, 90 degrees off
+        {-5, 0, 0},   // behind
+        {0, 30, 0},   // the origin in x/z: a hit whatever y says
+        {20, 0, 0},   // ahead but out of range
+        {7, 0, -7},   // exactly 45 degrees, distance < 10
+        {10, 0, 0},   // exactly at the radius
+        {3, 0, 2.9f}  // just inside 45 degrees
+    };
+    std::vector<uint32_t> out(pos.size());
+    const size_t in_range = select_in_range(pos, {0, 0, 0}, 10, out);
+    EXPECT_EQ(std::vector<uint32_t>(out.begin(), out.begin() + in_range),
+              (std::vector<uint32_t>{0, 1, 2, 3, 5, 6, 7}))
+        << simd_level_name(level);
+    const size_t in_cone = select_in_cone(pos, {0, 0, 0}, {2, 0, 0}, 10,
+                                          std::numbers::pi_v<float> / 4 - 1e-4f, out);
+    EXPECT_EQ(std::vector<uint32_t>(out.begin(), out.begin() + in_cone),
+              (std::vector<uint32_t>{0, 3, 6, 7}))
+        << simd_level_name(level);
+
+    std::vector<float> damage(3);
+    const std::vector<float> armor = {0, 100, 1e6f};
+    const std::vector<float> scale = {1, 2, 1};
+    evaluate_damage({50, 100, 1}, armor, scale, damage);
+    EXPECT_FLOAT_EQ(damage[0], 50);
+    EXPECT_FLOAT_EQ(damage[1], 50);
+    EXPECT_FLOAT_EQ(damage[2], 1);  // floored
+  }
+}
+
+}  // namespace
+}  // namespace kbs
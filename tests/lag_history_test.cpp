@@ -0,0 +1,132 @@
+#include "space/lag_history.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <vector>
+
+namespace kbs {
+namespace {
+
+// Default bounds quantize the ground axes to 4096 / 65535 m.
+constexpr float kGroundStep = 4096.0f / 65535.0f;
+
+LagHistoryOptions short_history() {
+  LagHistoryOptions o;
+  o.history_ms = 200;
+  o.tick_ms = 50;
+  return o;
+}
+
+void expect_near(Vec3 a, Vec3 b, float tolerance) {
+  EXPECT_NEAR(a.x, b.x, tolerance);
+  EXPECT_NEAR(a.y, b.y, tolerance);
+  EXPECT_NEAR(a.z, b.z, tolerance);
+}
+
+TEST(LagHistory, InterpolatesBetweenFrames) {
+  LagHistory h;
+  h.add(1, {0, 0, 0});
+  h.add(2, {-100, 5, 40});
+  h.commit(100);
+  h.set(1, {10, 0, -20});
+  h.commit(200);
+  EXPECT_EQ(h.oldest_ms(), 100u);
+  EXPECT_EQ(h.newest_ms(), 200u);
+
+  Vec3 p;
+  ASSERT_TRUE(h.position_at(1, 150, p));
+  expect_near(p, {5, 0, -10}, kGroundStep);
+  ASSERT_TRUE(h.position_at(1, 175, p));
+  expect_near(p, {7.5f, 0, -15}, kGroundStep);
+  // Unmoved entities carry their position forward.
+  ASSERT_TRUE(h.position_at(2, 200, p));
+  expect_near(p, {-100, 5, 40}, kGroundStep);
+  // Past the newest frame answers with the newest.
+  ASSERT_TRUE(h.position_at(1, 10000, p));
+  expect_near(p, {10, 0, -20}, kGroundStep);
+  EXPECT_FALSE(h.position_at(3, 150, p));
+}
+
+TEST(LagHistory, OldRequestsAreClampedToTheWindow) {
+  LagHistory h(short_history());
+  h.add(1, {0, 0, 0});
+  for (uint64_t t = 0; t <= 1000; t += 50) {
+    h.set(1, {static_cast<float>(t) / 10, 0, 0});  // 1 m per 10 ms
+    h.commit(t);
+  }
+  EXPECT_EQ(h.newest_ms(), 1000u);
+  EXPECT_GE(h.oldest_ms(), 800u - 50);
+  EXPECT_LE(h.oldest_ms(), 800u);
+
+  Vec3 p;
+  ASSERT_TRUE(h.position_at(1, 900, p));
+  EXPECT_NEAR(p.x, 90, kGroundStep);
+  EXPECT_EQ(h.stats().clamped, 0u);
+  // A client claiming half a second of lag sees the window's edge.
+  ASSERT_TRUE(h.position_at(1, 500, p));
+  EXPECT_NEAR(p.x, 80, kGroundStep);
+  ASSERT_TRUE(h.position_at(1, 0, p));
+  EXPECT_NEAR(p.x, 80, kGroundStep);
+  EXPECT_EQ(h.stats().clamped, 2u);
+  EXPECT_EQ(h.stats().rewinds, 3u);
+}
+
+TEST(LagHistory, EntitiesExistOnlyWhileTracked) {
+  LagHistory h;
+  Vec3 p;
+  EXPECT_FALSE(h.set(1, {0, 0, 0}));
+  h.add(1, {1, 0, 1});
+  EXPECT_FALSE(h.position_at(1, 100, p));  // nothing committed yet
+  h.commit(100);
+  h.add(2, {2, 0, 2});
+  h.commit(200);
+
+  EXPECT_FALSE(h.position_at(2, 100, p));  // did not exist yet
+  ASSERT_TRUE(h.position_at(2, 150, p));   // spawned in between: no blending
+  expect_near(p, {2, 0, 2}, kGroundStep);
+
+  // A removed entity is forgotten, and its reused slot does not make the
+  // newcomer visible at times before it was added.
+  h.remove(1);
+  EXPECT_FALSE(h.position_at(1, 200, p));
+  h.add(3, {50, 0, 50});
+  h.commit(300);
+  EXPECT_EQ(h.size(), 2u);
+  EXPECT_FALSE(h.position_at(3, 200, p));
+  ASSERT_TRUE(h.position_at(3, 300, p));
+  expect_near(p, {50, 0, 50}, kGroundStep);
+}
+
+TEST(LagHistory, RadiusQueryUsesPastPositions) {
+  LagHistory h;
+  for (EntityId id = 1; id <= 20; ++id) h.add(id, {static_cast<float>(id), 0, 0});
+  h.commit(100);
+  // Everyone runs 30 m along z.
+  for (EntityId id = 1; id <= 20; ++id) h.set(id, {static_cast<float>(id), 0, 30});
+  h.commit(200);
+
+  std::vector<EntityId> hits;
+  EXPECT_EQ(h.query_radius_at(100, {0, 0, 0}, 5.5f, hits), 5u);
+  std::sort(hits.begin(), hits.end());
+  EXPECT_EQ(hits, (std::vector<EntityId>{1, 2, 3, 4, 5}));
+  hits.clear();
+  EXPECT_EQ(h.query_radius_at(200, {0, 0, 0}, 5.5f, hits), 0u);
+  // Halfway there, by interpolation; y is ignored.
+  EXPECT_EQ(h.query_radius_at(150, {10, 99, 15}, 1.2f, hits), 3u);
+}
+
+TEST(LagHistory, PositionsClampToTheBounds) {
+  LagHistoryOptions o;
+  o.min_x = o.min_y = o.min_z = 0;
+  o.max_x = o.max_y = o.max_z = 100;
+  LagHistory h(o);
+  h.add(1, {-50, 500, 42});
+  h.commit(10);
+  Vec3 p;
+  ASSERT_TRUE(h.position_at(1, 10, p));
+  expect_near(p, {0, 100, 42}, 100.0f / 65535);
+}
+
+}  // namespace
+}  // namespace kbs
@@ -0,0 +1,117 @@
+#include "net/message_buffer.h"
+
+#include <gtest/gtest.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <string>
+
+#include "net/output_queue.h"
+
+namespace kbs {
+namespace {
+
+std::string frame_bytes(uint16_t msg_id, std::string_view body) {
+  MessageBuffer b;
+  const size_t token = b.begin_frame(msg_id);
+  b.append(body);
+  b.end_frame(token);
+  return b.to_string();
+}
+
+TEST(MessageBuffer, FramesSpanChunksAndParseBack) {
+  MessageBuffer b;
+  const std::string big(Chunk::kDefaultCapacity + 100, 'b');
+  for (const std::string& body : {std::string("hi"), big, std::string()}) {
+    const size_t token = b.begin_frame(static_cast<uint16_t>(body.size() % 1000));
+    b.append(body);
+    b.end_frame(token);
+  }
+  EXPECT_GT(b.slices().size(), 1u);
+  EXPECT_EQ(b.size(), 3 * kFrameHeaderSize + 2 + big.size());
+
+  const std::string wire = b.to_string();
+  std::string_view rest = wire;
+  Frame f;
+  size_t consumed = 0;
+  ASSERT_EQ(parse_frame(rest, f, consumed), FrameStatus::kOk);
+  EXPECT_EQ(f.msg_id, 2u);
+  EXPECT_EQ(f.body, "hi");
+  rest.remove_prefix(consumed);
+  ASSERT_EQ(parse_frame(rest, f, consumed), FrameStatus::kOk);
+  EXPECT_EQ(f.body, big);
+  rest.remove_prefix(consumed);
+  ASSERT_EQ(parse_frame(rest, f, consumed), FrameStatus::kOk);
+  EXPECT_TRUE(f.body.empty());
+  EXPECT_EQ(consumed, rest.size());
+}
+
+TEST(MessageBuffer, ParseFrameNeedsWholeFrameAndHonoursLimit) {
+  const std::string wire = frame_bytes(7, "payload");
+  Frame f;
+  size_t consumed = 0;
+  for (size_t n = 0; n < wire.size(); ++n) {
+    EXPECT_EQ(parse_frame(std::string_view(wire).substr(0, n), f, consumed),
+              FrameStatus::kIncomplete);
+  }
+  EXPECT_EQ(parse_frame(wire, f, consumed, 6), FrameStatus::kTooLarge);
+  EXPECT_EQ(parse_frame(wire, f, consumed, 7), FrameStatus::kOk);
+  // The length prefix alone decides: a 16 MiB + 1 claim is refused early.
+  const std::string huge("\x01\x00\x00\x01\x00\x00", 6);
+  EXPECT_EQ(parse_frame(huge, f, consumed), FrameStatus::kTooLarge);
+}
+
+TEST(MessageBuffer, SharedBytesAreNotDisturbedByLaterAppends) {
+  MessageBuffer a;
+  a.append("shared");
+  MessageBuffer copy = a;
+  EXPECT_EQ(copy.slices()[0].chunk.get(), a.slices()[0].chunk.get());
+  a.append("-more");
+  copy.append("-other");
+  EXPECT_EQ(a.to_string(), "shared-more");
+  EXPECT_EQ(copy.to_string(), "shared-other");
+
+  MessageBuffer joined;
+  joined.append("<");
+  joined.append(a);
+  joined.append(">");
+  EXPECT_EQ(joined.to_string(), "<shared-more>");
+
+  MessageBuffer p;
+  p.append("xxxx-tail");
+  p.patch(0, "head", 4);
+  EXPECT_EQ(p.to_string(), "head-tail");
+  std::memcpy(p.reserve(3), "!!!", 3);
+  EXPECT_EQ(p.to_string(), "head-tail!!!");
+}
+
+TEST(OutputQueue, GathersSlicesAcrossPartialWrites) {
+  int fds[2];
+  ASSERT_EQ(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+  OutputQueue q;
+  MessageBuffer b;
+  b.append(std::string(Chunk::kDefaultCapacity * 3, 'q'));
+  q.push(b);
+  q.push_copy("end", 3);
+  const size_t total = q.bytes();
+  int writes = 0;
+  while (!q.empty()) {
+    ASSERT_GT(q.write_to(fds[0]), 0);
+    ++writes;
+  }
+  EXPECT_LE(writes, 2);
+  std::string received;
+  char buf[1 << 16];
+  while (received.size() < total) {
+    const ssize_t n = ::read(fds[1], buf, sizeof(buf));
+    ASSERT_GT(n, 0);
+    received.append(buf, static_cast<size_t>(n));
+  }
+  EXPECT_EQ(received, b.to_string() + "end");
+  ::close(fds[0]);
+  ::close(fds[1]);
+}
+
+}  // namespace
+}  // namespace kbs
@@ -0,0 +1,272 @@
+#include "nav/nav_mesh.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "nav/path_service.h"
+
+namespace kbs {
+namespace {
+
+// w x h unit squares on y = 0 with shared corner vertices, minus the cells
+// hole(x, z) rules out.
+template <typename Hole>
+NavMeshData grid_mesh(int w, int h, Hole hole) {
+  NavMeshData d;
+  for (int z = 0; z <= h; ++z) {
+    for (int x = 0; x <= w; ++x) {
+      d.vertices.push_back({static_cast<float>(x), 0, static_cast<float>(z)});
+    }
+  }
+  const auto v = [w](int x, int z) { return static_cast<uint32_t>(z * (w + 1) + x); };
+  for (int z = 0; z < h; ++z) {
+    for (int x = 0; x < w; ++x) {
+      if (hole(x, z)) continue;
+      d.polygons.push_back({v(x, z), v(x + 1, z), v(x + 1, z + 1), v(x, z + 1)});
+    }
+  }
+  return d;
+}
+
+NavMeshData grid_mesh(int w, int h) {
+  return grid_mesh(w, h, [](int, int) { return false; });
+}
+
+float path_length(const std::vector<Vec3>& points) {
+  float total = 0;
+  for (size_t i = 1; i < points.size(); ++i) {
+    const float dx = points[i].x - points[i - 1].x;
+    const float dz = points[i].z - points[i - 1].z;
+    total += std::sqrt(dx * dx + dz * dz);
+  }
+  return total;
+}
+
+// Each corridor step crosses a shared edge into a different polygon.
+void expect_connected(const NavMesh& mesh, const std::vector<PolyRef>& corridor) {
+  for (size_t i = 1; i < corridor.size(); ++i) {
+    const Vec3 a = mesh.center(corridor[i - 1]);
+    const Vec3 b = mesh.center(corridor[i]);
+    EXPECT_NEAR(std::abs(a.x - b.x) + std::abs(a.z - b.z), 1.0f, 1e-4f) << "step " << i;
+  }
+}
+
+TEST(NavMesh, RejectsMalformedData) {
+  NavMeshData out_of_range = grid_mesh(1, 1);
+  out_of_range.polygons[0][2] = 99;
+  EXPECT_THROW(NavMesh{std::move(out_of_range)}, std::invalid_argument);
+
+  NavMeshData degenerate;
+  degenerate.vertices = {{0, 0, 0}, {1, 0, 0}, {2, 0, 0}};
+  degenerate.polygons = {{0, 1, 2}};
+  EXPECT_THROW(NavMesh{std::move(degenerate)}, std::invalid_argument);
+
+  NavMeshData concave;
+  concave.vertices = {{0, 0, 0}, {4, 0, 0}, {1, 0, 1}, {0, 0, 4}};
+  concave.polygons = {{0, 1, 2, 3}};
+  EXPECT_THROW(NavMesh{std::move(concave)}, std::invalid_argument);
+
+  NavMeshData three_way = grid_mesh(2, 1);
+  three_way.vertices.push_back({0.5f, 0, 0.5f});
+  three_way.polygons.push_back({1, 4, 6});  // reuses the edge between cells 0 and 1
+  EXPECT_THROW(NavMesh{std::move(three_way)}, std::invalid_argument);
+}
+
+TEST(NavMesh, FindsContainingAndNearestPolygons) {
+  const NavMesh mesh(grid_mesh(4, 3));
+  ASSERT_EQ(mesh.poly_count(), 12u);
+  const PolyRef p = mesh.find_poly({2.5f, 0, 1.5f});
+  ASSERT_NE(p, kInvalidPoly);
+  EXPECT_FLOAT_EQ(mesh.center(p).x, 2.5f);
+  EXPECT_FLOAT_EQ(mesh.center(p).z, 1.5f);
+  EXPECT_EQ(mesh.find_poly({-0.5f, 0, 1}), kInvalidPoly);
+
+  Vec3 snapped;
+  const PolyRef near = mesh.find_nearest({-0.5f, 0, 1.5f}, 1.0f, &snapped);
+  ASSERT_NE(near, kInvalidPoly);
+  EXPECT_NEAR(snapped.x, 0.0f, 1e-4f);
+  EXPECT_NEAR(snapped.z, 1.5f, 1e-4f);
+  EXPECT_EQ(mesh.find_nearest({-5, 0, 1.5f}, 1.0f, &snapped), kInvalidPoly);
+}
+
+TEST(NavQuery, OpenGroundPathIsStraight) {
+  const NavMesh mesh(grid_mesh(10, 10));
+  NavQuery query(mesh);
+  const Vec3 start{0.5f, 0, 2.3f};
+  const Vec3 goal{9.5f, 0, 2.7f};
+  std::vector<PolyRef> corridor;
+  ASSERT_EQ(query.find_corridor(mesh.find_poly(start), mesh.find_poly(goal), start, goal,
+                                corridor),
+            PathStatus::kOk);
+  EXPECT_EQ(corridor.front(), mesh.find_poly(start));
+  EXPECT_EQ(corridor.back(), mesh.find_poly(goal));
+  expect_connected(mesh, corridor);
+
+  std::vector<Vec3> points;
+  query.string_pull(corridor, start, goal, points);
+  ASSERT_EQ(points.size(), 2u);
+  EXPECT_FLOAT_EQ(points.back().x, goal.x);
+  EXPECT_FLOAT_EQ(points.back().z, goal.z);
+
+  // Diagonally the corridor is a staircase; the pulled path is no longer
+  // than one through its cell centres, and never shorter than the line.
+  const Vec3 corner{9.5f, 0, 9.5f};
+  ASSERT_EQ(query.find_corridor(mesh.find_poly(start), mesh.find_poly(corner), start, corner,
+                                corridor),
+            PathStatus::kOk);
+  expect_connected(mesh, corridor);
+  query.string_pull(corridor, start, corner, points);
+  std::vector<Vec3> centres{start};
+  for (size_t i = 1; i + 1 < corridor.size(); ++i) centres.push_back(mesh.center(corridor[i]));
+  centres.push_back(corner);
+  EXPECT_LE(path_length(points), path_length(centres));
+  EXPECT_GE(path_length(points) + 1e-4f, path_length({start, corner}));
+  EXPECT_LT(points.size(), centres.size());
+}
+
+TEST(NavQuery, PathBendsAroundWall) {
+  // A wall at x = 5 from z = 0 to 8; the only way across is over the top.
+  const NavMesh mesh(grid_mesh(10, 10, [](int x, int z) { return x == 5 && z < 8; }));
+  NavQuery query(mesh);
+  const Vec3 start{4.5f, 0, 0.5f};
+  const Vec3 goal{6.5f, 0, 0.5f};
+  std::vector<PolyRef> corridor;
+  ASSERT_EQ(query.find_corridor(mesh.find_poly(start), mesh.find_poly(goal), start, goal,
+                                corridor),
+            PathStatus::kOk);
+  expect_connected(mesh, corridor);
+
+  std::vector<Vec3> points;
+  query.string_pull(corridor, start, goal, points);
+  ASSERT_GE(points.size(), 4u);
+  // The corners hug the end of the wall instead of the cell centres.
+  EXPECT_NEAR(points[1].x, 5.0f, 1e-4f);
+  EXPECT_NEAR(points[1].z, 8.0f, 1e-4f);
+  EXPECT_NEAR(points[2].x, 6.0f, 1e-4f);
+  EXPECT_NEAR(points[2].z, 8.0f, 1e-4f);
+  const float shortest = 2 * std::sqrt(0.5f * 0.5f + 7.5f * 7.5f) + 1;
+  EXPECT_NEAR(path_length(points), shortest, 1e-3f);
+}
+
+TEST(NavQuery, UnreachableAndNodeLimitedSearches) {
+  const NavMesh split(grid_mesh(10, 4, [](int x, int) { return x == 5; }));
+  NavQuery query(split);
+  const Vec3 start{0.5f, 0, 0.5f};
+  const Vec3 goal{9.5f, 0, 0.5f};
+  std::vector<PolyRef> corridor;
+  EXPECT_EQ(query.find_corridor(split.find_poly(start), split.find_poly(goal), start, goal,
+                                corridor),
+            PathStatus::kNoPath);
+  ASSERT_FALSE(corridor.empty());
+  // It leads as close to the goal as the island allows.
+  EXPECT_FLOAT_EQ(split.center(corridor.back()).x, 4.5f);
+
+  const NavMesh strip(grid_mesh(40, 1));
+  NavQuery limited(strip, 8);
+  const Vec3 far{39.5f, 0, 0.5f};
+  EXPECT_EQ(limited.find_corridor(strip.find_poly(start), strip.find_poly(far), start, far,
+                                  corridor),
+            PathStatus::kPartial);
+  EXPECT_LE(limited.last_expanded(), 9u);
+  EXPECT_GT(strip.center(corridor.back()).x, start.x);
+  expect_connected(strip, corridor);
+
+  // The search state is reused; a full search afterwards is still exact.
+  NavQuery full(strip);
+  ASSERT_EQ(full.find_corridor(strip.find_poly(start), strip.find_poly(far), start, far,
+                               corridor),
+            PathStatus::kOk);
+  EXPECT_EQ(corridor.size(), 40u);
+  ASSERT_EQ(full.find_corridor(strip.find_poly(far), strip.find_poly(start), far, start,
+                               corridor),
+            PathStatus::kOk);
+  EXPECT_EQ(corridor.size(), 40u);
+}
+
+// Polls until n results arrived (or five seconds passed).
+std::vector<PathResult> collect(PathService& service, size_t n) {
+  std::vector<PathResult> out;
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (out.size() < n && std::chrono::steady_clock::now() < deadline) {
+    if (service.poll([&](PathResult& r) { out.push_back(std::move(r)); }) == 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+  return out;
+}
+
+TEST(PathService, BatchedQueriesCompleteAndHitTheCache) {
+  const NavMesh mesh(grid_mesh(10, 10, [](int x, int z) { return x == 5 && z < 8; }));
+  PathService service(mesh);
+  std::vector<PathRequest> batch;
+  for (uint64_t id = 1; id <= 4; ++id) {
+    // Same start and goal polygons, different points inside them.
+    const float jitter = 0.1f * static_cast<float>(id);
+    batch.push_back({id, {4.2f + jitter, 0, 0.5f}, {6.5f, 0, 0.2f + jitter}});
+  }
+  batch.push_back({5, {-10, 0, 0}, {6.5f, 0, 0.5f}});  // far off the mesh
+  batch.push_back({6, {-1, 0, 0.5f}, {6.5f, 0, 0.5f}});  // close enough to snap
+  ASSERT_EQ(service.submit(batch), batch.size());
+
+  std::vector<PathResult> results = collect(service, batch.size());
+  ASSERT_EQ(results.size(), batch.size());
+  EXPECT_EQ(service.in_flight(), 0u);
+  std::sort(results.begin(), results.end(),
+            [](const PathResult& a, const PathResult& b) { return a.id < b.id; });
+  for (size_t i = 0; i < 4; ++i) {
+    ASSERT_EQ(results[i].status, PathStatus::kOk);
+    ASSERT_GE(results[i].points.size(), 4u);
+    EXPECT_FLOAT_EQ(results[i].points.front().x, batch[i].start.x);
+    EXPECT_FLOAT_EQ(results[i].points.back().z, batch[i].goal.z);
+  }
+  EXPECT_EQ(results[4].status, PathStatus::kOffMesh);
+  EXPECT_TRUE(results[4].points.empty());
+  EXPECT_EQ(results[5].status, PathStatus::kOk);
+  EXPECT_NEAR(results[5].points.front().x, 0.0f, 1e-4f);
+
+  // Repeated start/goal polygons come from the cache.
+  ASSERT_TRUE(service.submit(batch[0]));
+  results = collect(service, 1);
+  ASSERT_EQ(results.size(), 1u);
+  EXPECT_TRUE(results[0].cached);
+  const PathServiceStats s = service.stats();
+  EXPECT_EQ(s.submitted, 7u);
+  EXPECT_EQ(s.completed, 7u);
+  EXPECT_GE(s.cache_hits, 1u);
+  EXPECT_GE(s.cache_misses, 2u);
+  EXPECT_EQ(s.cache_hits + s.cache_misses, 6u);  // the off-mesh request never looks
+
+  service.clear_cache();
+  ASSERT_TRUE(service.submit(batch[0]));
+  results = collect(service, 1);
+  ASSERT_EQ(results.size(), 1u);
+  EXPECT_FALSE(results[0].cached);
+}
+
+TEST(PathService, RefusesRequestsBeyondInFlightLimit) {
+  const NavMesh mesh(grid_mesh(4, 4));
+  PathServiceOptions options;
+  options.num_threads = 1;
+  options.max_in_flight = 3;
+  PathService service(mesh, options);
+  const PathRequest r{1, {0.5f, 0, 0.5f}, {3.5f, 0, 3.5f}};
+  const std::vector<PathRequest> batch(5, r);
+  EXPECT_EQ(service.submit(batch), 3u);
+  EXPECT_FALSE(service.submit(r));
+  EXPECT_EQ(service.stats().rejected, 3u);
+
+  // Polling frees the slots again.
+  ASSERT_EQ(collect(service, 3).size(), 3u);
+  EXPECT_TRUE(service.submit(r));
+  EXPECT_EQ(collect(service, 1).size(), 1u);
+}
+
+}  // namespace
+}  // namespace kbs
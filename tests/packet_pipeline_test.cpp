@@ -0,0 +1,179 @@
+#include "gateway/packet_pipeline.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "net/event_loop.h"
+
+namespace kbs {
+namespace {
+
+struct Delivery {
+  uint64_t conn;
+  PacketDirection dir;
+  bool ok;
+  std::string bytes;
+};
+
+CipherKeys make_keys(uint8_t seed) {
+  CipherKeys k;
+  for (size_t i = 0; i < k.key.size(); ++i) k.key[i] = static_cast<uint8_t>(seed + i);
+  for (size_t i = 0; i < k.iv.size(); ++i) k.iv[i] = static_cast<uint8_t>(seed * 3 + i);
+  return k;
+}
+
+PacketPipelineOptions one_worker() {
+  PacketPipelineOptions o;
+  o.num_threads = 1;
+  return o;
+}
+
+// Gateway side of one connection (conn 1) and the client's codec.
+class PacketPipelineTest : public ::testing::Test {
+ protected:
+  PacketPipelineTest() : client_(to_server_, to_client_) {
+    pipeline_.open_session(1, loop_, to_client_, to_server_,
+                           [this](uint64_t conn, PacketDirection dir, bool ok, std::string& b) {
+                             delivered_.push_back({conn, dir, ok, std::move(b)});
+                             if (delivered_.size() == expected_) loop_.quit();
+                           });
+  }
+
+  // Runs the loop until n more deliveries arrived (or a second passed).
+  void wait_for(size_t n) {
+    expected_ = delivered_.size() + n;
+    const TimerId timeout = loop_.run_after(1000, [this] { loop_.quit(); });
+    loop_.run();
+    loop_.cancel_timer(timeout);
+    ASSERT_EQ(delivered_.size(), expected_);
+  }
+
+  std::string client_seal(std::string_view payload) {
+    std::string frame;
+    EXPECT_TRUE(client_.seal(payload, frame));
+    return frame;
+  }
+
+  const CipherKeys to_client_ = make_keys(1);
+  const CipherKeys to_server_ = make_keys(2);
+  EventLoop loop_;
+  PacketPipeline pipeline_{one_worker()};
+  PacketCodec client_;
+  std::vector<Delivery> delivered_;
+  size_t expected_ = 0;
+};
+
+TEST_F(PacketPipelineTest, RoundTripsBothDirections) {
+  const std::string payload(500, 'm');
+  ASSERT_TRUE(pipeline_.submit(1, PacketDirection::kOutbound, payload));
+  ASSERT_TRUE(pipeline_.submit(1, PacketDirection::kInbound, client_seal("hello gateway")));
+  wait_for(2);
+
+  ASSERT_TRUE(delivered_[0].ok);
+  EXPECT_EQ(delivered_[0].dir, PacketDirection::kOutbound);
+  size_t length = 0;
+  EXPECT_EQ(sealed_frame_length(delivered_[0].bytes, length), SealedFrameStatus::kOk);
+  EXPECT_EQ(length, delivered_[0].bytes.size());
+  std::string opened;
+  ASSERT_TRUE(client_.open(delivered_[0].bytes, opened));
+  EXPECT_EQ(opened, payload);
+
+  ASSERT_TRUE(delivered_[1].ok);
+  EXPECT_EQ(delivered_[1].dir, PacketDirection::kInbound);
+  EXPECT_EQ(delivered_[1].bytes, "hello gateway");
+  EXPECT_EQ(pipeline_.stats().failures, 0u);
+}
+
+TEST_F(PacketPipelineTest, TamperedFrameFailsAndEndsSession) {
+  std::string frame = client_seal("attack at dawn");
+  frame[kSealedHeaderSize + 2] ^= 0x01;
+  ASSERT_TRUE(pipeline_.submit(1, PacketDirection::kInbound, frame));
+  wait_for(1);
+  EXPECT_FALSE(delivered_[0].ok);
+  EXPECT_EQ(delivered_[0].conn, 1u);
+  EXPECT_EQ(pipeline_.stats().failures, 1u);
+
+  // Nothing more is delivered for the connection, even a valid frame.
+  ASSERT_TRUE(pipeline_.submit(1, PacketDirection::kInbound, client_seal("second")));
+  expected_ = 2;
+  const TimerId timeout = loop_.run_after(100, [this] { loop_.quit(); });
+  loop_.run();
+  loop_.cancel_timer(timeout);
+  EXPECT_EQ(delivered_.size(), 1u);
+}
+
+TEST_F(PacketPipelineTest, TamperedFlagsByteFailsAuthentication) {
+  std::string frame = client_seal(std::string(200, 'c'));
+  frame[4] ^= kSealedCompressed;
+  ASSERT_TRUE(pipeline_.submit(1, PacketDirection::kInbound, frame));
+  wait_for(1);
+  EXPECT_FALSE(delivered_[0].ok);
+}
+
+TEST(PacketCodec, FrameLengthRejectsOversizedPrefix) {
+  size_t length = 0;
+  std::string frame(3, '\0');
+  EXPECT_EQ(sealed_frame_length(frame, length), SealedFrameStatus::kIncomplete);
+  frame = std::string("\x10\0\0\0", 4) + std::string(8, 'x');
+  EXPECT_EQ(sealed_frame_length(frame, length), SealedFrameStatus::kIncomplete);
+  frame += std::string(8, 'x');
+  EXPECT_EQ(sealed_frame_length(frame, length), SealedFrameStatus::kOk);
+  EXPECT_EQ(length, 20u);
+  // A 4 GiB claim is refused from the prefix alone, not buffered for.
+  EXPECT_EQ(sealed_frame_length(std::string("\xff\xff\xff\xff", 4), length),
+            SealedFrameStatus::kTooLarge);
+  const size_t limit = max_sealed_frame(1024);
+  frame.assign(4, '\0');
+  for (int i = 0; i < 4; ++i) frame[i] = static_cast<char>((limit - 3) >> (8 * i));
+  EXPECT_EQ(sealed_frame_length(frame, length, 1024), SealedFrameStatus::kTooLarge);
+}
+
+TEST(PacketCodec, MaxPayloadIsInclusive) {
+  PacketCodecOptions options;
+  options.max_payload = 4096;
+  const CipherKeys a = make_keys(5);
+  const CipherKeys b = make_keys(6);
+  PacketCodec sender(a, b, options);
+  PacketCodec receiver(b, a, options);
+
+  // Exactly max_payload, compressible and not: both open.
+  std::string random(4096, '\0');
+  uint32_t x = 1;
+  for (char& c : random) c = static_cast<char>((x = x * 1664525 + 1013904223) >> 24);
+  for (const std::string& payload : {std::string(4096, 'p'), random}) {
+    std::string frame;
+    ASSERT_TRUE(sender.seal(payload, frame));
+    std::string opened;
+    ASSERT_TRUE(receiver.open(frame, opened));
+    EXPECT_EQ(opened, payload);
+  }
+  // One byte more is refused by the sender, which stays usable.
+  std::string frame;
+  EXPECT_FALSE(sender.seal(std::string(4097, 'p'), frame));
+  EXPECT_TRUE(frame.empty());
+  ASSERT_TRUE(sender.seal("after", frame));
+  std::string opened;
+  ASSERT_TRUE(receiver.open(frame, opened));
+  EXPECT_EQ(opened, "after");
+}
+
+TEST(PacketCodec, OpenRejectsPayloadInflatingPastLimit) {
+  PacketCodecOptions big;
+  big.max_payload = 8192;
+  PacketCodecOptions small;
+  small.max_payload = 4096;
+  const CipherKeys a = make_keys(7);
+  const CipherKeys b = make_keys(8);
+  PacketCodec sender(a, b, big);
+  PacketCodec receiver(b, a, small);
+  std::string frame;
+  ASSERT_TRUE(sender.seal(std::string(4097, 'p'), frame));
+  std::string opened;
+  EXPECT_FALSE(receiver.open(frame, opened));
+  EXPECT_TRUE(opened.empty());
+}
+
+}  // namespace
+}  // namespace kbs
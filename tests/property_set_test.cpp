@@ -0,0 +1,86 @@
+#include "entity/property_set.h"
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <string>
+
+#include "common/vec3.h"
+
+namespace kbs {
+namespace {
+
+struct Position : Property<Vec3> {};
+struct Hp : Property<int32_t> {};
+struct Gold : Property<uint64_t, kScopeOwnClient | kScopeServer> {};
+struct Secret : Property<uint16_t, kScopeServer> {};
+struct Slots : Property<std::array<int16_t, 4>> {};
+using Props = PropertySet<Position, Hp, Gold, Secret, Slots>;
+
+TEST(PropertySet, DeltaCarriesOnlyDirtyFieldsForScope) {
+  Props a;
+  a.set<Hp>(90);
+  a.set<Gold>(1234);
+  a.set<Secret>(7);
+  EXPECT_FALSE(a.set_if_changed<Hp>(90));
+
+  MessageBuffer others;
+  EXPECT_EQ(a.encode_delta(others, kScopeOtherClients), Props::kMaskBytes + sizeof(int32_t));
+  MessageBuffer own;
+  EXPECT_EQ(a.encode_delta(own, kScopeOwnClient),
+            Props::kMaskBytes + sizeof(int32_t) + sizeof(uint64_t));
+
+  Props b;
+  const std::string wire = own.to_string();
+  std::string_view in = wire;
+  Props::Mask applied = 0;
+  ASSERT_TRUE(b.decode(in, &applied));
+  EXPECT_TRUE(in.empty());
+  EXPECT_EQ(applied, Props::bit<Hp> | Props::bit<Gold>);
+  EXPECT_EQ(b.get<Hp>(), 90);
+  EXPECT_EQ(b.get<Gold>(), 1234u);
+  EXPECT_EQ(b.get<Secret>(), 0u);  // server-only, never sent
+  EXPECT_EQ(b.dirty(), 0u);        // decoding does not mark dirty
+}
+
+TEST(PropertySet, FullEncodingRoundTripsEveryVisibleField) {
+  Props a;
+  a.set<Position>({1, 2, 3});
+  a.mutate<Slots>()[2] = -5;
+  a.clear_dirty();
+  MessageBuffer buf;
+  EXPECT_EQ(a.encode_full(buf, kScopeServer), Props::encoded_size(Props::kAllMask));
+  Props b;
+  const std::string wire = buf.to_string();
+  std::string_view in = wire;
+  ASSERT_TRUE(b.decode(in));
+  EXPECT_EQ(b.get<Position>().z, 3);
+  EXPECT_EQ(b.get<Slots>()[2], -5);
+}
+
+TEST(PropertySet, DecodeRejectsTruncatedAndUnknownFields) {
+  Props a;
+  a.set<Hp>(5);
+  a.set<Position>({4, 5, 6});
+  MessageBuffer buf;
+  a.encode_delta(buf);
+  const std::string wire = buf.to_string();
+
+  Props b;
+  b.set<Hp>(1);
+  for (size_t n = 0; n < wire.size(); ++n) {
+    std::string_view in(wire.data(), n);
+    EXPECT_FALSE(b.decode(in));
+    EXPECT_EQ(in.size(), n);  // not consumed
+  }
+  EXPECT_EQ(b.get<Hp>(), 1);  // untouched
+
+  std::string unknown = wire;
+  unknown[0] = static_cast<char>(unknown[0] | (1u << Props::kCount));
+  std::string_view in = unknown;
+  EXPECT_FALSE(b.decode(in));
+  EXPECT_EQ(b.get<Hp>(), 1);
+}
+
+}  // namespace
+}  // namespace kbs
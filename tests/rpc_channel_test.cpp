@@ -0,0 +1,178 @@
+#include "rpc/rpc_channel.h"
+
+#include <gtest/gtest.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+
+#include "common/task.h"
+#include "net/event_loop.h"
+
+namespace kbs {
+namespace {
+
+int nonblocking(int fd) {
+  ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+  return fd;
+}
+
+// A channel over one end of a socketpair.  The other end is a second
+// channel when the test needs answers, or left raw so requests go
+// unanswered.
+class RpcChannelTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    int fds[2];
+    ASSERT_EQ(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    conn_ = std::make_unique<TcpConnection>(loop_, nonblocking(fds[0]), 1, InetAddress());
+    peer_fd_ = nonblocking(fds[1]);
+    channel_ = RpcChannel::create(*conn_);
+    conn_->set_close_callback([this](TcpConnection&) { channel_->close(); });
+    conn_->start();
+  }
+
+  void TearDown() override {
+    channel_.reset();
+    peer_channel_.reset();
+    peer_conn_.reset();
+    if (peer_fd_ >= 0) ::close(peer_fd_);
+    conn_.reset();
+  }
+
+  // Serves the raw end with a channel of its own.
+  RpcChannel& serve_peer() {
+    peer_conn_ = std::make_unique<TcpConnection>(loop_, peer_fd_, 2, InetAddress());
+    peer_fd_ = -1;
+    peer_channel_ = RpcChannel::create(*peer_conn_);
+    peer_conn_->start();
+    return *peer_channel_;
+  }
+
+  // Runs task on the loop until it finishes (or five seconds pass).
+  void run(Task<void> task) {
+    co_spawn([](Task<void> t, EventLoop& loop, bool& done) -> Task<void> {
+      co_await std::move(t);
+      done = true;
+      loop.quit();
+    }(std::move(task), loop_, done_));
+    if (!done_) {
+      const TimerId timeout = loop_.run_after(5000, [this] { loop_.quit(); });
+      loop_.run();
+      loop_.cancel_timer(timeout);
+    }
+    ASSERT_TRUE(done_);
+  }
+
+  EventLoop loop_;
+  std::unique_ptr<TcpConnection> conn_;
+  std::shared_ptr<RpcChannel> channel_;
+  int peer_fd_ = -1;
+  std::unique_ptr<TcpConnection> peer_conn_;
+  std::shared_ptr<RpcChannel> peer_channel_;
+  bool done_ = false;
+};
+
+TEST_F(RpcChannelTest, PipelinedCallsMatchResponses) {
+  serve_peer().register_method(1, [](std::string req) -> Task<RpcResult> {
+    co_return RpcResult{RpcStatus::kOk, "echo:" + req};
+  });
+  run([](RpcChannel& ch) -> Task<void> {
+    RpcChannel::Call a = ch.call(1, "a");
+    RpcChannel::Call b = ch.call(1, "b");
+    RpcChannel::Call missing = ch.call(9, "");
+    EXPECT_EQ(ch.in_flight(), 3u);
+    EXPECT_EQ((co_await b).payload, "echo:b");
+    EXPECT_EQ((co_await a).payload, "echo:a");
+    EXPECT_EQ((co_await missing).status, RpcStatus::kNoSuchMethod);
+    EXPECT_EQ(ch.in_flight(), 0u);
+  }(*channel_));
+}
+
+TEST_F(RpcChannelTest, UnansweredCallTimesOut) {
+  run([](RpcChannel& ch) -> Task<void> {
+    RpcChannel::Call slow = ch.call(1, "ignored", 20);
+    RpcChannel::Call slower = ch.call(1, "ignored", 60000);
+    const RpcResult r = co_await slow;
+    EXPECT_EQ(r.status, RpcStatus::kTimeout);
+    EXPECT_EQ(ch.in_flight(), 1u);
+    ch.close();
+    EXPECT_EQ((co_await slower).status, RpcStatus::kDisconnected);
+  }(*channel_));
+}
+
+TEST_F(RpcChannelTest, CloseFailsOutstandingCalls) {
+  run([](RpcChannel& ch) -> Task<void> {
+    RpcChannel::Call a = ch.call(1, "x", 60000);
+    RpcChannel::Call b = ch.call(2, "y", 60000);
+    ch.close();
+    EXPECT_FALSE(ch.connected());
+    EXPECT_EQ(ch.in_flight(), 0u);
+    EXPECT_EQ((co_await a).status, RpcStatus::kDisconnected);
+    EXPECT_EQ((co_await b).status, RpcStatus::kDisconnected);
+    // Later calls fail fast.
+    EXPECT_EQ((co_await ch.call(1, "z")).status, RpcStatus::kDisconnected);
+    EXPECT_FALSE(ch.notify(1, "z"));
+  }(*channel_));
+}
+
+TEST_F(RpcChannelTest, PeerDisconnectFailsOutstandingCalls) {
+  run([](RpcChannel& ch, int& peer_fd) -> Task<void> {
+    RpcChannel::Call a = ch.call(1, "x", 60000);
+    ::close(std::exchange(peer_fd, -1));
+    EXPECT_EQ((co_await a).status, RpcStatus::kDisconnected);
+    EXPECT_FALSE(ch.connected());
+  }(*channel_, peer_fd_));
+}
+
+TEST_F(RpcChannelTest, OversizedPayloadsAreRefusedLocally) {
+  serve_peer().register_method(1, [](std::string req) -> Task<RpcResult> {
+    if (req == "big") co_return RpcResult{RpcStatus::kOk, std::string(kMaxFrameBody, 'r')};
+    co_return RpcResult{RpcStatus::kOk, "echo:" + req};
+  });
+  run([](RpcChannel& ch) -> Task<void> {
+    RpcChannel::Call other = ch.call(1, "other");
+    const std::string huge(RpcChannel::kMaxPayload + 1, 'x');
+    EXPECT_EQ((co_await ch.call(1, huge)).status, RpcStatus::kTooLarge);
+    EXPECT_FALSE(ch.notify(1, huge));
+    // The link survived: the call made before still completes, and an
+    // oversized response comes back as an error instead of killing it.
+    EXPECT_EQ((co_await other).payload, "echo:other");
+    const RpcResult big = co_await ch.call(1, "big");
+    EXPECT_EQ(big.status, RpcStatus::kError);
+    EXPECT_TRUE(ch.connected());
+    EXPECT_EQ((co_await ch.call(1, "after")).payload, "echo:after");
+  }(*channel_));
+}
+
+TEST_F(RpcChannelTest, CloseFromInsideMessageDispatch) {
+  // A non-RPC frame whose handler closes the channel: close() then runs
+  // inside the connection's message callback, which it clears.
+  RpcChannel::Call pending = channel_->call(1, "x", 60000);
+  int frames = 0;
+  channel_->set_frame_callback([&](const Frame&) {
+    ++frames;
+    channel_->close();
+    loop_.quit();
+  });
+  std::string frame;
+  const uint32_t body = 0;
+  const uint16_t msg_id = 7;
+  frame.append(reinterpret_cast<const char*>(&body), sizeof(body));
+  frame.append(reinterpret_cast<const char*>(&msg_id), sizeof(msg_id));
+  frame += frame;  // the second one must not be dispatched
+  ASSERT_EQ(::write(peer_fd_, frame.data(), frame.size()), static_cast<ssize_t>(frame.size()));
+  const TimerId timeout = loop_.run_after(5000, [this] { loop_.quit(); });
+  loop_.run();
+  loop_.cancel_timer(timeout);
+
+  EXPECT_EQ(frames, 1);
+  EXPECT_FALSE(channel_->connected());
+  ASSERT_TRUE(pending.await_ready());
+  EXPECT_EQ(pending.await_resume().status, RpcStatus::kDisconnected);
+}
+
+}  // namespace
+}  // namespace kbs
@@ -0,0 +1,62 @@
+#include "script/script_vm.h"
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+namespace kbs {
+namespace {
+
+namespace fs = std::filesystem;
+
+// One process-wide interpreter at a time, so each test owns its VM.
+class ScriptVmTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    dir_ = fs::temp_directory_path() / ("kbs_script_test_" + std::to_string(::getpid()));
+    fs::remove_all(dir_);
+    fs::create_directories(dir_);
+  }
+  void TearDown() override { fs::remove_all(dir_); }
+
+  void write_module(const std::string& name, const std::string& source) {
+    std::ofstream(dir_ / (name + ".py")) << source;
+  }
+
+  fs::path dir_;
+};
+
+TEST_F(ScriptVmTest, CallsModuleFunctionsWithViews) {
+  write_module("kbs_mod", "def scale(xs, k):\n    for i in range(len(xs)): xs[i] *= k\n"
+                          "    return len(xs)\n");
+  ScriptVm vm({{dir_.string()}});
+  const ScriptObject scale = vm.attr(vm.import("kbs_mod"), "scale");
+  float xs[] = {1, 2, 3};
+  ScriptObject result;
+  ASSERT_TRUE(vm.call(scale, {ScriptArg::view(std::span<float>(xs)), 2.0}, &result));
+  int64_t n = 0;
+  ASSERT_TRUE(ScriptVm::as_int(result, n));
+  EXPECT_EQ(n, 3);
+  EXPECT_EQ(xs[2], 6);
+
+  EXPECT_FALSE(vm.exec("raise ValueError('nope')"));
+  EXPECT_NE(vm.last_error().find("ValueError: nope"), std::string::npos);
+  EXPECT_EQ(vm.stats().errors, 1u);
+  EXPECT_THROW(vm.import("kbs_no_such_module"), std::runtime_error);
+}
+
+TEST_F(ScriptVmTest, FailedStartupCanBeRetried) {
+  // Shadows the standard module the constructor imports last.
+  write_module("traceback", "raise ImportError('shadowed')\n");
+  EXPECT_THROW(ScriptVm({{dir_.string()}}), std::runtime_error);
+  // The first attempt finalized its interpreter and released the slot.
+  ScriptVm vm;
+  EXPECT_TRUE(vm.exec("x = 1"));
+  EXPECT_THROW(ScriptVm(), std::logic_error);
+}
+
+}  // namespace
+}  // namespace kbs
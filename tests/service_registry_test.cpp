@@ -0,0 +1,173 @@
+#include "cluster/service_registry.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace kbs {
+namespace {
+
+NodeInfo node(uint64_t id, ServiceKind kind = ServiceKind::kGateway) {
+  NodeInfo n;
+  n.node_id = id;
+  n.kind = kind;
+  n.address = "10.0.0." + std::to_string(id) + ":7000";
+  return n;
+}
+
+// Ring placement only: no load bound gets in the way.
+ServiceRegistryOptions unbounded() {
+  ServiceRegistryOptions o;
+  o.load_factor = 1e9;
+  return o;
+}
+
+std::map<uint64_t, uint64_t> route_all(ServiceRegistry& r, uint64_t keys) {
+  std::map<uint64_t, uint64_t> owner;
+  for (uint64_t k = 0; k < keys; ++k) {
+    const std::optional<NodeInfo> n = r.route(ServiceKind::kGateway, k);
+    if (n) owner[k] = n->node_id;
+  }
+  return owner;
+}
+
+TEST(NodeInfo, HeartbeatRoundTripsAndRejectsMalformed) {
+  NodeInfo n = node(0x1122334455667788, ServiceKind::kWorld);
+  n.load = {1234, 5000, 16.5f};
+  n.draining = true;
+  const std::string wire = n.encode();
+  const std::optional<NodeInfo> back = NodeInfo::decode(wire);
+  ASSERT_TRUE(back);
+  EXPECT_EQ(back->node_id, n.node_id);
+  EXPECT_EQ(back->kind, ServiceKind::kWorld);
+  EXPECT_TRUE(back->draining);
+  EXPECT_EQ(back->load.ccu, 1234u);
+  EXPECT_EQ(back->load.capacity, 5000u);
+  EXPECT_FLOAT_EQ(back->load.tick_ms, 16.5f);
+  EXPECT_EQ(back->address, n.address);
+
+  for (size_t len = 0; len < wire.size(); ++len) {
+    EXPECT_FALSE(NodeInfo::decode(wire.substr(0, len))) << "prefix " << len;
+  }
+  EXPECT_FALSE(NodeInfo::decode(wire + "x"));  // address length disagrees
+  std::string bad_kind = wire;
+  bad_kind[8] = 7;
+  EXPECT_FALSE(NodeInfo::decode(bad_kind));
+}
+
+TEST(ServiceRegistry, LeavesAndJoinsMoveOnlyTheirOwnKeys) {
+  ServiceRegistry r(unbounded());
+  for (uint64_t id = 1; id <= 4; ++id) r.heartbeat(node(id), 0);
+  const std::map<uint64_t, uint64_t> before = route_all(r, 4000);
+  ASSERT_EQ(before.size(), 4000u);
+  EXPECT_EQ(route_all(r, 4000), before);  // stable
+
+  std::map<uint64_t, size_t> per_node;
+  for (const auto& [k, id] : before) ++per_node[id];
+  ASSERT_EQ(per_node.size(), 4u);
+  for (const auto& [id, n] : per_node) {
+    EXPECT_GT(n, 4000u / 4 / 2) << "node " << id;
+    EXPECT_LT(n, 4000u / 4 * 2) << "node " << id;
+  }
+
+  ASSERT_TRUE(r.remove(3));
+  EXPECT_FALSE(r.remove(3));
+  const std::map<uint64_t, uint64_t> after_leave = route_all(r, 4000);
+  for (const auto& [k, id] : before) {
+    if (id == 3) {
+      EXPECT_NE(after_leave.at(k), 3u);
+    } else {
+      EXPECT_EQ(after_leave.at(k), id) << "key " << k;
+    }
+  }
+
+  // Coming back under the same id restores its old points exactly.
+  r.heartbeat(node(3), 0);
+  EXPECT_EQ(route_all(r, 4000), before);
+
+  r.heartbeat(node(5), 0);
+  for (const auto& [k, id] : route_all(r, 4000)) {
+    if (id != 5) {
+      EXPECT_EQ(id, before.at(k)) << "key " << k;
+    }
+  }
+}
+
+TEST(ServiceRegistry, BoundedLoadCapsTheHottestNode) {
+  ServiceRegistryOptions o;
+  o.load_factor = 1.25;
+  ServiceRegistry r(o);
+  for (uint64_t id = 1; id <= 5; ++id) r.heartbeat(node(id), 0);
+  // A node that already reports far more than its share gets nothing new.
+  NodeInfo hot = node(6);
+  hot.load.ccu = 100000;
+  r.heartbeat(hot, 0);
+
+  std::map<uint64_t, uint64_t> load;
+  const uint64_t keys = 6000;
+  for (uint64_t k = 0; k < keys; ++k) {
+    const std::optional<NodeInfo> n = r.route(ServiceKind::kGateway, k * 7919);
+    ASSERT_TRUE(n);
+    ++load[n->node_id];
+  }
+  EXPECT_EQ(load.count(6), 0u);
+  const double average = static_cast<double>(keys + 100000) / 6;
+  for (uint64_t id = 1; id <= 5; ++id) {
+    EXPECT_LE(load[id], std::ceil(1.25 * average)) << "node " << id;
+  }
+  // Five cold nodes shared everything; none took much over a fifth.
+  const uint64_t hottest = std::max_element(load.begin(), load.end(), [](auto& a, auto& b) {
+                             return a.second < b.second;
+                           })->second;
+  EXPECT_LE(hottest, static_cast<uint64_t>(std::ceil(1.25 * (keys / 5.0))) + 1);
+  const ServiceRegistryStats s = r.stats();
+  EXPECT_EQ(s.routed, keys);
+  EXPECT_GT(s.overflowed, 0u);
+}
+
+TEST(ServiceRegistry, SkipsDrainingFullSlowAndExpiredNodes) {
+  ServiceRegistryOptions o;
+  o.tick_budget_ms = 50;
+  ServiceRegistry r(o);
+
+  NodeInfo draining = node(1);
+  draining.draining = true;
+  NodeInfo full = node(2);
+  full.load = {10, 10, 0};
+  NodeInfo slow = node(3, ServiceKind::kWorld);
+  slow.load.tick_ms = 80;
+  for (const NodeInfo& n : {draining, full, slow}) r.heartbeat(n, 0);
+  EXPECT_FALSE(r.route(ServiceKind::kGateway, uint64_t{42}));
+  EXPECT_FALSE(r.route(ServiceKind::kWorld, uint64_t{42}));
+  EXPECT_EQ(r.stats().unroutable, 2u);
+
+  // Capacity counts keys routed since the last heartbeat.
+  NodeInfo small = node(4);
+  small.load = {0, 2, 0};
+  r.heartbeat(small, 0);
+  EXPECT_EQ(r.route(ServiceKind::kGateway, "alice")->node_id, 4u);
+  EXPECT_EQ(r.route(ServiceKind::kGateway, "bob")->node_id, 4u);
+  EXPECT_FALSE(r.route(ServiceKind::kGateway, "carol"));
+  r.heartbeat(small, 1000);
+  EXPECT_TRUE(r.route(ServiceKind::kGateway, "carol"));
+
+  // Kinds route separately: world keys never land on gateways.
+  r.heartbeat(node(5, ServiceKind::kWorld), 1000);
+  EXPECT_EQ(r.route(ServiceKind::kWorld, uint64_t{1})->node_id, 5u);
+  EXPECT_EQ(r.nodes(ServiceKind::kWorld).size(), 2u);
+
+  // Nodes 1-3 last spoke at 0; 4 and 5 at 1000.
+  EXPECT_EQ(r.expire(3500), 3u);
+  EXPECT_EQ(r.nodes(ServiceKind::kGateway).size(), 1u);
+  EXPECT_EQ(r.stats().expired, 3u);
+  EXPECT_EQ(r.expire(4001), 2u);
+  EXPECT_FALSE(r.route(ServiceKind::kWorld, uint64_t{1}));
+  EXPECT_EQ(r.stats().nodes, 0u);
+}
+
+}  // namespace
+}  // namespace kbs
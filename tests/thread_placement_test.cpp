@@ -0,0 +1,69 @@
+#include "common/thread_placement.h"
+
+#include <gtest/gtest.h>
+#include <pthread.h>
+
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace kbs {
+namespace {
+
+TEST(ThreadPlacement, ParsesCpuLists) {
+  EXPECT_EQ(parse_cpu_list("0-3,8,10-11"), (std::vector<int>{0, 1, 2, 3, 8, 10, 11}));
+  // Sorted and deduplicated, empty items skipped.
+  EXPECT_EQ(parse_cpu_list("5,1-2,,2,1"), (std::vector<int>{1, 2, 5}));
+  EXPECT_TRUE(parse_cpu_list("").empty());
+  for (const char* bad : {"3-1", "x", "1-", "-2", "1-2-3", "0-100000", "4,y"}) {
+    EXPECT_THROW(parse_cpu_list(bad), std::invalid_argument) << bad;
+  }
+}
+
+TEST(ThreadPlacement, ParsesSpecs) {
+  const ThreadPlacement p = ThreadPlacement::parse("cpus:2-4;node:1;name:io;remote-memory");
+  EXPECT_EQ(p.cpus, (std::vector<int>{2, 3, 4}));
+  EXPECT_EQ(p.numa_node, 1);
+  EXPECT_EQ(p.name, "io");
+  EXPECT_FALSE(p.local_memory);
+  EXPECT_EQ(p.cpu_for(0), 2);
+  EXPECT_EQ(p.cpu_for(4), 3);  // wraps
+
+  const ThreadPlacement floating = ThreadPlacement::parse("");
+  EXPECT_TRUE(floating.empty());
+  EXPECT_EQ(floating.cpu_for(0), -1);
+  for (const char* bad : {"cpus:9-1", "node:-1", "node:x", "pin:3", "name"}) {
+    EXPECT_THROW(ThreadPlacement::parse(bad), std::invalid_argument) << bad;
+  }
+}
+
+TEST(ThreadPlacement, NamesTheThread) {
+  ThreadPlacement p;
+  p.name = "kbs-placement-test";
+  std::string name;
+  bool placed = false;
+  std::thread([&] {
+    placed = place_current_thread(p, 12);
+    char buf[16] = {};
+    ::pthread_getname_np(::pthread_self(), buf, sizeof(buf));
+    name = buf;
+  }).join();
+  EXPECT_TRUE(placed);
+  // Shortened to the kernel's 15 bytes, keeping the index.
+  EXPECT_EQ(name, "kbs-placemen-12");
+}
+
+TEST(ThreadPlacement, HostTopologyIsConsistent) {
+  const CpuTopology& topo = CpuTopology::host();
+  ASSERT_FALSE(topo.cpus.empty());
+  EXPECT_GE(topo.num_nodes, 1);
+  size_t on_nodes = 0;
+  for (int node = 0; node < topo.num_nodes; ++node) on_nodes += topo.node_cpus(node).size();
+  EXPECT_EQ(on_nodes, topo.cpus.size());
+  for (const CpuTopology::Cpu& c : topo.cpus) EXPECT_EQ(topo.node_of(c.id), c.node);
+  EXPECT_EQ(topo.node_of(-1), -1);
+}
+
+}  // namespace
+}  // namespace kbs
@@ -0,0 +1,89 @@
+#include "common/tick_arena.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <memory_resource>
+#include <vector>
+
+namespace kbs {
+namespace {
+
+// Counts what the arena asks its upstream for.
+class CountingResource final : public std::pmr::memory_resource {
+ public:
+  size_t live = 0;
+  size_t calls = 0;
+
+ private:
+  void* do_allocate(size_t bytes, size_t alignment) override {
+    ++calls;
+    live += bytes;
+    return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+  }
+  void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+    live -= bytes;
+    std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+  }
+  bool do_is_equal(const std::pmr::memory_resource& o) const noexcept override {
+    return this == &o;
+  }
+};
+
+TEST(TickArena, AlignsAndCountsUsage) {
+  TickArena arena(4096);
+  auto* c = arena.create<char>('x');
+  auto* d = arena.create<double>(1.5);
+  auto* v = static_cast<std::byte*>(arena.allocate(100, 64));
+  EXPECT_EQ(*c, 'x');
+  EXPECT_EQ(*d, 1.5);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(d) % alignof(double), 0u);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(v) % 64, 0u);
+  EXPECT_GE(arena.bytes_used(), 1 + sizeof(double) + 100);
+  int* xs = arena.allocate_array<int>(10);
+  for (int i = 0; i < 10; ++i) xs[i] = i;
+  EXPECT_EQ(xs[9], 9);
+  arena.reset();
+  EXPECT_EQ(arena.bytes_used(), 0u);
+}
+
+TEST(TickArena, SpilledTickGrowsToOneBlock) {
+  CountingResource upstream;
+  {
+    TickArena arena(4096, &upstream);
+    EXPECT_EQ(upstream.calls, 1u);
+    std::vector<void*> ptrs;
+    for (int i = 0; i < 40; ++i) ptrs.push_back(arena.allocate(400, 8));
+    EXPECT_GT(upstream.calls, 2u);  // spilled into extra blocks
+    EXPECT_GE(arena.bytes_used(), 16000u);
+    arena.reset();
+    EXPECT_GE(arena.peak_bytes(), 16000u);
+
+    // The same peak again fits in the single regrown block.
+    const size_t before = upstream.calls;
+    for (int t = 0; t < 5; ++t) {
+      for (int i = 0; i < 40; ++i) ptrs[i] = arena.allocate(400, 8);
+      arena.reset();
+    }
+    EXPECT_EQ(upstream.calls, before);
+    EXPECT_EQ(arena.upstream_allocations(), before);
+    EXPECT_GE(arena.bytes_reserved(), 16000u);
+    // An allocation bigger than a block gets a block of its own.
+    EXPECT_NE(arena.allocate(1 << 20, 16), nullptr);
+  }
+  EXPECT_EQ(upstream.live, 0u);
+}
+
+TEST(TickArena, BacksPmrContainers) {
+  TickArena arena(1024);
+  std::pmr::vector<uint64_t> v(&arena);
+  for (uint64_t i = 0; i < 1000; ++i) v.push_back(i);
+  EXPECT_EQ(v[999], 999u);
+  EXPECT_GE(arena.bytes_used(), 1000 * sizeof(uint64_t));
+  EXPECT_TRUE(arena.is_equal(arena));
+  TickArena other;
+  EXPECT_FALSE(arena.is_equal(other));
+}
+
+}  // namespace
+}  // namespace kbs
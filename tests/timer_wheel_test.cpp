@@ -0,0 +1,134 @@
+#include "common/timer_wheel.h"
+
+#include <gtest/gtest.h>
+
+#include <deque>
+#include <map>
+#include <random>
+#include <vector>
+
+namespace kbs {
+namespace {
+
+TEST(TimerWheel, OneShotPeriodicCancelAndReschedule) {
+  TimerWheel w(1000);
+  std::vector<uint64_t> fired;
+  const TimerId once = w.schedule(5, [&] { fired.push_back(w.now()); });
+  const TimerId zero = w.schedule(0, [&] { fired.push_back(w.now() + 100000); });
+  int periodic = 0;
+  const TimerId every = w.schedule(3, [&] { ++periodic; }, 4);
+  const TimerId moved = w.schedule(2, [&] { fired.push_back(w.now() + 200000); });
+  EXPECT_TRUE(w.reschedule(moved, 10));
+  EXPECT_EQ(w.size(), 4u);
+
+  EXPECT_EQ(w.advance(1), 1u);  // a 0 delay fires on the next tick
+  EXPECT_EQ(fired, std::vector<uint64_t>{101001});
+  EXPECT_FALSE(w.pending(zero));
+  w.advance(4);
+  EXPECT_EQ(fired.back(), 1005u);
+  EXPECT_FALSE(w.cancel(once));  // already fired
+  w.advance(6);
+  EXPECT_EQ(fired.back(), 201010u);
+  EXPECT_EQ(periodic, 3);  // 1003, 1007, 1011
+  EXPECT_TRUE(w.pending(every));
+  EXPECT_TRUE(w.cancel(every));
+  EXPECT_FALSE(w.cancel(every));
+  EXPECT_EQ(w.size(), 0u);
+  EXPECT_EQ(w.ticks_until_next(), UINT64_MAX);
+  w.advance(100);
+  EXPECT_EQ(periodic, 3);
+}
+
+TEST(TimerWheel, CallbacksMayCancelAndScheduleDuringFiring) {
+  TimerWheel w;
+  // Two timers due in the same tick, each cancelling the other: whichever
+  // runs first wins and the other never runs.
+  int ran = 0;
+  TimerId a = 0;
+  TimerId b = 0;
+  a = w.schedule(1, [&] {
+    ++ran;
+    w.cancel(b);
+  });
+  b = w.schedule(1, [&] {
+    ++ran;
+    w.cancel(a);
+  });
+  // A periodic timer stopping itself, and one scheduling a follow-up.
+  int ticks = 0;
+  TimerId self = 0;
+  self = w.schedule(1, [&] {
+    if (++ticks == 3) {
+      EXPECT_TRUE(w.cancel(self));
+    }
+  }, 1);
+  bool follow_up = false;
+  w.schedule(2, [&] { w.schedule(1, [&] { follow_up = true; }); });
+  w.advance(1);
+  EXPECT_EQ(ran, 1);
+  w.advance(1);  // the follow-up is scheduled now, for the next tick
+  EXPECT_FALSE(follow_up);
+  w.advance(1);
+  EXPECT_TRUE(follow_up);
+  w.advance(10);
+  EXPECT_EQ(ticks, 3);
+  EXPECT_FALSE(w.pending(self));
+  EXPECT_EQ(w.size(), 0u);
+}
+
+// Delays up to 2^20 exercise three levels and their cascades.
+TEST(TimerWheel, MatchesModelAcrossLevels) {
+  TimerWheel w(12345);
+  std::mt19937_64 rng(5);
+  std::map<TimerId, uint64_t> due;  // id -> expected tick
+  std::vector<std::pair<TimerId, uint64_t>> fired;
+  std::deque<TimerId> ids;  // by schedule order; callbacks find theirs here
+  const auto delay = [&] {
+    const int bits = static_cast<int>(rng() % 21);
+    return rng() % (uint64_t{1} << bits);
+  };
+  for (int round = 0; round < 400; ++round) {
+    for (int k = 0; k < 20; ++k) {
+      const uint64_t d = delay();
+      const size_t serial = ids.size();
+      ids.push_back(w.schedule(d, [&, serial] { fired.emplace_back(ids[serial], w.now()); }));
+      due[ids.back()] = w.now() + std::max<uint64_t>(d, 1);
+    }
+    // Cancel or move a few of the pending ones.
+    for (int k = 0; k < 5 && !due.empty(); ++k) {
+      auto it = due.begin();
+      std::advance(it, static_cast<long>(rng() % due.size()));
+      if (rng() % 2) {
+        const uint64_t d = delay();
+        ASSERT_TRUE(w.reschedule(it->first, d));
+        it->second = w.now() + std::max<uint64_t>(d, 1);
+      } else {
+        ASSERT_TRUE(w.cancel(it->first));
+        due.erase(it);
+      }
+    }
+    const uint64_t next = w.ticks_until_next();
+    const uint64_t earliest =
+        std::min_element(due.begin(), due.end(), [](auto& a, auto& b) {
+          return a.second < b.second;
+        })->second;
+    EXPECT_LE(next, earliest - w.now());
+
+    w.advance(1 + rng() % 5000);
+    for (auto [id, at] : fired) {
+      auto it = due.find(id);
+      ASSERT_NE(it, due.end());
+      EXPECT_EQ(at, it->second);
+      due.erase(it);
+    }
+    fired.clear();
+    for (auto& [id, at] : due) ASSERT_GT(at, w.now()) << "overdue timer did not fire";
+    EXPECT_EQ(w.size(), due.size());
+  }
+  w.advance(uint64_t{1} << 21);
+  for (auto [id, at] : fired) due.erase(id);
+  EXPECT_TRUE(due.empty());
+}
+
+}  // namespace
+}  // namespace kbs
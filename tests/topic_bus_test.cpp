@@ -0,0 +1,178 @@
+#include "cluster/topic_bus.h"
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace kbs {
+namespace {
+
+struct Fanout {
+  std::vector<uint64_t> sessions;
+  std::vector<std::pair<TopicId, std::string>> messages;  // decoded frames
+};
+
+// A bus whose sink decodes each fan-out buffer back into messages.
+class TopicBusTest : public ::testing::Test {
+ protected:
+  TopicBusTest()
+      : bus_([this](std::span<const uint64_t> s, const MessageBuffer& b) { sink(s, b); }) {}
+
+  void sink(std::span<const uint64_t> sessions, const MessageBuffer& buf) {
+    Fanout& f = out_.emplace_back();
+    f.sessions.assign(sessions.begin(), sessions.end());
+    const std::string bytes = buf.to_string();
+    std::string_view rest = bytes;
+    Frame frame;
+    size_t consumed = 0;
+    while (parse_frame(rest, frame, consumed) == FrameStatus::kOk) {
+      TopicId topic;
+      ASSERT_GE(frame.body.size(), sizeof(topic));
+      std::memcpy(&topic, frame.body.data(), sizeof(topic));
+      f.messages.emplace_back(topic, std::string(frame.body.substr(sizeof(topic))));
+      rest.remove_prefix(consumed);
+    }
+    EXPECT_TRUE(rest.empty());
+  }
+
+  TopicBus bus_;
+  std::vector<Fanout> out_;
+};
+
+constexpr TopicId kZone = make_topic(TopicKind::kZone, 7);
+constexpr TopicId kGuild = make_topic(TopicKind::kGuild, 7);
+
+TEST(TopicId, KindRoundTrips) {
+  EXPECT_EQ(topic_kind(make_topic(TopicKind::kParty, 0xFFFFFFFFFFFFFFFFull)), TopicKind::kParty);
+  EXPECT_EQ(make_topic(TopicKind::kWorld, 5), 5u);
+  EXPECT_EQ(topic_kind(TopicId{0xFF} << 56), TopicKind::kCustom);
+}
+
+TEST_F(TopicBusTest, OneBufferPerTopicPerFlush) {
+  bus_.subscribe(3, kZone);
+  bus_.subscribe(1, kZone);
+  bus_.subscribe(1, kZone);  // idempotent
+  bus_.subscribe(2, kGuild);
+  EXPECT_EQ(bus_.subscribers(kZone), 2u);
+  for (const char* m : {"a", "b", "c"}) {
+    EXPECT_EQ(bus_.publish(kZone, 1, m), TopicBus::PublishResult::kOk);
+  }
+  EXPECT_EQ(bus_.publish(make_topic(TopicKind::kZone, 8), 1, "nobody"),
+            TopicBus::PublishResult::kOk);
+  EXPECT_EQ(bus_.flush(), 3u);
+  ASSERT_EQ(out_.size(), 1u);
+  EXPECT_EQ(out_[0].sessions, (std::vector<uint64_t>{1, 3}));
+  ASSERT_EQ(out_[0].messages.size(), 3u);
+  EXPECT_EQ(out_[0].messages[2], std::make_pair(kZone, std::string("c")));
+  EXPECT_EQ(bus_.stats().deliveries, 2u);
+  EXPECT_EQ(bus_.flush(), 0u);
+
+  bus_.unsubscribe_all(1);
+  EXPECT_EQ(bus_.subscribers(kZone), 1u);
+  bus_.unsubscribe(3, kZone);
+  EXPECT_EQ(bus_.subscribers(kZone), 0u);
+}
+
+TEST_F(TopicBusTest, CoalesceKeyKeepsLatest) {
+  bus_.subscribe(1, kZone);
+  bus_.publish(kZone, 1, "boss 80%", 0, 42);
+  bus_.publish(kZone, 1, "chat");
+  bus_.publish(kZone, 1, "boss 40%", 0, 42);
+  bus_.flush();
+  ASSERT_EQ(out_.size(), 1u);
+  ASSERT_EQ(out_[0].messages.size(), 2u);
+  EXPECT_EQ(out_[0].messages[0].second, "boss 40%");
+  EXPECT_EQ(out_[0].messages[1].second, "chat");
+  EXPECT_EQ(bus_.stats().coalesced, 1u);
+}
+
+TEST_F(TopicBusTest, RateLimitIsPerSenderAndSpareOnOversize) {
+  bus_.subscribe(1, kZone);
+  const std::string huge(TopicBusOptions{}.max_payload + 1, 'x');
+  // Oversized messages are dropped before they reach the bucket.
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_EQ(bus_.publish(kZone, 1, huge, 9), TopicBus::PublishResult::kDropped);
+  }
+  // Zone burst is 5.
+  for (int i = 0; i < 5; ++i) {
+    EXPECT_EQ(bus_.publish(kZone, 1, "x", 9), TopicBus::PublishResult::kOk);
+  }
+  EXPECT_EQ(bus_.publish(kZone, 1, "x", 9), TopicBus::PublishResult::kRateLimited);
+  EXPECT_EQ(bus_.publish(kZone, 1, "x", 8), TopicBus::PublishResult::kOk);
+  EXPECT_EQ(bus_.publish(kZone, 1, "x", 0), TopicBus::PublishResult::kOk);
+  EXPECT_EQ(bus_.stats().rate_limited, 1u);
+  EXPECT_EQ(bus_.stats().dropped, 10u);
+}
+
+TEST_F(TopicBusTest, PeersForwardOnlyInterestingLocalMessages) {
+  std::vector<std::pair<uint16_t, std::string>> to_remote;
+  std::vector<std::vector<uint64_t>> remote_out;  // recipients per buffer
+  TopicBus remote([&](std::span<const uint64_t> s, const MessageBuffer&) {
+    remote_out.emplace_back(s.begin(), s.end());
+  });
+  std::vector<std::pair<uint16_t, std::string>> to_local;
+  const TopicBus::PeerId at_local =
+      bus_.add_peer([&](uint16_t m, std::string p) { to_local.emplace_back(m, std::move(p)); });
+  const TopicBus::PeerId at_remote =
+      remote.add_peer([&](uint16_t m, std::string p) { to_remote.emplace_back(m, std::move(p)); });
+  // Delivers what each bus sent the other so far.
+  const auto pump = [&] {
+    for (auto& [m, p] : std::exchange(to_local, {})) {
+      EXPECT_TRUE(remote.on_peer_message(at_remote, m, p));
+    }
+    for (auto& [m, p] : std::exchange(to_remote, {})) {
+      EXPECT_TRUE(bus_.on_peer_message(at_local, m, p));
+    }
+  };
+
+  remote.subscribe(50, kGuild);
+  pump();
+  bus_.publish(kGuild, 4, "hello");
+  bus_.publish(kZone, 4, "unwanted");
+  bus_.flush();
+  EXPECT_TRUE(out_.empty());  // no local subscribers
+  pump();
+  EXPECT_EQ(remote.flush(), 1u);
+  ASSERT_EQ(remote_out.size(), 1u);
+  EXPECT_EQ(remote_out[0], std::vector<uint64_t>{50});
+  EXPECT_EQ(bus_.stats().remote_out, 1u);
+  EXPECT_EQ(remote.stats().remote_in, 1u);
+
+  // Received messages are not sent back, even to an interested peer.
+  bus_.subscribe(1, kGuild);
+  pump();
+  remote.publish(kGuild, 4, "from remote");
+  remote.flush();
+  pump();
+  bus_.flush();
+  pump();
+  EXPECT_EQ(remote.stats().remote_in, 1u);
+  ASSERT_EQ(out_.size(), 1u);
+  EXPECT_EQ(out_[0].messages[0].second, "from remote");
+}
+
+TEST_F(TopicBusTest, MalformedPeerMessagesAreRejected) {
+  const TopicBus::PeerId peer = bus_.add_peer([](uint16_t, std::string) {});
+  EXPECT_FALSE(bus_.on_peer_message(peer + 1, TopicBus::kMethodInterest, std::string(9, '\1')));
+  EXPECT_FALSE(bus_.on_peer_message(peer, TopicBus::kMethodInterest, ""));
+  EXPECT_FALSE(bus_.on_peer_message(peer, TopicBus::kMethodInterest, std::string(5, '\1')));
+  EXPECT_FALSE(bus_.on_peer_message(peer, 0x7777, ""));
+
+  std::string record;
+  const TopicId topic = kZone;
+  const uint16_t msg_id = 1;
+  const uint32_t len = 100;  // more than follows
+  record.append(reinterpret_cast<const char*>(&topic), sizeof(topic));
+  record.append(reinterpret_cast<const char*>(&msg_id), sizeof(msg_id));
+  record.append(reinterpret_cast<const char*>(&len), sizeof(len));
+  record += "short";
+  EXPECT_FALSE(bus_.on_peer_message(peer, TopicBus::kMethodPublish, record));
+  EXPECT_FALSE(bus_.on_peer_message(peer, TopicBus::kMethodPublish, "abc"));
+  EXPECT_TRUE(bus_.on_peer_message(peer, TopicBus::kMethodPublish, ""));
+}
+
+}  // namespace
+}  // namespace kbs
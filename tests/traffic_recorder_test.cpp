@@ -0,0 +1,110 @@
+#include "net/traffic_recorder.h"
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace kbs {
+namespace {
+
+namespace fs = std::filesystem;
+using Type = TrafficRecorder::RecordType;
+
+struct Seen {
+  Type type;
+  uint64_t conn;
+  std::string data;
+  uint64_t lost;
+
+  bool operator==(const Seen&) const = default;
+};
+
+class TrafficRecorderTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    path_ = (fs::temp_directory_path() / ("kbs_traffic_" + std::to_string(::getpid()))).string();
+  }
+  void TearDown() override { fs::remove(path_); }
+
+  // The writer only drains when the recorder is destroyed.
+  TrafficRecorderOptions options(size_t max_buffer) const {
+    TrafficRecorderOptions o;
+    o.path = path_;
+    o.flush_ms = 60000;
+    o.max_buffer_bytes = max_buffer;
+    return o;
+  }
+
+  std::vector<Seen> read_back(size_t* count = nullptr) const {
+    std::vector<Seen> out;
+    const size_t n = TrafficRecorder::read(path_, [&](const TrafficRecorder::Record& r) {
+      out.push_back({r.type, r.conn_id, std::string(r.data), r.lost_bytes});
+    });
+    if (count) *count = n;
+    return out;
+  }
+
+  std::string path_;
+};
+
+TEST_F(TrafficRecorderTest, RoundTripsRecordsInOrder) {
+  {
+    TrafficRecorder rec(options(1 << 20));
+    rec.record_open(1);
+    rec.record_data(1, "hello");
+    rec.record_data(1, std::string(300, 'x'));  // multi-byte varint length
+    rec.record_open(uint64_t{1} << 40);
+    rec.record_close(1);
+    EXPECT_EQ(rec.stats().records, 5u);
+  }
+  size_t count = 0;
+  EXPECT_EQ(read_back(&count),
+            (std::vector<Seen>{{Type::kOpen, 1, "", 0},
+                               {Type::kData, 1, "hello", 0},
+                               {Type::kData, 1, std::string(300, 'x'), 0},
+                               {Type::kOpen, uint64_t{1} << 40, "", 0},
+                               {Type::kClose, 1, "", 0}}));
+  EXPECT_EQ(count, 5u);
+}
+
+TEST_F(TrafficRecorderTest, FullBufferKeepsOpenCloseAndMarksGaps) {
+  {
+    TrafficRecorder rec(options(64));
+    rec.record_open(1);
+    rec.record_data(1, "kept");
+    rec.record_data(1, std::string(100, 'a'));  // over the cap: dropped
+    rec.record_data(1, std::string(60, 'b'));
+    rec.record_open(2);
+    rec.record_close(1);  // still recorded, after the gap
+    rec.record_close(2);
+    const TrafficRecorderStats s = rec.stats();
+    EXPECT_EQ(s.dropped, 2u);
+    EXPECT_EQ(s.gaps, 1u);
+  }
+  EXPECT_EQ(read_back(), (std::vector<Seen>{{Type::kOpen, 1, "", 0},
+                                            {Type::kData, 1, "kept", 0},
+                                            {Type::kOpen, 2, "", 0},
+                                            {Type::kGap, 1, "", 160},
+                                            {Type::kClose, 1, "", 0},
+                                            {Type::kClose, 2, "", 0}}));
+}
+
+TEST_F(TrafficRecorderTest, ReadStopsAtTornTailAndRejectsOtherFiles) {
+  {
+    TrafficRecorder rec(options(1 << 20));
+    rec.record_open(1);
+    rec.record_data(1, "abcdef");
+  }
+  fs::resize_file(path_, fs::file_size(path_) - 2);
+  EXPECT_EQ(read_back(), (std::vector<Seen>{{Type::kOpen, 1, "", 0}}));
+
+  std::ofstream(path_, std::ios::trunc) << "not a recording";
+  EXPECT_THROW(read_back(), std::runtime_error);
+}
+
+}  // namespace
+}  // namespace kbs
@@ -0,0 +1,235 @@
+#include "net/udp_session.h"
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <deque>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "net/event_loop.h"
+#include "net/udp_endpoint.h"
+
+namespace kbs {
+namespace {
+
+// Two sessions joined by an in-memory link that can lose, delay and
+// reorder datagrams.
+class UdpLink {
+ public:
+  explicit UdpLink(const UdpSessionOptions& options = {},
+                   const UdpSessionOptions& b_options = {})
+      : a_(7, InetAddress(1, true), options), b_(7, InetAddress(2, true), b_options) {
+    a_.set_output([this](std::string_view d) { carry(ab_, d); });
+    b_.set_output([this](std::string_view d) { carry(ba_, d); });
+    b_.set_message_callback([this](UdpChannel channel, std::string_view m) {
+      if (channel == UdpChannel::kReliable) {
+        reliable_.emplace_back(m);
+      } else {
+        unreliable_.emplace_back(m);
+      }
+    });
+  }
+
+  UdpSession& a() { return a_; }
+  UdpSession& b() { return b_; }
+  uint64_t now() const { return now_; }
+  const std::vector<std::string>& reliable() const { return reliable_; }
+  const std::vector<std::string>& unreliable() const { return unreliable_; }
+
+  void set_loss_percent(uint32_t loss) { loss_ = loss; }
+  void set_reverse(bool reverse) { reverse_ = reverse; }
+
+  // One 10 ms step: deliver what is due, then flush both ends.
+  void step() {
+    deliver(ab_, b_);
+    deliver(ba_, a_);
+    a_.flush(now_);
+    b_.flush(now_);
+    now_ += 10;
+  }
+
+  // Steps until a has nothing unacknowledged or limit_ms passes.
+  void run_until_idle(uint64_t limit_ms) {
+    const uint64_t end = now_ + limit_ms;
+    do {
+      step();
+    } while (now_ < end && (a_.pending_segments() != 0 || !ab_.empty() || !ba_.empty()));
+  }
+
+ private:
+  struct InFlight {
+    uint64_t at;
+    std::string data;
+  };
+
+  void carry(std::deque<InFlight>& q, std::string_view d) {
+    if (rng_() % 100 < loss_) return;
+    q.push_back({now_ + 20, std::string(d)});
+  }
+
+  void deliver(std::deque<InFlight>& q, UdpSession& to) {
+    std::vector<std::string> due;
+    while (!q.empty() && q.front().at <= now_) {
+      due.push_back(std::move(q.front().data));
+      q.pop_front();
+    }
+    if (reverse_) std::reverse(due.begin(), due.end());
+    for (const std::string& d : due) EXPECT_TRUE(to.input(d, now_));
+  }
+
+  UdpSession a_;
+  UdpSession b_;
+  std::deque<InFlight> ab_;
+  std::deque<InFlight> ba_;
+  std::vector<std::string> reliable_;
+  std::vector<std::string> unreliable_;
+  std::mt19937 rng_{1};
+  uint32_t loss_ = 0;
+  bool reverse_ = false;
+  uint64_t now_ = 0;
+};
+
+std::vector<std::string> make_messages(size_t count) {
+  std::vector<std::string> out;
+  for (size_t i = 0; i < count; ++i) {
+    // Every 25th spans several datagrams.
+    std::string m(i % 25 == 0 ? 5000 : 1 + i % 100, static_cast<char>('a' + i % 26));
+    m += std::to_string(i);
+    out.push_back(std::move(m));
+  }
+  return out;
+}
+
+TEST(UdpSession, DeliversInOrderOverLossyLink) {
+  UdpLink link;
+  link.set_loss_percent(20);
+  const std::vector<std::string> sent = make_messages(300);
+  for (const std::string& m : sent) ASSERT_TRUE(link.a().send(UdpChannel::kReliable, m));
+  link.run_until_idle(20000);
+
+  EXPECT_EQ(link.reliable(), sent);
+  EXPECT_EQ(link.a().pending_segments(), 0u);
+  EXPECT_GT(link.a().stats().retransmits + link.a().stats().fast_retransmits, 0u);
+  EXPECT_FALSE(link.a().dead(link.now()));
+}
+
+TEST(UdpSession, ReordersReliableAndDropsStaleUnreliable) {
+  UdpLink link;
+  link.set_reverse(true);
+  const std::vector<std::string> sent = make_messages(100);
+  for (const std::string& m : sent) ASSERT_TRUE(link.a().send(UdpChannel::kReliable, m));
+  link.run_until_idle(5000);
+  EXPECT_EQ(link.reliable(), sent);
+
+  // Three updates flushed separately arrive newest first: only the newest
+  // is delivered.
+  for (const char* m : {"u1", "u2", "u3"}) {
+    ASSERT_TRUE(link.a().send(UdpChannel::kUnreliable, m));
+    link.a().flush(link.now());
+  }
+  link.run_until_idle(100);
+  EXPECT_EQ(link.unreliable(), std::vector<std::string>{"u3"});
+  EXPECT_EQ(link.b().stats().unreliable_dropped, 2u);
+}
+
+TEST(UdpSession, CloseReachesPeer) {
+  UdpLink link;
+  ASSERT_TRUE(link.a().send(UdpChannel::kReliable, "bye"));
+  link.run_until_idle(1000);
+  link.a().close();
+  EXPECT_TRUE(link.a().closed());
+  EXPECT_TRUE(link.a().close_pending());
+  EXPECT_FALSE(link.a().send(UdpChannel::kReliable, "late"));
+  link.run_until_idle(100);
+
+  EXPECT_FALSE(link.a().close_pending());
+  EXPECT_TRUE(link.b().closed());
+  EXPECT_TRUE(link.b().dead(link.now()));
+  EXPECT_EQ(link.reliable(), std::vector<std::string>{"bye"});
+}
+
+TEST(UdpSession, OversizedMessageClosesReceiver) {
+  UdpSessionOptions small;
+  small.max_message = 4000;
+  UdpLink link({}, small);
+  ASSERT_TRUE(link.a().send(UdpChannel::kReliable, std::string(1000, 'x')));
+  ASSERT_TRUE(link.a().send(UdpChannel::kReliable, std::string(10000, 'y')));
+  link.run_until_idle(1000);
+
+  EXPECT_EQ(link.reliable().size(), 1u);
+  EXPECT_TRUE(link.b().closed());
+  EXPECT_EQ(link.b().stats().oversized, 1u);
+  // The sender refuses what its own limit rules out.
+  UdpSession c(9, InetAddress(3, true), small);
+  EXPECT_FALSE(c.send(UdpChannel::kReliable, std::string(5000, 'z')));
+}
+
+template <typename T>
+void put(std::string& out, T v) {
+  out.append(reinterpret_cast<const char*>(&v), sizeof(T));
+}
+
+// A datagram of conv 7 holding only ack-range segments.
+std::string ack_ranges(std::initializer_list<std::pair<uint32_t, uint16_t>> ranges) {
+  std::string d;
+  put<uint32_t>(d, 7);    // conv
+  put<uint8_t>(d, 0);     // flags
+  put<uint32_t>(d, 0);    // cumulative ack
+  put<uint16_t>(d, 256);  // window
+  for (auto [first, count] : ranges) {
+    put<uint8_t>(d, 3);  // kAckRange
+    put<uint32_t>(d, first);
+    put<uint16_t>(d, sizeof(uint16_t));
+    put<uint16_t>(d, count);
+  }
+  return d;
+}
+
+TEST(UdpSession, AckRangesOutsideSendWindowAreIgnored) {
+  UdpSession a(7, InetAddress(1, true));
+  a.set_output([](std::string_view) {});
+  for (const char* m : {"m0", "m1", "m2"}) ASSERT_TRUE(a.send(UdpChannel::kReliable, m));
+  a.flush(0);
+  ASSERT_EQ(a.pending_segments(), 3u);
+
+  // Starting before the oldest unacknowledged segment (which would wrap
+  // onto all three) or past the newest: nothing is acknowledged.
+  EXPECT_TRUE(a.input(ack_ranges({{0xFFFFFFF0u, 0xFFFF}, {3, 0xFFFF}, {1000, 0xFFFF}}), 10));
+  EXPECT_EQ(a.pending_segments(), 3u);
+  // A huge count from inside the window acknowledges only what was sent.
+  EXPECT_TRUE(a.input(ack_ranges({{0, 0xFFFF}}), 20));
+  EXPECT_EQ(a.pending_segments(), 0u);
+}
+
+TEST(UdpEndpoint, SessionClosedDirectlyIsSentAndReaped) {
+  EventLoop loop;
+  UdpEndpoint server(loop, InetAddress(0, true));
+  UdpEndpointOptions client_options;
+  client_options.accept = false;
+  UdpEndpoint client(loop, InetAddress(0, true), client_options);
+  int server_closed = 0;
+  int client_closed = 0;
+  server.set_message_callback([](UdpSession& s, UdpChannel, std::string_view) { s.close(); });
+  server.set_close_callback([&](UdpSession&) { ++server_closed; });
+  client.set_close_callback([&](UdpSession&) {
+    ++client_closed;
+    loop.quit();
+  });
+  server.start();
+  client.start();
+  UdpSession& session = client.connect(server.local_address());
+  ASSERT_TRUE(session.send(UdpChannel::kReliable, "hello"));
+  client.flush();
+  loop.run_after(5000, [&] { loop.quit(); });
+  loop.run();
+
+  EXPECT_EQ(server_closed, 1);
+  EXPECT_EQ(client_closed, 1);
+  EXPECT_EQ(server.session_count(), 0u);
+  EXPECT_EQ(client.session_count(), 0u);
+}
+
+}  // namespace
+}  // namespace kbs
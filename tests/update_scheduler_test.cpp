@@ -0,0 +1,177 @@
+#include "space/update_scheduler.h"
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <map>
+#include <vector>
+
+namespace kbs {
+namespace {
+
+// Drives one scheduler against a fixed set of positions, recording what
+// each tick picked.
+class SchedulerRig {
+ public:
+  explicit SchedulerRig(const UpdateSchedulerOptions& options = {}) : scheduler_(options) {}
+
+  void place(EntityId id, Vec3 pos) {
+    scheduler_.add(id);
+    positions_[id] = pos;
+  }
+
+  // One tick at the origin; every update costs bytes_each.
+  std::vector<ScheduledUpdate> tick(size_t bytes_each = 10) {
+    std::vector<ScheduledUpdate> out;
+    scheduler_.run(
+        Vec3{0, 0, 0}, [this](EntityId id) { return positions_.at(id); },
+        [&](const ScheduledUpdate& u) {
+          out.push_back(u);
+          return bytes_each;
+        });
+    return out;
+  }
+
+  UpdateScheduler& scheduler() { return scheduler_; }
+
+ private:
+  UpdateScheduler scheduler_;
+  std::map<EntityId, Vec3> positions_;
+};
+
+const ScheduledUpdate* find(const std::vector<ScheduledUpdate>& updates, EntityId id) {
+  for (const ScheduledUpdate& u : updates) {
+    if (u.id == id) return &u;
+  }
+  return nullptr;
+}
+
+TEST(UpdateScheduler, QuantizedPositionsRoundTripWithinOneStep) {
+  const Vec3 origin{100, 5, -40};
+  const float range = 64;
+  const float step = range / 32767.0f;
+  for (const Vec3 offset : {Vec3{0, 0, 0}, Vec3{1.2345f, -0.5f, 63.9f}, Vec3{-63, 10, -0.001f}}) {
+    const Vec3 back = dequantize_relative(quantize_relative(origin + offset, origin, range),
+                                          origin, range);
+    EXPECT_NEAR(back.x, origin.x + offset.x, step);
+    EXPECT_NEAR(back.y, origin.y + offset.y, step);
+    EXPECT_NEAR(back.z, origin.z + offset.z, step);
+  }
+  // Outside the range each axis clamps instead of wrapping.
+  const QuantizedVec3 q = quantize_relative(Vec3{1000, -1000, 0}, Vec3{0, 0, 0}, range);
+  EXPECT_EQ(q.x, 32767);
+  EXPECT_EQ(q.y, -32767);
+  EXPECT_EQ(q.z, 0);
+}
+
+TEST(UpdateScheduler, SpawnsOnceThenOnlyChanges) {
+  SchedulerRig rig;
+  rig.place(1, Vec3{5, 0, 0});
+  std::vector<ScheduledUpdate> t = rig.tick();
+  ASSERT_EQ(t.size(), 1u);
+  EXPECT_TRUE(t[0].spawn);
+  EXPECT_EQ(t[0].lod, UpdateLod::kFull);
+
+  EXPECT_TRUE(rig.tick().empty());
+  rig.scheduler().mark_changed(1, 0b101);
+  t = rig.tick();
+  ASSERT_EQ(t.size(), 1u);
+  EXPECT_FALSE(t[0].spawn);
+  EXPECT_EQ(t[0].fields, 0b101u);
+  EXPECT_TRUE(rig.tick().empty());
+}
+
+TEST(UpdateScheduler, DistantEntitiesUpdateLessOftenAtReducedLod) {
+  UpdateSchedulerOptions o;
+  o.max_interval = 8;
+  SchedulerRig rig(o);
+  rig.place(1, Vec3{5, 0, 0});    // inside near_distance
+  rig.place(2, Vec3{0, 0, 100});  // past far_distance
+  rig.tick();                     // spawns
+
+  int near_sent = 0;
+  int far_sent = 0;
+  uint64_t far_fields = 0;
+  for (int i = 0; i < 32; ++i) {
+    rig.scheduler().mark_changed(1, 1);
+    rig.scheduler().mark_changed(2, uint64_t{1} << (i % 4));
+    const std::vector<ScheduledUpdate> t = rig.tick();
+    if (const ScheduledUpdate* u = find(t, 1)) {
+      ++near_sent;
+      EXPECT_EQ(u->lod, UpdateLod::kFull);
+    }
+    if (const ScheduledUpdate* u = find(t, 2)) {
+      ++far_sent;
+      EXPECT_EQ(u->lod, UpdateLod::kReduced);
+      far_fields |= u->fields;
+    }
+  }
+  EXPECT_EQ(near_sent, 32);
+  EXPECT_EQ(far_sent, 4);
+  // Changes made on skipped ticks were carried into the next update.
+  EXPECT_EQ(far_fields, 0b1111u);
+  EXPECT_GT(rig.scheduler().stats().deferred, 0u);
+}
+
+TEST(UpdateScheduler, PartyAndThreatKeepFullRateAndLod) {
+  SchedulerRig rig;
+  rig.place(1, Vec3{80, 0, 0});
+  rig.place(2, Vec3{-80, 0, 0});
+  rig.scheduler().set_party(1, true);
+  rig.scheduler().set_threat(2, 4);
+  rig.tick();
+  for (int i = 0; i < 8; ++i) {
+    rig.scheduler().mark_changed(1, 1);
+    rig.scheduler().mark_changed(2, 1);
+    const std::vector<ScheduledUpdate> t = rig.tick();
+    ASSERT_EQ(t.size(), 2u);
+    for (const ScheduledUpdate& u : t) EXPECT_EQ(u.lod, UpdateLod::kFull);
+  }
+}
+
+TEST(UpdateScheduler, BudgetDefersButNeverStarves) {
+  UpdateSchedulerOptions o;
+  o.bytes_per_tick = 300;
+  o.burst_bytes = 300;
+  SchedulerRig rig(o);
+  for (EntityId id = 1; id <= 10; ++id) rig.place(id, Vec3{static_cast<float>(id), 0, 0});
+  rig.tick(100);  // spawns, part of them
+
+  std::map<EntityId, int> sent;
+  for (int i = 0; i < 40; ++i) {
+    for (EntityId id = 1; id <= 10; ++id) rig.scheduler().mark_changed(id, 1);
+    const std::vector<ScheduledUpdate> t = rig.tick(100);
+    EXPECT_LE(t.size(), 3u);
+    for (const ScheduledUpdate& u : t) ++sent[u.id];
+  }
+  ASSERT_EQ(sent.size(), 10u);
+  for (const auto& [id, n] : sent) EXPECT_GE(n, 8) << "entity " << id;
+  const UpdateSchedulerStats& s = rig.scheduler().stats();
+  EXPECT_LE(s.bytes, 300u * 41);
+  EXPECT_GT(s.deferred, 0u);
+}
+
+TEST(UpdateScheduler, RemovedEntitiesAreForgotten) {
+  SchedulerRig rig;
+  for (EntityId id = 1; id <= 3; ++id) rig.place(id, Vec3{1, 0, 0});
+  rig.tick();
+  rig.scheduler().remove(1);
+  rig.scheduler().remove(1);
+  EXPECT_FALSE(rig.scheduler().contains(1));
+  EXPECT_EQ(rig.scheduler().size(), 2u);
+  rig.scheduler().mark_changed(1, 1);
+  rig.scheduler().mark_changed(3, 2);
+  const std::vector<ScheduledUpdate> t = rig.tick();
+  ASSERT_EQ(t.size(), 1u);
+  EXPECT_EQ(t[0].id, 3u);
+  EXPECT_EQ(t[0].fields, 2u);
+
+  // Coming back into view is a new spawn.
+  rig.scheduler().add(1);
+  const std::vector<ScheduledUpdate> again = rig.tick();
+  ASSERT_EQ(again.size(), 1u);
+  EXPECT_TRUE(again[0].spawn);
+}
+
+}  // namespace
+}  // namespace kbs
@@ -0,0 +1,230 @@
+#include "entity/world_snapshot.h"
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "entity/replay_log.h"
+#include "entity/world.h"
+
+namespace kbs {
+namespace {
+
+namespace fs = std::filesystem;
+
+struct Position {
+  float x, y, z;
+};
+struct Health {
+  int32_t hp;
+};
+
+// Fresh, empty directory per test, removed afterwards.
+class SnapshotTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    snapshot_component<Position>("position");
+    snapshot_component<Health>("health");
+    const auto* info = ::testing::UnitTest::GetInstance()->current_test_info();
+    dir_ = fs::temp_directory_path() /
+           ("kbs_test_" + std::to_string(::getpid()) + "_" + info->name());
+    fs::remove_all(dir_);
+    fs::create_directories(dir_);
+  }
+  void TearDown() override { fs::remove_all(dir_); }
+
+  std::string path(const std::string& name) const { return (dir_ / name).string(); }
+
+  std::vector<std::string> files(const std::string& prefix) const {
+    std::vector<std::string> out;
+    for (const auto& e : fs::directory_iterator(dir_)) {
+      const std::string name = e.path().filename().string();
+      if (name.rfind(prefix, 0) == 0) out.push_back(name);
+    }
+    std::sort(out.begin(), out.end());
+    return out;
+  }
+
+  SnapshotOptions options(uint64_t interval) const {
+    SnapshotOptions o;
+    o.dir = dir_.string();
+    o.interval_ticks = interval;
+    o.sync_log = false;
+    return o;
+  }
+
+  // Ends ticks first..last, recording one input per tick; waits for each
+  // due snapshot (started at tick 0) so none is skipped.
+  static void run_ticks(SnapshotManager& m, World& w, uint64_t first, uint64_t last,
+                        uint64_t interval) {
+    for (uint64_t t = first; t <= last; ++t) {
+      const uint8_t payload[] = {static_cast<uint8_t>(t)};
+      m.record(t, 1, payload);
+      const uint64_t written = m.stats().snapshots;
+      m.end_tick(w, t);
+      if (t % interval != 0) continue;
+      while (m.stats().snapshots == written) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+    }
+  }
+
+  fs::path dir_;
+};
+
+TEST_F(SnapshotTest, RoundTripKeepsIdsAndColumns) {
+  World w;
+  const EntityId a = w.create(Position{1, 2, 3}, Health{100});
+  const EntityId b = w.create(Position{4, 5, 6});
+  const EntityId gone = w.create(Health{7});
+  w.destroy(gone);
+
+  WorldSnapshot snap = WorldSnapshot::capture(w, 42);
+  EXPECT_EQ(snap.entities(), 2u);
+  snap.write(path("s.kbss"));
+
+  World r;
+  EXPECT_EQ(WorldSnapshot::restore(r, path("s.kbss")), 42u);
+  EXPECT_EQ(r.size(), 2u);
+  ASSERT_TRUE(r.alive(a));
+  ASSERT_TRUE(r.alive(b));
+  EXPECT_FALSE(r.alive(gone));
+  EXPECT_EQ(r.get<Position>(a)->y, 2);
+  EXPECT_EQ(r.get<Health>(a)->hp, 100);
+  EXPECT_EQ(r.get<Position>(b)->z, 6);
+  EXPECT_FALSE(r.has<Health>(b));
+  // The freed slot's generation survived: its next id is new.
+  const EntityId reused = r.create();
+  EXPECT_NE(reused, gone);
+  EXPECT_NE(reused, a);
+  EXPECT_NE(reused, b);
+
+  // Restoring needs an empty world.
+  EXPECT_THROW(WorldSnapshot::restore(r, path("s.kbss")), std::logic_error);
+}
+
+TEST_F(SnapshotTest, RestoreRejectsCorruptFile) {
+  World w;
+  w.create(Position{1, 2, 3});
+  WorldSnapshot::capture(w, 1).write(path("s.kbss"));
+  {
+    std::fstream f(path("s.kbss"), std::ios::in | std::ios::out | std::ios::binary);
+    f.seekp(-1, std::ios::end);
+    f.put('\x5a');
+  }
+  World r;
+  EXPECT_THROW(WorldSnapshot::restore(r, path("s.kbss")), std::runtime_error);
+  EXPECT_EQ(r.size(), 0u);
+}
+
+TEST_F(SnapshotTest, RecoverReplaysAfterNewestSnapshot) {
+  std::vector<uint64_t> replayed;
+  const auto collect = [&](uint64_t t, uint16_t, std::span<const uint8_t>) {
+    replayed.push_back(t);
+  };
+  {
+    World w;
+    w.create(Position{1, 1, 1});
+    SnapshotManager m(options(10));
+    EXPECT_EQ(m.recover(w, collect), 0u);
+    m.start(w, 0);
+    run_ticks(m, w, 1, 25, 10);
+    EXPECT_EQ(m.stats().snapshots, 3u);  // 0, 10, 20
+  }
+  World w;
+  SnapshotManager m(options(10));
+  EXPECT_EQ(m.recover(w, collect), 25u);
+  EXPECT_EQ(replayed, (std::vector<uint64_t>{21, 22, 23, 24, 25}));
+  EXPECT_EQ(w.size(), 1u);
+}
+
+TEST_F(SnapshotTest, PruneKeepsNewestSnapshots) {
+  {
+    World w;
+    SnapshotManager m(options(10));
+    m.start(w, 0);
+    run_ticks(m, w, 1, 45, 10);
+  }  // joins the writer, and its last prune
+  EXPECT_EQ(files("snapshot-"),
+            (std::vector<std::string>{"snapshot-30.kbss", "snapshot-40.kbss"}));
+  EXPECT_EQ(files("replay-"), (std::vector<std::string>{"replay-30.log", "replay-40.log"}));
+}
+
+TEST_F(SnapshotTest, UnusableSnapshotsAreQuarantinedNotKept) {
+  // Left by another run: torn or from an incompatible build, and newer
+  // than anything this run will write for a while.
+  for (const char* name : {"snapshot-500.kbss", "snapshot-600.kbss"}) {
+    std::ofstream(path(name)) << "garbage";
+  }
+  {
+    World w;
+    SnapshotManager m(options(10));
+    EXPECT_EQ(m.recover(w, [](uint64_t, uint16_t, std::span<const uint8_t>) {}), 0u);
+    EXPECT_EQ(m.stats().quarantined, 2u);
+    m.start(w, 0);
+    run_ticks(m, w, 1, 25, 10);
+  }
+  EXPECT_EQ(files("snapshot-"),
+            (std::vector<std::string>{"snapshot-10.kbss", "snapshot-20.kbss",
+                                      "snapshot-500.kbss.bad", "snapshot-600.kbss.bad"}));
+}
+
+TEST_F(SnapshotTest, ReplayLogRefusesOversizedRecords) {
+  const std::vector<uint8_t> big(ReplayLog::kMaxRecord + 1);
+  const std::vector<uint8_t> max(ReplayLog::kMaxRecord);
+  {
+    ReplayLog log(path("r.log"));
+    EXPECT_FALSE(log.append(1, 1, big));
+    EXPECT_EQ(log.size(), 0u);
+    EXPECT_TRUE(log.append(2, 1, max));
+    ASSERT_TRUE(log.flush(false));
+  }
+  std::vector<uint64_t> ticks;
+  const ReplayLog::ReadResult r =
+      ReplayLog::read(path("r.log"), [&](uint64_t t, uint16_t, std::span<const uint8_t> p) {
+        ticks.push_back(t);
+        EXPECT_EQ(p.size(), max.size());
+      });
+  EXPECT_EQ(r.records, 1u);
+  EXPECT_FALSE(r.truncated());
+  EXPECT_EQ(ticks, std::vector<uint64_t>{2});
+
+  World w;
+  SnapshotManager m(options(10));
+  m.start(w, 0);
+  EXPECT_FALSE(m.record(1, 1, big));
+  EXPECT_EQ(m.stats().rejected_records, 1u);
+}
+
+TEST_F(SnapshotTest, TornLogTailIsReported) {
+  World w;
+  w.create(Position{1, 1, 1});
+  {
+    SnapshotManager m(options(10));
+    m.start(w, 0);
+    run_ticks(m, w, 1, 3, 10);
+  }
+  {
+    std::ofstream f(path("replay-0.log"), std::ios::app | std::ios::binary);
+    f << "torn";
+  }
+  const ReplayLog::ReadResult r =
+      ReplayLog::read(path("replay-0.log"), [](uint64_t, uint16_t, std::span<const uint8_t>) {});
+  EXPECT_EQ(r.records, 3u);
+  EXPECT_EQ(r.trailing_bytes, 4u);
+
+  World restored;
+  SnapshotManager m(options(10));
+  EXPECT_EQ(m.recover(restored, [](uint64_t, uint16_t, std::span<const uint8_t>) {}), 3u);
+  EXPECT_EQ(m.stats().truncated_segments, 1u);
+}
+
+}  // namespace
+}  // namespace kbs
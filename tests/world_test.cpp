@@ -0,0 +1,123 @@
+#include "entity/world.h"
+
+#include <gtest/gtest.h>
+
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace kbs {
+namespace {
+
+struct Pos {
+  float x, y, z;
+};
+struct Vel {
+  float dx;
+};
+// Counts live instances, to check relocation and destruction.
+struct Name {
+  static inline int live = 0;
+  std::string value;
+
+  Name() { ++live; }
+  explicit Name(std::string v) : value(std::move(v)) { ++live; }
+  Name(Name&& o) noexcept : value(std::move(o.value)) { ++live; }
+  Name& operator=(Name&&) = default;
+  ~Name() { --live; }
+};
+
+TEST(World, ComponentsSurviveArchetypeMoves) {
+  {
+    World w;
+    const EntityId a = w.create(Pos{1, 2, 3}, Name("a"));
+    const EntityId b = w.create(Pos{4, 5, 6}, Name("b"));
+    w.add(a, Vel{9});
+    EXPECT_TRUE(w.has<Vel>(a));
+    EXPECT_FALSE(w.has<Vel>(b));
+    EXPECT_EQ(w.get<Pos>(a)->z, 3);
+    EXPECT_EQ(w.get<Name>(a)->value, "a");
+    w.remove<Name>(a);
+    EXPECT_EQ(w.get<Name>(a), nullptr);
+    EXPECT_EQ(w.get<Vel>(a)->dx, 9);
+    EXPECT_EQ(w.get<Name>(b)->value, "b");
+    EXPECT_EQ(Name::live, 1);
+    w.add(b, Vel{1});
+    EXPECT_EQ(w.get<Pos>(b)->x, 4);
+  }
+  EXPECT_EQ(Name::live, 0);  // the world destroyed what was left
+}
+
+TEST(World, DestroyedIdsNeverAlias) {
+  World w;
+  const EntityId a = w.create(Pos{1, 0, 0});
+  const EntityId b = w.create(Pos{2, 0, 0});
+  const EntityId c = w.create(Pos{3, 0, 0});
+  w.destroy(a);  // c is swapped into a's place in the chunk
+  EXPECT_FALSE(w.alive(a));
+  EXPECT_EQ(w.get<Pos>(a), nullptr);
+  EXPECT_EQ(w.get<Pos>(c)->x, 3);
+  EXPECT_EQ(w.get<Pos>(b)->x, 2);
+  const EntityId d = w.create();
+  EXPECT_NE(d, a);
+  EXPECT_TRUE(w.alive(d));
+  EXPECT_FALSE(w.alive(a));
+  w.destroy(a);  // stale: no-op
+  EXPECT_EQ(w.size(), 3u);
+  EXPECT_FALSE(w.alive(kInvalidEntityId));
+}
+
+TEST(World, IterationMatchesModelAfterRandomChurn) {
+  World w;
+  std::mt19937 rng(11);
+  std::map<EntityId, float> model;  // entities with Pos and Vel -> Pos.x
+  std::vector<EntityId> ids;
+  for (int i = 0; i < 20000; ++i) {
+    const int op = static_cast<int>(rng() % 5);
+    if (op == 0 || op == 4 || ids.empty()) {
+      const auto x = static_cast<float>(i);
+      const EntityId e = rng() % 2 ? w.create(Pos{x, 0, 0}, Vel{1}) : w.create(Pos{x, 0, 0});
+      ids.push_back(e);
+      if (w.has<Vel>(e)) model[e] = x;
+      continue;
+    }
+    const size_t k = rng() % ids.size();
+    const EntityId e = ids[k];
+    if (op == 1) {
+      w.destroy(e);
+      ids[k] = ids.back();
+      ids.pop_back();
+      model.erase(e);
+    } else if (op == 2 && !w.has<Vel>(e)) {
+      w.add(e, Vel{1});
+      model[e] = w.get<Pos>(e)->x;
+    } else if (op == 3 && w.has<Vel>(e)) {
+      w.remove<Vel>(e);
+      model.erase(e);
+    }
+  }
+  EXPECT_EQ(w.size(), ids.size());
+
+  std::map<EntityId, float> seen;
+  size_t chunks = 0;
+  w.each_chunk<Pos, Vel>([&](std::span<const EntityId> es, std::span<Pos> ps, std::span<Vel> vs) {
+    ASSERT_EQ(es.size(), ps.size());
+    ASSERT_EQ(es.size(), vs.size());
+    for (size_t i = 0; i < es.size(); ++i) seen[es[i]] = ps[i].x;
+    ++chunks;
+  });
+  EXPECT_EQ(seen, model);
+  EXPECT_GT(chunks, 1u);
+
+  size_t with_pos = 0;
+  w.each<Pos>([&](Pos& p) {
+    p.y = 1;
+    ++with_pos;
+  });
+  EXPECT_EQ(with_pos, ids.size());
+  for (EntityId e : ids) EXPECT_EQ(w.get<Pos>(e)->y, 1);
+}
+
+}  // namespace
+}  // namespace kbs
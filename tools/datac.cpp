@@ -0,0 +1,295 @@
+// kbs_datac: compiles CSV tables into one memory-mappable data file.
+//
+//   kbs_datac --version 42 -o game.kbd items=data/items.csv npcs=data/npcs.csv
+//
+// The first CSV line declares typed columns, which fix the row layout:
+//
+//   id:u32,name:str,price:i32,weight:f32,stackable:bool
+//
+// Columns are packed with natural alignment in the order given, exactly
+// like a C++ struct with the same members, and the header line (spaces
+// removed) is the schema the game's row struct must declare as kSchema.
+// Types: i8 u8 i16 u16 i32 u32 i64 u64 f32 f64 bool str.  An integer "id"
+// column is required.  Fields may be quoted ("a, b"; "" for a quote).
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "data/data_file.h"
+
+namespace kbs {
+namespace {
+
+enum class ColumnType { kI8, kU8, kI16, kU16, kI32, kU32, kI64, kU64, kF32, kF64, kBool, kStr };
+
+struct TypeInfo {
+  std::string_view name;
+  ColumnType type;
+  size_t size;
+};
+
+constexpr TypeInfo kTypes[] = {
+    {"i8", ColumnType::kI8, 1},     {"u8", ColumnType::kU8, 1},   {"i16", ColumnType::kI16, 2},
+    {"u16", ColumnType::kU16, 2},   {"i32", ColumnType::kI32, 4}, {"u32", ColumnType::kU32, 4},
+    {"i64", ColumnType::kI64, 8},   {"u64", ColumnType::kU64, 8}, {"f32", ColumnType::kF32, 4},
+    {"f64", ColumnType::kF64, 8},   {"bool", ColumnType::kBool, 1},
+    {"str", ColumnType::kStr, sizeof(DataString)},
+};
+
+struct Column {
+  std::string name;
+  ColumnType type;
+  size_t size;
+  size_t align;
+  size_t offset;
+};
+
+struct Options {
+  uint64_t version = 0;
+  std::string output;
+  std::vector<std::pair<std::string, std::string>> tables;  // name, csv path
+};
+
+struct CsvError : std::runtime_error {
+  using std::runtime_error::runtime_error;
+};
+
+// Splits one record; handles quoted fields, including embedded newlines
+// (the caller keeps feeding lines while a quote is open).
+bool split_csv(std::string_view line, std::vector<std::string>& fields, std::string& cur,
+               bool& quoted) {
+  for (size_t i = 0; i < line.size(); ++i) {
+    const char c = line[i];
+    if (quoted) {
+      if (c == '"' && i + 1 < line.size() && line[i + 1] == '"') {
+        cur += '"';
+        ++i;
+      } else if (c == '"') {
+        quoted = false;
+      } else {
+        cur += c;
+      }
+    } else if (c == '"') {
+      quoted = true;
+    } else if (c == ',') {
+      fields.push_back(std::move(cur));
+      cur.clear();
+    } else if (c != '\r') {
+      cur += c;
+    }
+  }
+  if (quoted) {
+    cur += '\n';
+    return false;
+  }
+  fields.push_back(std::move(cur));
+  cur.clear();
+  return true;
+}
+
+std::string_view trim(std::string_view s) {
+  while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1);
+  while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) s.remove_suffix(1);
+  return s;
+}
+
+template <typename T>
+T parse_number(std::string_view s, const Column& col) {
+  s = trim(s);
+  T v{};
+  if (s.empty()) return v;  // empty cells default to zero
+  const auto [p, ec] = std::from_chars(s.data(), s.data() + s.size(), v);
+  if (ec != std::errc() || p != s.data() + s.size()) {
+    throw CsvError("bad " + col.name + " value '" + std::string(s) + "'");
+  }
+  return v;
+}
+
+template <typename T>
+void store(std::string& row, size_t offset, T v) {
+  std::memcpy(row.data() + offset, &v, sizeof(T));
+}
+
+void encode_field(DataFileWriter& w, const Column& col, std::string_view s, std::string& row,
+                  uint64_t& id) {
+  switch (col.type) {
+    case ColumnType::kI8: store(row, col.offset, parse_number<int8_t>(s, col)); break;
+    case ColumnType::kU8: store(row, col.offset, parse_number<uint8_t>(s, col)); break;
+    case ColumnType::kI16: store(row, col.offset, parse_number<int16_t>(s, col)); break;
+    case ColumnType::kU16: store(row, col.offset, parse_number<uint16_t>(s, col)); break;
+    case ColumnType::kI32: store(row, col.offset, parse_number<int32_t>(s, col)); break;
+    case ColumnType::kU32: store(row, col.offset, parse_number<uint32_t>(s, col)); break;
+    case ColumnType::kI64: store(row, col.offset, parse_number<int64_t>(s, col)); break;
+    case ColumnType::kU64: store(row, col.offset, parse_number<uint64_t>(s, col)); break;
+    case ColumnType::kF32: store(row, col.offset, parse_number<float>(s, col)); break;
+    case ColumnType::kF64: store(row, col.offset, parse_number<double>(s, col)); break;
+    case ColumnType::kBool: {
+      const std::string_view t = trim(s);
+      const bool v = t == "1" || t == "true" || t == "TRUE" || t == "yes";
+      if (!v && !t.empty() && t != "0" && t != "false" && t != "FALSE" && t != "no") {
+        throw CsvError("bad " + col.name + " value '" + std::string(t) + "'");
+      }
+      store<uint8_t>(row, col.offset, v);
+      break;
+    }
+    case ColumnType::kStr: store(row, col.offset, w.intern(s)); break;
+  }
+  if (col.name != "id") return;
+  if (col.type == ColumnType::kI8 || col.type == ColumnType::kI16 ||
+      col.type == ColumnType::kI32 || col.type == ColumnType::kI64) {
+    const int64_t v = parse_number<int64_t>(s, col);
+    if (v < 0) throw CsvError("negative id");
+    id = static_cast<uint64_t>(v);
+  } else {
+    id = parse_number<uint64_t>(s, col);
+  }
+}
+
+std::vector<Column> parse_header(const std::vector<std::string>& fields, std::string& schema,
+                                 size_t& row_size) {
+  std::vector<Column> cols;
+  size_t offset = 0;
+  size_t max_align = 1;
+  bool has_id = false;
+  for (const std::string& f : fields) {
+    const std::string_view spec = trim(f);
+    const size_t colon = spec.find(':');
+    if (colon == std::string_view::npos) {
+      throw CsvError("header column '" + std::string(spec) + "' needs name:type");
+    }
+    const std::string_view type = trim(spec.substr(colon + 1));
+    const auto it = std::find_if(std::begin(kTypes), std::end(kTypes),
+                                 [&](const TypeInfo& t) { return t.name == type; });
+    if (it == std::end(kTypes)) throw CsvError("unknown type '" + std::string(type) + "'");
+    Column c;
+    c.name = std::string(trim(spec.substr(0, colon)));
+    c.type = it->type;
+    c.size = it->size;
+    c.align = c.type == ColumnType::kStr ? alignof(DataString) : c.size;
+    offset = (offset + c.align - 1) / c.align * c.align;
+    c.offset = offset;
+    offset += c.size;
+    max_align = std::max(max_align, c.align);
+    if (c.name == "id") {
+      if (c.type == ColumnType::kF32 || c.type == ColumnType::kF64 ||
+          c.type == ColumnType::kBool || c.type == ColumnType::kStr) {
+        throw CsvError("id column must be an integer");
+      }
+      has_id = true;
+    }
+    if (!schema.empty()) schema += ',';
+    schema += c.name;
+    schema += ':';
+    schema += type;
+    cols.push_back(std::move(c));
+  }
+  if (!has_id) throw CsvError("no id column");
+  row_size = (offset + max_align - 1) / max_align * max_align;
+  return cols;
+}
+
+void compile_table(DataFileWriter& w, const std::string& name, const std::string& path) {
+  std::ifstream in(path);
+  if (!in) throw std::runtime_error(path + ": cannot open");
+  std::vector<Column> cols;
+  std::string schema;
+  size_t row_size = 0;
+  std::vector<uint64_t> ids;
+  std::string rows;
+  std::vector<std::string> fields;
+  std::string cur;
+  bool quoted = false;
+  std::string line;
+  size_t line_no = 0;
+  size_t record_line = 1;
+  try {
+    while (std::getline(in, line)) {
+      ++line_no;
+      if (fields.empty() && cur.empty() && !quoted) {
+        record_line = line_no;
+        if (trim(line).empty() || line[0] == '#') continue;
+      }
+      if (!split_csv(line, fields, cur, quoted)) continue;
+      if (cols.empty()) {
+        cols = parse_header(fields, schema, row_size);
+      } else {
+        if (fields.size() != cols.size()) {
+          throw CsvError("expected " + std::to_string(cols.size()) + " fields, got " +
+                         std::to_string(fields.size()));
+        }
+        std::string row(row_size, '\0');
+        uint64_t id = 0;
+        for (size_t i = 0; i < cols.size(); ++i) encode_field(w, cols[i], fields[i], row, id);
+        ids.push_back(id);
+        rows += row;
+      }
+      fields.clear();
+    }
+    if (quoted) throw CsvError("unterminated quote");
+    if (cols.empty()) throw CsvError("missing header");
+    w.add_table(name, schema, row_size, ids,
+                {reinterpret_cast<const uint8_t*>(rows.data()), rows.size()});
+  } catch (const std::exception& e) {
+    throw std::runtime_error(path + ":" + std::to_string(record_line) + ": " + e.what());
+  }
+  std::printf("%-24s %8zu rows  %4zu bytes/row  %s\n", name.c_str(), ids.size(), row_size,
+              schema.c_str());
+}
+
+void usage() {
+  std::fprintf(stderr,
+               "usage: kbs_datac --version N -o OUT table=file.csv [table=file.csv ...]\n");
+  std::exit(2);
+}
+
+Options parse_args(int argc, char** argv) {
+  Options o;
+  bool have_version = false;
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view a = argv[i];
+    if (a == "--version" && i + 1 < argc) {
+      o.version = std::strtoull(argv[++i], nullptr, 10);
+      have_version = true;
+    } else if (a == "-o" && i + 1 < argc) {
+      o.output = argv[++i];
+    } else if (const size_t eq = a.find('='); eq != std::string_view::npos && eq > 0) {
+      o.tables.emplace_back(std::string(a.substr(0, eq)), std::string(a.substr(eq + 1)));
+    } else {
+      usage();
+    }
+  }
+  if (!have_version || o.output.empty() || o.tables.empty()) usage();
+  return o;
+}
+
+int run(int argc, char** argv) {
+  const Options opts = parse_args(argc, argv);
+  DataFileWriter w(opts.version);
+  try {
+    for (const auto& [name, path] : opts.tables) compile_table(w, name, path);
+    w.write(opts.output);
+    // Read it back the way a server will.
+    auto file = DataFile::open(opts.output);
+    std::printf("wrote %s: version %llu, %zu bytes\n", opts.output.c_str(),
+                static_cast<unsigned long long>(file->version()), file->size_bytes());
+  } catch (const std::exception& e) {
+    std::fprintf(stderr, "kbs_datac: %s\n", e.what());
+    return 1;
+  }
+  return 0;
+}
+
+}  // namespace
+}  // namespace kbs
+
+int main(int argc, char** argv) { return kbs::run(argc, argv); }